@@ -1,98 +1,219 @@
 #include "Buffer.h"
+#include "ChunkPool.h"
 #include "Log.h"
+#include <algorithm>
+#include <cstring>
 
-Buffer::Buffer(int size){
-    buffer.resize(size); // 初始化缓冲区大小
-    readPos=writePos=0; // 初始化读写指针
+static const int MAX_IOV=16; // writeToFile一次最多写出的块数
+static const size_t READ_SIZE=4096; // 最后一个块的可写空间不少于这个大小时readFromFile只读到这个块中，不额外取一个块
+// ChunkPool的单例一旦创建就不会替换，缓存裸指针，申请和归还块时不需要拷贝shared_ptr（原子地修改引用计数）
+static ChunkPool* const chunkPool=ChunkPool::instance().get();
+
+Buffer::~Buffer(){
+    clear();
 }
-int Buffer::unusedBytes(){
-    return readPos;
+
+Buffer::Block Buffer::allocate(size_t len){
+    if(len<=ChunkPool::CHUNK_SIZE){
+        int chunk=chunkPool->allocate();
+        return {chunkPool->data(chunk),ChunkPool::CHUNK_SIZE,0,0,chunk};
+    }
+    // 大块的大小取整到块大小的整数倍
+    size_t capacity=(len+ChunkPool::CHUNK_SIZE-1)/ChunkPool::CHUNK_SIZE*ChunkPool::CHUNK_SIZE;
+    return {new char[capacity],capacity,0,0,-1};
+}
+
+void Buffer::release(Block& block){
+    if(block.chunk==-1)delete[] block.data;
+    else chunkPool->release(block.chunk);
+    block.data=nullptr;
 }
-int Buffer::readableBytes(){
-    return writePos-readPos;
+
+void Buffer::clear(){
+    for(size_t i=head;i<blocks.size();i++)release(blocks[i]);
+    blocks.clear();
+    head=0;
+    readable=0;
 }
+
 int Buffer::writableBytes(){
-    return buffer.size()-writePos;
+    if(head==blocks.size())return 0;
+    return blocks.back().capacity-blocks.back().end;
 }
+
 ssize_t Buffer::readFromFile(int fd){
-    char temp[65535]; // 临时缓存
-    // 使用分散读readv保证数据全部读完
+    // 最后一个块的可写空间足够时只读到这个块中（常见的情况，不需要从池中取块再归还）
+    // 否则使用分散读：先读到最后一个块的可写空间中，剩下的数据直接读到一个新的块中，不需要再拷贝
     struct iovec iov[2];
-    iov[0].iov_base=(&buffer[0])+writePos;
-    iov[0].iov_len=writableBytes();
-    iov[1].iov_base=temp;
-    iov[1].iov_len=sizeof(temp);
-    // 使用分散读将数据读到两个缓存中
-    ssize_t len = readv(fd, iov, 2);
+    int count=0;
+    size_t writable=writableBytes();
+    if(writable>0){
+        iov[count].iov_base=blocks.back().data+blocks.back().end;
+        iov[count].iov_len=writable;
+        count++;
+    }
+    Block block={nullptr,0,0,0,-1};
+    if(writable<READ_SIZE){
+        block=allocate(ChunkPool::CHUNK_SIZE);
+        iov[count].iov_base=block.data;
+        iov[count].iov_len=block.capacity;
+        count++;
+    }
+    ssize_t len=readv(fd,iov,count);
     // 读取失败返回-1
-    if(len<=0)return len;
-    // 读出的数据总长小于缓冲区buffer可写空间的长度
-    if(len<=writableBytes()){
-        writePos+=len;
-    }else{
-        int writable=writableBytes();
-        int oldSize=buffer.size();
-        if(writableBytes()+unusedBytes()>=len){
-            // 可写空间加上未使用空间足够容纳从文件中读出的数据
-            // 将可读空间前移，把未使用的空间用起来
-            std::copy((&buffer[0])+readPos,(&buffer[0])+oldSize,&buffer[0]);
-            writePos=oldSize-readPos;
-            readPos=0;
-            std::copy(temp,temp+len-writable,(&buffer[0])+writePos);
-            writePos+=(len-writable);
-        }else{
-            // 容量不够时直接扩容
-            buffer.resize(oldSize+len-writable+1);
-            std::copy(temp,temp+len-writable,(&buffer[0])+oldSize);
-            writePos=oldSize+len-writable;
-        }
+    if(len<=0){
+        if(block.data!=nullptr)release(block);
+        return len;
     }
+    size_t first=std::min<size_t>(len,writable);
+    if(first>0)blocks.back().end+=first;
+    if((size_t)len>first){
+        block.end=len-first;
+        blocks.push_back(block);
+    }else if(block.data!=nullptr)release(block); // 新的块没有用到，直接归还
+    readable+=len;
     return len;
 }
 
 ssize_t Buffer::writeToFile(int fd){
-    // 第一个可读的字节的地址是(&buffer[0])+readPos；可读字节总数为readableBytes()
-    int len=write(fd,(&buffer[0])+readPos,readableBytes());
+    // 使用集中写一次写出多个块中的数据
+    struct iovec iov[MAX_IOV];
+    int count=0;
+    for(size_t i=head;i<blocks.size()&&count<MAX_IOV;i++){
+        if(blocks[i].end==blocks[i].begin)continue;
+        iov[count].iov_base=blocks[i].data+blocks[i].begin;
+        iov[count].iov_len=blocks[i].end-blocks[i].begin;
+        count++;
+    }
+    if(count==0)return 0;
+    ssize_t len=writev(fd,iov,count);
     // 返回值len是实际写入的字节数，写入失败时返回-1
     if(len<=0)return len;
-    readPos+=len; // 写入成功时需要移动读指针
+    abandonData(len); // 写入成功时丢弃已经写出的数据
     return len;
 }
 
 void Buffer::appendData(const std::vector<char>& data){
-    if(data.size()<=writableBytes()){
-        std::copy(&data[0],(&data[0])+data.size(),(&buffer[0])+writePos);
-        writePos+=data.size();
-    }else{
-        int writable=writableBytes();
-        int readable=readableBytes();
-        int oldSize=buffer.size();
-        if(writableBytes()+unusedBytes()>=data.size()){
-            // 可写空间加上未使用空间足够容纳追加的数据
-            // 将可读空间前移，把未使用的空间用起来
-            std::copy((&buffer[0])+readPos,(&buffer[0])+writePos,&buffer[0]);
-            writePos=readable;
-            readPos=0;
-            std::copy(&data[0],(&data[0])+data.size(),(&buffer[0])+writePos);
-            writePos+=data.size();
-        }else{
-            // 容量不够时直接扩容
-            buffer.resize(oldSize+data.size()-writable+1);
-            std::copy(&data[0],(&data[0])+data.size(),(&buffer[0])+writePos);
-            writePos+=data.size();
+    appendData(data.data(),data.size());
+}
+
+void Buffer::appendData(const char* data,size_t len){
+    while(len>0){
+        size_t writable=writableBytes();
+        if(writable==0){
+            // 最后一个块已满：数据不需要连续，追加一个能容纳剩下数据的块
+            if(head<blocks.size()&&blocks.back().begin==blocks.back().end){
+                release(blocks.back());
+                blocks.pop_back();
+            }
+            blocks.push_back(allocate(len));
+            continue;
         }
+        size_t n=std::min(len,writable);
+        Block& back=blocks.back();
+        memcpy(back.data+back.end,data,n);
+        back.end+=n;
+        readable+=n;
+        data+=n;
+        len-=n;
     }
 }
 
+std::string_view Buffer::front(){
+    if(readable==0)return std::string_view();
+    Block& block=blocks[head];
+    return std::string_view(block.data+block.begin,block.end-block.begin);
+}
+
+char* Buffer::peek(){
+    if(head==blocks.size())return nullptr;
+    // 可读数据跨越多个块时合并，之后读入的数据可以放在合并后的块中，反复合并的总开销与数据量成正比
+    if(blocks[head].end-blocks[head].begin<readable)reserve(2*readable);
+    return blocks[head].data+blocks[head].begin;
+}
+
+void Buffer::reserve(size_t len){
+    len=std::max(len,readable);
+    if(head<blocks.size()&&blocks.size()-head==1){
+        Block& block=blocks[head];
+        if(block.capacity-block.begin>=len)return; // 已经满足
+        if(block.capacity>=len){
+            // 块本身足够大，把可读数据前移即可
+            memmove(block.data,block.data+block.begin,readable);
+            block.begin=0;
+            block.end=readable;
+            return ;
+        }
+    }
+    // 把所有可读数据搬到一个足够大的块中
+    Block block=allocate(len);
+    for(size_t i=head;i<blocks.size();i++){
+        memcpy(block.data+block.end,blocks[i].data+blocks[i].begin,blocks[i].end-blocks[i].begin);
+        block.end+=blocks[i].end-blocks[i].begin;
+        release(blocks[i]);
+    }
+    blocks.clear();
+    head=0;
+    blocks.push_back(block);
+}
+
+char* Buffer::beginWrite(size_t len,size_t keep){
+    size_t need=std::max<size_t>(len,1);
+    if(writableBytes()>=(int)need)return blocks.back().data+blocks.back().end;
+    // 最后一个块的可写空间不够：换一个新的块，必须保持连续的keep个字节一起搬过去
+    Block block=allocate(keep+need);
+    if(keep>0){
+        Block& back=blocks.back();
+        memcpy(block.data,back.data+back.end-keep,keep);
+        back.end-=keep;
+        block.end=keep;
+    }
+    if(head<blocks.size()&&blocks.back().begin==blocks.back().end){
+        release(blocks.back());
+        blocks.pop_back();
+    }
+    blocks.push_back(block);
+    return block.data+block.end;
+}
+
+void Buffer::erase(size_t len,size_t tail){
+    Block& block=blocks.back();
+    size_t from=block.end-tail-len;
+    if(from==block.begin){
+        block.begin+=len; // 删除的字节在块中可读数据的开头，直接跳过
+    }else{
+        memmove(block.data+from,block.data+from+len,tail);
+        block.end-=len;
+    }
+    readable-=len;
+}
+
 std::vector<char> Buffer::lookDate(int begin,int end){
-    const char* b=(&buffer[0])+readPos+begin;
-    const char* e=(&buffer[0])+readPos+end;
-    std::vector<char> data(b,e);
+    const char* data=peek();
+    std::vector<char> result(data+begin,data+end);
     // 这里编译器会自动进行优化，将data转为右值引用，实现移动语义（资源的转移）
-    return data;
+    return result;
 }
 
 void Buffer::abandonData(int len){
-    // 通过移动read指针的方式丢弃数据
-    readPos+=len;
-}
\ No newline at end of file
+    readable-=len;
+    if(readable==0){
+        clear(); // 数据全部处理完时归还所有块，空闲的缓冲区不占用内存
+        return ;
+    }
+    size_t rest=len;
+    while(rest>0){
+        Block& block=blocks[head];
+        size_t n=std::min(rest,block.end-block.begin);
+        block.begin+=n;
+        rest-=n;
+        if(block.begin==block.end){
+            release(block); // 取完数据的块立即归还
+            head++;
+        }
+    }
+    if(head>=16&&head*2>=blocks.size()){
+        blocks.erase(blocks.begin(),blocks.begin()+head);
+        head=0;
+    }
+}
@@ -3,23 +3,44 @@
 
 #include <vector>
 #include <string>
-#include <atomic>
+#include <string_view>
 #include <unistd.h>
 #include <sys/uio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 
+// 由内存块组成的缓冲区：可读数据依次存放在若干个块中，小的块是从全局的ChunkPool中取出的固定大小的块，
+// 超过固定大小的连续数据（很大的请求或者响应）使用单独申请的大块；数据被取走后块立即归还，空闲的缓冲区不占用内存
+// 从文件中读数据时直接读到块中（不经过临时缓冲区），向文件中写数据时用writev一次写出多个块
 class Buffer{
 public:
-    Buffer(int size=1024);
-    int unusedBytes(); // 目前没有被使用的字节数
-    int readableBytes(); // 可读字节数
-    int writableBytes(); // 可写字节数
-    
+    Buffer() = default;
+    ~Buffer();
+    int readableBytes(){return this->readable;} // 可读字节数
+    int writableBytes(); // 最后一个块中可写的字节数
+
     ssize_t readFromFile(int fd); // 从文件fd中读数据到可写空间
     ssize_t writeToFile(int fd); // 从可读空间向文件fd中写数据
     void appendData(const std::vector<char>& data); // 向缓冲区可写空间中添加数据
+    void appendData(const char* data,size_t len); // 向缓冲区可写空间中添加数据（数据可以跨越多个块）
+
+    // 第一个块中的可读数据（不合并），请求不跨越块时（常见的情况）解析器可以直接在这里解析
+    std::string_view front();
+    // 可读空间的起始地址：可读数据跨越多个块时，先把它们合并到一个块中（留出同样大小的空间给之后读入的数据）
+    // 直到下一次修改缓冲区之前有效
+    char* peek();
+    // 保证可读空间的前len字节（包括还没有读入的数据）位于同一个块中：需要时把已有的数据搬到一个足够大的块中，
+    // 之后读入的数据直接读到这个块中，不会再搬移
+    void reserve(size_t len);
+
+    // 直接在缓冲区中写数据：beginWrite保证最后一个块中至少有len字节的可写空间并返回其起始地址，写完后调用hasWritten移动写指针
+    // keep为必须与可写空间保持连续的可读字节数（可读空间最后的keep个字节），需要换一个块时它们会被一起搬到新的块中
+    char* beginWrite(size_t len,size_t keep=0);
+    void hasWritten(size_t len){this->blocks.back().end+=len;this->readable+=len;}
+    void unwrite(size_t len){this->blocks.back().end-=len;this->readable-=len;} // 撤销最后写入的len字节
+    char* tail(size_t len){return this->blocks.back().data+this->blocks.back().end-len;} // 最后len个可读字节的起始地址（它们必须在同一个块中）
+    void erase(size_t len,size_t tail); // 删除可读空间中最后tail个字节之前的len个字节（它们必须在同一个块中）
     /*
     在解析HTTP报文时，需要先查看报文是否完整，如果完整才能取出解析，如果不完整则要等待
     由于这种查看并非将数据全部取出，因此需要提供一个仅供查看数据的函数lookData
@@ -27,13 +48,24 @@ public:
     */
     std::vector<char> lookDate(int begin,int end); // 查看缓冲区可读空间[begin,end)中的数据（并非真正取出）
     void abandonData(int len); // 丢掉缓冲区可读空间中len字节的数据
+
+    Buffer(const Buffer&) = delete; // 禁用拷贝构造函数
+    Buffer& operator=(const Buffer&) = delete; // 禁用赋值运算符
 private:
-    std::vector<char> buffer; // 缓冲区（本质是字节序列）
-    // 0～readPos：暂时没有被使用的空间
-    // readPos～writePos：可以读的空间（可以把这部分数据读到文件中）
-    // writePos～buffer.size：可以写的空间（可以将文件中的数据写到这部分空间中）
-    std::atomic<int> readPos; // 读指针
-    std::atomic<int> writePos; // 写指针
+    struct Block{
+        char* data; // 块的起始地址
+        size_t capacity; // 块的大小
+        size_t begin; // 块中可读数据的起点
+        size_t end; // 块中可读数据的终点（之后是可写空间）
+        int chunk; // ChunkPool中块的编号，-1表示单独申请的大块
+    };
+    Block allocate(size_t len); // 申请一个至少len字节的块
+    void release(Block& block); // 释放一个块
+    void clear(); // 释放所有块
+
+    std::vector<Block> blocks; // blocks[head]之后的块依次存放可读数据，只有最后一个块可以有可写空间
+    size_t head=0; // 第一个还有数据的块（之前的块已经释放，积累到一定数量后再从vector中删除）
+    size_t readable=0; // 可读字节数
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,53 @@
+#include "ChunkPool.h"
+#include <new>
+
+static std::shared_ptr<ChunkPool> chunkPool=nullptr;
+static std::mutex mutex;
+
+std::shared_ptr<ChunkPool> ChunkPool::instance(){
+    // 懒汉模式
+    // 使用双重检查保证线程安全
+    if(chunkPool==nullptr){
+        std::unique_lock<std::mutex> lock(mutex); // 访问临界区之前需要加锁
+        if(chunkPool==nullptr){
+            chunkPool=std::shared_ptr<ChunkPool>(new ChunkPool());
+        }
+    }
+    return chunkPool;
+}
+
+int ChunkPool::allocate(){
+    uint64_t old=top.load(std::memory_order_acquire);
+    while((uint32_t)old!=0){
+        int index=(uint32_t)old-1;
+        // 读到next之后栈顶可能已经被其他线程取走并重新放回，此时版本号已经改变，下面的CAS会失败
+        uint32_t following=next(index).load(std::memory_order_relaxed);
+        uint64_t desired=((old>>32)+1)<<32|following;
+        if(top.compare_exchange_weak(old,desired,std::memory_order_acquire,std::memory_order_acquire))return index;
+    }
+    return grow(); // 池中没有空闲的块
+}
+
+void ChunkPool::release(int index){
+    uint64_t old=top.load(std::memory_order_relaxed);
+    uint64_t desired;
+    do{
+        next(index).store((uint32_t)old,std::memory_order_relaxed);
+        desired=((old>>32)+1)<<32|(uint32_t)(index+1);
+    }while(!top.compare_exchange_weak(old,desired,std::memory_order_release,std::memory_order_relaxed));
+}
+
+int ChunkPool::grow(){
+    std::unique_lock<std::mutex> lock(slabLock);
+    int n=slabNum.load();
+    if(n==MAX_SLABS)throw std::bad_alloc();
+    Slab* slab=new Slab();
+    slab->memory=new char[SLAB_CHUNKS*CHUNK_SIZE];
+    slabs[n].store(slab,std::memory_order_release);
+    slabNum.store(n+1);
+    // 第一个块直接返回，其余的块放入空闲栈
+    int first=n*SLAB_CHUNKS;
+    for(int i=SLAB_CHUNKS-1;i>0;i--)release(first+i);
+    return first;
+}
+
@@ -0,0 +1,47 @@
+#ifndef CHUNKPOOL
+#define CHUNKPOOL
+
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// 缓冲区使用的全局内存块池：固定大小的块按slab批量向系统申请，用完后归还到池中循环使用
+// slab直到进程退出都不释放（静态对象析构之后可能还有缓冲区归还块）
+// 空闲的块组成一个无锁的栈，块用编号表示，栈顶同时保存一个版本号，防止ABA问题；只有申请新的slab时才加锁
+class ChunkPool{
+public:
+    static const size_t CHUNK_SIZE=16*1024; // 块的大小
+
+    static std::shared_ptr<ChunkPool> instance(); // 获取ChunkPool的单例对象
+
+    int allocate(); // 分配一个块，返回块的编号
+    void release(int index); // 归还一个块
+    char* data(int index){ // 块的起始地址
+        return slabs[index/SLAB_CHUNKS].load(std::memory_order_acquire)->memory+(size_t)(index%SLAB_CHUNKS)*CHUNK_SIZE;
+    }
+    size_t chunkNum(){return (size_t)slabNum.load()*SLAB_CHUNKS;} // 已经向系统申请的块数
+
+    ChunkPool(const ChunkPool&) = delete; // 禁用拷贝构造函数
+    ChunkPool& operator=(const ChunkPool&) = delete; // 禁用赋值运算符
+private:
+    ChunkPool() = default; // 禁用外部构造
+
+    static const int SLAB_CHUNKS=64; // 每个slab中的块数（1MB）
+    static const int MAX_SLABS=16384; // 最多申请的slab数（16GB）
+    struct Slab{
+        char* memory; // SLAB_CHUNKS个块的内存
+        std::atomic<uint32_t> next[SLAB_CHUNKS]; // 空闲栈中每个块的下一个块的编号加1（0表示栈底）
+    };
+
+    std::atomic<uint32_t>& next(int index){return slabs[index/SLAB_CHUNKS].load(std::memory_order_acquire)->next[index%SLAB_CHUNKS];}
+    int grow(); // 申请一个新的slab，返回其中的一个块，其余的块放入空闲栈
+
+    std::atomic<uint64_t> top{0}; // 空闲栈：低32位是栈顶块的编号加1（0表示栈为空），高32位是版本号
+    std::atomic<Slab*> slabs[MAX_SLABS]={}; // 已经申请的slab（只增加，不释放，栈中读到的编号总是有效的）
+    std::atomic<int> slabNum{0}; // 已经申请的slab数
+    std::mutex slabLock; // 申请新的slab时加锁
+};
+
+#endif
@@ -1,12 +1,13 @@
 #include "Connection.h"
 #include "Log.h"
 
-int Connection::connNum=0; // 初始化
-Connection::Connection(int cfd, const std::string& ip,int port){
+std::atomic<int> Connection::connNum{0}; // 初始化
+Connection::Connection(int cfd, const std::string& ip,int port,Protocol protocol){
     connNum++;
     this->cfd=cfd;
     this->ip=ip;
     this->port=port;
+    this->protocol=protocol;
     // 默认关闭keep-alive
     isKeepAlive=false;
 }
@@ -30,6 +31,7 @@ ssize_t Connection::readFromFile(){
 bool Connection::process(){
     // 该函数处理readBuffer中的数据，并将处理结果写到writeBuffer中
     // 如果进行处理了，则返回true；如果没有进行处理，则返回false（如果只返回true或false将导致无法继续处理）
+    if(protocol==RESP)return RespProcess::instance()->process(this);
     return HttpProcess::instance()->process(this);
 }
 
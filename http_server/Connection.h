@@ -4,16 +4,22 @@
 #include <sys/uio.h>
 #include <arpa/inet.h>
 #include <string>
+#include <atomic>
 #include "Buffer.h"
+#include "HttpParser.h"
 #include "HttpProcess.h"
+#include "RespProcess.h"
 
 class HttpProcess;
+class RespProcess;
 
 class Connection{
     friend class HttpProcess;
+    friend class RespProcess;
 public:
-    static int connNum; // 当前连接的总数
-    Connection(int cfd, const std::string& ip,int port); // 初始化
+    enum Protocol{HTTP,RESP}; // 连接使用的协议（由接入的监听端口决定）
+    static std::atomic<int> connNum; // 当前连接的总数（多个线程同时接入和断开连接）
+    Connection(int cfd, const std::string& ip,int port,Protocol protocol=HTTP); // 初始化
     ~Connection();
 
     int getFd(){return this->cfd;}
@@ -22,6 +28,7 @@ public:
     void setKeepAlive(bool keepAlive){this->isKeepAlive=keepAlive;}
     bool getKeepAlive(){return this->isKeepAlive;}
     bool hasData(){return writeBuffer.readableBytes()!=0;} // 判断写缓冲区中是否还有数据未写入
+    int pendingBytes(){return writeBuffer.readableBytes();} // 写缓冲区中还没有写入的字节数
     ssize_t readFromFile(); // 从文件中向缓冲区读数据
     bool process(); // 处理数据
     ssize_t writeToFile(); // 向文件中写数据
@@ -31,6 +38,8 @@ private:
     int port; // 客户端端口
     Buffer readBuffer; // 读缓冲区
     Buffer writeBuffer; // 写缓冲区
+    Protocol protocol; // 使用的协议
+    HttpParser parser; // HTTP请求解析器（保存不完整请求的解析状态）
 
     bool isKeepAlive; // 是否保持长连接
 };
@@ -6,9 +6,11 @@
 #include <vector>
 #include <memory>
 
+// 单一事件循环模式使用Epoll的单例；多reactor模式下每个事件循环构造自己的Epoll
 class Epoll{
 public:
     static std::shared_ptr<Epoll> instance(); // 获取Epoll的单例对象
+    Epoll() = default;
     void init(int maxSize=1024); // 初始化函数
 
     bool addFd(int fd,uint32_t events); // 添加文件描述符
@@ -22,7 +24,6 @@ public:
     Epoll(const Epoll&) = delete; // 禁用拷贝构造函数
     Epoll& operator=(const Epoll&) = delete; // 禁用赋值运算符
 private:
-    Epoll() = default; // 禁用外部构造
     int fd; // epoll文件描述符
     std::vector<struct epoll_event> events; // 用于保存就绪的文件描述符
 };
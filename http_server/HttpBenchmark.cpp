@@ -0,0 +1,145 @@
+// HTTP请求解析测试：对比旧的解析器（逐字节lookDate + std::regex + std::map）和可以恢复的HttpParser
+// 用法：./http_benchmark [请求数] [分片大小]
+// 流水线：读缓冲区中连续放着所有请求，依次解析并丢弃；分片：每个请求按分片大小逐段追加到读缓冲区，每追加一段解析一次
+#include "HttpParser.h"
+#include "Buffer.h"
+#include <iostream>
+#include <chrono>
+#include <map>
+#include <regex>
+#include <string>
+
+// 旧的解析器（与改动之前的实现相同），只修正了数据不足的判断：
+// 原来的判断只检查可读空间不为空，请求不完整时会越过可读空间继续读，分片测试无法进行
+static bool legacyParser(Buffer& readBuffer,std::map<std::string,std::string>& parseResult){
+    int currLen=0;
+    std::string currLine;
+    int state=0;
+    while(true){
+        if(readBuffer.readableBytes()<currLen+1) return false;
+        char c=readBuffer.lookDate(currLen,currLen+1).at(0);
+        currLen++;
+        if(c=='\r'){
+            if(readBuffer.readableBytes()<currLen+1) return false;
+            char cc=readBuffer.lookDate(currLen,currLen+1).at(0);
+            if(cc=='\n'){
+                currLen++;
+                switch (state){
+                case 0:{
+                    std::regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
+                    std::smatch subMatch;
+                    if(regex_match(currLine, subMatch, patten)){
+                        parseResult["method"]=subMatch[1];
+                        parseResult["url"]=subMatch[2];
+                        parseResult["version"]=subMatch[3];
+                    }else{
+                        parseResult["error"]="true";
+                    }
+                    state=1;
+                    break;
+                }
+                case 1:{
+                    std::regex patten("^([^:]*) ?: ?(.*)$");
+                    std::smatch subMatch;
+                    if(regex_match(currLine, subMatch, patten)){
+                        std::string key=subMatch[1];
+                        {
+                            if(key[0]>='A'&&key[0]<='Z')key[0]=key[0]-'A'+'a';
+                            size_t index=1;for(;index<key.size();index++)if(key[index]=='-')break;
+                            if(index+1<key.size()&&key[index+1]>='A'&&key[index+1]<='Z')key[index+1]=key[index+1]-'A'+'a';
+                        }
+                        parseResult[key]=subMatch[2];
+                    }else parseResult["error"]="true";
+                    if(readBuffer.readableBytes()<currLen+2) return false;
+                    std::vector<char> temp=readBuffer.lookDate(currLen,currLen+2);
+                    if(temp[0]=='\r'&&temp[1]=='\n'){
+                        currLen+=2;
+                        std::string str=parseResult["content-length"];
+                        if(!str.empty()){
+                            int bodyLen=std::stoi(str);
+                            if(readBuffer.readableBytes()<currLen+bodyLen) return false;
+                            std::vector<char> body=readBuffer.lookDate(currLen,currLen+bodyLen);
+                            currLen+=bodyLen;
+                            readBuffer.abandonData(currLen);
+                            parseResult["body"]=std::string(body.begin(),body.end());
+                        }
+                        return true;
+                    }
+                    break;
+                }
+                }
+                currLine="";
+            }else currLine.push_back(c);
+        }else currLine.push_back(c);
+    }
+}
+
+// 与curl、浏览器发出的请求类似的POST请求
+static std::string makeRequest(){
+    std::string body="{\"cmd\":[\"insert\",\"user:10086\",\"{\\\"name\\\":\\\"tom\\\",\\\"age\\\":18}\"]}";
+    return "POST /kv_store HTTP/1.1\r\n"
+        "Host: 127.0.0.1:9090\r\n"
+        "User-Agent: curl/7.81.0\r\n"
+        "Accept: */*\r\n"
+        "Connection: keep-alive\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: "+std::to_string(body.size())+"\r\n"
+        "\r\n"+body;
+}
+
+static double seconds(std::chrono::steady_clock::time_point begin){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-begin).count();
+}
+
+// 解析一个请求：legacy为true时使用旧的解析器；返回是否解析完成，完成时丢弃请求并累计请求体的长度
+static bool parseOne(bool legacy,Buffer& buffer,HttpParser& parser,size_t& checksum){
+    if(legacy){
+        std::map<std::string,std::string> parseResult;
+        if(!legacyParser(buffer,parseResult))return false;
+        checksum+=parseResult["body"].size()+parseResult["url"].size();
+        return true;
+    }
+    HttpRequest request;
+    if(parser.parse(buffer.peek(),buffer.readableBytes(),request)!=HttpParser::COMPLETE)return false;
+    checksum+=request.body.size()+request.url.size();
+    buffer.abandonData(parser.length());
+    parser.reset();
+    return true;
+}
+
+int main(int argc,char* argv[]){
+    int requestNum=argc>1?std::stoi(argv[1]):20000;
+    size_t fragment=argc>2?std::stoul(argv[2]):16;
+    std::string request=makeRequest();
+    std::string pipeline;
+    for(int i=0;i<requestNum;i++)pipeline+=request;
+    std::cout<<"requests="<<requestNum<<" size="<<request.size()<<"B fragment="<<fragment<<"B"<<std::endl;
+    std::cout<<"parser\tpipeline(req/s)\tpipeline(MB/s)\tfragmented(req/s)"<<std::endl;
+    for(bool legacy:{true,false}){
+        HttpParser parser;
+        size_t checksum=0;
+        Buffer buffer;
+        buffer.appendData(pipeline.data(),pipeline.size());
+        auto begin=std::chrono::steady_clock::now();
+        int parsed=0;
+        while(parseOne(legacy,buffer,parser,checksum))parsed++;
+        double pipelineTime=seconds(begin);
+
+        // 分片测试的请求数较少，旧的解析器每次都从头解析，耗时与分片数的平方成正比
+        int fragmentedNum=std::max(1,requestNum/10);
+        begin=std::chrono::steady_clock::now();
+        for(int i=0;i<fragmentedNum;i++){
+            for(size_t offset=0;offset<request.size();offset+=fragment){
+                buffer.appendData(request.data()+offset,std::min(fragment,request.size()-offset));
+                if(parseOne(legacy,buffer,parser,checksum))parsed++;
+            }
+        }
+        double fragmentedTime=seconds(begin);
+        if(parsed!=requestNum+fragmentedNum)std::cerr<<"parsed "<<parsed<<" requests"<<std::endl;
+        std::cout<<(legacy?"legacy":"parser")<<"\t"<<static_cast<long long>(requestNum/pipelineTime)
+            <<"\t"<<pipeline.size()/pipelineTime/1e6
+            <<"\t"<<static_cast<long long>(fragmentedNum/fragmentedTime)<<std::endl;
+        std::cerr<<"(checksum "<<checksum<<")"<<std::endl;
+    }
+    return 0;
+}
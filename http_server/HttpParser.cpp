@@ -0,0 +1,180 @@
+#include "HttpParser.h"
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// 服务器用到的请求头的名称（小写），下标与HttpRequest::Header对应
+size_t HttpParser::maxBodySize=64*1024*1024;
+
+static const std::string_view headerNames[HttpRequest::HEADER_NUM]={"connection","content-type","content-length"};
+
+// name与小写的lower是否相同（不区分大小写）
+static bool equalsLower(const char* name,size_t len,std::string_view lower){
+    if(len!=lower.size())return false;
+    for(size_t i=0;i<len;i++){
+        char c=name[i];
+        if(c>='A'&&c<='Z')c=c-'A'+'a';
+        if(c!=lower[i])return false;
+    }
+    return true;
+}
+
+static bool isSpace(char c){return c==' '||c=='\t';}
+
+static const char* findScalar(const char* p,const char* end,char a,char b){
+    for(;p<end;p++)if(*p==a||*p==b)return p;
+    return end;
+}
+
+#if defined(__x86_64__)
+// x86-64总是支持SSE2：每次比较16个字节，剩下不足16个字节时逐个比较
+static const char* findSse2(const char* p,const char* end,char a,char b){
+    __m128i va=_mm_set1_epi8(a);
+    __m128i vb=_mm_set1_epi8(b);
+    for(;end-p>=16;p+=16){
+        __m128i v=_mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask=_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v,va),_mm_cmpeq_epi8(v,vb)));
+        if(mask!=0)return p+__builtin_ctz(mask);
+    }
+    return findScalar(p,end,a,b);
+}
+
+// 支持AVX2的CPU每次比较32个字节（不需要额外的编译选项，运行时检测CPU后选择）
+__attribute__((target("avx2")))
+static const char* findAvx2(const char* p,const char* end,char a,char b){
+    __m256i va=_mm256_set1_epi8(a);
+    __m256i vb=_mm256_set1_epi8(b);
+    for(;end-p>=32;p+=32){
+        __m256i v=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask=_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v,va),_mm256_cmpeq_epi8(v,vb)));
+        if(mask!=0)return p+__builtin_ctz(mask);
+    }
+    return findSse2(p,end,a,b);
+}
+#endif
+
+using FindFunction=const char*(*)(const char*,const char*,char,char);
+
+static FindFunction selectFind(){
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))return findAvx2;
+    return findSse2;
+#else
+    return findScalar;
+#endif
+}
+
+static const FindFunction findFunction=selectFind();
+
+const char* HttpParser::find(const char* begin,const char* end,char a,char b){
+    return findFunction(begin,end,a,b);
+}
+
+HttpParser::Result HttpParser::parse(const char* data,size_t len,HttpRequest& request){
+    while(state!=BODY){
+        // 从上次停下的位置继续查找行尾
+        const char* end=data+len;
+        const char* p=find(data+scanned,end,'\r','\n');
+        size_t lineEnd=p-data;
+        if(p==end||(*p=='\r'&&lineEnd+1==len)){
+            // 行不完整（或者CR之后的LF还没有到达），下一次从这里继续
+            scanned=lineEnd;
+            return len>MAX_HEADER_SIZE?TOO_LARGE:INCOMPLETE;
+        }
+        size_t next; // 下一行的起点
+        if(*p=='\n')next=lineEnd+1; // 容忍只有LF的行尾
+        else if(p[1]=='\n')next=lineEnd+2;
+        else{
+            error=true; // 单独的CR
+            next=lineEnd+1;
+        }
+        if(next>MAX_HEADER_SIZE)return TOO_LARGE;
+        if(state==REQUEST_LINE){
+            // 忽略请求行之前的空行
+            if(lineEnd>lineBegin){
+                parseRequestLine(data,lineBegin,lineEnd);
+                state=HEADERS;
+            }
+        }else if(lineEnd==lineBegin){
+            // 空行，请求头结束
+            state=BODY;
+            if(!parseContentLength(data))return BODY_TOO_LARGE;
+        }else parseHeader(data,lineBegin,lineEnd);
+        lineBegin=scanned=next;
+    }
+    if(len-lineBegin<bodyLength)return INCOMPLETE; // 请求体不完整
+    total=lineBegin+bodyLength;
+    request.method=method.view(data);
+    request.url=url.view(data);
+    request.version=version.view(data);
+    for(int i=0;i<HttpRequest::HEADER_NUM;i++)request.headers[i]=headers[i].view(data);
+    request.body=std::string_view(data+lineBegin,bodyLength);
+    request.error=error;
+    return COMPLETE;
+}
+
+void HttpParser::parseRequestLine(const char* data,size_t begin,size_t end){
+    // 请求行的格式：方法 URL HTTP/版本
+    const char* b=data+begin;
+    const char* e=data+end;
+    const char* space1=find(b,e,' ',' ');
+    const char* space2=space1==e?e:find(space1+1,e,' ',' ');
+    static const char prefix[]="HTTP/";
+    const size_t prefixLen=sizeof(prefix)-1;
+    if(space2==e||e-space2-1<(long)prefixLen||std::memcmp(space2+1,prefix,prefixLen)!=0
+        ||find(space2+1,e,' ',' ')!=e){
+        error=true; // 存在语法错误
+        return ;
+    }
+    method={uint32_t(begin),uint32_t(space1-b)};
+    url={uint32_t(space1+1-data),uint32_t(space2-space1-1)};
+    version={uint32_t(space2+1+prefixLen-data),uint32_t(e-space2-1-prefixLen)};
+}
+
+void HttpParser::parseHeader(const char* data,size_t begin,size_t end){
+    // 请求头的格式：名称:值，冒号前后可以有空白
+    const char* b=data+begin;
+    const char* e=data+end;
+    const char* colon=find(b,e,':',':');
+    if(colon==e){
+        error=true;
+        return ;
+    }
+    const char* nameEnd=colon;
+    while(nameEnd>b&&isSpace(nameEnd[-1]))nameEnd--;
+    const char* value=colon+1;
+    while(value<e&&isSpace(*value))value++;
+    while(e>value&&isSpace(e[-1]))e--;
+    for(int i=0;i<HttpRequest::HEADER_NUM;i++){
+        if(equalsLower(b,nameEnd-b,headerNames[i])){
+            headers[i]={uint32_t(value-data),uint32_t(e-value)};
+            break;
+        }
+    }
+}
+
+bool HttpParser::parseContentLength(const char* data){
+    bodyLength=0;
+    std::string_view str=headers[HttpRequest::HEADER_CONTENT_LENGTH].view(data);
+    if(str.empty())return true; // 没有请求体
+    size_t length=0;
+    for(char c:str){
+        if(c<'0'||c>'9'){
+            // 长度无效时无法确定请求的边界，返回400之后关闭连接
+            error=true;
+            return true;
+        }
+        if(length>maxBodySize)return false; // 之后的数字只会更大（maxBodySize不超过2^40，这里不会溢出）
+        length=length*10+(c-'0');
+    }
+    if(length>maxBodySize)return false;
+    bodyLength=length;
+    return true;
+}
+
+void HttpParser::reset(){
+    *this=HttpParser();
+}
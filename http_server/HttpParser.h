@@ -0,0 +1,63 @@
+#ifndef HTTPPARSER
+#define HTTPPARSER
+
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+
+// 一个HTTP请求的解析结果：所有字段都是读缓冲区中的切片，在丢弃已经处理的数据或者读缓冲区读入新数据之前有效
+struct HttpRequest{
+    enum Header{HEADER_CONNECTION,HEADER_CONTENT_TYPE,HEADER_CONTENT_LENGTH,HEADER_NUM}; // 服务器用到的请求头，其余请求头解析后忽略
+    std::string_view method;
+    std::string_view url;
+    std::string_view version; // 不包括"HTTP/"
+    std::string_view headers[HEADER_NUM]; // 请求头的值（去掉首尾空白），没有该请求头时为空
+    std::string_view body;
+    bool error=false; // 请求存在语法错误（仍然会跳过整个请求，返回400）
+};
+
+// 可以恢复的HTTP/1.1请求解析器（状态机），每个连接一个
+// 直接在读缓冲区的可读空间中解析，数据不完整时保存状态，下一次从上次停下的位置继续，已经扫描过的字节不会再扫描
+// 状态中只保存相对于可读空间起点的偏移，读缓冲区搬移或者扩容之后仍然有效
+// 行尾（CR/LF）和请求头中的冒号使用SIMD（AVX2或SSE2）查找，请求头名称不区分大小写
+class HttpParser{
+public:
+    enum Result{INCOMPLETE,COMPLETE,TOO_LARGE,BODY_TOO_LARGE};
+    static const size_t MAX_HEADER_SIZE=64*1024; // 请求行加请求头的最大字节数
+    static size_t maxBodySize; // 请求体的最大字节数（配置文件中的maxBodySize）
+
+    // data为可读空间的起始地址，len为可读字节数（两次调用之间可读空间只能在末尾增加数据）
+    // 返回COMPLETE时request为解析结果，length()为请求占用的字节数；请求头超过MAX_HEADER_SIZE时返回TOO_LARGE，
+    // Content-Length超过maxBodySize时返回BODY_TOO_LARGE（请求头解析完成后立即返回，不等待请求体）
+    Result parse(const char* data,size_t len,HttpRequest& request);
+    size_t length(){return this->total;} // 解析完成的请求占用的字节数
+    // 请求头解析完成之后（正在等待请求体）整个请求占用的字节数，之前返回0
+    size_t required(){return this->state==BODY?this->lineBegin+this->bodyLength:0;}
+    void reset(); // 丢弃解析完成的请求之后调用，开始解析下一个请求
+
+    // 在[begin,end)中查找第一个等于a或者b的字节，没有找到时返回end
+    static const char* find(const char* begin,const char* end,char a,char b);
+private:
+    enum State{REQUEST_LINE,HEADERS,BODY};
+    struct Slice{
+        // 字段在可读空间中的偏移和长度
+        uint32_t offset=0;
+        uint32_t length=0;
+        std::string_view view(const char* data){return std::string_view(data+offset,length);}
+    };
+
+    void parseRequestLine(const char* data,size_t begin,size_t end); // 解析请求行[begin,end)
+    void parseHeader(const char* data,size_t begin,size_t end); // 解析一行请求头[begin,end)
+    // 请求头结束后根据content-length确定请求体的长度，超过maxBodySize时返回false
+    bool parseContentLength(const char* data);
+
+    State state=REQUEST_LINE;
+    size_t lineBegin=0; // 当前行的起点
+    size_t scanned=0; // 当前行中已经扫描过的位置（之前没有行尾）
+    size_t bodyLength=0; // 请求体的长度
+    size_t total=0; // 请求占用的字节数（解析完成后有效）
+    bool error=false;
+    Slice method,url,version,headers[HttpRequest::HEADER_NUM];
+};
+
+#endif
@@ -1,11 +1,13 @@
 #include "HttpProcess.h"
 #include "Log.h"
 #include "Processor.h"
-#include <regex>
-#include <iostream>
+#include "ProcessorShim.h"
+#include <map>
+#include <algorithm>
 
 static std::shared_ptr<HttpProcess> httpProcess=nullptr;
 static std::mutex mutex;
+static const size_t MAX_RESERVE=1<<20; // 请求体还没有到达时最多提前准备的连续空间，更大的请求先读到块链中，到齐后再合并
 static std::map<std::string,std::string> codes={
     std::pair<std::string,std::string>("200","OK"),
     std::pair<std::string,std::string>("400","Bad Request"),
@@ -13,6 +15,8 @@ static std::map<std::string,std::string> codes={
     std::pair<std::string,std::string>("404","Not Found"),
     std::pair<std::string,std::string>("405","Method Not Allowed"),
     std::pair<std::string,std::string>("406","Not Acceptable"),
+    std::pair<std::string,std::string>("413","Payload Too Large"),
+    std::pair<std::string,std::string>("431","Request Header Fields Too Large"),
     std::pair<std::string,std::string>("500","Internal Server Error"),
     std::pair<std::string,std::string>("505","HTTP Version Not Supported")
 };
@@ -32,145 +36,125 @@ std::shared_ptr<HttpProcess> HttpProcess::instance(){
 bool HttpProcess::process(Connection* conn){
     // 如果处理了readBuffer，并写入了writeBuffer，则返回true
     // 如果没有处理readBuffer（一般是没有达到处理条件，例如报文不完整），则返回false
-    std::map<std::string,std::string> parseResult;
-    parseResult["error"]="false";
-    if(httpParser(conn->readBuffer,parseResult)){
-        std::string response;
-        if(parseResult["error"]=="true"){
-            // HTTP请求存在语法错误，不移交上层，直接返回400错误报文
-            response=httpBuilder(parseResult["version"],"400",parseResult["connection"],"");
-        }else if(parseResult["version"]!="1.0"&&parseResult["version"]!="1.1"){
-            // 不支持1.0，1.1以外的HTTP协议版本，不移交上层，直接返回505错误报文
-            response=httpBuilder(parseResult["version"],"505",parseResult["connection"],"");
-        }else if(parseResult["method"]!="GET"&&parseResult["method"]!="POST"){
-            // 不支持GET POST以外的方法，不移交上层，直接返回405错误报文
-            response=httpBuilder(parseResult["version"],"405",parseResult["connection"],"");
-        }else if(!parseResult["content-type"].empty()&&parseResult["content-type"]!="application/json"){
-            // 不支持json格式以外的数据，不移交上层，直接返回406错误报文
-            response=httpBuilder(parseResult["version"],"406",parseResult["connection"],"");
-        }else{
-            if(parseResult["method"]=="GET"){
-                // 如果是GET请求，则需要重写parseResult的url和body
-                // 将纯url的部分写到url中，参数部分写到body中
-                std::regex p1("^([^\\?]*)\\?([^]*)$");std::smatch url;regex_match(parseResult["url"],url,p1);
-                std::string has_args(url[1]);
-                if (has_args!="") { // url中含有参数
-                    parseResult["url"]=url[1];
-                    std::string params(url[2]); // 参数部分
-                    // 构建关于参数的json字符串，并写道parseResult["body"]中
-                    parseResult["body"]="{";
-                    std::string temp;
-                    for(int i=0;i<params.size();i++){
-                        if(params[i]=='='){
-                            parseResult["body"].append("\""+temp+"\":");
-                            temp="";
-                        }else if(params[i]=='&'){
-                            parseResult["body"].append("\""+temp+"\",");
-                            temp="";
-                        }else temp.push_back(params[i]);
-                    }
-                    parseResult["body"].append("\""+temp+"\"}");
-                }else { // url中不含参数
-                    parseResult["body"]="";
+    Buffer& readBuffer=conn->readBuffer;
+    HttpParser& parser=conn->parser;
+    HttpRequest request;
+    // 请求通常在读缓冲区的第一个块中，直接在块中解析
+    std::string_view data=readBuffer.front();
+    HttpParser::Result result=parser.parse(data.data(),data.size(),request);
+    size_t readable=readBuffer.readableBytes();
+    if(result==HttpParser::INCOMPLETE&&data.size()<readable&&parser.required()<=readable){
+        // 请求跨越了多个块：合并到一个块中之后继续解析（请求头还不完整，或者已经知道请求的长度并且整个请求都已经到达）
+        readBuffer.reserve(parser.required());
+        data=readBuffer.front();
+        result=parser.parse(data.data(),data.size(),request);
+    }
+    if(result==HttpParser::INCOMPLETE){
+        // 报文不完整，等待后面报文到达后从停下的位置继续解析
+        // 请求体较大时，提前准备好连续空间（最多MAX_RESERVE字节），之后的数据直接读到这块空间中，不需要再搬移
+        // 只在数据都在一个块中时准备，超出部分读到块链中，不会因为请求头中的长度提前申请大块内存
+        if(parser.required()>data.size()&&data.size()==readable)readBuffer.reserve(std::min(parser.required(),MAX_RESERVE));
+        return false;
+    }
+    std::string response;
+    if(result==HttpParser::TOO_LARGE||result==HttpParser::BODY_TOO_LARGE){
+        // 请求头过大返回431，请求体过大返回413，之后关闭连接（不再读取这个请求剩下的数据）
+        response=httpBuilder("1.1",result==HttpParser::TOO_LARGE?"431":"413","","");
+        conn->setKeepAlive(false);
+        readBuffer.abandonData(readBuffer.readableBytes());
+        parser.reset();
+        conn->writeBuffer.appendData(response.data(),response.size());
+        return true;
+    }
+    std::string_view version=request.version.empty()?"1.1":request.version;
+    std::string_view connection=request.headers[HttpRequest::HEADER_CONNECTION];
+    std::string_view contentType=request.headers[HttpRequest::HEADER_CONTENT_TYPE];
+    if(request.error){
+        // HTTP请求存在语法错误，不移交上层，直接返回400错误报文
+        // 之后的数据无法确定请求的边界，发送完之后关闭连接
+        response=httpBuilder(version,"400","","");
+        conn->setKeepAlive(false);
+    }else if(version!="1.0"&&version!="1.1"){
+        // 不支持1.0，1.1以外的HTTP协议版本，不移交上层，直接返回505错误报文
+        response=httpBuilder(version,"505",connection,"");
+    }else if(request.method!="GET"&&request.method!="POST"){
+        // 不支持GET POST以外的方法，不移交上层，直接返回405错误报文
+        response=httpBuilder(version,"405",connection,"");
+    }else if(!contentType.empty()&&contentType!="application/json"){
+        // 不支持json格式以外的数据，不移交上层，直接返回406错误报文
+        response=httpBuilder(version,"406",connection,"");
+    }else{
+        std::string_view url=request.url;
+        std::string_view body=request.body;
+        std::string args; // GET请求的参数转换成的json
+        if(request.method=="GET"){
+            // 如果是GET请求，则需要重写url和body
+            // 将纯url的部分写到url中，参数部分写到body中
+            size_t mark=url.find('?');
+            if(mark!=std::string_view::npos&&mark!=0){ // url中含有参数
+                std::string_view params=url.substr(mark+1); // 参数部分
+                url=url.substr(0,mark);
+                // 构建关于参数的json字符串
+                args="{\"";
+                for(char c:params){
+                    if(c=='=')args.append("\":\"");
+                    else if(c=='&')args.append("\",\"");
+                    else args.push_back(c);
                 }
-                
-            }
-            // 解析成功，交给Processor进行处理
-            if(parseResult["connection"]=="keep-alive")conn->setKeepAlive(true); // 设置长连接
-            // 获取http响应体
-            std::string body = Processor::instance()->process(parseResult["method"], parseResult["url"], parseResult["body"]);
-            // 处理结束，根据处理结果构造HTTP响应报文
-            if(body==""){ // 函数调用失败，服务器内部错误
-                response=httpBuilder(parseResult["version"],"500",parseResult["connection"],"");
-            }else{
-                if(body=="404"){ // 返回404，说明没有找到方法
-                    response=httpBuilder(parseResult["version"],"404",parseResult["connection"],"");
-                }else response=httpBuilder(parseResult["version"],"200",parseResult["connection"],body);
+                args.append("\"}");
             }
+            body=args; // url中不含参数时body为空
         }
-        std::vector<char> data(response.begin(),response.end());
-        conn->writeBuffer.appendData(data);
-        return true; // 解析并处理完成，返回true，向客户端发送响应报文
-    }else return false; // 解析失败，报文不完整，等待后面报文到达后继续解析
+        // 解析成功，交给Processor进行处理
+        if(connection=="keep-alive")conn->setKeepAlive(true); // 设置长连接
+        // 由存储引擎直接把响应体写到写缓冲区中，再在响应体之前填上响应头
+        // 请求的各个字段都指向读缓冲区，处理完之后才能丢弃读缓冲区中的请求
+        respond(conn->writeBuffer,version,connection,Processor::Request{request.method,url,body});
+    }
+    if(!response.empty())conn->writeBuffer.appendData(response.data(),response.size());
+    readBuffer.abandonData(parser.length()); // 丢弃掉已经处理过的数据
+    parser.reset();
+    return true; // 解析并处理完成，返回true，向客户端发送响应报文
 }
 
-bool HttpProcess::httpParser(Buffer& readBuffer,std::map<std::string,std::string>& parseResult){
-    int currLen=0; // 当前已经解析过的数据的长度
-    std::string currLine; // 当前行内容
-    int state=0; // 当前的解析状态 0：正在解析请求行；1：正在解析请求头
-    while(true){
-        if(readBuffer.readableBytes()<1) return false; // 数据不足，解析失败
-        char c=readBuffer.lookDate(currLen,currLen+1).at(0); // 取出一个字节的数据
-        currLen++;
-        if(c=='\r'){
-            if(readBuffer.readableBytes()<1) return false; // 数据不足，解析失败
-            char cc=readBuffer.lookDate(currLen,currLen+1).at(0); // 取出一个字节的数据
-            if(cc='\n'){// 解析到一个行的末尾
-                currLen++;
-                switch (state){
-                case 0:{
-                    // 解析请求行
-                    std::regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$"); // 请求行的正则表达式
-                    std::smatch subMatch;
-                    if(regex_match(currLine, subMatch, patten)){   
-                        parseResult["method"]=subMatch[1]; // 请求方法
-                        parseResult["url"]=subMatch[2]; // url
-                        parseResult["version"]=subMatch[3]; // HTTP版本
-                    }else{
-                        parseResult["error"]="true";; // 匹配失败，存在语法错误，设置parseResult的错误标志
-                    }
-                    state=1; // 下一步需要解析请求头
-                    break;
-                }
-                case 1:{
-                    // 正则表达式解析请求头
-                    std::regex patten("^([^:]*) ?: ?(.*)$");
-                    std::smatch subMatch;
-                    if(regex_match(currLine, subMatch, patten)){
-                        std::string key=subMatch[1];
-                        {
-                            // 将key的单词的首字母统一转小写，方便处理
-                            // 例如将头部Content-Type转为content-type
-                            if(key[0]>='A'&&key[0]<='Z')key[0]=key[0]-'A'+'a';
-                            int index=1;for(;index<key.size();index++)if(key[index]=='-')break;
-                            if(index+1<key.size()&&key[index+1]>='A'&&key[index+1]<='Z')key[index+1]=key[index+1]-'A'+'a';
-                        }
-                        parseResult[key]=subMatch[2];
-                    }else parseResult["error"]="true";; // 匹配失败，存在语法错误，设置parseResult的错误标志
-                    // 检查是否能继续解析请求体
-                    if(readBuffer.readableBytes()<2) return false; // 数据不足，解析失败
-                    std::vector<char> temp=readBuffer.lookDate(currLen,currLen+2);
-                    if(temp[0]=='\r'&&temp[1]=='\n'){ // 出现换行，开始解析请求体
-                        currLen+=2;
-                        // 如果content-length不存在，则返回空字符串
-                        std::string str=parseResult["content-length"];
-                        if(!str.empty()){// str为空时，说明是GET请求，无需解析请求体，直接返回true
-                            int bodyLen=bodyLen=std::stoi(str);
-                            if(readBuffer.readableBytes()<bodyLen) return false; // 数据不足，解析失败
-                            std::vector<char> body=readBuffer.lookDate(currLen,currLen+bodyLen);
-                            currLen+=bodyLen;
-                            readBuffer.abandonData(currLen); // 丢弃掉已经处理过的数据
-                            parseResult["body"]=std::string(body.begin(),body.end());
-                        }
-                        return true; // 解析成功
-                    }
-                    break;
-                }
-                }
-                currLine=""; // 解析完当前行后清空变量
-            }else currLine.push_back(c);
-        }else currLine.push_back(c);
-    }
+std::string HttpProcess::httpBuilder(std::string_view version,const std::string& code,std::string_view connection,const std::string& body){
+    std::string response=headerBuilder(version,code,connection,body.size());
+    response.append(body);
+    return response;
 }
 
-std::string HttpProcess::httpBuilder(const std::string& version,const std::string& code,const std::string& connection,const std::string& body){
-    std::string response;
-    response="HTTP/"+version+" "+code+" "+codes[code]+"\r\n"; // 首行
+std::string HttpProcess::headerBuilder(std::string_view version,const std::string& code,std::string_view connection,size_t length){
+    std::string response="HTTP/";
+    response.append(version.data(),version.size());
+    response.append(" "+code+" "+codes[code]+"\r\n"); // 首行
     if(connection=="keep-alive")response.append("Connection: keep-alive\r\n");
     response.append("Content-Type: application/json\r\n");
-    response.append("Content-Length: "+std::to_string(body.size())+"\r\n");
+    response.append("Content-Length: "+std::to_string(length)+"\r\n");
     response.append("Access-Control-Allow-Methods: GET,POST\r\n");
     response.append("\r\n");
-    response.append(body);
     return response;
-}
\ No newline at end of file
+}
+
+void HttpProcess::respond(Buffer& writeBuffer,std::string_view version,std::string_view connection,const Processor::Request& request){
+    // 状态码要等引擎处理完才知道，因此先在写缓冲区中预留响应头的空间，引擎把响应体写在预留空间之后
+    static const size_t HEADER_ROOM=160; // 响应头的最大长度（版本只能是1.0或1.1，其余字段的长度是固定的）
+    writeBuffer.beginWrite(HEADER_ROOM);
+    writeBuffer.hasWritten(HEADER_ROOM);
+    BufferOutput output(writeBuffer,HEADER_ROOM); // 预留的响应头空间与响应体保持连续
+    int code=ProcessorShim::process(request,output);
+    output.finish();
+    size_t length=output.size();
+    if(code!=200){ // 404或者500：丢弃引擎写入的内容，返回没有响应体的错误报文
+        writeBuffer.unwrite(HEADER_ROOM+length);
+        std::string response=httpBuilder(version,std::to_string(code),connection,"");
+        writeBuffer.appendData(response.data(),response.size());
+        return ;
+    }
+    std::string header=headerBuilder(version,"200",connection,length);
+    size_t gap=HEADER_ROOM-header.size(); // 响应头右对齐到响应体之前，之前剩下的空隙
+    char* begin=writeBuffer.tail(HEADER_ROOM+length);
+    std::copy(header.begin(),header.end(),begin+gap);
+    // 去掉空隙：本次响应在块中可读数据的开头时（没有流水线请求时总是如此）直接跳过空隙，响应体不需要移动；
+    // 否则空隙夹在两个响应之间，只能把本次的响应前移
+    writeBuffer.erase(gap,header.size()+length);
+}
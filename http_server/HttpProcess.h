@@ -3,8 +3,10 @@
 
 #include <memory>
 #include <mutex>
-#include <map>
+#include <string>
+#include <string_view>
 #include "Connection.h"
+#include "Processor.h"
 
 class Connection;
 
@@ -18,13 +20,14 @@ public:
     HttpProcess& operator=(const HttpProcess&) = delete; // 禁用赋值运算符
 private:
     HttpProcess() = default; // 禁用外部构造
-    // 定义一些私有方法，用于解析http请求和构造http响应
+    // 定义一些私有方法，用于构造http响应（请求由每个连接的HttpParser解析）
 
-    // 解析成功返回true，并在该函数内丢掉readBuffer已经处理过的数据，解析失败(报文不完整，无法解析)返回false
-    // 报文有语法错误也是可以成功解析并丢掉已经处理过的数据的，只要返回给客户端400错误即可
-    bool httpParser(Buffer& readBuffer,std::map<std::string,std::string>& parseResult); // 解析HTTP请求，并把解析结果放到parseResult中
     // 根据HTTP解析结果和处理结果封装HTTP响应报文
-    std::string httpBuilder(const std::string& version,const std::string& code,const std::string& connection,const std::string& body);
+    std::string httpBuilder(std::string_view version,const std::string& code,std::string_view connection,const std::string& body);
+    // 构造响应头（不包括响应体），length为响应体的长度
+    std::string headerBuilder(std::string_view version,const std::string& code,std::string_view connection,size_t length);
+    // 调用存储引擎处理请求，引擎直接把响应体写到writeBuffer中，之后在响应体之前填上响应头
+    void respond(Buffer& writeBuffer,std::string_view version,std::string_view connection,const Processor::Request& request);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,100 @@
+// 线程池吞吐量测试：对比旧的线程池（单个加锁队列 + std::function）和工作窃取线程池
+// 用法：./pool_benchmark [最大线程数] [任务数] [每批任务数] [每个任务的计算量]
+// 提交者只有一个线程（与服务器的事件循环相同），每个任务由std::bind绑定成员函数和三个指针参数（与Server提交的任务相同）
+#include "ThreadPool.h"
+#include <iostream>
+#include <chrono>
+#include <queue>
+#include <functional>
+#include <string>
+
+// 旧的线程池（与改动之前的实现相同）：所有线程共用一个加锁的队列，工作线程每次循环都拷贝三次单例的shared_ptr，
+// 线程分离后不再结束，因此每次测试的线程池都不释放
+class LegacyPool{
+public:
+    static LegacyPool* create(int threadNum){
+        LegacyPool* pool=new LegacyPool();
+        pool->self=std::shared_ptr<LegacyPool>(pool);
+        for(int i=0;i<threadNum;i++){
+            std::thread([pool](){
+                while(true){
+                    std::unique_lock<std::mutex> lock(pool->instance()->poolLock);
+                    if(!pool->instance()->taskQue.empty()){
+                        auto task=pool->instance()->taskQue.front();
+                        pool->instance()->taskQue.pop();
+                        lock.unlock();
+                        task();
+                        lock.lock();
+                    }else pool->instance()->condvar.wait(lock);
+                }
+            }).detach();
+        }
+        return pool;
+    }
+    std::shared_ptr<LegacyPool> instance(){return self;} // 与旧实现的单例一样返回shared_ptr的拷贝
+    void addTask(std::function<void()> task){
+        std::lock_guard<std::mutex> lock(poolLock);
+        taskQue.push(task);
+        condvar.notify_one();
+    }
+private:
+    std::shared_ptr<LegacyPool> self;
+    std::mutex poolLock;
+    std::condition_variable condvar;
+    std::queue<std::function<void()>> taskQue;
+};
+
+// 任务绑定的对象：与Server::readEvent一样是一个成员函数，参数为三个指针
+struct Counter{
+    std::atomic<long long> done{0};
+    void work(int* rounds,long long* sink,void*){
+        long long x=0;
+        for(int i=0;i<*rounds;i++)x+=i*i;
+        *sink+=x&1; // 不同线程之间的数据竞争不影响测试，只是防止计算被优化掉
+        done.fetch_add(1,std::memory_order_release);
+    }
+};
+
+// 提交taskNum个任务并等待全部完成，返回每秒完成的任务数；submit(i)提交第i个任务
+template<typename F>
+static double measure(Counter& counter,long long taskNum,F&& submit){
+    counter.done=0;
+    auto begin=std::chrono::steady_clock::now();
+    for(long long i=0;i<taskNum;i++)submit(i);
+    while(counter.done.load(std::memory_order_acquire)<taskNum)std::this_thread::yield();
+    double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-begin).count();
+    return taskNum/seconds;
+}
+
+int main(int argc,char* argv[]){
+    int maxThreads=argc>1?std::stoi(argv[1]):8;
+    long long taskNum=argc>2?std::stoll(argv[2]):1000000;
+    size_t batchSize=argc>3?std::stoul(argv[3]):64;
+    int rounds=argc>4?std::stoi(argv[4]):16;
+    Counter counter;
+    long long sink=0;
+    std::cout<<"tasks="<<taskNum<<" batch="<<batchSize<<" rounds="<<rounds<<std::endl;
+    std::cout<<"threads\tlegacy(tasks/s)\taddTask(tasks/s)\taddTasks(tasks/s)"<<std::endl;
+    for(int threadNum=1;threadNum<=maxThreads;threadNum*=2){
+        LegacyPool* legacy=LegacyPool::create(threadNum);
+        double legacyRate=measure(counter,taskNum,[&](long long){
+            legacy->addTask(std::bind(&Counter::work,&counter,&rounds,&sink,nullptr));
+        });
+
+        ThreadPool& pool=*ThreadPool::instance();
+        pool.init(threadNum);
+        double singleRate=measure(counter,taskNum,[&](long long){
+            pool.addTask(std::bind(&Counter::work,&counter,&rounds,&sink,nullptr));
+        });
+        std::vector<ThreadPool::Task> tasks;
+        double batchRate=measure(counter,taskNum,[&](long long i){
+            tasks.emplace_back(std::bind(&Counter::work,&counter,&rounds,&sink,nullptr));
+            if(tasks.size()==batchSize||i==taskNum-1)pool.addTasks(tasks);
+        });
+        pool.shutdown();
+        std::cout<<threadNum<<"\t"<<static_cast<long long>(legacyRate)<<"\t"<<static_cast<long long>(singleRate)
+            <<"\t"<<static_cast<long long>(batchRate)<<std::endl;
+    }
+    std::cerr<<"(sink "<<sink<<")"<<std::endl;
+    return 0;
+}
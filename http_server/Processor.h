@@ -3,19 +3,89 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
+#include <cstring>
+#include <algorithm>
 
+// 存储引擎与服务器之间的接口
+// v1：process(method, url, body)返回响应体字符串（"404"表示没有找到方法，""表示服务器内部错误）
+// v2：引擎得到请求的视图和服务器提供的输出，直接把响应体写到输出中（例如连接的写缓冲区），返回状态码
+// 实现了v2的引擎导出processorAbiVersion，同时保留v1接口，旧的服务器仍然可以使用
+// 服务器中的这份声明把v2的符号声明为弱符号：链接只实现了v1的processor库时这些符号为空，由ProcessorShim回退到v1接口
 class Processor{
 public:
+    static const int ABI_VERSION=2; // 接口版本
+
+    // 请求的视图，只在process调用期间有效
+    struct Request{
+        std::string_view method;
+        std::string_view url;
+        std::string_view body;
+    };
+
+    // 响应体的输出：内存由服务器提供，写入的快速路径是内联的，空间不足时才调用服务器实现的grow
+    class Output{
+    public:
+        void append(const char* data,size_t len){
+            if(this->capacity-this->length<len) this->grow(this->length+len);
+            memcpy(this->start+this->length,data,len);
+            this->length+=len;
+        }
+        void push_back(char c){
+            if(this->length==this->capacity) this->grow(this->length+1);
+            this->start[this->length++]=c;
+        }
+        Output& operator+=(std::string_view text){
+            this->append(text.data(),text.size());
+            return *this;
+        }
+        Output& operator+=(char c){
+            this->push_back(c);
+            return *this;
+        }
+        size_t size() const {return this->length;} // 已经写入的字节数
+    protected:
+        virtual ~Output() = default;
+        // 将可写空间扩大到至少size字节，可以移动start，但必须保留已经写入的length字节
+        virtual void grow(size_t size) = 0;
+        char* start=nullptr; // 输出的起始地址
+        size_t length=0; // 已经写入的字节数
+        size_t capacity=0; // start处可写的字节数
+    };
+
+    // 以std::string为存储的输出，析构时把text截断为实际写入的内容（text原有的内容会被覆盖）
+    class StringOutput: public Output{
+    public:
+        explicit StringOutput(std::string& text):text(text){
+            this->text.resize(this->text.capacity());
+            this->start=&this->text[0];
+            this->capacity=this->text.size();
+        }
+        ~StringOutput() override {this->text.resize(this->length);}
+    protected:
+        void grow(size_t size) override {
+            this->text.resize(std::max(size,std::max<size_t>(this->capacity*2,64)));
+            this->start=&this->text[0];
+            this->capacity=this->text.size();
+        }
+    private:
+        std::string& text;
+    };
+
     static std::shared_ptr<Processor> instance(); // 获取Processor的单例对象
 
     void init(); // 初始化方法
-    std::string process(std::string& method, std::string& url, std::string& body); // 处理http请求并返回结果
+    std::string process(std::string& method, std::string& url, std::string& body); // v1：处理http请求并返回结果
+    __attribute__((weak)) int process(const Request& request, Output& output); // v2：处理请求，响应体写到output中，返回HTTP状态码（200、404、500）
     ~Processor(); // 析构函数
-    
+
     Processor(const Processor&) = delete; // 禁用拷贝构造函数
     Processor& operator=(const Processor&) = delete; // 禁用赋值运算符
 private:
     Processor() = default; // 禁用外部构造
 };
 
-#endif
\ No newline at end of file
+// 引擎实现的接口版本（v1的引擎没有这个符号）
+extern "C" int processorAbiVersion() __attribute__((weak));
+
+#endif
@@ -0,0 +1,39 @@
+#include "ProcessorShim.h"
+
+bool ProcessorShim::isV2(){
+    // 弱符号：v1的processor库中没有processorAbiVersion，此时它的地址为空
+    return processorAbiVersion!=nullptr&&processorAbiVersion()>=2;
+}
+
+int ProcessorShim::process(const Processor::Request& request, Processor::Output& output){
+    static const bool v2=isV2();
+    if(v2)return Processor::instance()->process(request,output);
+    // v1接口需要可修改的字符串参数，每个线程复用自己的字符串
+    thread_local std::string method,url,body;
+    method.assign(request.method.data(),request.method.size());
+    url.assign(request.url.data(),request.url.size());
+    body.assign(request.body.data(),request.body.size());
+    std::string result=Processor::instance()->process(method,url,body);
+    if(result=="")return 500; // 函数调用失败，服务器内部错误
+    if(result=="404")return 404; // 没有找到方法
+    output+=result;
+    return 200;
+}
+
+BufferOutput::BufferOutput(Buffer& buffer,size_t keep):buffer(buffer),keep(keep){
+    this->start=buffer.beginWrite(0,keep);
+    this->capacity=buffer.writableBytes();
+}
+
+void BufferOutput::finish(){
+    buffer.hasWritten(this->length);
+}
+
+void BufferOutput::grow(size_t size){
+    // 先提交已经写入的部分，使其在换到新的块时和keep一起被搬过去，然后再撤销提交
+    buffer.hasWritten(this->length);
+    char* end=buffer.beginWrite(std::max(size,this->capacity*2)-this->length,this->keep+this->length);
+    buffer.unwrite(this->length);
+    this->start=end-this->length;
+    this->capacity=buffer.writableBytes();
+}
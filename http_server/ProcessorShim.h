@@ -0,0 +1,27 @@
+#ifndef PROCESSORSHIM
+#define PROCESSORSHIM
+
+#include "Processor.h"
+#include "Buffer.h"
+
+// 服务器调用存储引擎的唯一入口：引擎实现了v2接口时直接把响应体写到output中；
+// 只实现了v1接口的旧processor库则调用v1接口，再把返回的字符串写到output中
+namespace ProcessorShim {
+    bool isV2(); // 链接的processor库是否实现了v2接口
+    int process(const Processor::Request& request, Processor::Output& output); // 返回HTTP状态码（200、404、500）
+}
+
+// 以Buffer的可写空间作为输出：引擎直接把响应体写到连接的写缓冲区中，finish之后才计入可读空间
+// keep为写缓冲区最后需要与输出保持连续的字节数（例如预留的响应头空间），输出换到新的块时它们会被一起搬过去
+class BufferOutput: public Processor::Output{
+public:
+    explicit BufferOutput(Buffer& buffer,size_t keep=0);
+    void finish(); // 提交已经写入的数据（移动写指针）
+protected:
+    void grow(size_t size) override;
+private:
+    Buffer& buffer;
+    size_t keep;
+};
+
+#endif
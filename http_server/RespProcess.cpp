@@ -0,0 +1,454 @@
+#include "RespProcess.h"
+#include "Log.h"
+#include "ProcessorShim.h"
+#include <unordered_map>
+#include <charconv>
+#include <cstring>
+
+static std::shared_ptr<RespProcess> respProcess=nullptr;
+static std::mutex mutex;
+
+// 单条命令的上限（与Redis相同），防止恶意的长度字段导致分配过多内存
+static const long MAX_ARGS=1024*1024; // 参数个数
+static const long MAX_BULK=512L*1024*1024; // 单个参数的字节数
+static const size_t MAX_INLINE=64*1024; // 内联命令一行的字节数
+
+// 在服务器中直接处理或者需要翻译的Redis命令，其余命令原样交给存储引擎
+enum Kind{PING,ECHO,COMMAND,QUIT,SET,SETNX,GET,DEL,EXISTS,MGET,MSET,INCR,DECR,INCRBY,DECRBY,APPEND,DBSIZE};
+static const std::unordered_map<std::string,Kind> kinds={
+    {"PING",PING},{"ECHO",ECHO},{"COMMAND",COMMAND},{"QUIT",QUIT},
+    {"SET",SET},{"SETNX",SETNX},{"GET",GET},{"DEL",DEL},{"EXISTS",EXISTS},{"MGET",MGET},{"MSET",MSET},
+    {"INCR",INCR},{"DECR",DECR},{"INCRBY",INCRBY},{"DECRBY",DECRBY},{"APPEND",APPEND},{"DBSIZE",DBSIZE}
+};
+
+// 构造RESP回复
+static void appendStatus(std::string& out,std::string_view text){
+    out+='+';
+    out.append(text.data(),text.size());
+    out+="\r\n";
+}
+static void appendError(std::string& out,std::string_view text){
+    out+='-';
+    out.append(text.data(),text.size());
+    out+="\r\n";
+}
+static void appendNumber(std::string& out,char type,long long value){
+    char digits[24];
+    auto result=std::to_chars(digits,digits+sizeof(digits),value);
+    out+=type;
+    out.append(digits,result.ptr-digits);
+    out+="\r\n";
+}
+static void appendBulk(std::string& out,std::string_view text){
+    appendNumber(out,'$',text.size());
+    out.append(text.data(),text.size());
+    out+="\r\n";
+}
+static void appendNil(std::string& out){
+    out+="$-1\r\n";
+}
+
+// 将text按json字符串的规则转义后追加到out（不包括两侧的引号）
+static void appendEscaped(std::string& out,std::string_view text){
+    static const char* digits="0123456789abcdef";
+    size_t start=0;
+    for(size_t i=0;i<text.size();i++){
+        unsigned char c=static_cast<unsigned char>(text[i]);
+        if(c>=0x20&&c!='"'&&c!='\\')continue;
+        out.append(text.data()+start,i-start);
+        switch(c){
+        case '"':out+="\\\"";break;
+        case '\\':out+="\\\\";break;
+        case '\n':out+="\\n";break;
+        case '\r':out+="\\r";break;
+        case '\t':out+="\\t";break;
+        default:
+            out+="\\u00";
+            out+=digits[c>>4];
+            out+=digits[c&0xF];
+        }
+        start=i+1;
+    }
+    out.append(text.data()+start,text.size()-start);
+}
+
+// 存储引擎返回的json中的一个字符串，key为true表示它是对象的键
+struct JsonString{
+    std::string_view text;
+    bool key;
+};
+
+// 按顺序取出json中的所有字符串（存储引擎的结果只由对象、数组和字符串组成，不需要完整的json解析）
+// 没有转义的字符串直接指向json，其余的解码到scratch中（预留json大小的空间，解码过程中不会重新分配）
+static bool scanJson(std::string_view json,std::vector<JsonString>& strings,std::string& scratch){
+    strings.clear();
+    scratch.clear();
+    scratch.reserve(json.size());
+    size_t i=0;
+    while(i<json.size()){
+        if(json[i]!='"'){
+            i++;
+            continue;
+        }
+        size_t start=++i;
+        size_t from=std::string::npos; // 出现转义后，字符串在scratch中的起点
+        for(;i<json.size()&&json[i]!='"';i++){
+            if(json[i]!='\\'){
+                if(from!=std::string::npos)scratch+=json[i];
+                continue;
+            }
+            if(from==std::string::npos){
+                from=scratch.size();
+                scratch.append(json.data()+start,i-start);
+            }
+            if(++i>=json.size())return false;
+            switch(json[i]){
+            case 'n':scratch+='\n';break;
+            case 'r':scratch+='\r';break;
+            case 't':scratch+='\t';break;
+            case 'b':scratch+='\b';break;
+            case 'f':scratch+='\f';break;
+            case 'u':{
+                // 存储引擎只会对控制字符使用\u00XX，这里按Unicode码点编码为UTF-8（不处理代理对）
+                unsigned code=0;
+                if(i+4>=json.size()||std::from_chars(json.data()+i+1,json.data()+i+5,code,16).ptr!=json.data()+i+5)return false;
+                i+=4;
+                if(code<0x80)scratch+=static_cast<char>(code);
+                else if(code<0x800){
+                    scratch+=static_cast<char>(0xC0|(code>>6));
+                    scratch+=static_cast<char>(0x80|(code&0x3F));
+                }else{
+                    scratch+=static_cast<char>(0xE0|(code>>12));
+                    scratch+=static_cast<char>(0x80|((code>>6)&0x3F));
+                    scratch+=static_cast<char>(0x80|(code&0x3F));
+                }
+                break;
+            }
+            default:scratch+=json[i]; // \"、\\和\/
+            }
+        }
+        if(i>=json.size())return false; // 没有结束的"
+        std::string_view text=(from==std::string::npos?json.substr(start,i-start):std::string_view(scratch).substr(from));
+        i++;
+        size_t next=i;
+        while(next<json.size()&&(json[next]==' '||json[next]=='\t'||json[next]=='\n'||json[next]=='\r'))next++;
+        strings.push_back({text,next<json.size()&&json[next]==':'});
+    }
+    return true;
+}
+
+// 取出键name对应的字符串值，不存在时返回nullptr
+static const std::string_view* field(const std::vector<JsonString>& strings,std::string_view name){
+    for(size_t i=0;i+1<strings.size();i++){
+        if(strings[i].key&&strings[i].text==name&&!strings[i+1].key)return &strings[i+1].text;
+    }
+    return nullptr;
+}
+
+static bool toInteger(std::string_view text,long long& value){
+    auto result=std::from_chars(text.data(),text.data()+text.size(),value);
+    return !text.empty()&&result.ec==std::errc()&&result.ptr==text.data()+text.size();
+}
+
+std::shared_ptr<RespProcess> RespProcess::instance(){
+    // 懒汉模式
+    // 使用双重检查保证线程安全
+    if(respProcess==nullptr){
+        std::unique_lock<std::mutex> lock(mutex); // 访问临界区之前需要加锁
+        if(respProcess==nullptr){
+            respProcess=std::shared_ptr<RespProcess>(new RespProcess());
+        }
+    }
+    return respProcess;
+}
+
+void RespProcess::init(const std::string& url){
+    this->url=url;
+}
+
+bool RespProcess::process(Connection* conn){
+    // RESP连接总是长连接，客户端发送QUIT或者协议出错时才由服务器关闭
+    conn->setKeepAlive(true);
+    // 每个线程复用自己的参数数组和回复缓冲区
+    thread_local std::vector<std::string_view> args;
+    thread_local std::string out;
+    out.clear();
+    const char* data=conn->readBuffer.peek();
+    size_t len=conn->readBuffer.readableBytes();
+    size_t used=0;
+    // 流水线：依次处理缓冲区中所有完整的命令，所有回复一次性写入写缓冲区
+    while(used<len){
+        long n=parseCommand(data+used,len-used,args);
+        if(n==0)break; // 命令不完整，等待后续数据到达
+        if(n<0){
+            // 格式错误之后的数据无法再划分出命令，回复错误后关闭连接
+            appendError(out,"ERR Protocol error");
+            conn->setKeepAlive(false);
+            used=len;
+            break;
+        }
+        used+=n;
+        if(args.empty())continue; // 空行
+        if(!execute(args,out)){
+            conn->setKeepAlive(false);
+            used=len;
+            break;
+        }
+    }
+    // args指向读缓冲区，处理完所有命令之后才能丢弃数据
+    if(used>0)conn->readBuffer.abandonData(used);
+    if(out.empty())return false;
+    conn->writeBuffer.appendData(out.data(),out.size());
+    static const size_t MAX_RETAINED=1<<20;
+    if(out.capacity()>MAX_RETAINED)std::string().swap(out); // 大回复之后释放缓冲区
+    return true;
+}
+
+// 读取一个以\r\n结尾的十进制整数：数据不完整返回0，格式错误返回-1，成功返回1并将p移动到\r\n之后
+static int readNumber(const char*& p,const char* end,long& value){
+    const char* cr=static_cast<const char*>(memchr(p,'\r',end-p));
+    if(cr==nullptr)return end-p>20?-1:0;
+    if(cr+1>=end)return 0;
+    if(cr[1]!='\n')return -1;
+    auto result=std::from_chars(p,cr,value);
+    if(result.ec!=std::errc()||result.ptr!=cr)return -1;
+    p=cr+2;
+    return 1;
+}
+
+long RespProcess::parseCommand(const char* data,size_t len,std::vector<std::string_view>& args){
+    args.clear();
+    const char* end=data+len;
+    if(data[0]!='*'){
+        // 内联命令：一行以空白符分隔的参数
+        const char* lf=static_cast<const char*>(memchr(data,'\n',len));
+        if(lf==nullptr)return len>MAX_INLINE?-1:0;
+        const char* p=data;
+        while(p<lf){
+            while(p<lf&&(*p==' '||*p=='\t'||*p=='\r'))p++;
+            const char* start=p;
+            while(p<lf&&*p!=' '&&*p!='\t'&&*p!='\r')p++;
+            if(p>start)args.emplace_back(start,p-start);
+        }
+        return lf+1-data;
+    }
+    // 批量字符串数组：*参数个数\r\n，之后每个参数为 $长度\r\n内容\r\n
+    const char* p=data+1;
+    long count;
+    int ret=readNumber(p,end,count);
+    if(ret<=0)return ret;
+    if(count>MAX_ARGS)return -1;
+    for(long i=0;i<count;i++){
+        if(p>=end)return 0;
+        if(*p!='$')return -1;
+        p++;
+        long size;
+        ret=readNumber(p,end,size);
+        if(ret<=0)return ret;
+        if(size<0||size>MAX_BULK)return -1;
+        if(end-p<size+2)return 0;
+        if(p[size]!='\r'||p[size+1]!='\n')return -1;
+        args.emplace_back(p,size);
+        p+=size+2;
+    }
+    return p-data;
+}
+
+bool RespProcess::call(const std::vector<std::string_view>& tokens,std::string& result){
+    thread_local std::string body;
+    body="{\"cmd\": [";
+    for(size_t i=0;i<tokens.size();i++){
+        if(i)body+=", ";
+        body+='"';
+        appendEscaped(body,tokens[i]);
+        body+='"';
+    }
+    body+="]}";
+    int code;
+    {
+        Processor::StringOutput output(result);
+        code=ProcessorShim::process(Processor::Request{"POST",url,body},output);
+    }
+    return code==200;
+}
+
+bool RespProcess::execute(const std::vector<std::string_view>& args,std::string& out){
+    thread_local std::string name;
+    thread_local std::vector<std::string_view> tokens;
+    thread_local std::vector<JsonString> strings;
+    thread_local std::string scratch;
+    thread_local std::string result; // 存储引擎返回的json
+    name.assign(args[0].data(),args[0].size());
+    for(char& c:name)if(c>='a'&&c<='z')c=c-'a'+'A'; // Redis的命令名不区分大小写
+    auto it=kinds.find(name);
+    tokens.clear();
+    if(it==kinds.end()){
+        // 不需要翻译的命令：命令名转为小写后原样交给存储引擎，以批量字符串返回json结果
+        for(char& c:name)if(c>='A'&&c<='Z')c=c-'A'+'a';
+        tokens.push_back(name);
+        tokens.insert(tokens.end(),args.begin()+1,args.end());
+        if(!call(tokens,result))appendError(out,"ERR unknown command or wrong arguments '"+std::string(args[0])+"'");
+        else appendBulk(out,result);
+        return true;
+    }
+    Kind kind=it->second;
+    size_t n=args.size();
+    // 检查参数个数
+    bool arity;
+    switch(kind){
+    case PING:arity=(n<=2);break;
+    case COMMAND:arity=true;break;
+    case QUIT:case DBSIZE:arity=(n==1);break;
+    case ECHO:case GET:case INCR:case DECR:arity=(n==2);break;
+    case SET:arity=(n>=3);break;
+    case SETNX:case INCRBY:case DECRBY:case APPEND:arity=(n==3);break;
+    case MSET:arity=(n>=3&&n%2==1);break;
+    default:arity=(n>=2);break; // DEL、EXISTS、MGET
+    }
+    if(!arity){
+        for(char& c:name)if(c>='A'&&c<='Z')c=c-'A'+'a';
+        appendError(out,"ERR wrong number of arguments for '"+name+"' command");
+        return true;
+    }
+    // 在服务器中直接处理的命令
+    switch(kind){
+    case PING:
+        if(n==1)appendStatus(out,"PONG");
+        else appendBulk(out,args[1]);
+        return true;
+    case ECHO:
+        appendBulk(out,args[1]);
+        return true;
+    case COMMAND: // redis-cli启动时会查询命令表，返回空表即可
+        out+="*0\r\n";
+        return true;
+    case QUIT:
+        appendStatus(out,"OK");
+        return false;
+    default:break;
+    }
+    // 翻译为存储引擎的命令
+    bool nx=false;
+    switch(kind){
+    case SET:{ // SET key value [EX seconds|PX milliseconds] [NX]
+        std::string_view ttl;
+        thread_local std::string seconds;
+        for(size_t i=3;i<n;i++){
+            name.assign(args[i].data(),args[i].size());
+            for(char& c:name)if(c>='a'&&c<='z')c=c-'a'+'A';
+            long long value;
+            if(name=="NX")nx=true;
+            else if((name=="EX"||name=="PX")&&i+1<n&&toInteger(args[i+1],value)&&value>0){
+                if(name=="PX")value=(value+999)/1000; // 存储引擎的过期时间以秒为单位，向上取整
+                seconds=std::to_string(value);
+                ttl=seconds;
+                i++;
+            }else{
+                appendError(out,"ERR syntax error");
+                return true;
+            }
+        }
+        tokens={nx?"setnx":"insert",args[1],args[2]};
+        if(!ttl.empty())tokens.push_back(ttl);
+        break;
+    }
+    case SETNX:tokens={"setnx",args[1],args[2]};break;
+    case GET:tokens={"search",args[1]};break;
+    case DEL:tokens.push_back("mdel");break;
+    case EXISTS:case MGET:tokens.push_back("mget");break;
+    case MSET:tokens.push_back("mset");break;
+    case INCR:case INCRBY:tokens={"incr",args[1]};break;
+    case DECR:case DECRBY:tokens={"decr",args[1]};break;
+    case APPEND:tokens={"append",args[1],args[2]};break;
+    case DBSIZE:tokens.push_back("size");break;
+    default:break;
+    }
+    if(kind==DEL||kind==EXISTS||kind==MGET||kind==MSET)tokens.insert(tokens.end(),args.begin()+1,args.end());
+    if(kind==INCRBY||kind==DECRBY)tokens.push_back(args[2]);
+
+    if(!call(tokens,result)){
+        if(kind==INCRBY||kind==DECRBY)appendError(out,"ERR value is not an integer or out of range");
+        else appendError(out,"ERR command failed");
+        return true;
+    }
+    if(!scanJson(result,strings,scratch)){
+        appendError(out,"ERR invalid response");
+        return true;
+    }
+    const std::string_view* status=field(strings,"result");
+    if(status&&*status=="read only"){
+        appendError(out,"READONLY You can't write against a read only replica.");
+        return true;
+    }
+    // 把存储引擎的结果转换为RESP的回复
+    switch(kind){
+    case SET:
+        if(nx&&status&&*status=="conflict")appendNil(out);
+        else if(status&&*status!="success"&&*status!="update value")appendError(out,"ERR "+std::string(*status));
+        else appendStatus(out,"OK");
+        break;
+    case SETNX:
+        appendNumber(out,':',status&&*status=="success"?1:0);
+        break;
+    case GET:{
+        const std::string_view* value=field(strings,"v");
+        if(value)appendBulk(out,*value);
+        else appendNil(out);
+        break;
+    }
+    case DEL:{ // 结果为每个key的状态，统计删除成功的数量
+        long long count=0;
+        for(auto& s:strings)if(!s.key&&s.text=="success")count++;
+        appendNumber(out,':',count);
+        break;
+    }
+    case EXISTS:case MGET:{
+        // 结果为 {"items": [{"k": ..., "v": ...}, {"k": ...}]}，不存在的key没有v
+        thread_local std::vector<const std::string_view*> values;
+        values.clear();
+        for(size_t i=0;i+1<strings.size();i++){
+            if(!strings[i].key||strings[i+1].key)continue; // 只看值为字符串的键（跳过items）
+            if(strings[i].text=="k")values.push_back(nullptr);
+            else if(strings[i].text=="v"&&!values.empty())values.back()=&strings[i+1].text;
+            i++; // 跳过键对应的值
+        }
+        if(kind==EXISTS){
+            long long count=0;
+            for(auto value:values)if(value)count++;
+            appendNumber(out,':',count);
+        }else{
+            appendNumber(out,'*',values.size());
+            for(auto value:values){
+                if(value)appendBulk(out,*value);
+                else appendNil(out);
+            }
+        }
+        break;
+    }
+    case MSET:
+        appendStatus(out,"OK");
+        break;
+    case INCR:case INCRBY:case DECR:case DECRBY:{
+        const std::string_view* value=field(strings,"v");
+        long long number;
+        if(status&&*status=="success"&&value&&toInteger(*value,number))appendNumber(out,':',number);
+        else if(status&&*status=="overflow")appendError(out,"ERR increment or decrement would overflow");
+        else appendError(out,"ERR value is not an integer or out of range");
+        break;
+    }
+    case APPEND:{
+        const std::string_view* value=field(strings,"v");
+        appendNumber(out,':',value?value->size():0);
+        break;
+    }
+    case DBSIZE:{
+        const std::string_view* value=field(strings,"size");
+        long long number;
+        if(value&&toInteger(*value,number))appendNumber(out,':',number);
+        else appendError(out,"ERR invalid response");
+        break;
+    }
+    default:break;
+    }
+    return true;
+}
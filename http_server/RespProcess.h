@@ -0,0 +1,40 @@
+#ifndef RESPPROCESS
+#define RESPPROCESS
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Connection.h"
+
+class Connection;
+
+// RESP（Redis序列化协议）处理器：让redis-cli、redis-benchmark以及各语言的Redis客户端可以直接访问存储引擎
+// 请求支持多条批量字符串组成的数组（*N\r\n$len\r\n...）和以空格分隔的内联命令（telnet风格）
+// 常用的Redis命令（GET、SET、DEL、MGET、INCR等）翻译为存储引擎的命令，并把json结果转换为对应的RESP类型；
+// 其余命令按小写的命令名原样交给存储引擎，以批量字符串返回json结果
+class RespProcess{
+public:
+    static std::shared_ptr<RespProcess> instance(); // 获取RespProcess的单例对象
+
+    void init(const std::string& url); // url为交给Processor处理时使用的路径
+    // 处理读缓冲区中所有完整的命令（支持流水线），回复按顺序追加到写缓冲区；至少处理了一条命令时返回true
+    bool process(Connection* conn);
+
+    RespProcess(const RespProcess&) = delete; // 禁用拷贝构造函数
+    RespProcess& operator=(const RespProcess&) = delete; // 禁用赋值运算符
+private:
+    RespProcess() = default; // 禁用外部构造
+
+    // 从data中解析一条命令：数据不完整返回0，格式错误返回-1，否则返回命令占用的字节数，args指向data中的参数
+    long parseCommand(const char* data,size_t len,std::vector<std::string_view>& args);
+    // 执行一条命令，并把回复追加到out；客户端要求关闭连接（QUIT）时返回false
+    bool execute(const std::vector<std::string_view>& args,std::string& out);
+    // 以json数组的形式把命令交给Processor处理，处理成功时返回true，result为引擎返回的json
+    bool call(const std::vector<std::string_view>& tokens,std::string& result);
+
+    std::string url="/kv_store";
+};
+
+#endif
@@ -2,21 +2,24 @@
 #include "Log.h"
 #include "ThreadPool.h"
 #include "Buffer.h"
-#include "Epoll.h"
-#include "Timer.h"
 #include "Processor.h"
+#include "RespProcess.h"
 #include <fstream>
+#include <algorithm>
 #include <functional>
+#include <thread>
 #include <unistd.h>
 #include <stdio.h>
+#include <errno.h>
+#include <signal.h>
 #include <arpa/inet.h>
 #include <stdlib.h>
 
 Server::Server(const std::string& configPath){
     listenEvent=EPOLLRDHUP; // 需要epoll检测对端关闭事件
-    connEvent=EPOLLONESHOT|EPOLLRDHUP|EPOLLET; //  保证只触发一次；需要epoll检测对端关闭事件；使用边沿触发模式
     system("clear"); // 清屏，方便之后的日志输出
     parseIni(configPath); // 解析配置文件
+    signal(SIGPIPE,SIG_IGN); // 向已经关闭的连接写数据时不终止进程，write返回错误后断开连接
 
     // 初始化日志系统
     Log::instance()->init(
@@ -25,18 +28,53 @@ Server::Server(const std::string& configPath){
         (config["isAsync"]=="true"?true:false)
     );
 
-    // 初始化线程池
-    ThreadPool::instance()->init(std::stoi(config["threadNum"]));
+    timeoutMS=std::stoi(config["timeoutMS"]);
+    maxConnNum=std::stoi(config["maxConnNum"]);
+    HttpParser::maxBodySize=std::min<unsigned long long>(std::stoull(config["maxBodySize"]),1ULL<<40);
+    multiReactor=(config["reactorMode"]=="multi");
+    int threadNum=std::max(std::stoi(config["threadNum"]),1);
+    if(multiReactor){
+        connEvent=EPOLLRDHUP|EPOLLET; // 连接只由一个线程处理，不需要EPOLLONESHOT；需要epoll检测对端关闭事件；使用边沿触发模式
+        // 每个线程一个事件循环，各自拥有epoll和定时器
+        for(int i=0;i<threadNum;i++){
+            Loop* loop=new Loop();
+            loop->ownEpoll.reset(new Epoll());
+            loop->ownEpoll->init(1024);
+            loop->ownTimer.reset(new Timer());
+            loop->epoll=loop->ownEpoll.get();
+            loop->timer=loop->ownTimer.get();
+            loops.emplace_back(loop);
+        }
+    }else{
+        connEvent=EPOLLONESHOT|EPOLLRDHUP|EPOLLET; //  保证只触发一次；需要epoll检测对端关闭事件；使用边沿触发模式
+
+        // 初始化线程池
+        ThreadPool::instance()->init(threadNum);
 
-    // 初始化Epoll
-    Epoll::instance()->init(1024);
+        // 初始化Epoll
+        Epoll::instance()->init(1024);
+
+        Loop* loop=new Loop();
+        loop->epoll=Epoll::instance().get();
+        loop->timer=Timer::instance().get();
+        loops.emplace_back(loop);
+    }
 
     // 初始化监听套接字
-    if(initSocket()==false){
-        // 套接字初始化失败
-        log_error("套接字初始化失败...");
-        isSuccess=false;
-    }else log_info("套接字初始化成功...");
+    for(auto& loop:loops){
+        if(initLoop(loop.get())==false){
+            isSuccess=false;
+            break;
+        }
+    }
+    if(isSuccess){
+        log_info(multiReactor?"套接字初始化成功，"+std::to_string(loops.size())+"个reactor..."
+            :std::string("套接字初始化成功..."));
+        if(loops[0]->respFd!=-1){
+            RespProcess::instance()->init(config["respUrl"]);
+            log_info("RESP套接字初始化成功，端口"+config["respPort"]+"...");
+        }
+    }
     
     // 初始化处理器
     Processor::instance()->init();
@@ -45,79 +83,138 @@ Server::Server(const std::string& configPath){
     
 }
 
+bool Server::initLoop(Loop* loop){
+    if(initSocket(std::stoi(config["port"]),loop->listenFd,loop->epoll)==false){
+        // 套接字初始化失败
+        log_error("套接字初始化失败...");
+        return false;
+    }
+    // 初始化RESP协议的监听套接字（端口为0时不开启）
+    int respPort=std::stoi(config["respPort"]);
+    if(respPort!=0&&initSocket(respPort,loop->respFd,loop->epoll)==false){
+        log_error("RESP套接字初始化失败...");
+        return false;
+    }
+    return true;
+}
+
 void Server::start(){
     if(!isSuccess){
         log_error("服务器初始化失败...已退出...");
         return ;
     }
     log_info("Ray服务器启动...");
+    if(!multiReactor){
+        run(loops[0].get());
+        return ;
+    }
+    // 其余的事件循环各自运行在一个线程中，第一个事件循环运行在主线程中
+    std::vector<std::thread> threads;
+    for(size_t i=1;i<loops.size();i++){
+        threads.emplace_back(&Server::runReactor,this,loops[i].get());
+    }
+    runReactor(loops[0].get());
+    for(auto& thread:threads)thread.join();
+}
 
+void Server::run(Loop* loop){
+    std::vector<ThreadPool::Task> tasks; // 本轮就绪事件的处理任务，处理完所有就绪事件后批量提交给线程池
     while(true){
-        int timeoutMS=Timer::instance()->getExpiration(); // 初始时这个函数将返回-1
+        int timeoutMS=loop->timer->getExpiration(); // 初始时这个函数将返回-1
         // timeoutMS==-1时，如果没有就绪事件，wait将阻塞
-        int eventCount=Epoll::instance()->wait(timeoutMS);
+        int eventCount=loop->epoll->wait(timeoutMS);
         for(int i=0;i<eventCount;i++){
             // 处理epoll通知的就绪事件
-            int fd=Epoll::instance()->getFd(i); // 获得第i个就绪事件对应的文件描述符
-            uint32_t events=Epoll::instance()->getEvents(i); // 获取第i个就绪事件对应的事件类型
-            if(fd==listenFd){
+            int fd=loop->epoll->getFd(i); // 获得第i个就绪事件对应的文件描述符
+            uint32_t events=loop->epoll->getEvents(i); // 获取第i个就绪事件对应的事件类型
+            if(fd==loop->listenFd){
                 // 监听套接字就绪，说明有新的客户端接入
-                // listenFd是水平触发模式，无需循环检测
-                struct sockaddr_in caddr;
-                socklen_t len = sizeof(caddr);
-                int cfd = accept(listenFd, (struct sockaddr *)&caddr, &len);
-                if(Connection::connNum<std::stoi(config["maxConnNum"])){
-                    connections[cfd]=new Connection(cfd,inet_ntoa(caddr.sin_addr),caddr.sin_port); // 创建一个连接
-                    log_info(connections[cfd]->getIP()+":"+std::to_string(connections[cfd]->getPort())+" 接入...");
-                    // 将cfd添加到epoll的监听文件集中
-                    Epoll::instance()->addFd(cfd,EPOLLIN|connEvent);
-                    setNonBlock(cfd); // 由于使用边沿触发模式，因此必须设置文件非阻塞
-                    // 将该连接添加到定时器中
-                    Timer::instance()->add(cfd,std::stoi(config["timeoutMS"]),
-                    std::bind(&Server::connectTimeout,this,connections[cfd]));
-                }else{
-                    log_warn("服务器繁忙...");
-                    close(cfd);
-                }
+                acceptConnection(loop,loop->listenFd,Connection::HTTP);
+            }
+            else if(fd==loop->respFd){
+                acceptConnection(loop,loop->respFd,Connection::RESP);
             }
             // 负责和客户端通信的通信套接字就绪
             else if(events&(EPOLLRDHUP|EPOLLHUP|EPOLLERR)){
                 // 对端出现异常，关闭该连接
-                disconnect(connections[fd]);
+                disconnect(loop,loop->connections[fd]);
             }
             else if(events&EPOLLIN){
                 // 读事件就绪，从文件描述符中将数据读出
                 // 节点活跃，应当调整节点的到期时间
-                Timer::instance()->adjust(fd,std::stoi(config["timeoutMS"]));
-                ThreadPool::instance()->addTask(std::bind(
-                    &Server::readEvent,this,connections[fd]
+                loop->timer->adjust(fd,this->timeoutMS);
+                tasks.emplace_back(std::bind(
+                    &Server::readEvent,this,loop,loop->connections[fd]
                 ));
             }
             else if(events&EPOLLOUT){
                 // 写事件就绪，向文件描述法中写数据
                 // 节点活跃，应当调整节点的到期时间
-                Timer::instance()->adjust(fd,std::stoi(config["timeoutMS"]));
-                ThreadPool::instance()->addTask(std::bind(
-                    &Server::writeEvent,this,connections[fd]
+                loop->timer->adjust(fd,this->timeoutMS);
+                tasks.emplace_back(std::bind(
+                    &Server::writeEvent,this,loop,loop->connections[fd]
                 ));
             }else log_warn("未知事件...");
         }
+        ThreadPool::instance()->addTasks(tasks);
+    }
+}
+
+void Server::runReactor(Loop* loop){
+    while(true){
+        int timeoutMS=loop->timer->getExpiration();
+        int eventCount=loop->epoll->wait(timeoutMS);
+        for(int i=0;i<eventCount;i++){
+            int fd=loop->epoll->getFd(i);
+            uint32_t events=loop->epoll->getEvents(i);
+            if(fd==loop->listenFd){
+                acceptConnection(loop,loop->listenFd,Connection::HTTP);
+                continue;
+            }
+            if(fd==loop->respFd){
+                acceptConnection(loop,loop->respFd,Connection::RESP);
+                continue;
+            }
+            // 同一批就绪事件中，之前的事件可能已经关闭了这个连接
+            auto it=loop->connections.find(fd);
+            if(it==loop->connections.end())continue;
+            Connection* conn=it->second;
+            if(events&(EPOLLRDHUP|EPOLLHUP|EPOLLERR)){
+                disconnect(loop,conn);
+                continue;
+            }
+            loop->timer->adjust(fd,this->timeoutMS);
+            if(events&EPOLLIN){
+                readEvent(loop,conn); // 读出数据后直接处理并写出响应
+            }else if(events&EPOLLOUT){
+                // 连接一直监听可写事件（边沿触发只在发送缓冲区由满变为可写时通知），只有还有数据没有写出时才需要处理
+                if(conn->hasData())serve(loop,conn);
+            }
+        }
     }
 }
 
 Server::~Server(){
     // 析构函数中释放系统资源
-    close(listenFd);
+    for(auto& loop:loops){
+        if(loop->listenFd!=-1)close(loop->listenFd);
+        if(loop->respFd!=-1)close(loop->respFd);
+    }
 }
 
 void Server::parseIni(const std::string& fileName){
     // 初始化config
     config.insert({
         {"port","9090"},
+        {"respPort","0"},
+        {"respUrl","/kv_store"},
         {"timeoutMS","60000"},
         {"mode","3"},
         {"isOptLinger","true"},
         {"threadNum","4"},
+        {"reactorMode","single"},
+        {"maxConnNum","1024"},
+        {"maxBodySize","67108864"},
         {"isOpenLog","true"},
         {"logLevel","1"},
         {"logQueSize","1024"}
@@ -142,12 +239,12 @@ void Server::parseIni(const std::string& fileName){
     file.close();
 }
 
-bool Server::initSocket(){
+bool Server::initSocket(int port,int& fd,Epoll* epoll){
     // 在linux系统中，将套接字抽象为文件，可以使用文件描述符引用
     // 对于用于监听的套接字，读文件可以取出成功建立连接的客户端的通信套接字
     // 对于用于通信的套接字，读写文件可以实现与网络中其他进程的通信
-    listenFd=socket(AF_INET,SOCK_STREAM,0); // 创建用于监听的套接字（使用IPv4的TCP协议）
-    if(listenFd==-1){
+    fd=socket(AF_INET,SOCK_STREAM,0); // 创建用于监听的套接字（使用IPv4的TCP协议）
+    if(fd==-1){
         log_error("监听套接字创建失败...");
         return false; // 创建套接字失败
     }
@@ -156,76 +253,113 @@ bool Server::initSocket(){
     saddr.sin_family=AF_INET;
     // 网络字节序（在网络中传输的数据的字节序）是大端序，主机字节序不一定是大端序，因此要进行转换
     saddr.sin_addr.s_addr=htonl(INADDR_ANY); // 绑定本机所有地址
-    saddr.sin_port=htons(std::stoi(config["port"])); // 将port从主机字节序转为网络字节序
+    saddr.sin_port=htons(port); // 将port从主机字节序转为网络字节序
     // 设置优雅关闭
     struct linger optLinger={0};
     optLinger.l_onoff=1;
     optLinger.l_linger=1;
-    int ret = setsockopt(listenFd, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger));
+    int ret = setsockopt(fd, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger));
     if(ret==-1){
         log_error("设置优雅关闭失败...");
         return false;
     }
     // 设置端口复用
     int optval = 1;
-    ret = setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, (const void*)&optval, sizeof(int));
+    ret = setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const void*)&optval, sizeof(int));
     if(ret==-1){
         log_error("设置端口复用失败...");
         return false;
     }
+    // 多reactor模式下每个事件循环的监听套接字绑定同一个端口，由内核把新连接分给其中一个
+    if(multiReactor){
+        ret = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (const void*)&optval, sizeof(int));
+        if(ret==-1){
+            log_error("设置SO_REUSEPORT失败...");
+            return false;
+        }
+    }
     // 绑定地址和端口
-    ret=bind(listenFd,(struct sockaddr*)(&saddr),sizeof(saddr));
+    ret=bind(fd,(struct sockaddr*)(&saddr),sizeof(saddr));
     if(ret==-1){
         log_error("监听套接字绑定失败...");
         return false;
     }
     // 监听套接字
-    ret=listen(listenFd,8); // 监听套接字
+    ret=listen(fd,8); // 监听套接字
     if(ret==-1){
         log_error("监听套接字失败...");
         return false;
     }
-    // 还需要监听【listenFd】上的读事件
-    // 一旦有客户端通过三次握手建立连接，就会触发listenFd上的可读事件
-    Epoll::instance()->addFd(listenFd,listenEvent|EPOLLIN);
+    // 还需要监听【fd】上的读事件
+    // 一旦有客户端通过三次握手建立连接，就会触发fd上的可读事件
+    epoll->addFd(fd,listenEvent|EPOLLIN);
     // 设置监听套接字为非阻塞
-    setNonBlock(listenFd);
+    setNonBlock(fd);
     return true;
 }
 
+void Server::acceptConnection(Loop* loop,int fd,Connection::Protocol protocol){
+    // 监听套接字是水平触发模式，无需循环检测
+    struct sockaddr_in caddr;
+    socklen_t len = sizeof(caddr);
+    int cfd = accept(fd, (struct sockaddr *)&caddr, &len);
+    if(cfd==-1)return ;
+    if(Connection::connNum<maxConnNum){
+        Connection* conn=new Connection(cfd,inet_ntoa(caddr.sin_addr),caddr.sin_port,protocol); // 创建一个连接
+        loop->connections[cfd]=conn;
+        log_info(conn->getIP()+":"+std::to_string(conn->getPort())+(protocol==Connection::RESP?" 接入(RESP)...":" 接入..."));
+        setNonBlock(cfd); // 由于使用边沿触发模式，因此必须设置文件非阻塞
+        // 将cfd添加到epoll的监听文件集中
+        // 多reactor模式下同时监听可写事件：边沿触发的可写事件只在发送缓冲区由满变为可写时通知，之后不需要再修改监听的事件
+        uint32_t events=EPOLLIN|connEvent;
+        if(multiReactor) events|=EPOLLOUT;
+        loop->epoll->addFd(cfd,events);
+        // 将该连接添加到定时器中
+        loop->timer->add(cfd,timeoutMS,
+        std::bind(&Server::connectTimeout,this,loop,conn));
+    }else{
+        log_warn("服务器繁忙...");
+        close(cfd);
+    }
+}
+
 void Server::setNonBlock(int fd){
     int flag=fcntl(fd, F_GETFL);
     flag|=O_NONBLOCK;
     fcntl(fd,F_SETFL,flag);
 }
 
-void Server::disconnect(Connection* conn){
+void Server::disconnect(Loop* loop,Connection* conn){
     log_info(conn->getIP()+":"+std::to_string(conn->getPort())+" 离开...");
-    Epoll::instance()->delFd(conn->getFd())==true;
-    Timer::instance()->del(conn->getFd()); // 从定时器中删除节点
-    connections.erase(conn->getFd());
+    loop->epoll->delFd(conn->getFd());
+    loop->timer->del(conn->getFd()); // 从定时器中删除节点
+    loop->connections.erase(conn->getFd());
     delete conn;
 }
 
-void Server::connectTimeout(Connection *conn){
+void Server::connectTimeout(Loop* loop,Connection *conn){
     log_info(conn->getIP()+":"+std::to_string(conn->getPort())+" 离开...");
-    Epoll::instance()->delFd(conn->getFd());
-    connections.erase(conn->getFd());
+    loop->epoll->delFd(conn->getFd());
+    loop->connections.erase(conn->getFd());
     delete conn;
 }
 
-void Server::readEvent(Connection* conn){
+void Server::readEvent(Loop* loop,Connection* conn){
     int ret=conn->readFromFile();
     if(ret==0){ // 客户端断开连接
-        disconnect(conn);
+        disconnect(loop,conn);
         return ;
     }
-    process(conn);
+    process(loop,conn);
 }
 
-void Server::process(Connection* conn){
+void Server::process(Loop* loop,Connection* conn){
+    if(multiReactor){ // 在当前线程中直接处理并写出响应
+        serve(loop,conn);
+        return ;
+    }
     if(conn->process()){ // 进行了处理，注册监听该文件描述符的可写事件
-        Epoll::instance()->modFd(conn->getFd(),connEvent|EPOLLOUT);
+        loop->epoll->modFd(conn->getFd(),connEvent|EPOLLOUT);
     }else{ // 没有处理（一般是因为当前数据的长度不足，无法进行处理），重新注册监听可读事件
         /*
         对于注册了EPOLLONESHOT的文件描述符，操作系统最多触发其上注册的一个可读、可写或者异常事件，且只触发一次
@@ -233,11 +367,11 @@ void Server::process(Connection* conn){
         注册了EPOLLONESHOT事件的socket一旦被某个线程处理完毕，该线程就应该立即重置这个socket上的EPOLLONESHOT事件
         以确保这个socket下一次可读时，其EPOLLIN事件能被触发，进而让其他工作线程有机会继续处理这个socket
         */
-        Epoll::instance()->modFd(conn->getFd(),connEvent|EPOLLIN);
+        loop->epoll->modFd(conn->getFd(),connEvent|EPOLLIN);
     }
 }
 
-void Server::writeEvent(Connection* conn){
+void Server::writeEvent(Loop* loop,Connection* conn){
     int ret=conn->writeToFile();
     if(!conn->hasData()){
         // 写缓冲区中的数据都已经写入
@@ -248,18 +382,56 @@ void Server::writeEvent(Connection* conn){
             如果读缓冲区中没有可处理的数据了，则conn的process返回false，重新注册监听可读事件
             这样一来就可以保持长连接了。
             */
-            process(conn);
+            process(loop,conn);
             return ;
         }
     }else if(ret==-1){
         // 写缓冲区中还有数据未写入，由于某种原因写入暂时失败了（例如内核空间不足）
         // 重新注册监听文件描述符的可写事件
-        Epoll::instance()->modFd(conn->getFd(),connEvent|EPOLLOUT);
+        loop->epoll->modFd(conn->getFd(),connEvent|EPOLLOUT);
         return ;// 退出该函数
     }else if(ret==0){ // 客户端断开连接
-        disconnect(conn);
+        disconnect(loop,conn);
         return ;
     }
     // 如果写缓冲区中所有的数据都已经写入，并且没有keep-alive的要求，则断开与该客户端的通信
-    disconnect(conn);
-}
\ No newline at end of file
+    disconnect(loop,conn);
+}
+
+void Server::serve(Loop* loop,Connection* conn){
+    // 先写出之前没有写完的响应：客户端不读取响应时不再处理它之后的请求，写缓冲区不会无限增长
+    if(conn->hasData()){
+        if(flush(loop,conn)<=0)return ;
+        if(!conn->getKeepAlive()){
+            disconnect(loop,conn);
+            return ;
+        }
+    }
+    // 依次处理读缓冲区中的请求，读缓冲区中没有完整的请求时等待下一次可读事件
+    // 流水线请求的响应先在写缓冲区中积累，处理完或者积累超过FLUSH_SIZE时用一次writev写出
+    static const int FLUSH_SIZE=256*1024;
+    while(conn->process()){
+        if(conn->getKeepAlive()&&conn->pendingBytes()<FLUSH_SIZE)continue;
+        int ret=flush(loop,conn);
+        if(ret<=0)return ; // 连接已断开，或者等待可写事件后继续
+        if(!conn->getKeepAlive()){
+            disconnect(loop,conn);
+            return ;
+        }
+    }
+    if(conn->hasData())flush(loop,conn);
+}
+
+int Server::flush(Loop* loop,Connection* conn){
+    while(conn->hasData()){
+        ssize_t ret=conn->writeToFile();
+        if(ret>0)continue;
+        if(ret==-1&&(errno==EAGAIN||errno==EWOULDBLOCK||errno==EINTR)){
+            if(errno==EINTR)continue;
+            return 0; // 内核发送缓冲区已满，等待可写事件
+        }
+        disconnect(loop,conn); // 客户端断开连接或者写入出错
+        return -1;
+    }
+    return 1;
+}
@@ -2,8 +2,12 @@
 #define SERVER
 
 #include <string>
+#include <vector>
+#include <memory>
 #include <unordered_map>
 #include "Connection.h"
+#include "Epoll.h"
+#include "Timer.h"
 
 class Server{
 public:
@@ -11,18 +15,40 @@ public:
     void start(); // 启动服务器
     ~Server();
 private:
+    // 事件循环：一个epoll实例、一个定时器以及注册在其中的监听套接字和连接
+    // 单一事件循环模式（reactorMode=single）只有一个事件循环，使用Epoll和Timer的单例，就绪事件交给线程池处理
+    // 多reactor模式（reactorMode=multi）每个线程一个事件循环，各自拥有epoll、定时器、连接以及通过SO_REUSEPORT
+    // 绑定在同一端口上的监听套接字，内核把新连接分给其中一个，之后该连接的读、处理、写和超时都在这个线程中完成，不需要加锁
+    struct Loop{
+        Epoll* epoll;
+        Timer* timer;
+        std::unique_ptr<Epoll> ownEpoll; // 多reactor模式下事件循环自己的epoll和定时器
+        std::unique_ptr<Timer> ownTimer;
+        int listenFd=-1; // 用于监听的套接字的文件描述符
+        int respFd=-1; // RESP协议监听套接字的文件描述符（没有开启时为-1）
+        std::unordered_map<int,Connection*> connections; // 文件描述符到Connection的映射
+    };
     void parseIni(const std::string& fileName); // 解析ini配置文件，并将解析结果写到config中
-    bool initSocket(); // 初始化套接字
+    bool initLoop(Loop* loop); // 初始化事件循环的监听套接字
+    bool initSocket(int port,int& fd,Epoll* epoll); // 初始化监听port的套接字，将其文件描述符写到fd中，并注册到epoll
+    void run(Loop* loop); // 单一事件循环模式的主循环
+    void runReactor(Loop* loop); // 多reactor模式下每个线程的事件循环
+    void acceptConnection(Loop* loop,int fd,Connection::Protocol protocol); // 监听套接字fd就绪，接入新的客户端
     void setNonBlock(int fd); // 将文件描述符设置为非阻塞
-    void disconnect(Connection* conn); // 客户端断开连接
-    void connectTimeout(Connection *conn); // 连接过期
-    void readEvent(Connection* conn); // conn的可读事件就绪，调用该函数进行处理
-    void process(Connection* conn); // 处理读出的数据
-    void writeEvent(Connection* conn); // conn的可写事件就绪，调用该函数进行处理
+    void disconnect(Loop* loop,Connection* conn); // 客户端断开连接
+    void connectTimeout(Loop* loop,Connection *conn); // 连接过期
+    void readEvent(Loop* loop,Connection* conn); // conn的可读事件就绪，调用该函数进行处理
+    void process(Loop* loop,Connection* conn); // 处理读出的数据
+    void writeEvent(Loop* loop,Connection* conn); // conn的可写事件就绪，调用该函数进行处理
+    // 多reactor模式：在事件循环线程中处理读缓冲区中的请求并直接写出响应，内核发送缓冲区满时等待可写事件
+    void serve(Loop* loop,Connection* conn);
+    int flush(Loop* loop,Connection* conn); // 写出写缓冲区中的数据：全部写出返回1；需要等待可写事件返回0；连接已断开（conn已释放）返回-1
     std::unordered_map<std::string,std::string> config; // 服务器配置
-    std::unordered_map<int,Connection*> connections; // 文件描述符到Connection的映射
+    std::vector<std::unique_ptr<Loop>> loops; // 所有事件循环（单一事件循环模式只有一个）
     bool isSuccess=true; // 服务器初始化是否成功
-    int listenFd; // 用于监听的套接字的文件描述符
+    bool multiReactor=false; // 是否为多reactor模式
+    int timeoutMS; // 连接的超时时间（毫秒）
+    int maxConnNum; // 最大连接数量
     uint32_t listenEvent; // 监听套接字的模式（这里使用LT水平触发模式）
     uint32_t connEvent; // 连接套接字的模式（这里使用ET边沿触发模式）
 };
@@ -1,5 +1,6 @@
 #include "ThreadPool.h"
 #include "Log.h"
+#include <algorithm>
 
 static std::shared_ptr<ThreadPool> threadPool=nullptr;
 static std::mutex mutex;
@@ -17,38 +18,168 @@ std::shared_ptr<ThreadPool> ThreadPool::instance(){
 }
 
 void ThreadPool::init(int threadNum){
+    threadNum=std::max(threadNum,1);
+    // shutdown之后可以重新初始化（例如以不同的线程数测试吞吐量）
+    workers.clear();
+    stopping.store(false);
     for(int i=0;i<threadNum;i++){
-        // 创建threadNum个线程并设置线程分离
-        std::thread([](){
-            while(true){
-                std::unique_lock<std::mutex> lock(ThreadPool::instance()->poolLock);
-                if(!ThreadPool::instance()->taskQue.empty()){
-                    // 从任务队列中取出任务并执行
-                    auto task=ThreadPool::instance()->taskQue.front();
-                    ThreadPool::instance()->taskQue.pop();
-                    // 这里加锁和解锁的原因请看文档
-                    lock.unlock(); // 暂时解锁
-                    task();
-                    lock.lock(); // 重新加锁
-                }else ThreadPool::instance()->condvar.wait(lock); // 如果任务队列为空，则该线程阻塞
-            }
-        }).detach();
+        workers.emplace_back(new Worker());
+        workers.back()->ring.resize(64);
+    }
+    // 工作线程直接持有this，不需要在循环中反复获取单例（shared_ptr的拷贝需要原子地修改引用计数）
+    for(int i=0;i<threadNum;i++){
+        threads.emplace_back(&ThreadPool::run,this,static_cast<size_t>(i));
     }
     log_info("线程池初始化成功...");
 }
 
-void ThreadPool::addTask(std::function<void()> task) {
-    std::lock_guard<std::mutex> lock(poolLock);
-    taskQue.push(task);
-    condvar.notify_one(); // 唤醒一个正在阻塞的工作线程
+void ThreadPool::Worker::push(Task&& task){
+    size_t n=size.load(std::memory_order_relaxed);
+    if(n==ring.size()){
+        // 环形数组已满，按顺序搬到两倍大小的数组中
+        std::vector<Task> larger(ring.size()*2);
+        for(size_t i=0;i<n;i++)larger[i]=std::move(ring[(head+i)&(ring.size()-1)]);
+        ring.swap(larger);
+        head=0;
+    }
+    ring[(head+n)&(ring.size()-1)]=std::move(task);
+    size.store(n+1,std::memory_order_relaxed);
 }
 
-ThreadPool::~ThreadPool(){
-    std::unique_lock<std::mutex> lock(poolLock);
-    while(!taskQue.empty()){
-        // 从任务队列中取出任务并执行
-        auto task=taskQue.front();
-        taskQue.pop();
+void ThreadPool::addTask(Task task){
+    if(stopping.load()){ // 已经关闭，没有线程会再执行队列中的任务，直接在当前线程中执行
         task();
+        return;
+    }
+    Worker& worker=*workers[next.fetch_add(1,std::memory_order_relaxed)%workers.size()];
+    worker.acquire();
+    worker.push(std::move(task));
+    worker.release();
+    wake(1);
+}
+
+void ThreadPool::addTasks(std::vector<Task>& tasks){
+    if(tasks.empty())return;
+    if(stopping.load()){
+        for(auto& task:tasks)task();
+        tasks.clear();
+        return;
+    }
+    size_t count=workers.size();
+    size_t start=next.fetch_add(1,std::memory_order_relaxed);
+    size_t chunk=(tasks.size()+count-1)/count; // 每个队列分到的任务数
+    size_t queues=0; // 分到任务的队列数
+    for(size_t i=0;i<tasks.size();i+=chunk,queues++){
+        Worker& worker=*workers[(start+queues)%count];
+        size_t end=std::min(tasks.size(),i+chunk);
+        worker.acquire();
+        for(size_t j=i;j<end;j++)worker.push(std::move(tasks[j]));
+        worker.release();
+    }
+    tasks.clear();
+    wake(queues);
+}
+
+void ThreadPool::wake(size_t count){
+    // 与run中的阻塞配对：线程先增加sleepers再检查队列，提交者先放入任务再检查sleepers，
+    // 两边之间都有全序的内存屏障，因此要么线程看到了任务，要么提交者看到了阻塞的线程
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(sleepers.load(std::memory_order_relaxed)==0)return; // 所有线程都在工作或者自旋，不需要系统调用
+    std::unique_lock<std::mutex> lock(parkLock);
+    for(size_t i=0;i<count;i++)condvar.notify_one();
+}
+
+bool ThreadPool::pop(size_t self,Task& task){
+    Worker& worker=*workers[self];
+    if(worker.size.load(std::memory_order_relaxed)==0)return false;
+    worker.acquire();
+    size_t n=worker.size.load(std::memory_order_relaxed);
+    if(n==0){
+        worker.release();
+        return false;
+    }
+    task=std::move(worker.ring[worker.head]);
+    worker.head=(worker.head+1)&(worker.ring.size()-1);
+    worker.size.store(n-1,std::memory_order_relaxed);
+    worker.release();
+    return true;
+}
+
+bool ThreadPool::steal(size_t self,Task& task){
+    Worker& own=*workers[self];
+    for(size_t k=1;k<workers.size();k++){
+        Worker& victim=*workers[(self+k)%workers.size()];
+        if(victim.size.load(std::memory_order_relaxed)==0)continue;
+        // 一次取走一半，减少窃取的次数；取出的任务保持原来的顺序
+        thread_local std::vector<Task> stolen;
+        victim.acquire();
+        size_t n=victim.size.load(std::memory_order_relaxed);
+        size_t take=(n+1)/2;
+        size_t mask=victim.ring.size()-1;
+        for(size_t i=n-take;i<n;i++)stolen.push_back(std::move(victim.ring[(victim.head+i)&mask]));
+        victim.size.store(n-take,std::memory_order_relaxed);
+        victim.release();
+        if(stolen.empty())continue;
+        task=std::move(stolen[0]);
+        if(stolen.size()>1){
+            own.acquire();
+            for(size_t i=1;i<stolen.size();i++)own.push(std::move(stolen[i]));
+            own.release();
+        }
+        stolen.clear();
+        return true;
     }
-}
\ No newline at end of file
+    return false;
+}
+
+bool ThreadPool::hasTask(){
+    for(auto& worker:workers){
+        if(worker->size.load(std::memory_order_relaxed)!=0)return true;
+    }
+    return false;
+}
+
+void ThreadPool::run(size_t self){
+    Task task;
+    int idle=0; // 连续没有找到任务的次数
+    while(true){
+        if(pop(self,task)||steal(self,task)){
+            task();
+            task=Task(); // 及时销毁任务绑定的对象
+            idle=0;
+            continue;
+        }
+        if(++idle<SPIN){
+            std::this_thread::yield(); // 自旋：任务密集时不需要阻塞和唤醒的系统调用
+            continue;
+        }
+        idle=0;
+        std::unique_lock<std::mutex> lock(parkLock);
+        sleepers.fetch_add(1,std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(hasTask()){
+            sleepers.fetch_sub(1,std::memory_order_relaxed);
+            continue;
+        }
+        if(stopping.load()){ // 已经关闭，并且所有任务都已经执行完成
+            sleepers.fetch_sub(1,std::memory_order_relaxed);
+            return;
+        }
+        condvar.wait(lock); // 如果任务队列为空，则该线程阻塞
+        sleepers.fetch_sub(1,std::memory_order_relaxed);
+    }
+}
+
+void ThreadPool::shutdown(){
+    {
+        std::unique_lock<std::mutex> lock(parkLock);
+        if(stopping.exchange(true))return;
+        condvar.notify_all();
+    }
+    for(auto& thread:threads)thread.join();
+    threads.clear();
+}
+
+ThreadPool::~ThreadPool(){
+    shutdown();
+}
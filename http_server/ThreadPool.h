@@ -4,24 +4,117 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
-#include <queue>
-#include <functional>
+#include <atomic>
+#include <vector>
 #include <memory>
+#include <new>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
 
+// 工作窃取线程池：每个工作线程有自己的任务队列，提交的任务轮流分给各个队列；
+// 工作线程先执行自己队列中的任务，队列为空时从其他队列的尾部窃取一半的任务，
+// 仍然没有任务时先自旋一小段时间，再阻塞在条件变量上（只有存在阻塞的线程时提交任务才需要唤醒）
 class ThreadPool{
 public:
+    // 任务：可调用对象直接保存在任务内部的定长空间中，提交任务不分配堆内存
+    class Task{
+    public:
+        static const size_t CAPACITY=48; // 可调用对象的最大字节数（例如std::bind绑定成员函数和三个指针参数）
+
+        Task() = default;
+        template<typename F,typename=typename std::enable_if<!std::is_same<typename std::decay<F>::type,Task>::value>::type>
+        Task(F&& f){
+            using Fn=typename std::decay<F>::type;
+            static_assert(sizeof(Fn)<=CAPACITY,"任务的可调用对象太大");
+            static_assert(alignof(Fn)<=alignof(std::max_align_t),"任务的可调用对象的对齐要求太高");
+            static_assert(std::is_nothrow_move_constructible<Fn>::value,"任务的可调用对象必须可以无异常地移动");
+            new (storage) Fn(std::forward<F>(f));
+            invoke=[](void* p){(*static_cast<Fn*>(p))();};
+            // dst不为空时把src移动到dst，之后都销毁src
+            manage=[](void* dst,void* src){
+                if(dst)new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+                static_cast<Fn*>(src)->~Fn();
+            };
+        }
+        Task(Task&& other) noexcept {moveFrom(other);}
+        Task& operator=(Task&& other) noexcept {
+            if(this!=&other){
+                reset();
+                moveFrom(other);
+            }
+            return *this;
+        }
+        ~Task(){reset();}
+        void operator()(){invoke(storage);}
+        explicit operator bool() const {return invoke!=nullptr;}
+
+        Task(const Task&) = delete; // 禁用拷贝构造函数
+        Task& operator=(const Task&) = delete; // 禁用赋值运算符
+    private:
+        void moveFrom(Task& other){
+            if(other.invoke){
+                other.manage(storage,other.storage);
+                invoke=other.invoke;
+                manage=other.manage;
+                other.invoke=nullptr;
+                other.manage=nullptr;
+            }
+        }
+        void reset(){
+            if(invoke){
+                manage(nullptr,storage);
+                invoke=nullptr;
+                manage=nullptr;
+            }
+        }
+        alignas(std::max_align_t) unsigned char storage[CAPACITY];
+        void (*invoke)(void*)=nullptr;
+        void (*manage)(void*,void*)=nullptr;
+    };
+
     static std::shared_ptr<ThreadPool> instance(); // 获取ThreadPool的单例对象
-    void init(int threadNum); // 初始化线程池
-    void addTask(std::function<void()> task); //向任务队列中添加任务
+    void init(int threadNum); // 初始化线程池（shutdown之后可以再次初始化）
+    void addTask(Task task); // 向任务队列中添加任务
+    // 批量提交：任务分成连续的几段分给各个队列，每个队列只加一次锁，最后统一唤醒阻塞的线程；提交后tasks被清空
+    void addTasks(std::vector<Task>& tasks);
+    // 执行完队列中剩余的任务后结束并回收所有工作线程；之后提交的任务直接在提交者的线程中执行
+    void shutdown();
 
     ~ThreadPool();
     ThreadPool(const ThreadPool&) = delete; // 禁用拷贝构造函数
     ThreadPool& operator=(const ThreadPool&) = delete; // 禁用赋值运算符
 private:
     ThreadPool() = default; // 禁用外部构造
-    std::mutex poolLock; // 线程池互斥锁
+
+    // 工作线程的任务队列：容量为2的幂的环形数组，容量不足时翻倍，由自旋锁保护（临界区只有几条指令）
+    struct alignas(64) Worker{
+        std::atomic_flag lock=ATOMIC_FLAG_INIT;
+        std::vector<Task> ring;
+        size_t head=0; // 第一个任务的位置
+        std::atomic<size_t> size{0}; // 任务数量，不加锁读取时用于判断队列是否为空
+        void acquire(){
+            while(lock.test_and_set(std::memory_order_acquire))std::this_thread::yield();
+        }
+        void release(){lock.clear(std::memory_order_release);}
+        void push(Task&& task); // 调用者持有锁
+    };
+
+    void run(size_t self); // 工作线程的主循环
+    bool pop(size_t self,Task& task); // 从自己的队列头部取出一个任务
+    bool steal(size_t self,Task& task); // 从其他队列的尾部窃取一半的任务，取出其中第一个，其余放入自己的队列
+    bool hasTask(); // 是否有任何队列不为空
+    void wake(size_t count); // 唤醒最多count个阻塞的线程
+
+    static const int SPIN=64; // 阻塞之前自旋查找任务的次数
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::atomic<size_t> next{0}; // 下一个任务分给的队列
+    std::mutex parkLock; // 阻塞和唤醒工作线程时使用的锁
     std::condition_variable condvar; // 条件变量
-    std::queue<std::function<void()>> taskQue; // 任务队列
+    std::atomic<int> sleepers{0}; // 阻塞的工作线程数量
+    std::atomic<bool> stopping{false}; // 是否正在关闭
 };
 
-#endif
\ No newline at end of file
+#endif
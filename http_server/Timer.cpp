@@ -1,5 +1,7 @@
 #include "Timer.h"
 #include "Log.h"
+#include <algorithm>
+#include <climits>
 
 static std::shared_ptr<Timer> timer=nullptr;
 static std::mutex mutex;
@@ -16,101 +18,198 @@ std::shared_ptr<Timer> Timer::instance(){
     return timer;
 }
 
-void Timer::up(int index){
-    if(index==0)return;
-    int parent=(index-1)/2; // 当前节点父节点的索引
-    while(parent>=0){ // parent<0时，表明当前节点已经到达根节点
-        if(heap[parent]<heap[index])break; // 已经满足了小根堆的特点，结束循环
-        // 交换节点，并更新节点位置
-        swap(parent,index);
-        index=parent;
-        parent=(index-1)/2;
+// 循环右移n位（0<=n<64）
+static inline uint64_t rotr(uint64_t x,int n){
+    return n==0?x:(x>>n)|(x<<(64-n));
+}
+
+Timer::Timer():start(std::chrono::steady_clock::now()){
+    std::fill(std::begin(heads),std::end(heads),-1);
+}
+
+uint64_t Timer::now(){
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now()-start).count();
+}
+
+int Timer::allocate(){
+    int index;
+    if(freeList!=-1){
+        index=freeList;
+        freeList=entries[index].next;
+    }else{
+        index=entries.size();
+        entries.emplace_back();
+    }
+    count++;
+    return index;
+}
+
+void Timer::release(int index){
+    Entry& entry=entries[index];
+    entry.callback=nullptr; // 释放回调函数绑定的资源
+    entry.slot=-1;
+    entry.next=freeList;
+    freeList=index;
+    count--;
+}
+
+void Timer::link(int index){
+    Entry& entry=entries[index];
+    // 已经到期的节点放在下一个刻度处理
+    uint64_t expiration=std::max(entry.expiration,current+1);
+    uint64_t delta=expiration-current;
+    // 放入能容纳它的最低一层：第L层能容纳距离当前刻度小于SLOTS^(L+1)的节点
+    int level=0;
+    while(level<LEVELS-1&&delta>=(uint64_t(1)<<(BITS*(level+1))))level++;
+    // 超出时间轮范围的节点先放在最高层最远的槽，到期时再按实际的到期时间重新放入
+    if(delta>=(uint64_t(1)<<(BITS*LEVELS)))expiration=current+(uint64_t(1)<<(BITS*LEVELS))-1;
+    int slot=(expiration>>(BITS*level))&MASK;
+    entry.placed=expiration;
+    entry.slot=level*SLOTS+slot;
+    entry.prev=-1;
+    entry.next=heads[entry.slot];
+    if(entry.next!=-1)entries[entry.next].prev=index;
+    heads[entry.slot]=index;
+    occupied[level]|=uint64_t(1)<<slot;
+}
+
+void Timer::unlink(int index){
+    Entry& entry=entries[index];
+    if(entry.prev!=-1)entries[entry.prev].next=entry.next;
+    else heads[entry.slot]=entry.next;
+    if(entry.next!=-1)entries[entry.next].prev=entry.prev;
+    if(heads[entry.slot]==-1)occupied[entry.slot/SLOTS]&=~(uint64_t(1)<<(entry.slot%SLOTS));
+    entry.slot=-1;
+}
+
+void Timer::cascade(int level,int slot){
+    int index=heads[level*SLOTS+slot];
+    heads[level*SLOTS+slot]=-1;
+    occupied[level]&=~(uint64_t(1)<<slot);
+    while(index!=-1){
+        int next=entries[index].next;
+        link(index); // 槽中节点的到期时间都在当前刻度之后SLOTS^level个刻度之内，会放入更低的层
+        index=next;
     }
 }
 
-void Timer::down(int index){
-    int child=index*2+1; // 当前节点左子树的索引
-    while(child<heap.size()){ // 当前节点有左子树时
-        // 应该将该节点与最小的那个子节点交换
-        if(child+1<heap.size()&&heap[child+1]<heap[child])child++;
-        if(heap[index]<heap[child])break; // 满足小根堆的特性，退出循环
-        swap(index,child);
-        index=child;
-        child=index*2+1;
+void Timer::expire(int slot){
+    int index=heads[slot];
+    heads[slot]=-1;
+    occupied[0]&=~(uint64_t(1)<<slot);
+    while(index!=-1){
+        Entry& entry=entries[index];
+        int next=entry.next;
+        if(entry.expiration>current){
+            // 节点放入时间轮之后被adjust延长了到期时间（或者超出了时间轮的范围），按新的到期时间重新放入
+            link(index);
+        }else{
+            // 节点到期：先移出时间轮，回调函数在释放锁之后统一执行
+            id2entry[entry.id]=-1;
+            expired.push_back(std::move(entry.callback));
+            release(index);
+        }
+        index=next;
     }
 }
 
-void Timer::swap(int i,int j){
-    std::swap(heap[i],heap[j]); // 交换位置
-    // 更新索引映射
-    id2index[heap[i].id]=i;
-    id2index[heap[j].id]=j;
+uint64_t Timer::nextTick(){
+    uint64_t result=UINT64_MAX;
+    if(occupied[0]!=0){
+        // 第0层中的节点都在之后SLOTS个刻度之内到期，从下一个刻度对应的槽开始找第一个非空的槽
+        int from=(current+1)&MASK;
+        result=current+1+__builtin_ctzll(rotr(occupied[0],from));
+    }
+    for(int level=1;level<LEVELS;level++){
+        if(occupied[level]==0)continue;
+        // 第level层的槽在当前刻度所在的块之后的块开始时级联，当前块对应的槽中的节点属于下一圈
+        uint64_t block=current>>(BITS*level);
+        int from=(block+1)&MASK;
+        uint64_t distance=__builtin_ctzll(rotr(occupied[level],from))+1;
+        result=std::min(result,(block+distance)<<(BITS*level));
+    }
+    return result;
 }
 
-void Timer::pop(){
-    swap(0,heap.size()-1); // 将要删除的节点先移到最后
-    id2index.erase(heap.back().id); // 删除节点的映射
-    heap.pop_back(); // 删除节点
-    down(0); // 调整节点位置
+void Timer::advance(uint64_t to){
+    // 直接跳到下一个需要处理的刻度，空闲期间不需要逐个刻度推进
+    while(count>0){
+        uint64_t tick=nextTick();
+        if(tick>to)break;
+        current=tick;
+        // 先从高层开始级联，高层级联下来的节点可能落在低层同一刻度级联的槽中
+        for(int level=LEVELS-1;level>0;level--){
+            if((tick&((uint64_t(1)<<(BITS*level))-1))==0)cascade(level,(tick>>(BITS*level))&MASK);
+        }
+        expire(tick&MASK);
+    }
+    if(to>current)current=to;
 }
 
 void Timer::adjust(int id,int timeout){
     std::unique_lock<std::mutex> lock(timerLock);
-    // 更新节点的到期时间
-    heap[id2index[id]].expiration=std::chrono::high_resolution_clock::now()+std::chrono::milliseconds(timeout);
-    // 调整节点位置
-    down(id2index[id]);
+    if(id<0||id>=(int)id2entry.size()||id2entry[id]==-1)return;
+    int index=id2entry[id];
+    Entry& entry=entries[index];
+    // 只记录新的到期时间，节点在原来的槽被处理时才移动
+    entry.expiration=now()+timeout;
+    if(entry.expiration<entry.placed){
+        // 到期时间提前了，需要立即移动到对应的槽
+        unlink(index);
+        link(index);
+    }
 }
 
 void Timer::add(int id,int timeout,std::function<void()> callback){
     std::unique_lock<std::mutex> lock(timerLock);
-    int index=heap.size();
-    id2index[id]=index;
-    // 向堆的最后加入这个节点
-    heap.push_back({id,
-    std::chrono::high_resolution_clock::now()+std::chrono::milliseconds(timeout),
-    callback});
-    // 向上调整
-    up(index);
-}
-
-void Timer::clearTimeoutNode(){
-    while(!heap.empty()){
-        Node node=heap.front();
-        // 如果根节点（它是最可能超时的节点）没有超时，说明已经没有超时节点了，退出循环
-        if(std::chrono::duration_cast<std::chrono::milliseconds>(
-            node.expiration-std::chrono::high_resolution_clock::now()).count()>0)break;
-        node.callback(); // 执行节点超时的回调函数
-        pop(); // 移出堆顶节点
+    if(id<0)return;
+    if(id>=(int)id2entry.size())id2entry.resize(std::max<size_t>(id+1,id2entry.size()*2),-1);
+    if(id2entry[id]!=-1){
+        // 相同id的节点已经存在，用新节点替换旧节点
+        unlink(id2entry[id]);
+        release(id2entry[id]);
     }
+    int index=allocate();
+    Entry& entry=entries[index];
+    entry.id=id;
+    entry.expiration=now()+timeout;
+    entry.callback=std::move(callback);
+    link(index);
+    id2entry[id]=index;
 }
 
 int Timer::getExpiration(){
-    std::unique_lock<std::mutex> lock(timerLock);
-    clearTimeoutNode(); // 先清除所有超时节点
+    std::vector<std::function<void()>> batch;
     int result=-1;
-    if(!heap.empty()) {
-        result=std::chrono::duration_cast<std::chrono::milliseconds>(
-            heap.front().expiration - std::chrono::high_resolution_clock::now()).count();
-        if(result<0)result=0;
+    {
+        std::unique_lock<std::mutex> lock(timerLock);
+        uint64_t tick=now();
+        advance(tick); // 处理所有到期的节点
+        if(count>0)result=std::min<uint64_t>(nextTick()-tick,INT_MAX);
+        batch.swap(expired);
     }
+    // 在锁外执行回调函数，回调函数中可以调用定时器的函数（到期的节点已经被删除，调用del无效）
+    for(auto& callback:batch)callback();
     // 如果result==-1，说明此时没有节点了（即所有的节点都已经超时）
-    // 如果result==0，说明此时有节点刚好超时，但是还没有被清除（由于服务器主循环每次都会调用该函数进行检测，因此这些刚好到期的节点下一次会被清除）
+    // 否则result是距离下一次需要处理时间轮的毫秒数（可能是节点到期，也可能只是高层的槽需要级联）
     return result;
 }
 
 void Timer::del(int id){
     std::unique_lock<std::mutex> lock(timerLock);
-    if(id2index.count(id)!=0){
-        int index=id2index[id];
-        Node node = heap[index];
-        // del中不能调用节点的回调函数，否则将会造成循环调用
-        // 当节点过期或者客户端关闭时，会调用Server的disconnect函数，该函数会调用定时器的del函数
-        // 如果是节点过期引起的disconnect回调，由于在调用disconnect之前，就已经清除节点，所以调用该函数无效
-        // 如果是客户端关闭引起的disconnect回调，则调用del主动删除节点
-        swap(index,heap.size()-1);
-        id2index.erase(id); // 删除节点的映射
-        heap.pop_back(); // 删除节点
-        down(index); // 调整节点位置
-    }
-}
\ No newline at end of file
+    if(id<0||id>=(int)id2entry.size()||id2entry[id]==-1)return;
+    // del中不能调用节点的回调函数，否则将会造成循环调用
+    // 当节点过期或者客户端关闭时，会调用Server的disconnect函数，该函数会调用定时器的del函数
+    // 如果是节点过期引起的disconnect回调，由于在调用disconnect之前，就已经清除节点，所以调用该函数无效
+    // 如果是客户端关闭引起的disconnect回调，则调用del主动删除节点
+    int index=id2entry[id];
+    unlink(index);
+    release(index);
+    id2entry[id]=-1;
+}
+
+size_t Timer::size(){
+    std::unique_lock<std::mutex> lock(timerLock);
+    return count;
+}
@@ -4,44 +4,67 @@
 #include <memory>
 #include <mutex>
 #include <vector>
-#include <unordered_map>
 #include <functional>
 #include <chrono>
+#include <cstdint>
 
-struct Node{
-    // 定时器的堆中存储的节点的结构
-    int id; // 节点的id（对于文件而言，id可以是文件描述符）
-    // 到期时间点
-    std::chrono::high_resolution_clock::time_point expiration;
-    std::function<void()> callback; // 节点到期后需要触发的回调函数
-    bool operator<(const Node& node) {
-        return expiration<node.expiration;
-    }
-};
-
+// 分层时间轮定时器：时间以毫秒为一个刻度（tick），共LEVELS层，每层SLOTS个槽，第L层的一个槽覆盖SLOTS^L个刻度
+// 节点按到期时间放入能容纳它的最低一层，高层的槽到期时把其中的节点重新分配到低层（级联），第0层的槽到期时处理其中的节点
+// 添加、删除、更新都是O(1)：更新到期时间只记录新的到期时间，节点仍然留在原来的槽中，
+// 直到原来的槽到期时再按新的到期时间重新放入时间轮（延迟刷新），活跃的长连接每个超时周期最多只移动一次
+// 单一事件循环模式使用Timer的单例；多reactor模式下每个事件循环构造自己的Timer
 class Timer{
 public:
     static std::shared_ptr<Timer> instance(); // 获取Timer的单例对象
+    Timer();
 
     void adjust(int id,int timeout); // 更新一个节点的到期时间
     void add(int id,int timeout,std::function<void()> callback); //添加一个节点
-    int getExpiration(); // 获取距离最近的到期时间的毫秒数
+    // 处理所有到期的节点，并获取距离下一次需要处理时间轮的毫秒数
+    // 同一个刻度到期的节点先全部从时间轮中移除，释放锁之后再依次执行它们的回调函数
+    int getExpiration();
     // 用于客户端主动断开连接时从定时器中删除一个节点
     void del(int id); // 根据id删除一个节点
+    size_t size(); // 定时器中的节点数
 
     Timer(const Timer&) = delete; // 禁用拷贝构造函数
     Timer& operator=(const Timer&) = delete; // 禁用赋值运算符
 private:
-    Timer() = default; // 禁用外部构造
-    void up(int index); // 将heap中索引为index的节点上移，保证小根堆的结构
-    void down(int index); // 将heap中索引为index的节点下移，保证小根堆的结构
-    void swap(int i,int j); // 将heap中索引为i和j的两个节点交换位置
-    void pop(); // 取出堆顶节点
-    void clearTimeoutNode(); // 清除所有超时的节点
-
-    std::mutex timerLock; // 定时器互斥锁
-    std::vector<Node> heap; // 定时器堆（是一个小根堆，顶部节点是到期时间最近的节点）
-    std::unordered_map<int,int> id2index; // 节点id到节点在heap中索引的映射
+    static constexpr int BITS=6;
+    static constexpr int SLOTS=1<<BITS; // 每层的槽数
+    static constexpr int LEVELS=4; // 层数，时间轮最多覆盖SLOTS^LEVELS个刻度（约4.6小时），更远的节点先放在最高层，到期时再重新放入
+    static constexpr uint64_t MASK=SLOTS-1;
+
+    struct Entry{
+        // 时间轮中的节点，以数组下标组成每个槽的双向链表
+        int id; // 节点的id（对于文件而言，id可以是文件描述符）
+        int prev,next; // 槽中的前一个和后一个节点，空闲节点用next组成空闲链表
+        int slot; // 节点所在的槽（层号*SLOTS+槽号），-1表示节点不在时间轮中
+        uint64_t expiration; // 到期的刻度（adjust只更新这个值）
+        uint64_t placed; // 放入槽时使用的到期刻度，节点会在这个刻度（或者更早的级联时）被检查
+        std::function<void()> callback; // 节点到期后需要触发的回调函数
+    };
+
+    uint64_t now(); // 当前的刻度（构造定时器之后经过的毫秒数）
+    int allocate(); // 分配一个节点，返回节点的下标
+    void release(int index); // 释放一个节点
+    void link(int index); // 按节点的到期时间把节点放入对应的槽中
+    void unlink(int index); // 把节点从所在的槽中移除
+    void advance(uint64_t to); // 把时间轮推进到刻度to，到期节点的回调函数放入expired
+    void cascade(int level,int slot); // 把高层的一个槽中的节点重新分配到低层
+    void expire(int slot); // 处理第0层的一个槽：到期的节点移出时间轮，到期时间已经更新的节点重新放入时间轮
+    uint64_t nextTick(); // 下一个需要处理的刻度（有节点的第0层槽到期或者有节点的高层槽级联），时间轮必须非空
+
+    std::mutex timerLock; // 定时器互斥锁（单一事件循环模式下工作线程会调用del）
+    std::chrono::steady_clock::time_point start; // 刻度0对应的时间点
+    uint64_t current=0; // 时间轮已经处理到的刻度
+    size_t count=0; // 时间轮中的节点数
+    int heads[LEVELS*SLOTS]; // 每个槽的链表头，-1表示空槽
+    uint64_t occupied[LEVELS]={}; // 每层非空槽的位图，用于O(1)地找到下一个需要处理的槽
+    std::vector<Entry> entries; // 节点池
+    int freeList=-1; // 空闲节点链表头
+    std::vector<int> id2entry; // 节点id到节点下标的映射（id是文件描述符，数值较小且连续，直接用数组索引），-1表示没有节点
+    std::vector<std::function<void()>> expired; // 本次处理中到期节点的回调函数
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,173 @@
+// 定时器测试：对比旧的定时器（小根堆 + unordered_map索引）和分层时间轮
+// 用法：./timer_benchmark [定时器数] [每个定时器的adjust次数] [超时时间(ms)]
+// 与服务器相同，每个定时器的回调由std::bind绑定成员函数和两个指针参数，超时时间在[timeout,2*timeout)之间
+// 添加、getExpiration、adjust和del的过程中不能有定时器到期（旧的定时器adjust不存在的节点会出错），超时时间不能太短
+#include "Timer.h"
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+#include <string>
+
+// 旧的定时器（与改动之前的实现相同）
+class LegacyTimer{
+public:
+    void adjust(int id,int timeout){
+        std::unique_lock<std::mutex> lock(timerLock);
+        heap[id2index[id]].expiration=std::chrono::high_resolution_clock::now()+std::chrono::milliseconds(timeout);
+        down(id2index[id]);
+    }
+    void add(int id,int timeout,std::function<void()> callback){
+        std::unique_lock<std::mutex> lock(timerLock);
+        int index=heap.size();
+        id2index[id]=index;
+        heap.push_back({id,std::chrono::high_resolution_clock::now()+std::chrono::milliseconds(timeout),callback});
+        up(index);
+    }
+    int getExpiration(){
+        std::unique_lock<std::mutex> lock(timerLock);
+        while(!heap.empty()){
+            Node node=heap.front();
+            if(std::chrono::duration_cast<std::chrono::milliseconds>(
+                node.expiration-std::chrono::high_resolution_clock::now()).count()>0)break;
+            node.callback();
+            pop();
+        }
+        int result=-1;
+        if(!heap.empty()){
+            result=std::chrono::duration_cast<std::chrono::milliseconds>(
+                heap.front().expiration-std::chrono::high_resolution_clock::now()).count();
+            if(result<0)result=0;
+        }
+        return result;
+    }
+    void del(int id){
+        std::unique_lock<std::mutex> lock(timerLock);
+        if(id2index.count(id)!=0){
+            int index=id2index[id];
+            swap(index,heap.size()-1);
+            id2index.erase(id);
+            heap.pop_back();
+            down(index);
+        }
+    }
+private:
+    struct Node{
+        int id;
+        std::chrono::high_resolution_clock::time_point expiration;
+        std::function<void()> callback;
+        bool operator<(const Node& node){return expiration<node.expiration;}
+    };
+    void up(int index){
+        if(index==0)return;
+        int parent=(index-1)/2;
+        while(parent>=0){
+            if(heap[parent]<heap[index])break;
+            swap(parent,index);
+            index=parent;
+            parent=(index-1)/2;
+        }
+    }
+    void down(int index){
+        int child=index*2+1;
+        while(child<(int)heap.size()){
+            if(child+1<(int)heap.size()&&heap[child+1]<heap[child])child++;
+            if(heap[index]<heap[child])break;
+            swap(index,child);
+            index=child;
+            child=index*2+1;
+        }
+    }
+    void swap(int i,int j){
+        std::swap(heap[i],heap[j]);
+        id2index[heap[i].id]=i;
+        id2index[heap[j].id]=j;
+    }
+    void pop(){
+        swap(0,heap.size()-1);
+        id2index.erase(heap.back().id);
+        heap.pop_back();
+        down(0);
+    }
+    std::mutex timerLock;
+    std::vector<Node> heap;
+    std::unordered_map<int,int> id2index;
+};
+
+// 回调绑定的对象：与Server::connectTimeout一样是一个成员函数，参数为两个指针
+struct Counter{
+    long long expired=0;
+    void onTimeout(void*,void*){expired++;}
+};
+
+static uint64_t nextRandom(uint64_t& state){
+    state^=state<<13;
+    state^=state>>7;
+    state^=state<<17;
+    return state;
+}
+
+static double seconds(std::chrono::steady_clock::time_point begin){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-begin).count();
+}
+
+// 依次测试添加、事件循环的getExpiration、活跃连接的adjust、主动断开的del、超时的批量处理
+template<typename T>
+static void run(const char* name,int timerNum,int adjustRounds,int timeout){
+    T timer;
+    Counter counter;
+    uint64_t state=88172645463325252ull;
+    auto begin=std::chrono::steady_clock::now();
+    for(int i=0;i<timerNum;i++){
+        timer.add(i,timeout+i%timeout,std::bind(&Counter::onTimeout,&counter,nullptr,nullptr));
+    }
+    double addTime=seconds(begin);
+
+    // 所有定时器都没有到期时，事件循环每一轮调用一次getExpiration
+    const int pollNum=1000000;
+    begin=std::chrono::steady_clock::now();
+    for(int i=0;i<pollNum;i++)timer.getExpiration();
+    double pollTime=seconds(begin);
+
+    long long adjustNum=(long long)timerNum*adjustRounds;
+    begin=std::chrono::steady_clock::now();
+    for(long long i=0;i<adjustNum;i++){
+        uint64_t r=nextRandom(state);
+        timer.adjust(r%timerNum,timeout+(r>>32)%timeout);
+    }
+    double adjustTime=seconds(begin);
+    auto lastAdjust=std::chrono::steady_clock::now();
+
+    begin=std::chrono::steady_clock::now();
+    for(int i=0;i<timerNum;i+=2)timer.del(i); // 一半的连接主动断开
+    double delTime=seconds(begin);
+
+    // 等待剩下的定时器全部到期，只统计getExpiration中花费的时间
+    std::this_thread::sleep_until(lastAdjust+std::chrono::milliseconds(2*timeout+10));
+    double expireTime=0;
+    int calls=0;
+    while(true){
+        begin=std::chrono::steady_clock::now();
+        int result=timer.getExpiration();
+        expireTime+=seconds(begin);
+        calls++;
+        if(result==-1)break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(result));
+    }
+    std::cout<<name<<"\t"<<static_cast<long long>(timerNum/addTime)
+        <<"\t"<<static_cast<long long>(adjustNum/adjustTime)
+        <<"\t"<<static_cast<long long>(pollNum/pollTime)
+        <<"\t"<<static_cast<long long>((timerNum/2)/delTime)
+        <<"\t"<<expireTime*1000<<"ms("<<counter.expired<<","<<calls<<")"<<std::endl;
+}
+
+int main(int argc,char* argv[]){
+    int timerNum=argc>1?std::stoi(argv[1]):1000000;
+    int adjustRounds=argc>2?std::stoi(argv[2]):4;
+    int timeout=argc>3?std::stoi(argv[3]):5000;
+    std::cout<<"timers="<<timerNum<<" adjust="<<adjustRounds<<"x timeout="<<timeout<<"ms"<<std::endl;
+    std::cout<<"timer\tadd(ops/s)\tadjust(ops/s)\tpoll(ops/s)\tdel(ops/s)\texpire(time(expired,calls))"<<std::endl;
+    run<LegacyTimer>("legacy",timerNum,adjustRounds,timeout);
+    run<Timer>("wheel",timerNum,adjustRounds,timeout);
+    return 0;
+}
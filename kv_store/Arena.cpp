@@ -0,0 +1,87 @@
+#include "Arena.h"
+#include <cstdlib>
+#include <new>
+#include <thread>
+
+Arena::~Arena() {
+    for (void* slab : this->slabs) {
+        std::free(slab);
+    }
+}
+
+int Arena::classIndex(size_t size) {
+    if (size <= 256) return size == 0 ? 0 : static_cast<int>((size - 1) / 16);
+    return 16 + static_cast<int>((size - 257) / 64);
+}
+
+size_t Arena::classSize(int index) {
+    if (index < 16) return (index + 1) * 16;
+    return 256 + (index - 15) * 64;
+}
+
+size_t Arena::roundUp(size_t size) {
+    if (size > MAX_SMALL) return size;
+    return classSize(classIndex(size));
+}
+
+void* Arena::allocate(size_t size) {
+    if (size > MAX_SMALL) {
+        void* ptr = std::malloc(size);
+        if (!ptr) throw std::bad_alloc();
+        this->allocated.fetch_add(size, std::memory_order_relaxed);
+        this->reserved.fetch_add(size, std::memory_order_relaxed);
+        return ptr;
+    }
+    int index = classIndex(size);
+    size_t blockSize = classSize(index);
+    SizeClass& sc = this->classes[index];
+    while (sc.lock.test_and_set(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+    void* ptr;
+    if (sc.freeList) {
+        // 优先复用已释放的内存块
+        ptr = sc.freeList;
+        sc.freeList = sc.freeList->next;
+    } else {
+        if (sc.cur + blockSize > sc.end) {
+            // 当前slab已用完，申请新的slab（slab尾部不足一个内存块的部分被浪费）
+            char* slab = static_cast<char*>(std::malloc(SLAB_SIZE));
+            if (!slab) {
+                sc.lock.clear(std::memory_order_release);
+                throw std::bad_alloc();
+            }
+            {
+                std::unique_lock<std::mutex> lock(this->slabLock);
+                this->slabs.push_back(slab);
+            }
+            this->reserved.fetch_add(SLAB_SIZE, std::memory_order_relaxed);
+            sc.cur = slab;
+            sc.end = slab + SLAB_SIZE;
+        }
+        ptr = sc.cur;
+        sc.cur += blockSize;
+    }
+    sc.lock.clear(std::memory_order_release);
+    this->allocated.fetch_add(blockSize, std::memory_order_relaxed);
+    return ptr;
+}
+
+void Arena::deallocate(void* ptr, size_t size) {
+    if (size > MAX_SMALL) {
+        std::free(ptr);
+        this->allocated.fetch_sub(size, std::memory_order_relaxed);
+        this->reserved.fetch_sub(size, std::memory_order_relaxed);
+        return;
+    }
+    int index = classIndex(size);
+    SizeClass& sc = this->classes[index];
+    FreeBlock* block = static_cast<FreeBlock*>(ptr);
+    while (sc.lock.test_and_set(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+    block->next = sc.freeList;
+    sc.freeList = block;
+    sc.lock.clear(std::memory_order_release);
+    this->allocated.fetch_sub(classSize(index), std::memory_order_relaxed);
+}
@@ -0,0 +1,53 @@
+#ifndef ARENA
+#define ARENA
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+
+// 按大小分级的slab分配器，每个跳表拥有一个
+// 不超过MAX_SMALL字节的请求向上取整到所属的大小级别，从该级别的空闲链表或当前slab中分配
+// 同一级别的内存块大小相同，释放后挂回空闲链表，可以被之后同级别的请求复用
+// 超过MAX_SMALL字节的请求直接使用malloc
+class Arena {
+public:
+    Arena() = default;
+    ~Arena(); // 释放所有slab（以及仍未释放的大块内存）
+
+    void* allocate(size_t size);
+    void deallocate(void* ptr, size_t size); // size必须与allocate时相同
+    static size_t roundUp(size_t size); // 实际占用的字节数
+
+    size_t allocatedBytes() const { return this->allocated.load(std::memory_order_relaxed); } // 正在使用的字节数
+    size_t reservedBytes() const { return this->reserved.load(std::memory_order_relaxed); } // 向系统申请的字节数
+
+    Arena(const Arena&) = delete; // 禁用拷贝构造函数
+    Arena& operator=(const Arena&) = delete; // 禁用赋值运算符
+
+    static const size_t MAX_SMALL = 1024; // 最大的大小级别
+    static const size_t SLAB_SIZE = 64 * 1024; // 每次向系统申请的slab大小
+private:
+    static const int CLASSES = 28; // 16~256按16字节分级，320~1024按64字节分级
+    static int classIndex(size_t size);
+    static size_t classSize(int index);
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+    // 每个大小级别使用独立的自旋锁，临界区只有几条指令
+    struct alignas(64) SizeClass {
+        std::atomic_flag lock = ATOMIC_FLAG_INIT;
+        FreeBlock* freeList = nullptr; // 已释放的内存块
+        char* cur = nullptr; // 当前slab中未分配部分的起始地址
+        char* end = nullptr; // 当前slab的结束地址
+    };
+    SizeClass classes[CLASSES];
+
+    std::mutex slabLock; // 保护slabs
+    std::vector<void*> slabs; // 所有slab，析构时统一释放
+    std::atomic<size_t> allocated{0};
+    std::atomic<size_t> reserved{0};
+};
+
+#endif
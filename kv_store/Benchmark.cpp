@@ -0,0 +1,684 @@
+// 跳表性能测试
+// 用法：
+//   ./benchmark throughput [最大线程数] [key数量] [每线程操作数] [读比例(%)]  对比互斥模式和并发模式的多线程吞吐量
+//   ./benchmark lookup [key数量] [查询次数] [value长度] [int|string|fixed16] 每个key的内存占用以及查询延迟
+//   ./benchmark sharded [最大线程数] [分片数] [每线程写入数]                 对比单个跳表和分片存储的多线程写入吞吐量
+//   ./benchmark batch [key数量] [每批key数] [批数]                           对比批量操作和逐个操作的吞吐量
+//   ./benchmark workload [参数=值 ...]                                       按指定的key分布和操作比例测试吞吐量和延迟分位数，见workload()
+//   ./benchmark parse [每种请求的次数]                                        对比逐字符拷贝的旧解析方式和零拷贝解析的命令解析和分发耗时
+//   ./benchmark load [key数量] [分片数] [value长度]                           启动耗时：对比逐条插入和批量构建加载快照的耗时（例如1000万、1亿个key），以及落盘的耗时
+#include "SkipList.h"
+#include "ShardedStore.h"
+#include "Command.h"
+#include "Snapshot.h"
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <sstream>
+#include <map>
+#include <array>
+#include <climits>
+#include <new>
+#include <cstdlib>
+#include <unistd.h>
+
+static double run(bool concurrent, int threadNum, int keyNum, int opNum, int readRatio) {
+    SkipList<int64_t> skipList(18, concurrent);
+    for (int i = 0; i < keyNum; i++) {
+        skipList.insertElement(i, "value" + std::to_string(i));
+    }
+    std::vector<std::thread> threads;
+    auto begin = std::chrono::steady_clock::now();
+    for (int t = 0; t < threadNum; t++) {
+        threads.emplace_back([&skipList, t, keyNum, opNum, readRatio]() {
+            std::mt19937 engine(t);
+            std::uniform_int_distribution<int> keyDist(0, keyNum - 1);
+            std::uniform_int_distribution<int> opDist(0, 99);
+            for (int i = 0; i < opNum; i++) {
+                int key = keyDist(engine);
+                int op = opDist(engine);
+                if (op < readRatio) {
+                    skipList.searchElement(key);
+                } else if (op % 2 == 0) {
+                    skipList.insertElement(key, "value");
+                } else {
+                    skipList.deleteElement(key);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return static_cast<double>(threadNum) * opNum / seconds;
+}
+
+static void throughput(int argc, char* argv[]) {
+    int maxThreads = argc > 2 ? std::stoi(argv[2]) : 8;
+    int keyNum = argc > 3 ? std::stoi(argv[3]) : 100000;
+    int opNum = argc > 4 ? std::stoi(argv[4]) : 200000;
+    int readRatio = argc > 5 ? std::stoi(argv[5]) : 95;
+    std::cout << "keys=" << keyNum << " ops/thread=" << opNum << " read=" << readRatio << "%" << std::endl;
+    std::cout << "threads\tmutex(ops/s)\tconcurrent(ops/s)" << std::endl;
+    for (int threadNum = 1; threadNum <= maxThreads; threadNum *= 2) {
+        double mutexOps = run(false, threadNum, keyNum, opNum, readRatio);
+        double concurrentOps = run(true, threadNum, keyNum, opNum, readRatio);
+        std::cout << threadNum << "\t" << static_cast<long long>(mutexOps)
+                  << "\t" << static_cast<long long>(concurrentOps) << std::endl;
+    }
+}
+
+// 当前进程的常驻内存（字节）
+static size_t residentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+// 第i个测试key：字符串key带有公共前缀，用于观察结点中保存的前缀对比较的帮助
+template<typename Key>
+static Key makeKey(int i) {
+    return KeyTraits<Key>::parse("key" + std::to_string(i));
+}
+
+template<>
+int64_t makeKey<int64_t>(int i) {
+    return i;
+}
+
+template<typename Key>
+static void lookup(int keyNum, int lookupNum, int valueLen) {
+    // 以随机顺序插入key
+    std::vector<Key> keys;
+    keys.reserve(keyNum);
+    for (int i = 0; i < keyNum; i++) keys.push_back(makeKey<Key>(i));
+    std::mt19937 engine(1);
+    std::shuffle(keys.begin(), keys.end(), engine);
+    int maxLevel = std::max(1, static_cast<int>(std::ceil(std::log2(keyNum))));
+    size_t rssBefore = residentBytes();
+    SkipList<Key> skipList(maxLevel);
+    std::string value(valueLen, 'v');
+    auto begin = std::chrono::steady_clock::now();
+    for (const Key& key : keys) {
+        skipList.insertElement(key, value);
+    }
+    double loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    size_t rssAfter = residentBytes();
+    std::cout << "keys=" << keyNum << " value=" << valueLen << "B maxLevel=" << maxLevel
+              << " insert=" << static_cast<long long>(keyNum / loadSeconds) << "ops/s" << std::endl;
+    std::cout << "memory/key: used=" << static_cast<double>(skipList.memoryUsage()) / keyNum
+              << "B reserved=" << static_cast<double>(skipList.reservedMemory()) / keyNum
+              << "B rss=" << static_cast<double>(rssAfter - rssBefore) / keyNum << "B" << std::endl;
+    // 逐个计时随机查询（零拷贝读取）
+    std::uniform_int_distribution<int> keyDist(0, keyNum - 1);
+    std::vector<long long> latency(lookupNum);
+    size_t checksum = 0;
+    for (int i = 0; i < lookupNum; i++) {
+        const Key& key = keys[keyDist(engine)];
+        auto t0 = std::chrono::steady_clock::now();
+        skipList.searchElement(key, [&checksum](std::string_view v) { checksum += v.size(); });
+        latency[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+    }
+    std::sort(latency.begin(), latency.end());
+    long long total = 0;
+    for (long long l : latency) total += l;
+    std::cout << "lookup latency(ns): avg=" << total / lookupNum
+              << " p50=" << latency[lookupNum / 2]
+              << " p99=" << latency[static_cast<size_t>(lookupNum * 0.99)]
+              << " p999=" << latency[static_cast<size_t>(lookupNum * 0.999)]
+              << " (checksum " << checksum << ")" << std::endl;
+}
+
+static void lookup(int argc, char* argv[]) {
+    int keyNum = argc > 2 ? std::stoi(argv[2]) : 10000000;
+    int lookupNum = argc > 3 ? std::stoi(argv[3]) : 1000000;
+    int valueLen = argc > 4 ? std::stoi(argv[4]) : 16;
+    std::string keyType = argc > 5 ? argv[5] : "int";
+    if (keyType == "string") {
+        lookup<std::string>(keyNum, lookupNum, valueLen);
+    } else if (keyType == "fixed16") {
+        lookup<FixedKey<16>>(keyNum, lookupNum, valueLen);
+    } else {
+        lookup<int64_t>(keyNum, lookupNum, valueLen);
+    }
+}
+
+// 每个线程写入互不重复的随机key
+static double write(int shards, int threadNum, int opNum) {
+    ShardedStore<int64_t> store(shards, static_cast<long long>(threadNum) * opNum);
+    std::vector<std::thread> threads;
+    auto begin = std::chrono::steady_clock::now();
+    for (int t = 0; t < threadNum; t++) {
+        threads.emplace_back([&store, t, threadNum, opNum]() {
+            std::mt19937 engine(t);
+            std::vector<int> keys(opNum);
+            for (int i = 0; i < opNum; i++) keys[i] = i * threadNum + t;
+            std::shuffle(keys.begin(), keys.end(), engine);
+            for (int key : keys) {
+                store.insertElement(key, "value");
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return static_cast<double>(threadNum) * opNum / seconds;
+}
+
+static void sharded(int argc, char* argv[]) {
+    int maxThreads = argc > 2 ? std::stoi(argv[2]) : 8;
+    int shards = argc > 3 ? std::stoi(argv[3]) : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    int opNum = argc > 4 ? std::stoi(argv[4]) : 200000;
+    std::cout << "shards=" << shards << " writes/thread=" << opNum << std::endl;
+    std::cout << "threads\t1 shard(ops/s)\t" << shards << " shards(ops/s)" << std::endl;
+    for (int threadNum = 1; threadNum <= maxThreads; threadNum *= 2) {
+        double single = write(1, threadNum, opNum);
+        double multi = write(shards, threadNum, opNum);
+        std::cout << threadNum << "\t" << static_cast<long long>(single)
+                  << "\t" << static_cast<long long>(multi) << std::endl;
+    }
+}
+
+// 每批key在[0,keyNum)中随机选取一段连续区间内的随机key，模拟一次页面渲染需要的一组相关key
+static void batch(int argc, char* argv[]) {
+    int keyNum = argc > 2 ? std::stoi(argv[2]) : 1000000;
+    int batchSize = argc > 3 ? std::stoi(argv[3]) : 200;
+    int batchNum = argc > 4 ? std::stoi(argv[4]) : 5000;
+    int span = batchSize * 16; // 每批key所在区间的长度
+    ShardedStore<int64_t> store(1, keyNum);
+    for (int i = 0; i < keyNum; i++) {
+        store.insertElement(i, "value");
+    }
+    std::mt19937 engine(1);
+    std::uniform_int_distribution<int> startDist(0, std::max(0, keyNum - span));
+    std::uniform_int_distribution<int> offsetDist(0, span - 1);
+    std::vector<std::vector<int64_t>> batches(batchNum);
+    for (auto& keys : batches) {
+        int start = startDist(engine);
+        for (int i = 0; i < batchSize; i++) keys.push_back(start + offsetDist(engine));
+    }
+    std::vector<std::string_view> values(batchSize, "value");
+    std::vector<int> results;
+    size_t found = 0;
+    auto measure = [&](auto&& op) {
+        auto begin = std::chrono::steady_clock::now();
+        for (auto& keys : batches) op(keys);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        return static_cast<long long>(static_cast<double>(batchNum) * batchSize / seconds);
+    };
+    long long singleGet = measure([&](const std::vector<int64_t>& keys) {
+        for (int64_t key : keys) store.searchElement(key, [&found](std::string_view) { found++; });
+    });
+    long long batchGet = measure([&](const std::vector<int64_t>& keys) {
+        store.searchElements(keys, [&found](size_t, std::string_view) { found++; });
+    });
+    long long singleSet = measure([&](const std::vector<int64_t>& keys) {
+        for (int64_t key : keys) store.insertElement(key, "value");
+    });
+    long long batchSet = measure([&](const std::vector<int64_t>& keys) {
+        store.insertElements(keys, values, results);
+    });
+    std::cout << "keys=" << keyNum << " batch=" << batchSize << " batches=" << batchNum << " (found " << found << ")" << std::endl;
+    std::cout << "op\tsingle(keys/s)\tbatch(keys/s)" << std::endl;
+    std::cout << "get\t" << singleGet << "\t" << batchGet << std::endl;
+    std::cout << "set\t" << singleSet << "\t" << batchSet << std::endl;
+}
+
+// Zipf分布的生成器（Gray等人的算法，YCSB中使用的方法）：返回[0,n)中的排名，排名越小出现的概率越大
+// 只在构造时计算一次zeta(n)，之后每次生成是O(1)的，多个线程可以共享同一个生成器
+class Zipf {
+public:
+    Zipf(uint64_t n, double theta) : n(n), theta(theta) {
+        this->alpha = 1.0 / (1.0 - theta);
+        this->zetan = zeta(n, theta);
+        this->eta = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta(2, theta) / this->zetan);
+    }
+    template<typename Engine>
+    uint64_t next(Engine& engine) const {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(engine);
+        double uz = u * this->zetan;
+        if (uz < 1.0) return 0;
+        if (uz < 1.0 + std::pow(0.5, this->theta)) return 1;
+        return std::min(this->n - 1, static_cast<uint64_t>(this->n * std::pow(this->eta * u - this->eta + 1.0, this->alpha)));
+    }
+private:
+    static double zeta(uint64_t n, double theta) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; i++) sum += 1.0 / std::pow(static_cast<double>(i), theta);
+        return sum;
+    }
+
+    uint64_t n;
+    double theta, alpha, zetan, eta;
+};
+
+// 一组测试的配置
+struct WorkloadConfig {
+    std::string dist; // key分布：uniform、zipf、sequential、latest
+    int threads;
+    int keys; // 预先插入的key数量
+    bool concurrent; // 并发模式或互斥模式
+};
+
+// 操作类型及其名称
+enum WorkloadOp { OP_READ, OP_INSERT, OP_DELETE, OP_ALL, OP_COUNT };
+static const char* const opNames[OP_COUNT] = {"read", "insert", "delete", "all"};
+
+// 一组测试的结果：每种操作的延迟（纳秒，已排序）
+struct WorkloadResult {
+    WorkloadConfig config;
+    double seconds;
+    long long ops;
+    std::vector<size_t> levels;
+    size_t memory;
+    std::vector<uint32_t> latency[OP_COUNT];
+    std::vector<uint32_t> total; // 所有操作的延迟
+};
+
+// 已排序的延迟中的分位数
+static uint32_t percentile(const std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    return sorted[std::min(sorted.size() - 1, static_cast<size_t>(sorted.size() * p))];
+}
+
+static std::vector<std::string> splitList(const std::string& s) {
+    std::vector<std::string> result;
+    std::stringstream stream(s);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) result.push_back(item);
+    }
+    return result;
+}
+
+static std::atomic<size_t> sink(0); // 读取结果的校验和
+
+// mix[op]为操作op所占的百分比，其余为读操作
+static WorkloadResult runWorkload(const WorkloadConfig& config, long long opNum, const int* mix, double theta, int seed) {
+    WorkloadResult result;
+    result.config = config;
+    SkipList<int64_t> skipList(ShardedStore<int64_t>::levelFor(config.keys), config.concurrent);
+    // 以随机顺序预先插入[0,keys)
+    std::vector<int64_t> keys(config.keys);
+    for (int i = 0; i < config.keys; i++) keys[i] = i;
+    std::mt19937_64 loadEngine(seed);
+    std::shuffle(keys.begin(), keys.end(), loadEngine);
+    for (int64_t key : keys) skipList.insertElement(key, "value");
+    std::vector<int64_t>().swap(keys);
+    result.levels = skipList.levelHistogram();
+    result.memory = skipList.memoryUsage();
+
+    Zipf zipf(std::max(config.keys, 2), theta);
+    std::atomic<int64_t> latest(config.keys); // latest分布中下一个新key，读操作集中在最近插入的key上
+    std::vector<std::array<std::vector<uint32_t>, OP_COUNT>> latency(config.threads);
+    std::vector<std::thread> threads;
+    auto begin = std::chrono::steady_clock::now();
+    for (int t = 0; t < config.threads; t++) {
+        threads.emplace_back([&, t]() {
+            std::mt19937_64 engine(seed + t + 1);
+            std::uniform_int_distribution<int> opDist(0, 99);
+            std::uniform_int_distribution<int64_t> uniform(0, config.keys - 1);
+            int64_t cursor = static_cast<int64_t>(config.keys) / config.threads * t; // sequential分布中每个线程的位置
+            auto& samples = latency[t];
+            for (auto& s : samples) s.reserve(opNum * (1 + mix[OP_INSERT] + mix[OP_DELETE]) / 100);
+            size_t checksum = 0;
+            for (long long i = 0; i < opNum; i++) {
+                int r = opDist(engine), op = OP_READ;
+                for (int o = OP_INSERT, sum = 0; o < OP_COUNT; o++) {
+                    sum += mix[o];
+                    if (r < sum) {
+                        op = o;
+                        break;
+                    }
+                }
+                int64_t key;
+                if (config.dist == "zipf") {
+                    // 打散排名，热点key不会集中在跳表的某一段
+                    key = static_cast<int64_t>(zipf.next(engine) * 0x9E3779B97F4A7C15ULL % config.keys);
+                } else if (config.dist == "sequential") {
+                    key = cursor++ % config.keys;
+                } else if (config.dist == "latest") {
+                    key = (op == OP_INSERT ? latest++ : std::max<int64_t>(0, latest.load() - 1 - zipf.next(engine)));
+                } else {
+                    key = uniform(engine);
+                }
+                auto t0 = std::chrono::steady_clock::now();
+                switch (op) {
+                    case OP_READ:
+                        skipList.searchElement(key, [&checksum](std::string_view v) { checksum += v.size(); });
+                        break;
+                    case OP_INSERT:
+                        skipList.insertElement(key, "value");
+                        break;
+                    case OP_DELETE:
+                        skipList.deleteElement(key);
+                        break;
+                    default:
+                        checksum += skipList.searchAll().size();
+                }
+                samples[op].push_back(static_cast<uint32_t>(std::min<long long>(UINT32_MAX,
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count())));
+            }
+            sink += checksum; // 避免读操作被优化掉
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    result.ops = opNum * config.threads;
+    for (int op = 0; op < OP_COUNT; op++) {
+        for (auto& samples : latency) {
+            result.latency[op].insert(result.latency[op].end(), samples[op].begin(), samples[op].end());
+        }
+        result.total.insert(result.total.end(), result.latency[op].begin(), result.latency[op].end());
+        std::sort(result.latency[op].begin(), result.latency[op].end());
+    }
+    std::sort(result.total.begin(), result.total.end());
+    return result;
+}
+
+static const double percentiles[] = {0.5, 0.9, 0.99, 0.999};
+static const char* const percentileNames[] = {"p50", "p90", "p99", "p999"};
+
+static void writeText(std::ostream& out, const std::vector<WorkloadResult>& results) {
+    out << "dist\tmode\tthreads\tkeys\tops/s\top\tcount\tp50(ns)\tp90(ns)\tp99(ns)\tp999(ns)\tmax(ns)" << std::endl;
+    for (auto& r : results) {
+        for (int op = -1; op < OP_COUNT; op++) {
+            const auto& sorted = (op < 0 ? r.total : r.latency[op]);
+            if (sorted.empty()) continue;
+            out << r.config.dist << "\t" << (r.config.concurrent ? "concurrent" : "mutex") << "\t" << r.config.threads
+                << "\t" << r.config.keys << "\t" << static_cast<long long>(r.ops / r.seconds)
+                << "\t" << (op < 0 ? "total" : opNames[op]) << "\t" << sorted.size();
+            for (double p : percentiles) out << "\t" << percentile(sorted, p);
+            out << "\t" << sorted.back() << std::endl;
+        }
+    }
+    // 层数分布只与key数量有关，每种key数量输出一次
+    std::map<int, const WorkloadResult*> byKeys;
+    for (auto& r : results) byKeys.emplace(r.config.keys, &r);
+    for (auto& entry : byKeys) {
+        out << "levels(keys=" << entry.first << "):";
+        for (size_t n : entry.second->levels) out << " " << n;
+        out << std::endl;
+    }
+}
+
+// CSV：每组测试的每种操作一行，另外一行total为所有操作
+static void writeCsv(std::ostream& out, const std::vector<WorkloadResult>& results) {
+    out << "dist,mode,threads,keys,ops_per_sec,memory,op,count,p50_ns,p90_ns,p99_ns,p999_ns,max_ns" << std::endl;
+    for (auto& r : results) {
+        for (int op = -1; op < OP_COUNT; op++) {
+            const auto& sorted = (op < 0 ? r.total : r.latency[op]);
+            if (sorted.empty()) continue;
+            out << r.config.dist << "," << (r.config.concurrent ? "concurrent" : "mutex") << "," << r.config.threads
+                << "," << r.config.keys << "," << static_cast<long long>(r.ops / r.seconds) << "," << r.memory
+                << "," << (op < 0 ? "total" : opNames[op]) << "," << sorted.size();
+            for (double p : percentiles) out << "," << percentile(sorted, p);
+            out << "," << sorted.back() << std::endl;
+        }
+    }
+}
+
+static void writeLatency(std::ostream& out, const std::vector<uint32_t>& sorted) {
+    out << "{\"count\": " << sorted.size();
+    for (int i = 0; i < 4; i++) out << ", \"" << percentileNames[i] << "\": " << percentile(sorted, percentiles[i]);
+    out << ", \"max\": " << (sorted.empty() ? 0 : sorted.back()) << "}";
+}
+
+static void writeJson(std::ostream& out, const std::string& label, const std::vector<WorkloadResult>& results) {
+    out << "{\"label\": \"" << label << "\", \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        auto& r = results[i];
+        out << (i ? "," : "") << "\n  {\"dist\": \"" << r.config.dist << "\", \"mode\": \""
+            << (r.config.concurrent ? "concurrent" : "mutex") << "\", \"threads\": " << r.config.threads
+            << ", \"keys\": " << r.config.keys << ", \"ops\": " << r.ops
+            << ", \"seconds\": " << r.seconds << ", \"opsPerSec\": " << static_cast<long long>(r.ops / r.seconds)
+            << ", \"memory\": " << r.memory << ", \"levels\": [";
+        for (size_t l = 0; l < r.levels.size(); l++) out << (l ? ", " : "") << r.levels[l];
+        out << "], \"latency\": {\"total\": ";
+        writeLatency(out, r.total);
+        for (int op = 0; op < OP_COUNT; op++) {
+            if (r.latency[op].empty()) continue;
+            out << ", \"" << opNames[op] << "\": ";
+            writeLatency(out, r.latency[op]);
+        }
+        out << "}}";
+    }
+    out << "\n]}" << std::endl;
+}
+
+// 参数均为 名称=值 的形式，列表用逗号分隔，对dist、mode、threads、keys的所有组合各运行一次：
+//   dist=uniform,zipf,sequential,latest  key分布（latest：插入新key，读操作按Zipf分布集中在最近插入的key上）
+//   mode=concurrent,mutex                跳表模式
+//   threads=1,2,4,8  keys=100000,1000000 线程数和预先插入的key数量
+//   ops=200000                           每个线程的操作数
+//   insert=5 delete=5 all=0              各操作的百分比，其余为按key查询；all为searchAll
+//   theta=0.99 seed=1                    Zipf分布的参数和随机数种子
+//   format=text|csv|json out=文件 label=名称   输出格式、输出文件（默认标准输出）以及写入json的标签，用于对比不同版本
+static void workload(int argc, char* argv[]) {
+    std::map<std::string, std::string> args = {
+        {"dist", "uniform,zipf,sequential,latest"}, {"mode", "concurrent"}, {"threads", "1,2,4,8"},
+        {"keys", "1000000"}, {"ops", "200000"}, {"insert", "5"}, {"delete", "5"}, {"all", "0"},
+        {"theta", "0.99"}, {"seed", "1"}, {"format", "text"}, {"out", ""}, {"label", ""}};
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (eq == std::string::npos || !args.count(arg.substr(0, eq))) {
+            std::cerr << "未知参数: " << arg << std::endl;
+            return;
+        }
+        args[arg.substr(0, eq)] = arg.substr(eq + 1);
+    }
+    int mix[OP_COUNT] = {0, std::stoi(args["insert"]), std::stoi(args["delete"]), std::stoi(args["all"])};
+    if (mix[OP_INSERT] + mix[OP_DELETE] + mix[OP_ALL] > 100) {
+        std::cerr << "操作比例之和超过100" << std::endl;
+        return;
+    }
+    long long opNum = std::stoll(args["ops"]);
+    double theta = std::stod(args["theta"]);
+    int seed = std::stoi(args["seed"]);
+    std::vector<WorkloadResult> results;
+    for (auto& keys : splitList(args["keys"])) {
+        for (auto& dist : splitList(args["dist"])) {
+            for (auto& mode : splitList(args["mode"])) {
+                for (auto& threads : splitList(args["threads"])) {
+                    WorkloadConfig config{dist, std::stoi(threads), std::max(1, std::stoi(keys)), mode != "mutex"};
+                    std::cerr << "running dist=" << dist << " mode=" << mode << " threads=" << threads
+                              << " keys=" << keys << std::endl;
+                    results.push_back(runWorkload(config, opNum, mix, theta, seed));
+                }
+            }
+        }
+    }
+    std::ofstream file;
+    if (!args["out"].empty()) file.open(args["out"]);
+    std::ostream& out = (file.is_open() ? file : std::cout);
+    if (args["format"] == "json") {
+        writeJson(out, args["label"], results);
+    } else if (args["format"] == "csv") {
+        writeCsv(out, results);
+    } else {
+        writeText(out, results);
+    }
+}
+
+// 统计每个线程的堆分配次数（parse模式用来比较每个请求的分配次数）
+static thread_local size_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+// 旧的解析方式：找到第一个:之后逐字符拷贝出每个token（不处理转义），再逐个比较命令名
+static int legacyParse(const std::string& body) {
+    int pos = body.find(':');
+    std::vector<std::string> tokens;
+    std::string token;
+    bool start = false;
+    for (size_t i = pos + 1; i < body.size(); i++) {
+        if (body[i] == '\"') {
+            if (!start) {
+                start = true;
+            } else {
+                tokens.push_back(token);
+                break;
+            }
+        } else if (body[i] == ' ') {
+            if (start) {
+                tokens.push_back(token);
+                token = "";
+            }
+        } else if (start) {
+            token.push_back(body[i]);
+        }
+    }
+    if (tokens.empty()) return -1;
+    static const char* const names[] = {"insert", "incr", "decr", "append", "cas", "setnx", "delete", "search",
+                                        "mget", "mset", "mdel", "size", "memory", "replication", "dump", "dumpstatus"};
+    for (int i = 0; i < 16; i++) {
+        if (tokens[0] == names[i]) return i + static_cast<int>(tokens.size());
+    }
+    return -1;
+}
+
+// 命令解析和分发的耗时以及每个请求的堆分配次数（不包括执行命令）
+static void parse(int argc, char* argv[]) {
+    int rounds = argc > 2 ? std::stoi(argv[2]) : 1000000;
+    const std::vector<std::string> bodies = {
+        R"({"cmd": "search 123456"})",
+        R"({"cmd": "insert 123456 value-of-some-length"})",
+        R"({"cmd": "search 100 200 50 desc"})",
+        R"({"cmd": "mset k1 v1 k2 v2 k3 v3 k4 v4 k5 v5 k6 v6 k7 v7 k8 v8"})",
+        R"({"cmd": "insert key \"quoted\" 60"})",
+        R"({"cmd": ["insert", "key", "value with spaces"]})",
+    };
+    std::vector<std::string_view> tokens;
+    std::string scratch;
+    size_t check = 0;
+    std::cout << "body\tlegacy(ns)\tlegacy(allocs)\tparse(ns)\tparse(allocs)" << std::endl;
+    for (auto& body : bodies) {
+        auto measure = [&](auto&& op) {
+            op(); // 预热，复用的缓冲区在这一次分配
+            size_t before = allocations;
+            auto begin = std::chrono::steady_clock::now();
+            for (int i = 0; i < rounds; i++) op();
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / rounds;
+            return std::make_pair(ns, static_cast<double>(allocations - before) / rounds);
+        };
+        auto legacy = measure([&]() { check += legacyParse(body); });
+        auto current = measure([&]() {
+            if (Command::parse(body, tokens, scratch) && !tokens.empty()) check += Command::lookup(tokens[0]) + tokens.size();
+        });
+        std::cout << body << "\t" << legacy.first << "\t" << legacy.second << "\t" << current.first << "\t" << current.second << std::endl;
+    }
+    std::cerr << "(checksum " << check << ")" << std::endl;
+}
+
+// 启动耗时：先写入一个有序的快照，再分别用逐条插入（每条记录从最高层开始查找插入位置）和
+// ShardedStore::load（并行解析、自底向上批量构建）加载，两次加载之间释放前一个存储
+// 最后把加载的数据重新落盘（各分片并行遍历、归并），测量落盘的耗时
+static void load(int argc, char* argv[]) {
+    long long keyNum = argc > 2 ? std::stoll(argv[2]) : 10000000;
+    int shards = argc > 3 ? std::stoi(argv[3]) : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    int valueLen = argc > 4 ? std::stoi(argv[4]) : 16;
+    const std::string fileName = "benchmark_load.snapshot";
+    {
+        SnapshotWriter writer(fileName);
+        std::string key;
+        std::string value(valueLen, 'v');
+        for (long long i = 0; i < keyNum; i++) {
+            key.clear();
+            KeyTraits<int64_t>::encode(key, i);
+            if (!writer.add(key, value)) break;
+        }
+        if (!writer.finish()) {
+            std::cerr << "写入快照失败" << std::endl;
+            return;
+        }
+    }
+    std::cout << "keys=" << keyNum << " shards=" << shards << " valueLen=" << valueLen << std::endl;
+    std::cout << "method\tseconds\tkeys/s\tsize" << std::endl;
+    auto report = [](const char* method, double seconds, long long keys) {
+        std::cout << method << "\t" << seconds << "\t" << static_cast<long long>(keys / seconds) << "\t" << keys << std::endl;
+    };
+    {
+        ShardedStore<int64_t> store(shards, keyNum);
+        auto begin = std::chrono::steady_clock::now();
+        SnapshotReader reader;
+        int64_t k;
+        if (reader.open(fileName)) {
+            reader.forEach([&store, &k](std::string_view key, std::string_view value, uint32_t expire) {
+                if (KeyTraits<int64_t>::decode(key, k)) store.insertElement(k, value, expire);
+            });
+        }
+        report("insert", std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count(), store.size());
+    }
+    {
+        ShardedStore<int64_t> store(shards, keyNum);
+        auto begin = std::chrono::steady_clock::now();
+        store.load(fileName, [](uint64_t loaded, uint64_t total) {
+            static auto last = std::chrono::steady_clock::now();
+            auto now = std::chrono::steady_clock::now();
+            if (now - last < std::chrono::seconds(1)) return;
+            last = now;
+            std::cerr << "loaded " << loaded << "/" << total << std::endl;
+        });
+        report("bulk", std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count(), store.size());
+        begin = std::chrono::steady_clock::now();
+        if (!store.dump(fileName)) std::cerr << "落盘失败" << std::endl;
+        report("dump", std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count(), store.size());
+    }
+    unlink(fileName.c_str());
+}
+
+int main(int argc, char* argv[]) {
+    std::string mode = argc > 1 ? argv[1] : "throughput";
+    if (mode == "lookup") {
+        lookup(argc, argv);
+    } else if (mode == "batch") {
+        batch(argc, argv);
+    } else if (mode == "sharded") {
+        sharded(argc, argv);
+    } else if (mode == "workload") {
+        workload(argc, argv);
+    } else if (mode == "parse") {
+        parse(argc, argv);
+    } else if (mode == "load") {
+        load(argc, argv);
+    } else if (mode == "throughput") {
+        throughput(argc, argv);
+    } else {
+        std::cout << "用法: ./benchmark throughput [最大线程数] [key数量] [每线程操作数] [读比例(%)]" << std::endl;
+        std::cout << "      ./benchmark lookup [key数量] [查询次数] [value长度] [int|string|fixed16]" << std::endl;
+        std::cout << "      ./benchmark sharded [最大线程数] [分片数] [每线程写入数]" << std::endl;
+        std::cout << "      ./benchmark batch [key数量] [每批key数] [批数]" << std::endl;
+        std::cout << "      ./benchmark workload [dist=uniform,zipf,sequential,latest] [mode=concurrent,mutex] [threads=1,2,4,8]" << std::endl;
+        std::cout << "                           [keys=1000000] [ops=200000] [insert=5] [delete=5] [all=0] [theta=0.99] [seed=1]" << std::endl;
+        std::cout << "                           [format=text|csv|json] [out=文件] [label=名称]" << std::endl;
+        std::cout << "      ./benchmark parse [每种请求的次数]" << std::endl;
+        std::cout << "      ./benchmark load [key数量] [分片数] [value长度]" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include "Coding.h"
+
+void putFixed32(std::string& dst, uint32_t value) {
+    char buf[4];
+    for (int i = 0; i < 4; i++) {
+        buf[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+    dst.append(buf, 4);
+}
+
+void putFixed64(std::string& dst, uint64_t value) {
+    char buf[8];
+    for (int i = 0; i < 8; i++) {
+        buf[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+    dst.append(buf, 8);
+}
+
+uint32_t decodeFixed32(const char* ptr) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(ptr);
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+uint64_t decodeFixed64(const char* ptr) {
+    return static_cast<uint64_t>(decodeFixed32(ptr)) | (static_cast<uint64_t>(decodeFixed32(ptr + 4)) << 32);
+}
+
+// 查表法计算CRC32C（slicing-by-8：每次处理8个字节），表在第一次使用时生成
+// table[k][i]为字节i后面再跟k个0字节的CRC，8个字节的CRC可以由8次相互独立的查表异或得到
+static const uint32_t (*crcTable())[256] {
+    static uint32_t table[8][256];
+    static bool init = [](){
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int j = 0; j < 8; j++) {
+                c = (c & 1) ? (0x82f63b78 ^ (c >> 1)) : (c >> 1);
+            }
+            table[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int k = 1; k < 8; k++) {
+                table[k][i] = table[0][table[k - 1][i] & 0xff] ^ (table[k - 1][i] >> 8);
+            }
+        }
+        return true;
+    }();
+    (void)init;
+    return table;
+}
+
+uint32_t crc32c(const char* data, size_t len, uint32_t crc) {
+    const uint32_t (*table)[256] = crcTable();
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for (; len >= 8; len -= 8, p += 8) {
+        uint32_t lo = crc ^ decodeFixed32(reinterpret_cast<const char*>(p));
+        uint32_t hi = decodeFixed32(reinterpret_cast<const char*>(p + 4));
+        crc = table[7][lo & 0xff] ^ table[6][(lo >> 8) & 0xff] ^ table[5][(lo >> 16) & 0xff] ^ table[4][lo >> 24] ^
+              table[3][hi & 0xff] ^ table[2][(hi >> 8) & 0xff] ^ table[1][(hi >> 16) & 0xff] ^ table[0][hi >> 24];
+    }
+    for (; len > 0; len--, p++) {
+        crc = table[0][(crc ^ *p) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
@@ -0,0 +1,19 @@
+#ifndef CODING
+#define CODING
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// 定长整数的编解码（统一使用小端序）以及校验和
+// WAL和快照文件中的所有整数都使用这里的函数读写
+
+void putFixed32(std::string& dst, uint32_t value); // 在dst末尾追加4字节
+void putFixed64(std::string& dst, uint64_t value); // 在dst末尾追加8字节
+uint32_t decodeFixed32(const char* ptr);
+uint64_t decodeFixed64(const char* ptr);
+
+// CRC32C（Castagnoli多项式），crc为之前数据的校验和，用于分段计算
+uint32_t crc32c(const char* data, size_t len, uint32_t crc = 0);
+
+#endif
@@ -0,0 +1,237 @@
+#include "Command.h"
+
+namespace {
+
+// 递归下降的json解析器，只解码cmd字段，其余字段只检查格式并跳过
+struct Parser {
+    const char* p;
+    const char* end;
+    std::vector<std::string_view>& tokens;
+    std::string& scratch;
+
+    void skipSpace() {
+        while (this->p < this->end && (*this->p == ' ' || *this->p == '\t' || *this->p == '\n' || *this->p == '\r')) this->p++;
+    }
+    bool consume(char c) {
+        this->skipSpace();
+        if (this->p < this->end && *this->p == c) {
+            this->p++;
+            return true;
+        }
+        return false;
+    }
+    bool hex4(uint32_t& value) {
+        if (this->end - this->p < 4) return false;
+        auto result = std::from_chars(this->p, this->p + 4, value, 16);
+        if (result.ptr != this->p + 4) return false;
+        this->p += 4;
+        return true;
+    }
+    void utf8(uint32_t c) {
+        if (c < 0x80) {
+            this->scratch.push_back(static_cast<char>(c));
+        } else if (c < 0x800) {
+            this->scratch.push_back(static_cast<char>(0xC0 | (c >> 6)));
+            this->scratch.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+        } else if (c < 0x10000) {
+            this->scratch.push_back(static_cast<char>(0xE0 | (c >> 12)));
+            this->scratch.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+            this->scratch.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+        } else {
+            this->scratch.push_back(static_cast<char>(0xF0 | (c >> 18)));
+            this->scratch.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+            this->scratch.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+            this->scratch.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+        }
+    }
+    // 解码一个转义序列（p指向\之后的字符），追加到scratch
+    bool unescape() {
+        if (this->p >= this->end) return false;
+        char c = *this->p++;
+        switch (c) {
+            case '"': case '\\': case '/': this->scratch.push_back(c); return true;
+            case 'b': this->scratch.push_back('\b'); return true;
+            case 'f': this->scratch.push_back('\f'); return true;
+            case 'n': this->scratch.push_back('\n'); return true;
+            case 'r': this->scratch.push_back('\r'); return true;
+            case 't': this->scratch.push_back('\t'); return true;
+            case 'u': {
+                uint32_t code = 0;
+                if (!this->hex4(code) || (code >= 0xDC00 && code < 0xE000)) return false;
+                if (code >= 0xD800 && code < 0xDC00) { // 代理对
+                    uint32_t low = 0;
+                    if (this->end - this->p < 2 || this->p[0] != '\\' || this->p[1] != 'u') return false;
+                    this->p += 2;
+                    if (!this->hex4(low) || low < 0xDC00 || low >= 0xE000) return false;
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                this->utf8(code);
+                return true;
+            }
+            default: return false;
+        }
+    }
+    // 解析字符串的内容（p指向开始的"之后），split为true时按空格切分为多个token，否则整个字符串是一个token
+    // token中出现转义之前直接指向body；遇到第一个转义时把已经扫描的部分拷贝到scratch，之后的内容都解码到scratch
+    bool string(bool split) {
+        bool inToken = !split; // 不切分时空字符串也是一个token
+        bool escaped = false; // 当前token是否已经转移到scratch中
+        const char* start = this->p; // 当前token在body中的起点
+        size_t from = 0; // 当前token在scratch中的起点
+        auto finish = [&]() {
+            if (!inToken) return;
+            if (escaped) this->tokens.emplace_back(this->scratch.data() + from, this->scratch.size() - from);
+            else this->tokens.emplace_back(start, this->p - start);
+            inToken = escaped = false;
+        };
+        while (this->p < this->end) {
+            char c = *this->p;
+            if (c == '"') {
+                finish();
+                this->p++;
+                return true;
+            }
+            if (static_cast<unsigned char>(c) < 0x20) return false; // json不允许未转义的控制字符
+            if (c == ' ' && split) {
+                finish();
+                this->p++;
+                continue;
+            }
+            if (!inToken) {
+                inToken = true;
+                start = this->p;
+            }
+            if (c == '\\') {
+                if (!escaped) {
+                    from = this->scratch.size();
+                    this->scratch.append(start, this->p - start);
+                    escaped = true;
+                }
+                this->p++;
+                if (!this->unescape()) return false;
+                continue;
+            }
+            if (escaped) this->scratch.push_back(c);
+            this->p++;
+        }
+        return false; // 没有结束的"
+    }
+    // 跳过一个任意的json值
+    bool skipValue() {
+        this->skipSpace();
+        if (this->p >= this->end) return false;
+        if (*this->p == '"') {
+            for (this->p++; this->p < this->end && *this->p != '"'; this->p++) {
+                if (*this->p == '\\') this->p++;
+            }
+            if (this->p >= this->end) return false;
+            this->p++;
+            return true;
+        }
+        if (*this->p == '{' || *this->p == '[') { // 嵌套的对象或数组：匹配括号（跳过其中的字符串）
+            int depth = 0;
+            while (this->p < this->end) {
+                char c = *this->p;
+                if (c == '"') {
+                    if (!this->skipValue()) return false;
+                    continue;
+                }
+                if (c == '{' || c == '[') depth++;
+                else if ((c == '}' || c == ']') && --depth == 0) {
+                    this->p++;
+                    return true;
+                }
+                this->p++;
+            }
+            return false;
+        }
+        // 数字、true、false、null
+        const char* start = this->p;
+        while (this->p < this->end && *this->p != ',' && *this->p != '}' && *this->p != ']' &&
+               *this->p != ' ' && *this->p != '\t' && *this->p != '\n' && *this->p != '\r') this->p++;
+        return this->p > start;
+    }
+    // 解析cmd字段的值：字符串或者字符串数组
+    bool command() {
+        if (this->consume('"')) return this->string(true);
+        if (!this->consume('[')) return false;
+        if (this->consume(']')) return true;
+        do {
+            if (!this->consume('"') || !this->string(false)) return false;
+        } while (this->consume(','));
+        return this->consume(']');
+    }
+};
+
+constexpr uint32_t hash(std::string_view name) {
+    uint32_t h = 2166136261u;
+    for (char c : name) {
+        h ^= static_cast<uint8_t>(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// 下标为命令编号
+const std::string_view names[] = {
+    "", "insert", "incr", "decr", "append", "cas", "setnx", "delete", "mset", "mdel",
+    "search", "mget", "size", "memory", "replication", "dump", "dumpstatus"
+};
+
+}
+
+namespace Command {
+
+bool parse(std::string_view body, std::vector<std::string_view>& tokens, std::string& scratch) {
+    tokens.clear();
+    scratch.clear();
+    scratch.reserve(body.size()); // 解码后的内容不会比body长，保证已有的token不会因为重新分配而失效
+    Parser parser{body.data(), body.data() + body.size(), tokens, scratch};
+    if (!parser.consume('{')) return false;
+    bool found = false;
+    do {
+        if (!parser.consume('"')) return false;
+        const char* start = parser.p;
+        while (parser.p < parser.end && *parser.p != '"') {
+            if (*parser.p == '\\') parser.p++;
+            parser.p++;
+        }
+        if (parser.p >= parser.end) return false;
+        std::string_view key(start, parser.p - start);
+        parser.p++;
+        if (!parser.consume(':')) return false;
+        if (key == "cmd" && !found) {
+            found = true;
+            if (!parser.command()) return false;
+        } else if (!parser.skipValue()) {
+            return false;
+        }
+    } while (parser.consume(','));
+    return found && parser.consume('}');
+}
+
+Id lookup(std::string_view name) {
+    Id id;
+    switch (hash(name)) {
+        case hash("insert"): id = INSERT; break;
+        case hash("incr"): id = INCR; break;
+        case hash("decr"): id = DECR; break;
+        case hash("append"): id = APPEND; break;
+        case hash("cas"): id = CAS; break;
+        case hash("setnx"): id = SETNX; break;
+        case hash("delete"): id = DELETE; break;
+        case hash("mset"): id = MSET; break;
+        case hash("mdel"): id = MDEL; break;
+        case hash("search"): id = SEARCH; break;
+        case hash("mget"): id = MGET; break;
+        case hash("size"): id = SIZE; break;
+        case hash("memory"): id = MEMORY; break;
+        case hash("replication"): id = REPL; break;
+        case hash("dump"): id = DUMP; break;
+        case hash("dumpstatus"): id = DUMPSTATUS; break;
+        default: return UNKNOWN;
+    }
+    return name == names[id] ? id : UNKNOWN; // 排除哈希值相同的其它字符串
+}
+
+}
@@ -0,0 +1,69 @@
+#ifndef COMMAND
+#define COMMAND
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <charconv>
+#include <cstdint>
+
+// 命令的解析和分发
+// 请求体是json对象，cmd字段为命令，有两种形式：
+//   {"cmd": "insert k v"}              字符串按空格切分（转义得到的空白符，例如\t，属于token本身，不用于切分）
+//   {"cmd": ["insert", "k", "a b"]}    数组的每个元素是一个token，value中可以包含空格
+// 字符串中的转义（\"、\\、\n、\uXXXX等）按照json的规则解码
+namespace Command {
+    enum Id {
+        UNKNOWN,
+        INSERT, INCR, DECR, APPEND, CAS, SETNX, DELETE, MSET, MDEL, // 写命令
+        SEARCH, MGET, SIZE, MEMORY, REPL, DUMP, DUMPSTATUS
+    };
+
+    // 解析请求体，成功时tokens为命令的各个部分：没有转义字符的token直接指向body，
+    // 其余token解码到scratch中（scratch预留body大小的空间，解析过程中不会重新分配）
+    // tokens和scratch可以在多次调用之间复用，避免重复分配内存
+    bool parse(std::string_view body, std::vector<std::string_view>& tokens, std::string& scratch);
+
+    // 命令名到编号的映射：对命令名做FNV-1a哈希后switch，哈希冲突时编译失败（case重复），因此是完美哈希
+    Id lookup(std::string_view name);
+    inline bool isWrite(Id id) {
+        return id >= INSERT && id <= MDEL;
+    }
+
+    // 整个字符串都必须是合法的十进制整数（不允许前导的+和空白符）
+    template<typename T>
+    bool toInt(std::string_view text, T& value) {
+        auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        return !text.empty() && result.ec == std::errc() && result.ptr == text.data() + text.size();
+    }
+
+    // 将text按json字符串的规则转义后追加到out（不包括两侧的引号）
+    // Out可以是std::string或者Processor::Output，需要支持append(data, len)、push_back和+=
+    template<typename Out>
+    void escape(Out& out, std::string_view text) {
+        static const char* digits = "0123456789abcdef";
+        size_t start = 0;
+        for (size_t i = 0; i < text.size(); i++) {
+            unsigned char c = static_cast<unsigned char>(text[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') continue;
+            out.append(text.data() + start, i - start); // 批量追加不需要转义的部分
+            switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                case '\b': out += "\\b"; break;
+                case '\f': out += "\\f"; break;
+                default:
+                    out += "\\u00";
+                    out.push_back(digits[c >> 4]);
+                    out.push_back(digits[c & 0xF]);
+            }
+            start = i + 1;
+        }
+        out.append(text.data() + start, text.size() - start);
+    }
+}
+
+#endif
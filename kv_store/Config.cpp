@@ -0,0 +1,23 @@
+#include "Config.h"
+#include <fstream>
+
+std::unordered_map<std::string,std::string> parseIni(const std::string& fileName,
+    const std::unordered_map<std::string,std::string>& defaults) {
+    std::unordered_map<std::string,std::string> config(defaults);
+    std::ifstream file;
+    file.open(fileName, std::ios::in);
+    if (!file.is_open()) {
+        return config;
+    }
+    // 逐行读取配置文件并解析
+    std::string buf;
+    while (getline(file, buf)) {
+        if (!buf.empty() && buf.back() == '\r') buf.pop_back(); // 兼容\r\n换行
+        if (buf.empty() || buf[0] == '#') continue; // 跳过空行和注释行
+        size_t index = buf.find('=');
+        if (index == std::string::npos) continue;
+        config[buf.substr(0, index)] = buf.substr(index + 1);
+    }
+    file.close();
+    return config;
+}
@@ -0,0 +1,12 @@
+#ifndef CONFIG
+#define CONFIG
+
+#include <string>
+#include <unordered_map>
+
+// 解析ini配置文件（格式与http_server的config.ini相同：以#开头的行为注释行，键值对以 键=值 的形式写出）
+// defaults中为各配置项的默认值，配置文件中出现的配置项会覆盖默认值；配置文件不存在时直接返回默认值
+std::unordered_map<std::string,std::string> parseIni(const std::string& fileName,
+    const std::unordered_map<std::string,std::string>& defaults);
+
+#endif
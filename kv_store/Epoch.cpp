@@ -0,0 +1,99 @@
+#include "Epoch.h"
+#include <mutex>
+#include <cstdlib>
+#include <iostream>
+#include <pthread.h>
+
+// 线程编号：每个线程在所有回收器中使用相同编号的槽位
+// 线程退出时归还编号，保证反复创建线程时编号不会耗尽
+static std::mutex idLock;
+static std::vector<int> freeIds;
+static int nextId=0;
+static std::atomic<int> maxId{0}; // 曾经分配过的最大编号+1，回收时只需扫描[0,maxId)
+
+// fork时其他线程可能正持有idLock，子进程中该锁将永远无法被释放
+// 因此在fork前获取该锁，fork后在父子进程中分别释放，保证子进程（例如后台落盘）可以正常使用回收器
+static int atFork=pthread_atfork(
+    [](){idLock.lock();},
+    [](){idLock.unlock();},
+    [](){idLock.unlock();});
+
+struct ThreadId{
+    int id;
+    ThreadId(){
+        std::unique_lock<std::mutex> lock(idLock);
+        if(!freeIds.empty()){
+            id=freeIds.back();
+            freeIds.pop_back();
+        }else{
+            id=nextId++;
+            if(id>=Epoch::MAX_THREADS){
+                std::cerr<<"Epoch: 线程数量超过"<<Epoch::MAX_THREADS<<std::endl;
+                std::abort();
+            }
+            maxId.store(nextId);
+        }
+    }
+    ~ThreadId(){
+        std::unique_lock<std::mutex> lock(idLock);
+        freeIds.push_back(id);
+    }
+};
+
+static int threadId(){
+    static thread_local ThreadId tid;
+    return tid.id;
+}
+
+// 每摘除多少个对象尝试回收一次
+static const size_t COLLECT_INTERVAL=64;
+
+Epoch::~Epoch(){
+    for(int i=0;i<MAX_THREADS;i++){
+        for(auto& r:slots[i].retired){
+            r.deleter(r.context,r.ptr);
+        }
+        slots[i].retired.clear();
+    }
+}
+
+void Epoch::enter(){
+    Slot& slot=slots[threadId()];
+    if(slot.depth++==0){
+        // 记录进入临界区时的全局纪元（seq_cst保证之后对共享结构的访问不会被重排到该写操作之前）
+        slot.epoch.store(globalEpoch.load());
+    }
+}
+
+void Epoch::exit(){
+    Slot& slot=slots[threadId()];
+    if(--slot.depth==0){
+        slot.epoch.store(0);
+    }
+}
+
+void Epoch::retire(void* ptr,void (*deleter)(void*,void*),void* context){
+    Slot& slot=slots[threadId()];
+    slot.retired.push_back({ptr,deleter,context,globalEpoch.load()});
+    if(slot.retired.size()%COLLECT_INTERVAL==0){
+        collect(slot);
+    }
+}
+
+void Epoch::collect(Slot& slot){
+    // 推进全局纪元，之后进入临界区的线程都无法再访问到此前摘除的对象
+    uint64_t minEpoch=globalEpoch.fetch_add(1)+1;
+    int n=maxId.load();
+    for(int i=0;i<n;i++){
+        uint64_t e=slots[i].epoch.load();
+        if(e!=0&&e<minEpoch)minEpoch=e;
+    }
+    // 能访问到对象的线程一定在对象被摘除之前（或同一纪元内）进入临界区
+    // 因此摘除纪元小于所有活跃线程进入纪元的对象可以安全释放
+    // retired中的对象按摘除纪元递增排列，只需释放前缀
+    size_t i=0;
+    for(;i<slot.retired.size()&&slot.retired[i].epoch<minEpoch;i++){
+        slot.retired[i].deleter(slot.retired[i].context,slot.retired[i].ptr);
+    }
+    slot.retired.erase(slot.retired.begin(),slot.retired.begin()+i);
+}
@@ -0,0 +1,60 @@
+#ifndef EPOCH
+#define EPOCH
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+// 基于纪元（epoch）的内存回收
+// 无锁跳表中，一个结点被摘除后，可能仍有其他线程正在访问它，因此不能立即delete
+// 线程在访问共享结构前进入临界区（记录进入时的全局纪元），被摘除的对象先挂到回收列表上（记录摘除时的全局纪元）
+// 只有当所有仍处于临界区的线程进入的纪元都大于对象被摘除时的纪元时，才能真正释放该对象
+class Epoch{
+public:
+    Epoch() = default;
+    ~Epoch(); // 析构时释放所有尚未回收的对象（此时不应再有线程访问）
+
+    void enter(); // 进入临界区（支持嵌套）
+    void exit(); // 退出临界区
+    // 将已经摘除的对象交给回收器，释放时调用deleter(context,ptr)
+    void retire(void* ptr,void (*deleter)(void*,void*),void* context=nullptr);
+    template<typename T>
+    void retire(T* ptr){
+        retire(ptr,[](void*,void* p){delete static_cast<T*>(p);});
+    }
+
+    Epoch(const Epoch&) = delete; // 禁用拷贝构造函数
+    Epoch& operator=(const Epoch&) = delete; // 禁用赋值运算符
+
+    static const int MAX_THREADS=256; // 同时访问同一个回收器的最大线程数
+private:
+    struct Retired{
+        void* ptr; // 待回收对象
+        void (*deleter)(void*,void*); // 释放函数
+        void* context; // 释放函数的上下文（例如对象所属的分配器）
+        uint64_t epoch; // 对象被摘除时的全局纪元
+    };
+    // 每个线程独占一个槽位，按缓存行对齐，避免伪共享
+    struct alignas(64) Slot{
+        std::atomic<uint64_t> epoch{0}; // 线程进入临界区时的纪元，0表示不在临界区中
+        int depth=0; // 临界区嵌套深度（只有槽位的所属线程访问）
+        std::vector<Retired> retired; // 该线程摘除的待回收对象（只有槽位的所属线程访问）
+    };
+    void collect(Slot& slot); // 回收slot中可以安全释放的对象
+
+    std::atomic<uint64_t> globalEpoch{1}; // 全局纪元
+    Slot slots[MAX_THREADS];
+};
+
+// 利用RAII进入和退出临界区
+class EpochGuard{
+public:
+    explicit EpochGuard(Epoch& epoch):epoch(epoch){epoch.enter();}
+    ~EpochGuard(){epoch.exit();}
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+private:
+    Epoch& epoch;
+};
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef KEYTRAITS
+#define KEYTRAITS
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+#include <charconv>
+#include <stdexcept>
+#include <functional>
+#include "Coding.h"
+
+// 跳表key的类型特征，描述某种key在结点中如何保存、如何比较、如何编码
+// Arg：接口中传递key使用的类型（字符串key为string_view，避免拷贝）
+// Slot：结点头中保存的部分；变长key的数据紧跟在结点的forward塔之后，占extraSize字节
+// Probe：查找前预先处理好的key（例如字符串key的前缀），一次查找只计算一次
+// 快照中的key使用encode编码；WAL和命令层使用toString/parse转换的文本形式
+template<typename Key>
+struct KeyTraits;
+
+// 64位整数key：结点中直接保存整数，比较只需一条指令
+template<>
+struct KeyTraits<int64_t> {
+    using Arg = int64_t;
+    using Slot = int64_t;
+    using Probe = int64_t;
+
+    static size_t extraSize(Arg) { return 0; }
+    static size_t slotExtra(const Slot&) { return 0; }
+    static void store(Slot& slot, char*, Arg key) { slot = key; }
+    static Arg load(const Slot& slot, const char*) { return slot; }
+    static Probe probe(Arg key) { return key; }
+    static bool less(const Slot& slot, const char*, const Probe& key) { return slot < key; }
+    static bool equal(const Slot& slot, const char*, const Probe& key) { return slot == key; }
+    static bool keyLess(Arg a, Arg b) { return a < b; }
+    static uint64_t hash(Arg key) { return static_cast<uint64_t>(key); }
+
+    static void encode(std::string& dst, Arg key) { putFixed64(dst, static_cast<uint64_t>(key)); }
+    static bool decode(std::string_view src, int64_t& key) {
+        if (src.size() == 8) {
+            key = static_cast<int64_t>(decodeFixed64(src.data()));
+        } else if (src.size() == 4) { // 旧版本快照中的32位key
+            key = static_cast<int32_t>(decodeFixed32(src.data()));
+        } else return false;
+        return true;
+    }
+    static std::string toString(Arg key) { return std::to_string(key); }
+    // 整个字符串都必须是合法的十进制整数，否则抛出异常（与std::stoi一致）
+    static int64_t parse(std::string_view text) {
+        int64_t key = 0;
+        auto result = std::from_chars(text.data(), text.data() + text.size(), key);
+        if (result.ec == std::errc::result_out_of_range) throw std::out_of_range("key out of range");
+        if (result.ec != std::errc() || result.ptr != text.data() + text.size()) throw std::invalid_argument("invalid key");
+        return key;
+    }
+};
+
+// 定长的字节串key，按字节序比较
+template<size_t N>
+struct FixedKey {
+    char bytes[N];
+};
+
+template<size_t N>
+struct KeyTraits<FixedKey<N>> {
+    using Arg = const FixedKey<N>&;
+    using Slot = FixedKey<N>;
+    using Probe = FixedKey<N>;
+
+    static size_t extraSize(Arg) { return 0; }
+    static size_t slotExtra(const Slot&) { return 0; }
+    static void store(Slot& slot, char*, Arg key) { slot = key; }
+    static Arg load(const Slot& slot, const char*) { return slot; }
+    static Probe probe(Arg key) { return key; }
+    static bool less(const Slot& slot, const char*, const Probe& key) { return memcmp(slot.bytes, key.bytes, N) < 0; }
+    static bool equal(const Slot& slot, const char*, const Probe& key) { return memcmp(slot.bytes, key.bytes, N) == 0; }
+    static bool keyLess(Arg a, Arg b) { return memcmp(a.bytes, b.bytes, N) < 0; }
+    static uint64_t hash(Arg key) { return std::hash<std::string_view>()(std::string_view(key.bytes, N)); }
+
+    static void encode(std::string& dst, Arg key) { dst.append(key.bytes, N); }
+    static bool decode(std::string_view src, FixedKey<N>& key) {
+        if (src.size() != N) return false;
+        memcpy(key.bytes, src.data(), N);
+        return true;
+    }
+    static std::string_view text(Arg key) { // 去掉parse时补的0
+        size_t len = N;
+        while (len > 0 && key.bytes[len - 1] == 0) len--;
+        return std::string_view(key.bytes, len);
+    }
+    static std::string toString(Arg key) { return std::string(text(key)); }
+    static FixedKey<N> parse(std::string_view text) { // 不足N字节时补0，超过N字节时抛出异常
+        if (text.size() > N) throw std::out_of_range("key too long");
+        FixedKey<N> key{};
+        memcpy(key.bytes, text.data(), text.size());
+        return key;
+    }
+};
+
+// 变长字符串key：结点头中保存前8个字节（按大端序拼成整数，不足8字节补0）和长度，完整的key紧跟在forward塔之后
+// 比较时先比较前缀，前缀不同即可得出结果，只有前缀相同时才需要访问完整的key
+struct StringSlot {
+    uint64_t prefix;
+    uint32_t len;
+};
+
+struct StringProbe {
+    uint64_t prefix;
+    std::string_view key;
+};
+
+template<>
+struct KeyTraits<std::string> {
+    using Arg = std::string_view;
+    using Slot = StringSlot;
+    using Probe = StringProbe;
+
+    static uint64_t prefixOf(std::string_view key) {
+        uint64_t prefix = 0;
+        for (size_t i = 0; i < 8; i++) {
+            prefix = (prefix << 8) | (i < key.size() ? static_cast<unsigned char>(key[i]) : 0);
+        }
+        return prefix;
+    }
+    static size_t extraSize(Arg key) { return key.size(); }
+    static size_t slotExtra(const Slot& slot) { return slot.len; }
+    static void store(Slot& slot, char* extra, Arg key) {
+        slot.prefix = prefixOf(key);
+        slot.len = static_cast<uint32_t>(key.size());
+        memcpy(extra, key.data(), key.size());
+    }
+    static Arg load(const Slot& slot, const char* extra) { return std::string_view(extra, slot.len); }
+    static Probe probe(Arg key) { return {prefixOf(key), key}; }
+    static bool less(const Slot& slot, const char* extra, const Probe& key) {
+        if (slot.prefix != key.prefix) return slot.prefix < key.prefix;
+        return std::string_view(extra, slot.len) < key.key;
+    }
+    static bool equal(const Slot& slot, const char* extra, const Probe& key) {
+        return slot.prefix == key.prefix && std::string_view(extra, slot.len) == key.key;
+    }
+    static bool keyLess(Arg a, Arg b) { return a < b; }
+    static uint64_t hash(Arg key) { return std::hash<std::string_view>()(key); }
+
+    static void encode(std::string& dst, Arg key) { dst.append(key.data(), key.size()); }
+    static bool decode(std::string_view src, std::string& key) {
+        key.assign(src.data(), src.size());
+        return true;
+    }
+    static std::string toString(Arg key) { return std::string(key); }
+    static std::string parse(std::string_view text) { return std::string(text); }
+};
+
+#endif
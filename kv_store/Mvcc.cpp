@@ -0,0 +1,48 @@
+#include "Mvcc.h"
+#include <thread>
+#include <pthread.h>
+
+// 在子进程中设置，之后读者不再等待fork时正在提交的版本
+static bool forkedChild=false;
+static int atFork=pthread_atfork(nullptr,nullptr,[](){forkedChild=true;});
+
+bool Mvcc::forked(){
+    return forkedChild;
+}
+
+uint64_t Mvcc::acquire(){
+    // 先增加活跃数量再取序号：写入线程在取得提交序号之后检查oldest()，
+    // 要么看到这个快照（或者正在创建的快照），要么它的提交序号小于快照的序号（对快照可见）
+    this->active++;
+    uint64_t snapshot=this->seq.fetch_add(1)+1;
+    while(true){
+        for(auto& slot:this->slots){
+            uint64_t expected=0;
+            if(slot.load()==0&&slot.compare_exchange_strong(expected,snapshot)) return snapshot;
+        }
+        std::this_thread::yield();
+    }
+}
+
+void Mvcc::release(uint64_t snapshot){
+    for(auto& slot:this->slots){
+        uint64_t expected=snapshot;
+        if(slot.compare_exchange_strong(expected,0)) break;
+    }
+    this->active--;
+}
+
+uint64_t Mvcc::oldest() const{
+    int active=this->active.load();
+    if(active==0) return UINT64_MAX;
+    uint64_t result=UINT64_MAX;
+    int registered=0;
+    for(auto& slot:this->slots){
+        uint64_t snapshot=slot.load();
+        if(snapshot==0) continue;
+        registered++;
+        if(snapshot<result) result=snapshot;
+    }
+    // 有快照已经计入活跃数量但还没有登记，它的序号可能更小
+    return registered<active?0:result;
+}
@@ -0,0 +1,55 @@
+#ifndef MVCC
+#define MVCC
+
+#include <atomic>
+#include <cstdint>
+
+// 多版本并发控制：全局提交序号和活跃的快照
+// 每次写入生成一个新版本，版本的提交序号为写入完成（新版本已经链接）之后读到的全局序号，旧版本挂在新版本之后
+// 创建快照时全局序号加1，快照的序号为加1之后的值：提交序号小于快照序号的版本对快照可见，其余版本对快照不可见
+// 写入只读取全局序号，只有创建快照时才修改它，因此没有快照时写入不会在同一个缓存行上竞争
+// 快照登记在固定数量的槽位中，创建和释放都不加锁（fork出的子进程中也可以使用）
+class Mvcc{
+public:
+    Mvcc() = default;
+
+    uint64_t now() const{ // 写入完成后读取的提交序号
+        return this->seq.load();
+    }
+    uint64_t acquire(); // 创建快照，返回快照的序号
+    void release(uint64_t snapshot); // 释放快照
+    bool idle() const{ // 没有活跃的（包括正在创建的）快照
+        return this->active.load()==0;
+    }
+    // 最早的活跃快照的序号，提交序号小于它的最新版本之前的版本不再被任何快照需要；没有快照时返回UINT64_MAX
+    // 有快照正在创建时返回0（保守地认为所有版本都被需要）
+    uint64_t oldest() const;
+    // 当前进程是否是fork出的子进程（后台落盘）：子进程中只有调用fork的线程，fork时还没有取得提交序号的版本永远不会提交
+    static bool forked();
+
+    Mvcc(const Mvcc&) = delete; // 禁用拷贝构造函数
+    Mvcc& operator=(const Mvcc&) = delete; // 禁用赋值运算符
+
+    static const int MAX_SNAPSHOTS=64; // 同时活跃的最大快照数量，超过时创建快照需要等待
+private:
+    std::atomic<uint64_t> seq{0}; // 全局序号
+    std::atomic<int> active{0}; // 活跃的快照数量（在登记到槽位之前增加，从槽位注销之后减少）
+    std::atomic<uint64_t> slots[MAX_SNAPSHOTS]={}; // 快照的序号，0表示空闲
+};
+
+// 利用RAII持有快照：持有期间读到的是创建快照时刻的一致视图
+class ReadView{
+public:
+    explicit ReadView(Mvcc& mvcc):mvcc(mvcc),snapshot(mvcc.acquire()){}
+    ~ReadView(){mvcc.release(snapshot);}
+    uint64_t seq() const{
+        return snapshot;
+    }
+    ReadView(const ReadView&) = delete;
+    ReadView& operator=(const ReadView&) = delete;
+private:
+    Mvcc& mvcc;
+    uint64_t snapshot;
+};
+
+#endif
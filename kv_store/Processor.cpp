@@ -1,13 +1,471 @@
 #include "Processor.h"
-#include "SkipList.h"
+#include "Store.h"
+#include "Wal.h"
+#include "Replication.h"
+#include "Config.h"
+#include "Coding.h"
+#include "Command.h"
 #include <memory>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+#include <thread>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/wait.h>
 
 static std::shared_ptr<Processor> processor=nullptr;
 static std::mutex mutex;
-static SkipList* skipList;
+static Store* store; // 分片存储，每个分片是一个独立的跳表
+static Wal* wal=nullptr; // 预写日志，未开启时为nullptr
+static Primary* primary=nullptr; // 主从复制的主节点，没有配置replicationPort时为nullptr
+static Replica* replica=nullptr; // 主从复制的副本（只读），没有配置replicaOf时为nullptr
+static std::unordered_map<std::string,std::string> config; // 存储引擎配置
+
+// 写操作的分段锁：同一个key的修改和追加日志在同一把锁内完成，保证日志中的顺序与修改顺序一致
+// 不同分段的写操作仍然可以并发执行，读操作不加锁
+static const int STRIPES=64;
+static std::mutex stripes[STRIPES];
+
+// key必须是规范形式，保证同一个key总是对应同一把锁
+static std::mutex& stripe(const std::string& key){
+    return stripes[std::hash<std::string>()(key)%STRIPES];
+}
+
+static std::atomic<uint64_t> expiredKeys{0}; // 过期删除的key数量
+
+// 删除已过期的key（key为规范形式）：持有分段锁，保证不会删掉并发写入的新value
+// 过期删除不写日志：回放时已经过期的PUT_TTL记录本身就会被丢弃
+static void expireKey(const std::string& key){
+    std::unique_lock<std::mutex> lock(stripe(key));
+    if(store->expire(key)==0) expiredKeys++;
+}
+
+// 修改日志同时写入WAL和复制的积压缓冲区，调用时必须持有key的分段锁（保证两者中的顺序都与修改顺序一致）
+// 追加一条记录，返回WAL的lsn（没有开启WAL时返回0）
+static uint64_t logRecord(Wal::RecordType type, const std::string& key, const std::string& value){
+    if(primary) primary->append(type, key, value);
+    return wal?wal->append(type, key, value):0;
+}
+
+// 批量追加同类型的记录，返回最后一条记录的lsn
+static uint64_t logRecords(Wal::RecordType type, const std::vector<std::pair<std::string_view,std::string_view>>& records){
+    if(primary) primary->append(type, records);
+    return wal?wal->append(type, records):0;
+}
+
+// 按照刷盘策略等待lsn及之前的日志持久化；WAL写入失败时抛出异常，命令返回500（修改已经作用于内存，但不保证持久化）
+static void syncLog(uint64_t lsn){
+    if(wal&&!wal->sync(lsn)) throw std::runtime_error("WAL写入失败");
+}
+
+// 追加一条写入记录；expire不为0时写入带过期时间的记录（value前加4字节的过期时间）
+static uint64_t logPut(const std::string& key, std::string_view value, uint32_t expire){
+    std::string record;
+    if(expire) putFixed32(record, expire);
+    record.append(value.data(), value.size());
+    return logRecord(expire?Wal::PUT_TTL:Wal::PUT, key, record);
+}
+
+// 内存预算：结点和value占用的字节数超过maxMemory后，写入线程在释放分段锁之后按CLOCK策略淘汰key
+// 淘汰降到预算的98%以下，避免之后每次写入都触发淘汰；同一时间只有一个线程淘汰，其他线程不等待，因此预算是软上限
+// 被淘汰的key写入删除日志（不等待刷盘），否则回放日志会让它们重新出现
+// 有活跃的快照时删除只写入删除标记（内存反而增加），因此暂停淘汰，快照释放之后的写入再继续；长时间的快照期间可能超出预算
+static size_t maxMemory=0; // 0表示不限制
+static std::mutex evictLock; // 同一时间只有一个线程淘汰
+static std::atomic<uint64_t> evictedKeys{0}; // 淘汰的key数量
+static std::atomic<uint64_t> evictedBytes{0}; // 淘汰释放的字节数
+static std::atomic<uint64_t> evictPaused{0}; // 因为有活跃的快照而暂停淘汰的次数
+
+static void evictIfNeeded(){
+    if(!maxMemory) return;
+    size_t used=store->memoryUsage();
+    if(used<=maxMemory) return;
+    std::unique_lock<std::mutex> lock(evictLock,std::try_to_lock);
+    if(!lock.owns_lock()) return;
+    if(store->snapshotActive()){
+        evictPaused++;
+        return;
+    }
+    // 被删除的结点要等纪元回收后才会从memoryUsage中减去，因此按照候选的大小累计释放的字节数，而不是反复读取memoryUsage
+    size_t target=used-maxMemory+maxMemory/50;
+    size_t freed=0;
+    std::vector<std::pair<std::string,size_t>> victims;
+    // 所有分片的淘汰指针各转两圈仍然不够时（例如大部分key正在被并发写入）放弃，下一次写入时再继续
+    for(int round=0;freed<target&&round<64;round++){
+        victims.clear();
+        store->evictionCandidates(target-freed,victims);
+        for(auto& victim:victims){
+            std::unique_lock<std::mutex> stripeLock(stripe(victim.first));
+            if(store->expire(victim.first)==0){ // 已过期的候选按过期处理，不需要写日志
+                freed+=victim.second;
+                expiredKeys++;
+                continue;
+            }
+            if(store->snapshotActive()){ // 淘汰期间有快照开始：之后的删除不会释放内存
+                evictPaused++;
+                return;
+            }
+            if(store->erase(victim.first)!=0) continue; // 已经被并发删除
+            logRecord(Wal::DEL, victim.first, "");
+            freed+=victim.second;
+            evictedKeys++;
+            evictedBytes+=victim.second;
+        }
+    }
+}
+
+// 插入数据并写日志，日志按照刷盘策略持久化后才返回
+// 日志中记录key的规范形式；key无法解析时抛出异常
+static int insert(std::string_view text, std::string_view value, uint32_t expire=0){
+    std::string key=store->normalize(text);
+    int result;
+    uint64_t lsn=0;
+    {
+        std::unique_lock<std::mutex> lock(stripe(key));
+        result=store->insert(key, value, expire);
+        lsn=logPut(key, value, expire);
+    }
+    syncLog(lsn);
+    evictIfNeeded();
+    return result;
+}
+
+// 删除数据并写日志（key不存在时不写日志）
+static int erase(std::string_view text){
+    std::string key=store->normalize(text);
+    int result;
+    uint64_t lsn=0;
+    {
+        std::unique_lock<std::mutex> lock(stripe(key));
+        result=store->erase(key);
+        if(result==0) lsn=logRecord(Wal::DEL, key, "");
+    }
+    syncLog(lsn);
+    return result;
+}
+
+// 原子的读-改-写（见Store::update）：修改和追加日志在分段锁内完成，日志中记录修改后的value
+// 返回值与Store::update相同；修改成功时value为修改后的value，放弃修改时为fn最后看到的当前value（key不存在时为nullptr）
+static int update(std::string_view text, const Store::Updater& fn, std::string& value, bool& found){
+    std::string key=store->normalize(text);
+    int result;
+    uint32_t expire=0;
+    uint64_t lsn=0;
+    {
+        std::unique_lock<std::mutex> lock(stripe(key));
+        result=store->update(key,[&](const std::string_view* old,std::string& v,uint32_t& e){
+            found=(old!=nullptr);
+            if(old) value.assign(old->data(),old->size());
+            if(!fn(old,v,e)) return false;
+            value=v;
+            expire=e;
+            return true;
+        });
+        if(result>=0) lsn=logPut(key, value, expire);
+    }
+    syncLog(lsn);
+    if(result>=0) evictIfNeeded();
+    return result;
+}
+
+// 按编号顺序获取keys涉及的所有分段锁（统一的加锁顺序避免死锁），每把锁只获取一次
+static std::vector<std::unique_lock<std::mutex>> lockStripes(const std::vector<std::string>& keys){
+    std::vector<size_t> ids;
+    for(auto& key:keys) ids.push_back(std::hash<std::string>()(key)%STRIPES);
+    std::sort(ids.begin(),ids.end());
+    ids.erase(std::unique(ids.begin(),ids.end()),ids.end());
+    std::vector<std::unique_lock<std::mutex>> locks;
+    for(size_t id:ids) locks.emplace_back(stripes[id]);
+    return locks;
+}
+
+// 批量插入：一次获取所有涉及的分段锁，批量修改跳表后一次追加所有日志，最后只等待一次刷盘
+static std::vector<int> insertBatch(const std::vector<std::string_view>& texts, const std::vector<std::string_view>& values){
+    std::vector<std::string> keys;
+    for(auto& text:texts) keys.push_back(store->normalize(text));
+    std::vector<int> results;
+    uint64_t lsn=0;
+    {
+        auto locks=lockStripes(keys);
+        store->insertBatch(keys, values, results);
+        if(wal||primary){
+            std::vector<std::pair<std::string_view,std::string_view>> records;
+            for(size_t i=0;i<keys.size();i++) records.push_back({keys[i], values[i]});
+            lsn=logRecords(Wal::PUT, records);
+        }
+    }
+    syncLog(lsn);
+    evictIfNeeded();
+    return results;
+}
+
+// 批量删除（不存在的key不写日志）
+static std::vector<int> eraseBatch(const std::vector<std::string_view>& texts){
+    std::vector<std::string> keys;
+    for(auto& text:texts) keys.push_back(store->normalize(text));
+    std::vector<int> results;
+    uint64_t lsn=0;
+    {
+        auto locks=lockStripes(keys);
+        store->eraseBatch(keys, results);
+        if(wal||primary){
+            std::vector<std::pair<std::string_view,std::string_view>> records;
+            for(size_t i=0;i<keys.size();i++){
+                if(results[i]==0) records.push_back({keys[i], ""});
+            }
+            lsn=logRecords(Wal::DEL, records);
+        }
+    }
+    syncLog(lsn);
+    return results;
+}
+
+// 后台落盘：先切换日志段，再fork出子进程写快照，快照写完后旧的日志段就不再需要了
+// 子进程拥有fork时刻所有分片的写时复制副本（无锁跳表在任意时刻都处于一致的状态），父进程中的读写不受影响
+// 修改先作用于跳表再写日志，因此切换之前的段中的修改一定已经包含在快照中，
+// 快照中没有包含的修改一定在新的段中（日志记录都是覆盖写，重复回放已经包含在快照中的修改不影响结果）
+static std::mutex dumpLock; // 保护以下落盘任务相关的变量
+static int nextJobId=1; // 下一个落盘任务的id
+static int runningJob=0; // 正在执行的落盘任务id，0表示没有
+static std::map<int,std::string> jobStatus; // 落盘任务id到任务状态（running、success、failed）的映射
+static std::thread reaper; // 等待子进程结束的线程
+
+// 主动过期：后台线程每隔expireIntervalMS毫秒从每个分片上次停下的位置继续检查expireSample个key，删除其中已过期的key
+// 只访问有限个结点，不会遍历整个跳表；一轮中过期的key超过检查数量的1/4时说明过期的key很多，立即继续下一轮（最多占用1/4的时间）
+static std::thread expirer; // 主动过期线程
+static std::mutex expireLock; // 保护stopExpire
+static std::condition_variable expireCond; // 通知主动过期线程退出
+static bool stopExpire=false;
+
+static void activeExpire(int interval,int sample){
+    std::vector<std::string> keys;
+    std::unique_lock<std::mutex> lock(expireLock);
+    while(!expireCond.wait_for(lock,std::chrono::milliseconds(interval),[](){ return stopExpire; })){
+        lock.unlock();
+        auto deadline=std::chrono::steady_clock::now()+std::chrono::milliseconds(interval/4+1);
+        do{
+            keys.clear();
+            store->sampleExpired(sample,keys);
+            for(auto& key:keys) expireKey(key);
+        }while(keys.size()>static_cast<size_t>(sample)/4&&std::chrono::steady_clock::now()<deadline);
+        lock.lock();
+    }
+}
+static const size_t MAX_JOBS=64; // 最多保留的任务状态数量
+
+// 启动落盘任务并立即返回任务id；如果已经有任务在执行，则返回该任务的id
+static int dump(){
+    std::unique_lock<std::mutex> lock(dumpLock);
+    if(runningJob) return runningJob;
+    if(reaper.joinable()) reaper.join(); // 上一个任务已经结束，回收等待线程
+    int id=nextJobId++;
+    while(jobStatus.size()>=MAX_JOBS) jobStatus.erase(jobStatus.begin());
+    std::string fileName=config["dumpFile"];
+    uint64_t segment=(wal?wal->rotate():0);
+    pid_t pid=fork();
+    if(pid==0){
+        // 子进程：写完快照后直接退出，不执行析构函数
+        _exit(store->dump(fileName)?0:1);
+    }
+    if(pid<0){
+        jobStatus[id]="failed";
+        return id;
+    }
+    runningJob=id;
+    jobStatus[id]="running";
+    reaper=std::thread([id,pid,segment](){
+        int status=0;
+        while(waitpid(pid,&status,0)==-1&&errno==EINTR);
+        bool ok=WIFEXITED(status)&&WEXITSTATUS(status)==0;
+        // 快照写入失败时保留旧的日志段
+        if(ok&&wal) wal->removeBefore(segment);
+        std::unique_lock<std::mutex> lock(dumpLock);
+        jobStatus[id]=(ok?"success":"failed");
+        runningJob=0;
+    });
+    return id;
+}
+
+// 查询落盘任务的状态
+static std::string dumpStatus(int id){
+    std::unique_lock<std::mutex> lock(dumpLock);
+    auto iter=jobStatus.find(id);
+    return iter==jobStatus.end()?"unknown":iter->second;
+}
+
+// 范围查询每页最多返回的key数量，保证每个请求的工作量有上限
+static const int MAX_PAGE=1000;
+
+// 游标：将方向、每页数量、下一页的起点和另一端的边界编码为十六进制字符串，对客户端不透明
+// 编码前的格式为 方向(a/d) 每页数量,起点长度,起点边界（key可以是任意字符串，因此起点带长度前缀），边界为空表示该方向没有边界
+static void encodeCursor(Processor::Output& out,std::string_view next,std::string_view bound,int limit,bool reverse){
+    std::string plain=std::string(reverse?"d":"a")+std::to_string(limit)+","+std::to_string(next.size())+",";
+    plain.append(next.data(),next.size());
+    plain.append(bound.data(),bound.size());
+    static const char* digits="0123456789abcdef";
+    for(unsigned char c:plain){
+        out.push_back(digits[c>>4]);
+        out.push_back(digits[c&0xf]);
+    }
+}
+
+static bool decodeCursor(std::string_view cursor,std::string& next,std::string& bound,int& limit,bool& reverse){
+    if(cursor.empty()||cursor.size()%2!=0) return false;
+    std::string plain;
+    for(size_t i=0;i<cursor.size();i+=2){
+        unsigned int c=0;
+        auto parsed=std::from_chars(cursor.data()+i,cursor.data()+i+2,c,16);
+        if(parsed.ec!=std::errc()||parsed.ptr!=cursor.data()+i+2) return false;
+        plain.push_back(static_cast<char>(c));
+    }
+    if(plain[0]!='a'&&plain[0]!='d') return false;
+    reverse=(plain[0]=='d');
+    size_t first=plain.find(',');
+    if(first==std::string::npos) return false;
+    size_t second=plain.find(',',first+1);
+    if(second==std::string::npos) return false;
+    size_t len;
+    std::string_view view(plain);
+    if(!Command::toInt(view.substr(1,first-1),limit)||!Command::toInt(view.substr(first+1,second-first-1),len)) return false;
+    if(second+1+len>plain.size()) return false;
+    next=plain.substr(second+1,len);
+    bound=plain.substr(second+1+len);
+    return true;
+}
+
+// 向响应中追加一个json字符串（按json的规则转义）
+static void appendString(Processor::Output& out,std::string_view text){
+    out.push_back('\"');
+    Command::escape(out,text);
+    out.push_back('\"');
+}
+
+// 向响应中追加一个整数，不产生临时字符串
+static void appendInt(Processor::Output& out,unsigned long long value){
+    char buf[24];
+    auto result=std::to_chars(buf,buf+sizeof(buf),value);
+    out.append(buf,result.ptr-buf);
+}
+
+// {"result": "状态"}
+static void appendResult(Processor::Output& out,const char* status){
+    out+="{\"result\": \"";
+    out+=status;
+    out+="\"}";
+}
+
+// 键值对 {"k": "key", "v": "value"}
+static void appendItem(Processor::Output& out,std::string_view key,std::string_view value){
+    out+="{\"k\": ";
+    appendString(out,key);
+    out+=", \"v\": ";
+    appendString(out,value);
+    out+="}";
+}
+
+// 查询[lo,hi]内的一页数据，写入 {"items": [...], "cursor": "下一页的游标（没有下一页时为空）"}
+// lo或hi为空字符串时该方向没有边界（search "" "" 10 从头翻页遍历所有key）
+static void rangePage(std::string_view lo,std::string_view hi,int limit,bool reverse,Processor::Output& out){
+    if(limit<1) limit=1;
+    if(limit>MAX_PAGE) limit=MAX_PAGE;
+    out+="{\"items\": [";
+    bool first=true;
+    std::string next;
+    bool more=store->scan(lo.empty()?nullptr:&lo,hi.empty()?nullptr:&hi,limit,reverse,[&](std::string_view key,std::string_view value){
+        if(!first) out+=", ";
+        first=false;
+        appendItem(out,key,value);
+    },next);
+    out+="], \"cursor\": \"";
+    if(more){
+        if(reverse) encodeCursor(out,next,lo,limit,true);
+        else encodeCursor(out,next,hi,limit,false);
+    }
+    out+="\"}";
+}
+
+// 范围查询命令中的边界：空token（数组形式的命令）或者字符串形式的命令中写出的""表示没有边界
+static std::string_view rangeBound(std::string_view token){
+    return token=="\"\""?std::string_view():token;
+}
+
+// 回放一条日志记录（WAL或者复制流中的记录）
+static void applyRecord(const Wal::Record& record, uint32_t now){
+    if(record.type==Wal::PUT) store->insert(record.key, record.value);
+    else if(record.type==Wal::PUT_TTL&&record.value.size()>=4){
+        uint32_t expire=decodeFixed32(record.value.data());
+        // 已经过期的写入相当于删除（不能让更早的value重新出现）
+        if(expire<=now) store->erase(record.key);
+        else store->insert(record.key, std::string_view(record.value).substr(4), expire);
+    }
+    else store->erase(record.key);
+}
+
+// 副本回放主节点推送的修改：与写命令一样持有分段锁，并写入自己的WAL（不等待刷盘）
+// 配置了replicationPort时副本同时也是下一级副本的主节点，修改会继续向下推送
+static void replicate(const Wal::Record& record){
+    try{
+        std::unique_lock<std::mutex> lock(stripe(record.key));
+        applyRecord(record, Store::clock());
+        logRecord(record.type, record.key, record.value);
+    }catch(std::exception&){
+        std::cerr<<"复制: 无法回放key "<<record.key<<"（主节点与副本的keyType不同？）"<<std::endl;
+    }
+}
+
+// 全量同步时删除副本中快照之外的key（副本之前的数据或者断线期间在主节点上被删除的key）
+// 快照按key顺序到达，副本每收到一批key就删除它们覆盖的范围[lo,hi]中不在keep里的key，不需要记住整个快照的key
+// 同步过程中副本仍然提供读服务，读到的可能是新旧数据的混合
+static void pruneKeys(const std::string* lo,const std::string* hi,const std::unordered_set<std::string>& keep){
+    std::string_view low,high;
+    if(lo) low=*lo;
+    if(hi) high=*hi;
+    std::vector<std::string> extra;
+    std::string next,from;
+    bool more=true;
+    while(more){
+        // 分页查询，每页的多余key删除之后再从next继续
+        more=store->scan(lo?&low:nullptr,hi?&high:nullptr,MAX_PAGE,false,[&](std::string_view key,std::string_view){
+            std::string text(key);
+            if(!keep.count(text)) extra.push_back(std::move(text));
+        },next);
+        for(auto& key:extra){
+            std::unique_lock<std::mutex> lock(stripe(key));
+            if(store->erase(key)==0) logRecord(Wal::DEL, key, "");
+        }
+        extra.clear();
+        if(more){
+            from=next;
+            low=from;
+            lo=&from;
+        }
+    }
+}
+
+// 全量同步的快照：每个未过期的key一条PUT或PUT_TTL记录
+static void snapshot(const std::function<void(Wal::RecordType, std::string_view, std::string_view)>& emit){
+    std::string record;
+    store->forEach([&](std::string_view key,std::string_view value,uint32_t expire){
+        if(!expire){
+            emit(Wal::PUT, key, value);
+            return;
+        }
+        record.clear();
+        putFixed32(record, expire);
+        record.append(value.data(), value.size());
+        emit(Wal::PUT_TTL, key, record);
+    });
+}
 
 std::shared_ptr<Processor> Processor::instance(){
     // 懒汉模式
@@ -21,98 +479,391 @@ std::shared_ptr<Processor> Processor::instance(){
     return processor;
 }
 
-void Processor::init() {
-    skipList = new SkipList(6);
-    skipList->load("dump_file");
+// 解析过期秒数（必须为正数），得到过期时间
+static bool parseTtl(std::string_view text,uint32_t& expire){
+    long long ttl;
+    if(!Command::toInt(text,ttl)||ttl<=0) return false;
+    expire=static_cast<uint32_t>(std::min<long long>(Store::clock()+std::min<long long>(ttl,UINT32_MAX),UINT32_MAX));
+    return true;
 }
 
-std::string Processor::process(std::string& method, std::string& url, std::string& body) {
-    if(method!="POST" || url!="/kv_store") return "404";
-    else {
-        // 解析json格式的命令：{"cmd": "xxx"}，并得到命令序列
-        int pos = body.find(':');
-        std::vector<std::string> tokens;
-        std::string token;
-        bool start=false;
-        for(int i=pos+1;i<body.size();i++){
-            if(body[i]=='\"') {
-                if(!start){
-                    // 遇到开始的"
-                    start=true;
-                }else{
-                    // 遇到结束的"
-                    tokens.push_back(token);
-                    break;
-                }
-            }else if(body[i]==' '){
-                if(start){
-                    tokens.push_back(token);
-                    token="";
-                }// 如果暂时未遇到第一个"，则忽略空格符
-            }else{
-                if(start){
-                    token.push_back(body[i]);
-                }
-            }
+// 条件写入（cas、setnx）的响应：成功时为success，条件不满足时为conflict，并带上当前的value（key存在时）
+static void conflictOrSuccess(int result,const std::string& current,bool found,Processor::Output& out){
+    if(result>=0) appendResult(out,"success");
+    else if(!found) appendResult(out,"conflict");
+    else{
+        out+="{\"result\": \"conflict\", \"v\": ";
+        appendString(out,current);
+        out+="}";
+    }
+}
+
+// incr和decr：value不是整数或者结果溢出时不修改，返回对应的状态
+static void addInteger(std::string_view key,long long delta,bool negate,Processor::Output& out){
+    std::string value;
+    const char* status="";
+    bool found;
+    int result=update(key,[&](const std::string_view* old,std::string& v,uint32_t&){
+        long long current=0;
+        if(old&&!Command::toInt(*old,current)){
+            status="not integer";
+            return false;
         }
-        // 如果解析出的tokens错误，则返回空字符，表示服务器内部错误
-        if(tokens.empty()) return "";
-        else{
-            if(tokens[0]=="insert") {
-                if(tokens.size()!=3)return "";
-                else{
-                    try{
-                        std::string result = (skipList->insertElement(std::stoi(tokens[1]), tokens[2])?"update value":"success");
-                        return "{\"result\": \"" + result + "\"}";
-                    }catch(std::exception e){
-                        return "";
-                    }
+        long long next;
+        if(negate?__builtin_sub_overflow(current,delta,&next):__builtin_add_overflow(current,delta,&next)){
+            status="overflow";
+            return false;
+        }
+        v=std::to_string(next);
+        return true;
+    },value,found);
+    if(result<0) appendResult(out,status);
+    else{
+        out+="{\"result\": \"success\", \"v\": ";
+        appendString(out,value);
+        out+="}";
+    }
+}
+
+// 执行一条命令，将响应写入out；参数错误时返回false（服务器返回500），key无法解析或者WAL写入失败时抛出异常
+static bool execute(Command::Id cmd,const std::vector<std::string_view>& tokens,Processor::Output& out){
+    size_t n=tokens.size();
+    switch(cmd){
+        case Command::INSERT:{ // insert key value [ttl]，ttl为过期秒数
+            if(n!=3&&n!=4) return false;
+            uint32_t expire=0;
+            if(n==4&&!parseTtl(tokens[3],expire)) return false;
+            appendResult(out,insert(tokens[1],tokens[2],expire)?"update value":"success");
+            return true;
+        }
+        case Command::INCR:
+        case Command::DECR:{ // incr key [delta]：key不存在时从0开始，保留原有的过期时间
+            if(n!=2&&n!=3) return false;
+            long long delta=1;
+            if(n==3&&!Command::toInt(tokens[2],delta)) return false;
+            addInteger(tokens[1],delta,cmd==Command::DECR,out);
+            return true;
+        }
+        case Command::APPEND:{ // append key value：key不存在时相当于insert，保留原有的过期时间
+            if(n!=3) return false;
+            std::string value;
+            bool found;
+            update(tokens[1],[&tokens](const std::string_view* old,std::string& v,uint32_t&){
+                if(old) v.assign(old->data(),old->size());
+                v.append(tokens[2].data(),tokens[2].size());
+                return true;
+            },value,found);
+            out+="{\"result\": \"success\", \"v\": ";
+            appendString(out,value);
+            out+="}";
+            return true;
+        }
+        case Command::CAS:{ // cas key expected new [ttl]：当前value等于expected时替换为new（与insert一样重新设置过期时间）
+            if(n!=4&&n!=5) return false;
+            uint32_t expire=0;
+            if(n==5&&!parseTtl(tokens[4],expire)) return false;
+            std::string value;
+            bool found;
+            int result=update(tokens[1],[&tokens,expire](const std::string_view* old,std::string& v,uint32_t& e){
+                if(!old||*old!=tokens[2]) return false;
+                v.assign(tokens[3].data(),tokens[3].size());
+                e=expire;
+                return true;
+            },value,found);
+            conflictOrSuccess(result,value,found,out);
+            return true;
+        }
+        case Command::SETNX:{ // setnx key value [ttl]：只在key不存在（或已过期）时写入
+            if(n!=3&&n!=4) return false;
+            uint32_t expire=0;
+            if(n==4&&!parseTtl(tokens[3],expire)) return false;
+            std::string value;
+            bool found;
+            int result=update(tokens[1],[&tokens,expire](const std::string_view* old,std::string& v,uint32_t& e){
+                if(old) return false;
+                v.assign(tokens[2].data(),tokens[2].size());
+                e=expire;
+                return true;
+            },value,found);
+            conflictOrSuccess(result,value,found,out);
+            return true;
+        }
+        case Command::DELETE:{
+            if(n!=2) return false;
+            appendResult(out,erase(tokens[1])?"no key":"success");
+            return true;
+        }
+        case Command::SEARCH:{
+            if(n==1){ // 全查：各分片并行遍历，边归并边构造响应
+                out+="[";
+                store->forEach([&out](std::string_view key,std::string_view value,uint32_t){
+                    appendItem(out,key,value);
+                    out+=", ";
+                });
+                out+="]";
+            }else if(n==2){ // 按key查：直接将跳表中的value追加到响应中，不产生中间拷贝
+                bool expired=false;
+                bool found=store->search(tokens[1],[&](std::string_view value){
+                    appendItem(out,tokens[1],value);
+                },&expired);
+                if(expired) expireKey(store->normalize(tokens[1])); // 惰性过期：读到已过期的key时顺便删除
+                if(!found) out+="{}";
+            }else if(n==3&&tokens[1]=="cursor"){ // 使用游标查询下一页：search cursor 游标
+                std::string next,bound;
+                int limit;
+                bool reverse;
+                if(!decodeCursor(tokens[2],next,bound,limit,reverse)) return false;
+                if(reverse) rangePage(bound,next,limit,true,out);
+                else rangePage(next,bound,limit,false,out);
+            }else if(n==4||n==5){ // 范围查询：search lo hi limit [asc|desc]
+                bool reverse=false;
+                if(n==5){
+                    if(tokens[4]=="desc") reverse=true;
+                    else if(tokens[4]!="asc") return false;
                 }
-            }else if(tokens[0]=="delete") {
-                if(tokens.size()!=2)return "";
+                int limit;
+                if(!Command::toInt(tokens[3],limit)) return false;
+                rangePage(rangeBound(tokens[1]),rangeBound(tokens[2]),limit,reverse,out);
+            }else return false;
+            return true;
+        }
+        case Command::MGET:{ // 批量查询：mget k1 k2 ...，返回 {"items": [{"k": "k1", "v": "v1"}, {"k": "k2"}, ...]}（不存在的key没有v）
+            if(n<2) return false;
+            std::vector<std::string_view> keys(tokens.begin()+1,tokens.end());
+            std::vector<std::string> values(keys.size());
+            std::vector<bool> found(keys.size(),false);
+            store->searchBatch(keys,[&](size_t i,std::string_view value){
+                values[i].assign(value.data(),value.size());
+                found[i]=true;
+            });
+            out+="{\"items\": [";
+            for(size_t i=0;i<keys.size();i++){
+                if(i) out+=", ";
+                if(found[i]) appendItem(out,keys[i],values[i]);
                 else{
-                    try{
-                        std::string result = (skipList->deleteElement(std::stoi(tokens[1]))?"no key":"success");
-                        return "{\"result\": \"" + result + "\"}";
-                    }catch(std::exception e){
-                        return "";
-                    }
+                    out+="{\"k\": ";
+                    appendString(out,keys[i]);
+                    out+="}";
                 }
-            }else if(tokens[0]=="search") {
-                if(tokens.size()==1){ // 全查
-                    std::vector<std::pair<int,std::string>> result = skipList->searchAll();
-                    std::string json = "[";
-                    for(auto iter=result.begin();iter!=result.end();iter++){
-                        json+="{\"k\": \"" + std::to_string(iter->first) + "\", \"v\": \"" + iter->second + "\"}, ";
-                    }
-                    json+="]";
-                    return json;
-                }else if(tokens.size()==2){
-                    try{
-                        std::pair<std::string, bool> value = skipList->searchElement(std::stoi(tokens[1]));
-                        if(value.second){
-                        return "{\"k\": \"" + tokens[1] + "\", \"v\": \"" + value.first + "\"}";
-                        }else return "{}";
-                    }catch(std::exception e){
-                        return "";
-                    }
-                }else return "";
-            }else if(tokens[0]=="size") {
-                if(tokens.size()!=1)return "";
-                else {
-                    return "{\"size\": \"" + std::to_string(skipList->size()) + "\"}";
-                }
-            }else if(tokens[0]=="dump") {
-                if(tokens.size()!=1)return "";
-                else {
-                    skipList->dump("dump_file");
-                    return "{\"result\": \"success\"}";
-                }
-            }else return "";
+            }
+            out+="]}";
+            return true;
+        }
+        case Command::MSET:{ // 批量插入：mset k1 v1 k2 v2 ...，返回每个key的结果
+            if(n<3||n%2==0) return false;
+            std::vector<std::string_view> keys,values;
+            for(size_t i=1;i<n;i+=2){
+                keys.push_back(tokens[i]);
+                values.push_back(tokens[i+1]);
+            }
+            std::vector<int> results=insertBatch(keys,values);
+            out+="{\"result\": [";
+            for(size_t i=0;i<results.size();i++){
+                if(i) out+=", ";
+                out+=(results[i]?"\"update value\"":"\"success\"");
+            }
+            out+="]}";
+            return true;
+        }
+        case Command::MDEL:{ // 批量删除：mdel k1 k2 ...，返回每个key的结果
+            if(n<2) return false;
+            std::vector<int> results=eraseBatch(std::vector<std::string_view>(tokens.begin()+1,tokens.end()));
+            out+="{\"result\": [";
+            for(size_t i=0;i<results.size();i++){
+                if(i) out+=", ";
+                out+=(results[i]?"\"no key\"":"\"success\"");
+            }
+            out+="]}";
+            return true;
+        }
+        case Command::SIZE:{
+            if(n!=1) return false;
+            out+="{\"size\": \"";
+            appendInt(out,store->size());
+            out+="\"}";
+            return true;
         }
+        case Command::MEMORY:{ // 内存使用情况和淘汰计数
+            if(n!=1) return false;
+            const std::pair<const char*,unsigned long long> fields[]={
+                {"used",store->memoryUsage()},
+                {"reserved",store->reservedMemory()},
+                {"maxMemory",maxMemory},
+                {"evictedKeys",evictedKeys.load()},
+                {"evictedBytes",evictedBytes.load()},
+                {"evictPaused",evictPaused.load()},
+                {"expiredKeys",expiredKeys.load()},
+                {"versions",static_cast<unsigned long long>(store->retainedVersions())}
+            };
+            out+="{";
+            for(auto& field:fields){
+                if(out.size()>1) out+=", ";
+                out+="\"";
+                out+=field.first;
+                out+="\": \"";
+                appendInt(out,field.second);
+                out+="\"";
+            }
+            out+="}";
+            return true;
+        }
+        case Command::REPL:{ // 复制状态和副本落后的修改数量
+            if(n!=1) return false;
+            if(replica) out+=replica->status();
+            else if(primary) out+=primary->status();
+            else out+="{\"role\": \"standalone\"}";
+            return true;
+        }
+        case Command::DUMP:
+        case Command::DUMPSTATUS:{ // dump：后台落盘，立即返回任务id；dumpstatus 任务id：查询落盘任务的状态
+            int id;
+            if(cmd==Command::DUMP){
+                if(n!=1) return false;
+                id=dump();
+            }else if(n!=2||!Command::toInt(tokens[1],id)) return false;
+            out+="{\"job\": \"";
+            appendInt(out,id);
+            out+="\", \"status\": \"";
+            out+=dumpStatus(id);
+            out+="\"}";
+            return true;
+        }
+        default:
+            return false;
     }
 }
 
+void Processor::init() {
+    // 存储引擎的配置文件与dump_file位于同一目录
+    config=parseIni("kv_store.ini", {
+        {"dumpFile","dump_file"},
+        {"isOpenWal","true"},
+        {"walFile","wal_file"},
+        {"walSync","group"},
+        {"walGroupMS","2"},
+        {"walGroupRecords","128"},
+        {"shards","0"},
+        {"expectedKeys","1000000"},
+        {"keyType","int"},
+        {"expireIntervalMS","100"},
+        {"expireSample","256"},
+        {"maxMemory","0"},
+        {"replicationPort","0"},
+        {"replicationBacklog","16777216"},
+        {"replicaOf",""}
+    });
+    int shards=std::stoi(config["shards"]);
+    if(shards<=0) shards=std::max(1u,std::thread::hardware_concurrency());
+    store = Store::create(config["keyType"], shards, std::stoll(config["expectedKeys"]));
+    if(store==nullptr){
+        std::cerr<<"不支持的key类型"<<config["keyType"]<<"，使用int"<<std::endl;
+        store = Store::create("int", shards, std::stoll(config["expectedKeys"]));
+    }
+    // 加载快照，大约每秒报告一次进度
+    auto loadStart=std::chrono::steady_clock::now();
+    auto lastReport=loadStart;
+    uint64_t loadedRecords=0;
+    store->load(config["dumpFile"],[&](uint64_t loaded,uint64_t total){
+        loadedRecords=loaded;
+        auto now=std::chrono::steady_clock::now();
+        if(now-lastReport<std::chrono::seconds(1)) return;
+        lastReport=now;
+        std::cerr<<"加载快照: "<<loaded<<"/"<<total<<" ("<<(total?loaded*100/total:100)<<"%)"<<std::endl;
+    });
+    if(loadedRecords>0){
+        double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-loadStart).count();
+        std::cerr<<"加载快照完成: "<<loadedRecords<<"条记录，"<<store->size()<<"个key，用时"<<seconds<<"秒（"
+            <<static_cast<uint64_t>(loadedRecords/std::max(seconds,1e-9))<<"条/秒）"<<std::endl;
+    }
+    if(config["isOpenWal"]=="true"){
+        wal=new Wal(config["walFile"], Wal::parsePolicy(config["walSync"]),
+            std::stoi(config["walGroupMS"]), std::stoi(config["walGroupRecords"]));
+        // 在快照的基础上回放日志
+        uint32_t now=Store::clock();
+        bool ok=wal->open([now](const Wal::Record& record){
+            applyRecord(record, now);
+        });
+        if(!ok){
+            std::cerr<<"WAL打开失败，已关闭预写日志"<<std::endl;
+            delete wal;
+            wal=nullptr;
+        }
+    }
+    maxMemory=std::stoull(config["maxMemory"]);
+    evictIfNeeded(); // 加载的数据可能已经超过预算（例如调小了maxMemory）
+    int interval=std::max(std::stoi(config["expireIntervalMS"]),1);
+    int sample=std::max(std::stoi(config["expireSample"]),1);
+    expirer=std::thread(activeExpire,interval,sample);
+    int port=std::stoi(config["replicationPort"]);
+    if(port>0){
+        primary=new Primary(port, std::stoull(config["replicationBacklog"]), snapshot);
+        if(!primary->start()){
+            std::cerr<<"复制监听失败，已关闭主从复制"<<std::endl;
+            delete primary;
+            primary=nullptr;
+        }
+    }
+    // replicaOf为主节点的 地址:端口，配置后本节点是只读的副本
+    std::string replicaOf=config["replicaOf"];
+    size_t colon=replicaOf.rfind(':');
+    if(colon!=std::string::npos){
+        replica=new Replica(replicaOf.substr(0,colon), std::stoi(replicaOf.substr(colon+1)), replicate, pruneKeys);
+        replica->start();
+    }
+}
+
+int Processor::process(const Request& request, Output& output) {
+    if(request.method!="POST" || request.url!="/kv_store") return 404;
+    // 每个线程复用自己的token数组和解码缓冲区：token直接指向body，响应直接写到output中，解析和分发的过程中不分配内存
+    thread_local std::vector<std::string_view> tokens;
+    thread_local std::string scratch;
+    // 如果解析出的tokens错误，则返回500，表示服务器内部错误
+    if(!Command::parse(request.body,tokens,scratch)||tokens.empty()) return 500;
+    Command::Id cmd=Command::lookup(tokens[0]);
+    if(replica&&Command::isWrite(cmd)){
+        output+="{\"result\": \"read only\"}";
+        return 200;
+    }
+    bool ok;
+    try{
+        ok=execute(cmd,tokens,output);
+    }catch(std::exception&){
+        ok=false; // key无法解析或者WAL写入失败
+    }
+    // 大请求之后释放缓冲区，避免每个线程长期占用大块内存
+    static const size_t MAX_RETAINED=1<<20;
+    if(scratch.capacity()>MAX_RETAINED) std::string().swap(scratch);
+    return ok?200:500; // 失败时服务器丢弃已经写入output的内容
+}
+
+std::string Processor::process(std::string& method, std::string& url, std::string& body) {
+    // v1接口：以字符串作为输出调用v2接口
+    std::string response;
+    int code;
+    {
+        StringOutput output(response);
+        code=process(Request{method,url,body},output);
+    }
+    if(code==404) return "404";
+    return code==200?response:std::string();
+}
+
+int processorAbiVersion() {
+    return Processor::ABI_VERSION;
+}
+
 Processor::~Processor() {
-    delete skipList;
+    delete replica; // 先停止回放，再停止推送
+    delete primary;
+    if(expirer.joinable()){
+        {
+            std::unique_lock<std::mutex> lock(expireLock);
+            stopExpire=true;
+        }
+        expireCond.notify_all();
+        expirer.join();
+    }
+    if(reaper.joinable()) reaper.join(); // 等待正在执行的落盘任务结束
+    delete wal;
+    delete store;
 }
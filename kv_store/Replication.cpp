@@ -0,0 +1,468 @@
+#include "Replication.h"
+#include "Coding.h"
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+namespace Replication {
+
+void encode(std::string& dst, uint8_t type, uint64_t seq, std::string_view key, std::string_view value) {
+    dst.push_back(static_cast<char>(type));
+    putFixed64(dst, seq);
+    putFixed32(dst, key.size());
+    dst.append(key);
+    putFixed32(dst, value.size());
+    dst.append(value);
+}
+
+size_t decode(std::string_view data, uint8_t& type, uint64_t& seq, std::string_view& key, std::string_view& value) {
+    if (data.size() < 13) return 0;
+    uint32_t keyLen = decodeFixed32(data.data() + 9);
+    if (data.size() < 17 + static_cast<size_t>(keyLen)) return 0;
+    uint32_t valueLen = decodeFixed32(data.data() + 13 + keyLen);
+    size_t size = 17 + static_cast<size_t>(keyLen) + valueLen;
+    if (data.size() < size) return 0;
+    type = static_cast<uint8_t>(data[0]);
+    seq = decodeFixed64(data.data() + 1);
+    key = data.substr(13, keyLen);
+    value = data.substr(17 + keyLen, valueLen);
+    return size;
+}
+
+uint64_t nowMS() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+}
+
+// 阻塞地发送全部数据，失败返回false（对端关闭时不产生SIGPIPE）
+static bool sendAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+static void setTimeout(int fd, int option, int ms) {
+    timeval tv{ms / 1000, (ms % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, option, &tv, sizeof(tv));
+}
+
+static const int HEARTBEAT_MS = 1000; // 主节点空闲时发送心跳的间隔
+static const int TIMEOUT_MS = 5000; // 超过这个时间没有收到对端的消息则认为连接已经断开
+static const size_t MAX_BATCH = 1 << 20; // 发送线程每次从积压缓冲区中取出（全量同步时每次发送）的最大字节数
+static const size_t PRUNE_BATCH = 4096; // 全量同步时副本每收到这么多个key，删除一次这些key覆盖的范围中快照之外的key
+
+Primary::Primary(int port, size_t backlogBytes, Snapshot snapshot)
+    : port(port), backlogBytes(backlogBytes), snapshot(std::move(snapshot)) {
+    std::random_device rd;
+    std::mt19937_64 rng((static_cast<uint64_t>(rd()) << 32) ^ Replication::nowMS());
+    char id[17];
+    snprintf(id, sizeof(id), "%016llx", static_cast<unsigned long long>(rng()));
+    this->replId = id;
+}
+
+Primary::~Primary() {
+    this->stop = true;
+    this->cond.notify_all();
+    if (this->acceptor.joinable()) this->acceptor.join();
+    if (this->listenFd != -1) close(this->listenFd);
+    std::unique_lock<std::mutex> l(this->peersLock);
+    for (auto& peer : this->peers) {
+        shutdown(peer.fd, SHUT_RDWR); // 唤醒阻塞在send上的发送线程
+        peer.thread.join();
+        close(peer.fd);
+    }
+}
+
+bool Primary::start() {
+    this->listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (this->listenFd == -1) return false;
+    int on = 1;
+    setsockopt(this->listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(this->port);
+    if (bind(this->listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1 ||
+        listen(this->listenFd, 16) == -1) {
+        std::cerr << "复制: 无法监听端口 " << this->port << ": " << strerror(errno) << std::endl;
+        close(this->listenFd);
+        this->listenFd = -1;
+        return false;
+    }
+    this->acceptor = std::thread(&Primary::listener, this);
+    return true;
+}
+
+void Primary::encode(Wal::RecordType type, std::string_view key, std::string_view value) {
+    std::string frame;
+    frame.reserve(17 + key.size() + value.size());
+    Replication::encode(frame, type, ++this->seq, key, value);
+    this->bytes += frame.size();
+    this->backlog.push_back(std::move(frame));
+    // 超出容量时丢弃最早的修改，落后于它们的副本需要重新全量同步
+    while (this->bytes > this->backlogBytes && this->backlog.size() > 1) {
+        this->bytes -= this->backlog.front().size();
+        this->backlog.pop_front();
+        this->firstSeq++;
+    }
+}
+
+void Primary::append(Wal::RecordType type, std::string_view key, std::string_view value) {
+    {
+        std::unique_lock<std::mutex> l(this->lock);
+        this->encode(type, key, value);
+    }
+    this->cond.notify_all();
+}
+
+void Primary::append(Wal::RecordType type, const std::vector<std::pair<std::string_view, std::string_view>>& records) {
+    if (records.empty()) return;
+    {
+        std::unique_lock<std::mutex> l(this->lock);
+        for (auto& record : records) {
+            this->encode(type, record.first, record.second);
+        }
+    }
+    this->cond.notify_all();
+}
+
+void Primary::reap() {
+    for (auto iter = this->peers.begin(); iter != this->peers.end();) {
+        if (!iter->done) {
+            ++iter;
+            continue;
+        }
+        iter->thread.join();
+        close(iter->fd);
+        iter = this->peers.erase(iter);
+    }
+}
+
+void Primary::listener() {
+    pollfd pfd{this->listenFd, POLLIN, 0};
+    while (!this->stop) {
+        if (poll(&pfd, 1, 200) <= 0) continue; // 定期检查是否需要停止
+        sockaddr_in addr{};
+        socklen_t len = sizeof(addr);
+        int fd = accept(this->listenFd, reinterpret_cast<sockaddr*>(&addr), &len);
+        if (fd == -1) continue;
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        char ip[INET_ADDRSTRLEN] = "";
+        inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+        std::unique_lock<std::mutex> l(this->peersLock);
+        this->reap();
+        this->peers.emplace_back();
+        Peer* peer = &this->peers.back();
+        peer->fd = fd;
+        peer->address = std::string(ip) + ":" + std::to_string(ntohs(addr.sin_port));
+        peer->thread = std::thread(&Primary::sender, this, peer);
+    }
+}
+
+bool Primary::fullSync(Peer* peer, uint64_t& cursor) {
+    // 先取位置再取快照：修改先作用于存储再追加到积压缓冲区，位置之前的修改一定包含在快照中；
+    // 位置之后的修改可能也已经包含在快照中，之后会再发送一次（记录都是覆盖写，按顺序重复回放不影响结果）
+    uint64_t position;
+    {
+        std::unique_lock<std::mutex> l(this->lock);
+        position = this->seq;
+    }
+    std::string data;
+    data.reserve(MAX_BATCH + 4096);
+    bool ok = true;
+    Replication::encode(data, Replication::FULL, position, this->replId, "");
+    this->snapshot([&data, &ok, peer, position](Wal::RecordType type, std::string_view key, std::string_view value) {
+        if (!ok) return; // 发送失败后只需要等待遍历结束
+        Replication::encode(data, type, position, key, value);
+        if (data.size() < MAX_BATCH) return;
+        ok = sendAll(peer->fd, data);
+        data.clear();
+    });
+    Replication::encode(data, Replication::FULL_END, position, "", "");
+    cursor = position;
+    return ok && sendAll(peer->fd, data);
+}
+
+void Primary::sender(Peer* peer) {
+    // 握手：读取副本的SYNC帧
+    std::string in;
+    char buf[4096];
+    uint8_t type = 0;
+    uint64_t from = 0;
+    std::string_view key, value;
+    size_t size = 0;
+    setTimeout(peer->fd, SO_RCVTIMEO, TIMEOUT_MS);
+    while ((size = Replication::decode(in, type, from, key, value)) == 0) {
+        ssize_t n = recv(peer->fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            peer->done = true;
+            return;
+        }
+        in.append(buf, n);
+    }
+    uint64_t cursor = 0; // 已经发送的最后一条修改的序号
+    bool ok = (type == Replication::SYNC);
+    setTimeout(peer->fd, SO_SNDTIMEO, TIMEOUT_MS); // 副本长时间不读取时断开（全量同步期间持有的快照会阻止回收旧版本）
+    if (ok) {
+        bool partial;
+        {
+            std::unique_lock<std::mutex> l(this->lock);
+            partial = (key == this->replId && from <= this->seq && from + 1 >= this->firstSeq);
+        }
+        if (partial) {
+            std::string data;
+            Replication::encode(data, Replication::CONTINUE, from, this->replId, "");
+            cursor = from;
+            ok = sendAll(peer->fd, data);
+        } else {
+            ok = this->fullSync(peer, cursor);
+        }
+        peer->acked = cursor;
+    }
+    in.erase(0, size);
+    while (ok && !this->stop) {
+        std::string data;
+        {
+            std::unique_lock<std::mutex> l(this->lock);
+            this->cond.wait_for(l, std::chrono::milliseconds(HEARTBEAT_MS),
+                [this, cursor]() { return this->stop || this->seq > cursor; });
+            if (this->stop) break;
+            if (cursor + 1 < this->firstSeq) break; // 需要的修改已经被丢弃，断开后副本会重新全量同步
+            while (cursor < this->seq && data.size() < MAX_BATCH) {
+                data += this->backlog[++cursor - this->firstSeq];
+            }
+            if (data.empty()) Replication::encode(data, Replication::HEARTBEAT, this->seq, "", "");
+        }
+        ok = sendAll(peer->fd, data);
+        // 读取副本的确认（不阻塞）
+        ssize_t n;
+        while ((n = recv(peer->fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) in.append(buf, n);
+        if (n == 0) break;
+        size_t offset = 0;
+        while ((size = Replication::decode(std::string_view(in).substr(offset), type, from, key, value)) > 0) {
+            if (type == Replication::ACK) peer->acked = from;
+            offset += size;
+        }
+        in.erase(0, offset);
+    }
+    peer->done = true;
+}
+
+std::string Primary::status() {
+    uint64_t seq;
+    {
+        std::unique_lock<std::mutex> l(this->lock);
+        seq = this->seq;
+    }
+    std::string json = "{\"role\": \"primary\", \"replId\": \"" + this->replId +
+        "\", \"seq\": \"" + std::to_string(seq) + "\", \"replicas\": [";
+    std::unique_lock<std::mutex> l(this->peersLock);
+    this->reap();
+    bool first = true;
+    for (auto& peer : this->peers) {
+        uint64_t acked = peer.acked;
+        if (!first) json += ", ";
+        first = false;
+        json += "{\"address\": \"" + peer.address + "\", \"acked\": \"" + std::to_string(acked) +
+            "\", \"lag\": \"" + std::to_string(seq > acked ? seq - acked : 0) + "\"}";
+    }
+    json += "]}";
+    return json;
+}
+
+Replica::Replica(const std::string& host, int port, Apply apply, Prune prune)
+    : host(host), port(port), apply(std::move(apply)), prune(std::move(prune)) {}
+
+Replica::~Replica() {
+    this->stop = true;
+    {
+        std::unique_lock<std::mutex> l(this->lock);
+        if (this->fd != -1) shutdown(this->fd, SHUT_RDWR);
+    }
+    if (this->thread.joinable()) this->thread.join();
+}
+
+void Replica::start() {
+    this->thread = std::thread(&Replica::run, this);
+}
+
+// 连接host:port，失败返回-1
+static int connectTo(const std::string& host, int port) {
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) return -1;
+    int fd = -1;
+    for (addrinfo* ai = result; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd == -1) continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    if (fd != -1) {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    return fd;
+}
+
+void Replica::run() {
+    while (!this->stop) {
+        int fd = connectTo(this->host, this->port);
+        if (fd != -1) {
+            {
+                std::unique_lock<std::mutex> l(this->lock);
+                this->fd = fd;
+            }
+            if (!this->stop) {
+                this->connected = true;
+                if (!this->session(fd)) std::cerr << "复制: 与主节点的连接断开" << std::endl;
+                this->connected = false;
+                this->syncing = false;
+            }
+            {
+                std::unique_lock<std::mutex> l(this->lock);
+                this->fd = -1;
+            }
+            close(fd);
+        }
+        // 等待1秒后重连
+        for (int i = 0; i < 10 && !this->stop; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+}
+
+bool Replica::session(int fd) {
+    std::string out;
+    {
+        std::unique_lock<std::mutex> l(this->lock);
+        Replication::encode(out, Replication::SYNC, this->applied, this->replId, "");
+    }
+    if (!sendAll(fd, out)) return false;
+    this->lastContact = Replication::nowMS();
+    setTimeout(fd, SO_RCVTIMEO, 100); // 定期检查是否需要停止以及主节点是否超时
+    std::string in;
+    std::vector<char> buf(1 << 16);
+    bool full = false; // 正在接收快照
+    uint64_t position = 0; // 快照对应的位置
+    std::string id; // 快照的复制id
+    // 快照按key顺序到达：副本不保存快照中所有的key，只保存最近一批（最多PRUNE_BATCH个）和已经处理到的位置
+    // 每收到一批key，删除副本中[上一批的最后一个key, 这一批的最后一个key]范围内不属于快照的key
+    std::unordered_set<std::string> window; // 最近一批快照中的key（包括上一批的最后一个key）
+    std::string last; // 已经处理到的位置：上一批的最后一个key
+    std::string latest; // 最近收到的快照中的key
+    bool pruned = false; // 是否已经处理过一批（last是否有效）
+    auto pruneWindow = [&](bool end) {
+        this->prune(pruned ? &last : nullptr, end ? nullptr : &latest, window);
+        last = latest;
+        pruned = true;
+        window.clear();
+        window.insert(last);
+    };
+    uint64_t acked = this->applied;
+    while (!this->stop) {
+        ssize_t n = recv(fd, buf.data(), buf.size(), 0);
+        if (n == 0) return false;
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) return false;
+            if (Replication::nowMS() - this->lastContact > TIMEOUT_MS) return false;
+            continue;
+        }
+        this->lastContact = Replication::nowMS();
+        in.append(buf.data(), n);
+        bool heartbeat = false;
+        size_t offset = 0, size;
+        uint8_t type;
+        uint64_t seq;
+        std::string_view key, value;
+        while ((size = Replication::decode(std::string_view(in).substr(offset), type, seq, key, value)) > 0) {
+            offset += size;
+            switch (type) {
+                case Replication::FULL:
+                    full = true;
+                    this->syncing = true;
+                    position = seq;
+                    id = key;
+                    window.clear();
+                    pruned = false;
+                    break;
+                case Replication::FULL_END:
+                    pruneWindow(true); // 删除最后一个key之后的所有key（快照为空时删除所有key）
+                    window = std::unordered_set<std::string>();
+                    full = false;
+                    this->syncing = false;
+                    {
+                        std::unique_lock<std::mutex> l(this->lock);
+                        this->replId = id;
+                    }
+                    this->applied = position;
+                    if (this->primarySeq < position) this->primarySeq = position;
+                    break;
+                case Replication::CONTINUE:
+                    break;
+                case Replication::HEARTBEAT:
+                    this->primarySeq = seq;
+                    heartbeat = true;
+                    break;
+                case Wal::PUT:
+                case Wal::DEL:
+                case Wal::PUT_TTL:
+                    this->apply(Wal::Record{seq, static_cast<Wal::RecordType>(type), std::string(key), std::string(value)});
+                    if (full) {
+                        latest.assign(key.data(), key.size());
+                        window.insert(latest);
+                        if (window.size() > PRUNE_BATCH) pruneWindow(false);
+                    } else {
+                        this->applied = seq;
+                        if (this->primarySeq < seq) this->primarySeq = seq;
+                    }
+                    break;
+                default:
+                    std::cerr << "复制: 未知的帧类型 " << static_cast<int>(type) << std::endl;
+                    return false;
+            }
+        }
+        in.erase(0, offset);
+        // 回放位置变化或者收到心跳时确认
+        if (this->applied != acked || heartbeat) {
+            acked = this->applied;
+            out.clear();
+            Replication::encode(out, Replication::ACK, acked, "", "");
+            if (!sendAll(fd, out)) return false;
+        }
+    }
+    return true;
+}
+
+std::string Replica::status() {
+    uint64_t applied = this->applied, primarySeq = this->primarySeq;
+    uint64_t now = Replication::nowMS(), last = this->lastContact;
+    return "{\"role\": \"replica\", \"primary\": \"" + this->host + ":" + std::to_string(this->port) +
+        "\", \"connected\": \"" + (this->connected ? "true" : "false") +
+        "\", \"syncing\": \"" + (this->syncing ? "true" : "false") +
+        "\", \"seq\": \"" + std::to_string(applied) +
+        "\", \"primarySeq\": \"" + std::to_string(primarySeq) +
+        "\", \"lag\": \"" + std::to_string(primarySeq > applied ? primarySeq - applied : 0) +
+        "\", \"lastContactMS\": \"" + std::to_string(last && now > last ? now - last : 0) + "\"}";
+}
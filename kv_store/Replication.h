@@ -0,0 +1,127 @@
+#ifndef REPLICATION
+#define REPLICATION
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <unordered_set>
+#include <cstdint>
+#include "Wal.h"
+
+// 主从复制：主节点把修改日志通过TCP推送给一个或多个副本，副本回放到自己的存储中，只提供读服务
+// 复制流由帧组成，每帧的格式：类型(1) | 序号(8) | key长度(4) | key | value长度(4) | value
+// 数据帧的类型和value的格式与WAL记录相同（PUT、DEL、PUT_TTL），其余为控制帧（见Replication::FrameType）
+// 每条修改在主节点上有一个从1开始递增的复制序号（与WAL的lsn无关，关闭WAL时也可以复制），
+// 最近的修改保存在内存中的积压缓冲区里，副本断线重连时从断开的位置继续；
+// 副本第一次连接、主节点重启（复制id改变）或者断开太久（需要的修改已经移出积压缓冲区）时先做全量同步
+namespace Replication {
+    enum FrameType : uint8_t {
+        FULL = 10,      // 主->副本：开始全量同步，序号为快照对应的位置，key为复制id，之后按key顺序发送快照中的所有key
+        FULL_END = 11,  // 主->副本：全量同步结束，副本删除快照中没有的key
+        CONTINUE = 12,  // 主->副本：从副本给出的位置继续，key为复制id
+        HEARTBEAT = 13, // 主->副本：空闲时每秒一次，序号为主节点最新的复制序号
+        SYNC = 20,      // 副本->主：握手，序号为已经回放的位置，key为之前的复制id（没有时为空）
+        ACK = 21        // 副本->主：确认已经回放到的位置
+    };
+
+    void encode(std::string& dst, uint8_t type, uint64_t seq, std::string_view key, std::string_view value);
+    // 从data中解析一帧，数据不完整时返回0，否则返回帧的长度
+    size_t decode(std::string_view data, uint8_t& type, uint64_t& seq, std::string_view& key, std::string_view& value);
+    uint64_t nowMS(); // 当前的Unix时间（毫秒）
+}
+
+// 主节点：修改在分段锁内追加到积压缓冲区（与写WAL的顺序一致），每个副本一个发送线程
+class Primary {
+public:
+    // 以emit(类型, key, value)输出存储的一致快照（每个未过期的key一条PUT或PUT_TTL记录）
+    using Snapshot = std::function<void(const std::function<void(Wal::RecordType, std::string_view, std::string_view)>& emit)>;
+
+    Primary(int port, size_t backlogBytes, Snapshot snapshot);
+    ~Primary(); // 停止监听和所有发送线程
+
+    bool start(); // 开始监听，失败返回false
+    void append(Wal::RecordType type, std::string_view key, std::string_view value); // 追加一条修改
+    void append(Wal::RecordType type, const std::vector<std::pair<std::string_view, std::string_view>>& records);
+    std::string status(); // json格式的复制状态（复制序号、每个副本确认的位置和落后的修改数量）
+
+    Primary(const Primary&) = delete; // 禁用拷贝构造函数
+    Primary& operator=(const Primary&) = delete; // 禁用赋值运算符
+private:
+    struct Peer { // 一个已连接的副本
+        int fd;
+        std::string address;
+        std::atomic<uint64_t> acked{0}; // 副本确认已经回放的位置
+        std::atomic<bool> done{false}; // 发送线程已经退出
+        std::thread thread;
+    };
+
+    void encode(Wal::RecordType type, std::string_view key, std::string_view value); // 调用时必须持有lock
+    void listener(); // 接受副本连接的线程
+    void sender(Peer* peer); // 与一个副本握手并持续推送修改
+    // 发送全量快照，cursor为快照对应的位置；边遍历边发送，每积累MAX_BATCH字节发送一次，不在内存中保存整个快照
+    bool fullSync(Peer* peer, uint64_t& cursor);
+    void reap(); // 回收已经退出的发送线程，调用时必须持有peersLock
+
+    int port;
+    size_t backlogBytes;
+    Snapshot snapshot;
+    std::string replId; // 复制id，每次启动随机生成
+    int listenFd = -1;
+    std::thread acceptor;
+    std::atomic<bool> stop{false};
+
+    std::mutex lock; // 保护以下成员
+    std::condition_variable cond; // 有新的修改时通知发送线程
+    std::deque<std::string> backlog; // 最近的修改帧，序号连续
+    size_t bytes = 0; // backlog中帧的总字节数
+    uint64_t firstSeq = 1; // backlog中第一帧的序号
+    uint64_t seq = 0; // 最新的复制序号
+
+    std::mutex peersLock; // 保护peers
+    std::list<Peer> peers;
+};
+
+// 副本：后台线程连接主节点，握手后回放收到的修改；断线后每秒重连一次
+class Replica {
+public:
+    using Apply = std::function<void(const Wal::Record&)>; // 回放一条PUT、DEL或PUT_TTL记录
+    // 全量同步时删除副本中快照之外的key：删除[lo, hi]中不在keep里的key，lo为nullptr时从头开始，hi为nullptr时到末尾
+    using Prune = std::function<void(const std::string* lo, const std::string* hi, const std::unordered_set<std::string>& keep)>;
+
+    Replica(const std::string& host, int port, Apply apply, Prune prune);
+    ~Replica();
+
+    void start();
+    std::string status(); // json格式的复制状态（已回放的位置、主节点的位置、落后的修改数量和距离上次收到消息的毫秒数）
+
+    Replica(const Replica&) = delete; // 禁用拷贝构造函数
+    Replica& operator=(const Replica&) = delete; // 禁用赋值运算符
+private:
+    void run(); // 后台线程
+    bool session(int fd); // 握手并回放修改，直到连接断开或者停止
+
+    std::string host;
+    int port;
+    Apply apply;
+    Prune prune;
+    std::thread thread;
+    std::atomic<bool> stop{false};
+
+    std::mutex lock; // 保护fd和replId
+    int fd = -1; // 当前的连接，停止时关闭它以唤醒后台线程
+    std::string replId; // 当前数据所属的复制id
+    std::atomic<bool> connected{false};
+    std::atomic<bool> syncing{false}; // 正在全量同步
+    std::atomic<uint64_t> applied{0}; // 已经回放的位置
+    std::atomic<uint64_t> primarySeq{0}; // 最近一次得知的主节点的复制序号
+    std::atomic<uint64_t> lastContact{0}; // 最近一次收到主节点消息的时间（毫秒）
+};
+
+#endif
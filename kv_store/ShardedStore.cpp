@@ -0,0 +1,339 @@
+#include "ShardedStore.h"
+#include "Snapshot.h"
+#include "Coding.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <queue>
+#include <climits>
+#include <cmath>
+#include <algorithm>
+
+template<typename Key>
+ShardedStore<Key>::ShardedStore(int shards, long long expectedKeys) {
+    shards = std::max(shards, 1);
+    int maxLevel = levelFor(expectedKeys / shards);
+    for (int i = 0; i < shards; i++) {
+        this->shards.emplace_back(new SkipList<Key>(maxLevel, true, &this->mvcc));
+    }
+}
+
+template<typename Key>
+int ShardedStore<Key>::levelFor(long long keys) {
+    // 每层结点数约为下一层的一半，log2(n)层即可保证O(logn)的查找
+    int level = static_cast<int>(std::ceil(std::log2(std::max(keys, 2LL))));
+    return std::min(std::max(level, 4), 32);
+}
+
+template<typename Key>
+int ShardedStore<Key>::size() const {
+    int total = 0;
+    for (auto& shard : this->shards) {
+        total += shard->size();
+    }
+    return total;
+}
+
+template<typename Key>
+size_t ShardedStore<Key>::memoryUsage() const {
+    size_t total = 0;
+    for (auto& shard : this->shards) {
+        total += shard->memoryUsage();
+    }
+    return total;
+}
+
+template<typename Key>
+int ShardedStore<Key>::retainedVersions() const {
+    int total = 0;
+    for (auto& shard : this->shards) {
+        total += shard->retainedVersions();
+    }
+    return total;
+}
+
+template<typename Key>
+size_t ShardedStore<Key>::reservedMemory() const {
+    size_t total = 0;
+    for (auto& shard : this->shards) {
+        total += shard->reservedMemory();
+    }
+    return total;
+}
+
+template<typename Key>
+std::vector<std::pair<int, std::vector<size_t>>> ShardedStore<Key>::partition(const std::vector<Key>& keys) const {
+    std::vector<std::pair<int, std::vector<size_t>>> groups(this->shards.size());
+    for (size_t i = 0; i < groups.size(); i++) {
+        groups[i].first = static_cast<int>(i);
+    }
+    for (size_t i = 0; i < keys.size(); i++) {
+        groups[this->shardOf(keys[i])].second.push_back(i);
+    }
+    for (auto& group : groups) {
+        std::stable_sort(group.second.begin(), group.second.end(), [&keys](size_t a, size_t b) {
+            return KeyTraits<Key>::keyLess(keys[a], keys[b]);
+        });
+    }
+    return groups;
+}
+
+template<typename Key>
+void ShardedStore<Key>::insertElements(const std::vector<Key>& keys, const std::vector<std::string_view>& values,
+                                       std::vector<int>& results) {
+    results.assign(keys.size(), 0);
+    std::vector<Key> sortedKeys;
+    std::vector<std::string_view> sortedValues;
+    std::vector<int> sortedResults;
+    for (auto& group : this->partition(keys)) {
+        if (group.second.empty()) continue;
+        sortedKeys.clear();
+        sortedValues.clear();
+        for (size_t i : group.second) {
+            sortedKeys.push_back(keys[i]);
+            sortedValues.push_back(values[i]);
+        }
+        sortedResults.resize(sortedKeys.size());
+        this->shards[group.first]->insertElements(sortedKeys, sortedValues, sortedResults.data());
+        for (size_t i = 0; i < group.second.size(); i++) {
+            results[group.second[i]] = sortedResults[i];
+        }
+    }
+}
+
+template<typename Key>
+void ShardedStore<Key>::deleteElements(const std::vector<Key>& keys, std::vector<int>& results) {
+    results.assign(keys.size(), 0);
+    std::vector<Key> sortedKeys;
+    std::vector<int> sortedResults;
+    for (auto& group : this->partition(keys)) {
+        if (group.second.empty()) continue;
+        sortedKeys.clear();
+        for (size_t i : group.second) sortedKeys.push_back(keys[i]);
+        sortedResults.resize(sortedKeys.size());
+        this->shards[group.first]->deleteElements(sortedKeys, sortedResults.data());
+        for (size_t i = 0; i < group.second.size(); i++) {
+            results[group.second[i]] = sortedResults[i];
+        }
+    }
+}
+
+template<typename Key>
+void ShardedStore<Key>::forEach(const Visitor& visit) {
+    using Iterator = typename SkipList<Key>::Iterator;
+    if (this->shards.size() == 1) {
+        Key next;
+        this->merge(nullptr, nullptr, INT_MAX, false, [&visit](const Iterator& iter) {
+            visit(iter.key(), iter.value(), iter.expire());
+        }, next);
+        return;
+    }
+    // 一个批次：一个分片中连续的若干条记录，value依次拷贝到values中
+    struct Batch {
+        std::vector<Key> keys;
+        std::vector<uint32_t> expires;
+        std::vector<size_t> ends; // 每个value在values中的终点
+        std::string values;
+        size_t bytes = 0; // 批次占用的字节数（见SCAN_BATCH）
+        void clear() {
+            this->keys.clear();
+            this->expires.clear();
+            this->ends.clear();
+            this->values.clear();
+            this->bytes = 0;
+        }
+    };
+    // 遍历线程和归并线程之间的队列
+    struct Feed {
+        std::mutex lock;
+        std::condition_variable cond;
+        std::deque<Batch> full; // 等待归并的批次
+        std::vector<Batch> spare; // 归并完的批次，遍历线程复用它们的内存
+        bool done = false; // 分片已经遍历完
+    };
+    ReadView view(this->mvcc);
+    const int shards = this->shardCount();
+    std::vector<Feed> feeds(shards);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < shards; i++) {
+        threads.emplace_back([this, i, &feeds, &view]() {
+            Feed& feed = feeds[i];
+            Batch batch;
+            Iterator iter(*this->shards[i], nullptr, false, &view);
+            bool last = false;
+            while (!last) {
+                batch.clear();
+                for (; iter.valid() && batch.bytes < SCAN_BATCH && batch.keys.size() < SCAN_RECORDS; iter.next()) {
+                    std::string_view value = iter.value();
+                    batch.bytes += sizeof(Key) + KeyTraits<Key>::extraSize(iter.key()) + sizeof(uint32_t) + sizeof(size_t) +
+                                   value.size();
+                    batch.keys.emplace_back(iter.key());
+                    batch.expires.push_back(iter.expire());
+                    batch.values.append(value.data(), value.size());
+                    batch.ends.push_back(batch.values.size());
+                }
+                last = !iter.valid();
+                std::unique_lock<std::mutex> lock(feed.lock);
+                feed.cond.wait(lock, [&feed]() { return feed.full.size() < SCAN_DEPTH; });
+                feed.full.push_back(std::move(batch));
+                feed.done = last;
+                if (!feed.spare.empty()) {
+                    batch = std::move(feed.spare.back());
+                    feed.spare.pop_back();
+                }
+                feed.cond.notify_all();
+            }
+        });
+    }
+    // 归并：每个分片当前的批次和其中下一条记录的位置，堆顶为key最小的分片
+    std::vector<Batch> current(shards);
+    std::vector<size_t> pos(shards, 0);
+    // 取出分片i的下一个批次，分片已经遍历完时返回false
+    auto fetch = [&](int i) {
+        Feed& feed = feeds[i];
+        std::unique_lock<std::mutex> lock(feed.lock);
+        feed.cond.wait(lock, [&feed]() { return !feed.full.empty() || feed.done; });
+        if (feed.full.empty()) return false;
+        feed.spare.push_back(std::move(current[i]));
+        current[i] = std::move(feed.full.front());
+        feed.full.pop_front();
+        pos[i] = 0;
+        feed.cond.notify_all();
+        return true;
+    };
+    auto after = [&](int a, int b) {
+        return KeyTraits<Key>::keyLess(current[b].keys[pos[b]], current[a].keys[pos[a]]);
+    };
+    std::priority_queue<int, std::vector<int>, decltype(after)> heap(after);
+    for (int i = 0; i < shards; i++) {
+        // 空的批次只会是分片的最后一个批次
+        if (fetch(i) && !current[i].keys.empty()) heap.push(i);
+    }
+    while (!heap.empty()) {
+        int i = heap.top();
+        heap.pop();
+        Batch& batch = current[i];
+        size_t p = pos[i];
+        size_t begin = (p == 0 ? 0 : batch.ends[p - 1]);
+        visit(batch.keys[p], std::string_view(batch.values.data() + begin, batch.ends[p] - begin), batch.expires[p]);
+        if (++pos[i] < batch.keys.size() || (fetch(i) && !current[i].keys.empty())) heap.push(i);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+template<typename Key>
+bool ShardedStore<Key>::dump(const std::string& fileName) {
+    SnapshotWriter writer(fileName);
+    std::string key;
+    bool ok = true;
+    // 迭代器跳过已过期的key，快照中只保存还没有过期的key及其过期时间
+    this->forEach([&](Arg k, std::string_view value, uint32_t expire) {
+        if (!ok) return;
+        key.clear();
+        KeyTraits<Key>::encode(key, k);
+        ok = writer.add(key, value, expire);
+    });
+    return ok && writer.finish();
+}
+
+template<typename Key>
+void ShardedStore<Key>::load(const std::string& fileName, const LoadProgress& progress) {
+    if (!SnapshotReader::isSnapshot(fileName)) {
+        // 旧的文本格式：每个分片一个线程，各自读一遍文件，只插入属于自己分片的key
+        std::vector<std::thread> threads;
+        for (int i = 0; i < this->shardCount(); i++) {
+            threads.emplace_back([this, i, &fileName]() {
+                this->shards[i]->load(fileName, [this, i](Arg key) { return this->shardOf(key) == i; });
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        return;
+    }
+    SnapshotReader reader;
+    if (!reader.open(fileName)) return;
+    // 快照按key升序写入，加载分为两个阶段，以LOAD_CHUNK个数据块为单位分批流水线进行：
+    // 解析：每个线程解析一段连续的数据块，把记录按分片分组（value仍然指向映射的内存）
+    // 构建：每个分片一个线程，按数据块的顺序把分给自己的记录交给SkipList::Builder，自底向上链接，不需要查找
+    // 解析第k批的同时构建第k-1批，每条记录只解析一次，整个加载过程的时间复杂度为O(n)
+    struct Record {
+        Key key;
+        std::string_view value;
+        uint32_t expire;
+    };
+    const int parsers = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    const int shards = this->shardCount();
+    const uint32_t blocks = reader.blockCount();
+    const uint32_t now = Value::clock();
+    // runs[批次奇偶][解析线程 * 分片数 + 分片]：该解析线程的数据块中属于该分片的记录，按key升序
+    std::vector<std::vector<Record>> runs[2];
+    runs[0].resize(parsers * shards);
+    runs[1].resize(parsers * shards);
+    std::vector<uint64_t> parsed(parsers); // 本批每个解析线程遍历的记录数（包括已过期的记录）
+    std::vector<char> ok(parsers);
+    std::vector<std::unique_ptr<typename SkipList<Key>::Builder>> builders;
+    for (auto& shard : this->shards) {
+        builders.emplace_back(new typename SkipList<Key>::Builder(*shard));
+    }
+    uint64_t loaded = 0;
+    uint64_t pending = 0; // 已解析、等待构建的记录数
+    bool failed = false; // 遇到了校验失败的数据块，之后的数据块不再加载
+    int buildRuns = 0; // 等待构建的批次中有效的解析线程数
+    uint32_t next = 0; // 下一批的第一个数据块
+    for (int batch = 0; (next < blocks && !failed) || buildRuns > 0; batch++) {
+        std::vector<std::thread> threads;
+        auto& parseRuns = runs[batch & 1];
+        auto& readyRuns = runs[(batch + 1) & 1];
+        int parseThreads = 0;
+        if (next < blocks && !failed) {
+            for (int t = 0; t < parsers && next < blocks; t++, next += LOAD_CHUNK) {
+                parseThreads++;
+                threads.emplace_back([&, t, from = next]() {
+                    for (int i = 0; i < shards; i++) parseRuns[t * shards + i].clear();
+                    uint64_t n = 0;
+                    Key k;
+                    ok[t] = reader.forEach(from, from + LOAD_CHUNK, [&](std::string_view key, std::string_view value, uint32_t expire) {
+                        n++;
+                        if (expire != 0 && expire <= now) return; // 落盘之后已经过期的key不再加载
+                        if (!KeyTraits<Key>::decode(key, k)) return;
+                        parseRuns[t * shards + (shards == 1 ? 0 : this->shardOf(k))].push_back(Record{k, value, expire});
+                    });
+                    parsed[t] = n;
+                });
+            }
+        }
+        for (int i = 0; i < shards && buildRuns > 0; i++) {
+            threads.emplace_back([&, i, count = buildRuns]() {
+                for (int t = 0; t < count; t++) {
+                    for (const Record& record : readyRuns[t * shards + i]) {
+                        builders[i]->add(record.key, record.value, record.expire);
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        loaded += pending;
+        if (progress && buildRuns > 0) progress(loaded, reader.size());
+        // 校验失败的数据块之前的记录仍然加载，之后的解析结果丢弃
+        buildRuns = parseThreads;
+        pending = 0;
+        for (int t = 0; t < parseThreads; t++) {
+            pending += parsed[t];
+            if (!ok[t]) {
+                failed = true;
+                buildRuns = t + 1;
+                break;
+            }
+        }
+    }
+}
+
+template class ShardedStore<int64_t>;
+template class ShardedStore<FixedKey<16>>;
+template class ShardedStore<std::string>;
@@ -0,0 +1,169 @@
+#ifndef SHARDEDSTORE
+#define SHARDEDSTORE
+
+#include <memory>
+#include <vector>
+#include <queue>
+#include <utility>
+#include <string>
+#include <string_view>
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include "SkipList.h"
+
+// 分片存储：按key的哈希把数据分散到多个相互独立的跳表中
+// 每个分片拥有自己的结点、分配器和回收器，不同分片上的写操作不会竞争同一条链表和同一组空闲链表
+// 跳表的最大层数根据每个分片预计的key数量确定，避免层数过少导致跳表退化为链表
+// size、范围查询和落盘需要访问所有分片：范围查询对各分片的有序结果做多路归并，落盘将归并结果写入同一个快照，
+// 因此快照与分片数量无关，修改分片数量后仍然可以加载之前的快照；落盘和全量遍历时各分片由各自的线程并行遍历
+// 所有分片共享同一个Mvcc，范围查询和落盘在所有分片上读到同一时刻的一致视图，不阻塞写入
+template<typename Key>
+class ShardedStore {
+public:
+    using Arg = typename KeyTraits<Key>::Arg;
+
+    ShardedStore(int shards, long long expectedKeys);
+
+    int shardCount() const {
+        return static_cast<int>(this->shards.size());
+    }
+    int size() const; // 所有分片的元素数量之和
+    // 0插入成功；1key已存在，更新value；expire为过期时间，见SkipList::insertElement
+    int insertElement(Arg key, std::string_view value, uint32_t expire = 0) {
+        return this->shard(key).insertElement(key, value, expire);
+    }
+    int updateElement(Arg key, const Updater& fn) { // 原子的读-改-写，见SkipList::updateElement
+        return this->shard(key).updateElement(key, fn);
+    }
+    int deleteElement(Arg key) { // 0删除成功；1key不存在
+        return this->shard(key).deleteElement(key);
+    }
+    int expireElement(Arg key) { // 删除已过期的key，见SkipList::expireElement
+        return this->shard(key).expireElement(key);
+    }
+    // 零拷贝查询，见SkipList::searchElement
+    template<typename F>
+    bool searchElement(Arg key, F&& visit, bool* expired = nullptr) {
+        return this->shard(key).searchElement(key, std::forward<F>(visit), expired);
+    }
+    // 范围查询，语义与SkipList::scan相同
+    template<typename F>
+    bool scan(const Key* lo, const Key* hi, int limit, bool reverse, F&& visit, Key& next) {
+        using Iterator = typename SkipList<Key>::Iterator;
+        return this->merge(lo, hi, limit, reverse, [&visit](const Iterator& iter) {
+            visit(iter.key(), iter.value());
+        }, next);
+    }
+    // 按key顺序以(key, value视图, 过期时间)访问所有未过期的key，所有分片读取同一个快照（用于落盘和全量遍历）
+    // 每个分片一个线程遍历，把记录拷贝到有界的批次中，当前线程按key归并各分片的批次并调用visit
+    // 遍历跳表（指针追逐，大量缓存未命中）在各分片上并行进行，归并只需要比较key；value视图只在visit调用期间有效
+    using Visitor = std::function<void(Arg key, std::string_view value, uint32_t expire)>;
+    void forEach(const Visitor& visit);
+    // 对第i个分片执行一步主动过期，见SkipList::sampleExpired
+    template<typename F>
+    bool sampleExpired(int i, const Key* from, int limit, F&& visit, Key& next) {
+        return this->shards[i]->sampleExpired(from, limit, std::forward<F>(visit), next);
+    }
+    int expiringCount(int i) const {
+        return this->shards[i]->expiringCount();
+    }
+    int retainedVersions(int i) const {
+        return this->shards[i]->retainedVersions();
+    }
+    int retainedVersions() const; // 所有分片为快照保留的旧版本数量
+    bool snapshotActive() const { // 是否有活跃的快照（此时删除只写入删除标记，不释放内存）
+        return !this->mvcc.idle();
+    }
+    // 对第i个分片执行一步CLOCK淘汰，见SkipList::clockSweep
+    template<typename F>
+    bool clockSweep(int i, const Key* from, int limit, F&& visit, Key& next) {
+        return this->shards[i]->clockSweep(from, limit, std::forward<F>(visit), next);
+    }
+    // 批量操作：keys不要求有序，先按分片分组，组内按key排序后交给分片的批量接口（见SkipList::searchElements）
+    // 批量查询：对找到的keys[i]以(i, value视图)调用visit
+    template<typename F>
+    void searchElements(const std::vector<Key>& keys, F&& visit) {
+        std::vector<Key> sorted;
+        for (auto& group : this->partition(keys)) {
+            if (group.second.empty()) continue;
+            sorted.clear();
+            for (size_t i : group.second) sorted.push_back(keys[i]);
+            this->shards[group.first]->searchElements(sorted, [&visit, &group](size_t i, std::string_view value) {
+                visit(group.second[i], value);
+            });
+        }
+    }
+    // 批量插入和删除，results[i]为keys[i]的结果；重复的key按照在keys中的先后顺序执行
+    void insertElements(const std::vector<Key>& keys, const std::vector<std::string_view>& values, std::vector<int>& results);
+    void deleteElements(const std::vector<Key>& keys, std::vector<int>& results);
+    bool dump(const std::string& fileName); // 按key顺序归并所有分片，写入一个快照
+    // 加载进度：已加载的记录数和快照中的记录总数
+    using LoadProgress = std::function<void(uint64_t loaded, uint64_t total)>;
+    // 加载快照：多个线程按数据块并行解析，每个分片一个线程按key顺序自底向上构建跳表（见SkipList::Builder）
+    // 每加载一批数据块调用一次progress；旧的文本格式每个分片一个线程，各自加载属于自己的key
+    void load(const std::string& fileName, const LoadProgress& progress = nullptr);
+    size_t memoryUsage() const; // 所有分片的结点和value占用的字节数
+    size_t reservedMemory() const; // 所有分片的分配器向系统申请的字节数
+
+    static int levelFor(long long keys); // 容纳keys个key所需的跳表最大层数
+
+    static const uint32_t LOAD_CHUNK = 64; // 加载时每个解析线程一次解析的数据块数（约4MB）
+    // 全量遍历时每个批次的字节数上限（key、value以及每条记录的过期时间和偏移），value很小或者为空时由记录数限制
+    static const size_t SCAN_BATCH = 64 * 1024;
+    static const size_t SCAN_RECORDS = 4096; // 全量遍历时每个批次的记录数上限
+    static const size_t SCAN_DEPTH = 2; // 全量遍历时每个分片最多领先归并线程的批次数
+
+    ShardedStore(const ShardedStore&) = delete; // 禁用拷贝构造函数
+    ShardedStore& operator=(const ShardedStore&) = delete; // 禁用赋值运算符
+private:
+    // 每个分片一个迭代器，用堆按key顺序归并，以迭代器调用visit（落盘时需要读取过期时间）
+    // 所有迭代器读取同一个快照
+    template<typename F>
+    bool merge(const Key* lo, const Key* hi, int limit, bool reverse, F&& visit, Key& next) {
+        using Iterator = typename SkipList<Key>::Iterator;
+        ReadView view(this->mvcc);
+        std::vector<std::unique_ptr<Iterator>> iters;
+        // 堆顶为下一个要访问的key所在的分片
+        auto after = [&iters, reverse](int a, int b) {
+            return reverse ? iters[a]->less(*iters[b]) : iters[b]->less(*iters[a]);
+        };
+        std::priority_queue<int, std::vector<int>, decltype(after)> heap(after);
+        for (auto& shard : this->shards) {
+            iters.emplace_back(new Iterator(*shard, reverse ? hi : lo, reverse, &view));
+            if (iters.back()->valid()) heap.push(static_cast<int>(iters.size()) - 1);
+        }
+        const Key* bound = reverse ? lo : hi; // 遍历终点一侧的边界
+        typename KeyTraits<Key>::Probe end{};
+        if (bound) end = KeyTraits<Key>::probe(*bound);
+        int n = 0;
+        while (!heap.empty()) {
+            int i = heap.top();
+            heap.pop();
+            Iterator& iter = *iters[i];
+            if (bound && iter.beyond(end)) break; // 堆顶已超出范围，其余分片也一样
+            if (n++ == limit) {
+                next = Key(iter.key());
+                return true;
+            }
+            visit(iter);
+            iter.next();
+            if (iter.valid()) heap.push(i);
+        }
+        return false;
+    }
+    int shardOf(Arg key) const {
+        // 对key的哈希再做一次乘法散列，连续的key不会集中在同一个分片
+        return static_cast<int>(((KeyTraits<Key>::hash(key) * 0x9E3779B97F4A7C15ULL) >> 32) % this->shards.size());
+    }
+    SkipList<Key>& shard(Arg key) {
+        return *this->shards[this->shardOf(key)];
+    }
+    // 将keys的下标按分片分组，组内按key稳定排序；返回(分片编号, 下标列表)
+    std::vector<std::pair<int, std::vector<size_t>>> partition(const std::vector<Key>& keys) const;
+
+    Mvcc mvcc; // 所有分片共享的提交序号和快照（必须在shards之前声明）
+    std::vector<std::unique_ptr<SkipList<Key>>> shards;
+};
+
+#endif
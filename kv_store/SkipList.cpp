@@ -1,50 +1,224 @@
 #include "SkipList.h"
-#include <ctime>
+#include "Snapshot.h"
+#include "Coding.h"
+#include <fstream>
+#include <random>
+#include <thread>
+#include <functional>
+#include <cstring>
+#include <chrono>
+#include <new>
 
-SkipList::SkipList(int maxLevel) {
+uint32_t Value::clock() {
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+Value* Value::create(void* p, std::string_view data, uint32_t expire) {
+    Value* v = static_cast<Value*>(p);
+    v->len = data.size();
+    v->expire = expire;
+    new (&v->seq) std::atomic<uint64_t>(PENDING);
+    new (&v->prev) std::atomic<Value*>(nullptr);
+    memcpy(const_cast<char*>(v->data()), data.data(), data.size());
+    return v;
+}
+
+template<typename Key>
+Node<Key>* Node<Key>::create(Arena& arena, Arg key, std::string_view value, int level, uint32_t expire) {
+    size_t towerSize = (level + 1) * sizeof(std::atomic<Node*>);
+    size_t inlineSize = (value.size() <= INLINE_VALUE ? Value::allocSize(value.size()) : 0);
+    size_t extra = Traits::extraSize(key);
+    Node* node = static_cast<Node*>(arena.allocate(sizeof(Node) + towerSize + (inlineSize ? alignValue(extra) : extra) + inlineSize));
+    node->level = static_cast<uint8_t>(level);
+    Traits::store(node->key, const_cast<char*>(node->keyData()), key);
+    node->inlineSize = static_cast<uint16_t>(inlineSize);
+    node->releases.store(0, std::memory_order_relaxed);
+    node->referenced.store(1, std::memory_order_relaxed); // 新写入的key在第一轮淘汰中不会被淘汰
+    // 不同层下一个结点地址初始化为0（NULL）
+    for (int i = 0; i <= level; i++) {
+        new (&node->forward(i)) std::atomic<Node*>(nullptr);
+    }
+    void* p = (inlineSize ? node->inlineValue() : arena.allocate(Value::allocSize(value.size())));
+    new (&node->value) std::atomic<Value*>(Value::create(p, value, expire));
+    return node;
+}
+
+template<typename Key>
+void Node<Key>::destroy(Arena& arena, Node* node) {
+    // 结点已经不可访问，释放整条版本链（内联的版本随结点一起释放）
+    Value* v = strip(node->value.load());
+    while (v) {
+        Value* prev = v->prev.load();
+        if (!node->isInline(v)) {
+            arena.deallocate(v, Value::allocSize(v->len));
+        }
+        v = prev;
+    }
+    arena.deallocate(node, node->allocSize());
+}
+
+template<typename Key>
+Value* Node<Key>::setValue(Arena& arena, std::string_view v, uint32_t expire, const Value** old, const Value* expected) {
+    Value* value = Value::create(arena.allocate(Value::allocSize(v.size())), v, expire);
+    Value* prev = this->value.load();
+    do {
+        if (isFrozen(prev) || (expected && prev != expected)) { // 新版本还没有发布，可以直接释放
+            arena.deallocate(value, Value::allocSize(v.size()));
+            return nullptr;
+        }
+        value->prev.store(prev);
+    } while (!this->value.compare_exchange_weak(prev, value));
+    *old = prev;
+    return value;
+}
+
+template<typename Key>
+bool Node<Key>::freeze(const Value* expected) {
+    Value* v = const_cast<Value*>(expected);
+    return this->value.compare_exchange_strong(v, reinterpret_cast<Value*>(reinterpret_cast<uintptr_t>(expected)|1));
+}
+
+template<typename Key>
+const Value* Node<Key>::visible(uint64_t snapshot) const {
+    const Value* v = this->current();
+    while (v) {
+        uint64_t seq = v->seq.load();
+        // 写入线程链接版本之后立即取得提交序号，这里只需要短暂等待
+        // fork出的子进程中写入线程已经不存在，不能等待：这样的版本比快照新（写入还没有返回，日志在提交之后才追加，
+        // 一定在落盘前切换出的新日志段中），视为不可见（PENDING大于任何快照序号）
+        while (seq == Value::PENDING && !Mvcc::forked()) {
+            std::this_thread::yield();
+            seq = v->seq.load();
+        }
+        if (seq < snapshot) return v;
+        v = v->prev.load();
+    }
+    return nullptr;
+}
+
+template<typename Key>
+SkipList<Key>::SkipList(int maxLevel, bool concurrent, Mvcc* mvcc) {
     this->maxLevel = maxLevel;
     this->currLevel = 0;
     this->count = 0;
+    this->ttlCount = 0;
+    this->versionCount = 0;
+    this->concurrent = concurrent;
+    if (!mvcc) {
+        this->ownMvcc.reset(new Mvcc());
+        mvcc = this->ownMvcc.get();
+    }
+    this->mvcc = mvcc;
     // 创建头结点（头结点不存储数据，只存储索引）
-    this->header = new Node(0, "", maxLevel);
+    this->header = Node::create(this->arena, Key{}, "", maxLevel);
+    this->header->current()->seq.store(0);
 }
 
-SkipList::~SkipList() {
-    // 关闭文件
-    if (this->writer.is_open()) {
-        this->writer.close();
-    }
-    if (this->reader.is_open()) {
-        this->reader.close();
-    }
-    //删除跳表节点
-    Node* curr = this->header->forward[0];
+template<typename Key>
+SkipList<Key>::~SkipList() {
+    //删除跳表节点（已被摘除的结点由epoch在析构时回收）
+    Node* curr = Node::unmark(this->header->forward(0).load());
     while(curr) {
-        Node* temp = curr->forward[0];
-        delete curr;
+        Node* temp = Node::unmark(curr->forward(0).load());
+        Node::destroy(this->arena, curr);
         curr = temp;
     }
-    delete this->header;
+    Node::destroy(this->arena, this->header);
+}
+
+template<typename Key>
+bool SkipList<Key>::dump(const std::string &fileName) {
+    std::unique_lock<std::mutex> lock(this->dumpLock);
+    SnapshotWriter writer(fileName);
+    std::string key;
+    // 快照读：落盘期间的写入不会出现在快照中，也不需要阻塞写入
+    ReadView view(*this->mvcc);
+    for (Iterator iter(*this, nullptr, false, &view); iter.valid(); iter.next()) {
+        key.clear();
+        Traits::encode(key, iter.key());
+        if (!writer.add(key, iter.value(), iter.expire())) return false;
+    }
+    return writer.finish();
 }
 
-void SkipList::dump(const std::string &fileName) {
-    this->writer.open(fileName, std::ios::out);
-    Node* curr = this->header->forward[0]; // 第一个数据结点
-    while (curr) {
-        this->writer << curr->getKey() << ":" << curr->getValue() << "\n";
-        curr = curr->forward[0];
+template<typename Key>
+void SkipList<Key>::load(const std::string &fileName, const std::function<bool(Arg)>& filter) {
+    if (!SnapshotReader::isSnapshot(fileName)) {
+        this->loadText(fileName, filter);
+        return;
     }
-    // 将数据从缓冲区刷入磁盘
-    this->writer.flush();
-    this->writer.close();
+    SnapshotReader reader;
+    if (!reader.open(fileName)) return;
+    Key k;
+    uint32_t now = Value::clock();
+    Builder builder(*this); // 快照中的key是有序的，直接自底向上构建
+    reader.forEach([&builder, &filter, &k, now](std::string_view key, std::string_view value, uint32_t expire) {
+        if (expire != 0 && expire <= now) return; // 落盘之后已经过期的key不再加载
+        if (!Traits::decode(key, k)) return;
+        if (filter && !filter(k)) return;
+        builder.add(k, value, expire);
+    });
 }
 
-void SkipList::load(const std::string &fileName) {
-    this->reader.open(fileName, std::ios::in);
-    if(this->reader.is_open()) {
+template<typename Key>
+SkipList<Key>::Builder::Builder(SkipList& list) : list(list), lock(list.mutex, std::defer_lock), tails(list.maxLevel + 1) {
+    if (!list.concurrent) this->lock.lock();
+    this->locateTails();
+}
+
+template<typename Key>
+SkipList<Key>::Builder::~Builder() {
+    this->list.count += this->added;
+    this->list.ttlCount += this->expiring;
+}
+
+template<typename Key>
+void SkipList<Key>::Builder::locateTails() {
+    Node* curr = this->list.header;
+    for (int i = this->list.maxLevel; i >= 0; i--) {
+        Node* next;
+        while ((next = Node::unmark(curr->forward(i).load()))) curr = next;
+        this->tails[i] = curr;
+    }
+}
+
+template<typename Key>
+void SkipList<Key>::Builder::add(Arg key, std::string_view value, uint32_t expire) {
+    Node* last = this->tails[0];
+    if (last != this->list.header && !last->less(Traits::probe(key))) {
+        // 输入无序或者有重复的key：按普通的插入处理
+        EpochGuard guard(this->list.epoch);
+        Node* preds[this->list.maxLevel + 1];
+        Node* succs[this->list.maxLevel + 1];
+        this->list.insert(key, value, expire, preds, succs, false);
+        this->locateTails();
+        return;
+    }
+    int level = this->list.getRandomLevel();
+    Node* node = Node::create(this->list.arena, key, value, level, expire);
+    // 结点对读者可见之前已经取得提交序号，读者不需要等待；
+    // 同样在链接之前记下插入线程的一次release（结点还不可见，不会有删除线程与之竞争，不需要原子的加法）
+    node->current()->seq.store(this->list.mvcc->now(), std::memory_order_relaxed);
+    node->releases.store(1, std::memory_order_relaxed);
+    // 新结点的forward都是空指针，自底向上接在每一层的尾结点之后；release保证读者看到结点时结点已经初始化
+    for (int i = 0; i <= level; i++) {
+        this->tails[i]->forward(i).store(node, std::memory_order_release);
+        this->tails[i] = node;
+    }
+    int curr = this->list.currLevel.load();
+    while (level > curr && !this->list.currLevel.compare_exchange_weak(curr, level));
+    this->added++;
+    if (expire != 0) this->expiring++;
+}
+
+template<typename Key>
+void SkipList<Key>::loadText(const std::string &fileName, const std::function<bool(Arg)>& filter) {
+    std::ifstream reader(fileName, std::ios::in);
+    if(reader.is_open()) {
         std::string line;
         std::string delimiter = ":"; // k-v分隔符
-        while (getline(this->reader, line)) {
+        while (getline(reader, line)) {
             // 检查line是否有效
             if(!line.empty()&&line.find(delimiter)!=std::string::npos) {
                 std::string key = line.substr(0, line.find(delimiter));
@@ -52,123 +226,476 @@ void SkipList::load(const std::string &fileName) {
                 if (key.empty()||value.empty()) {
                     continue;
                 }
-                insertElement(stoi(key), value);
+                Key k = Traits::parse(key);
+                if (filter && !filter(k)) continue;
+                insertElement(k, value);
             }
         }
-        this->reader.close();
+        reader.close();
     }
 }
 
-int SkipList::getRandomLevel(){
+template<typename Key>
+int SkipList<Key>::getRandomLevel(){
+    // rand()不是线程安全的，且每次用time重新播种会导致同一秒内生成的层数完全相同
+    // 这里每个线程使用独立的随机数生成器
+    static thread_local std::minstd_rand engine(
+        std::random_device{}() ^ std::hash<std::thread::id>()(std::this_thread::get_id()));
     int k = 0;
-    srand(time(nullptr));
-    while (rand() % 2) {
+    while (engine() & 1) {
         k++;
     }
     k = (k < this->maxLevel) ? k : this->maxLevel;
     return k;
 }
 
-int SkipList::insertElement(int key, const std::string value) {
-    std::unique_lock<std::mutex> lock(this->mutex);
-    Node* curr = this->header;
-    // update中存放forward应该被更新的结点
-    Node* update[this->maxLevel+1];
-    memset(update, 0, sizeof(Node*)*(this->maxLevel+1));
-    // 从跳表最高层开始找
-    for(int i = this->currLevel; i >= 0; i--) {
-        while(curr->forward[i] && curr->forward[i]->getKey() < key) {
-            curr = curr->forward[i];
+template<typename Key>
+int SkipList<Key>::fingerLevel(const Probe& key, Node** succs) {
+    // 上一个key的前驱一定小于key；如果某一层的后继为空或不小于key，这一层的前驱和后继对key仍然成立
+    // 从最高层向下，找到第一个后继小于key的层，只需从这一层开始向下查找
+    int i = this->maxLevel;
+    while (i > 0 && (!succs[i] || !succs[i]->less(key))) i--;
+    return i;
+}
+
+template<typename Key>
+bool SkipList<Key>::find(const Probe& key, Node** preds, Node** succs, bool finger) {
+retry:
+    int top = this->maxLevel;
+    Node* pred = this->header;
+    if (finger) {
+        top = this->fingerLevel(key, succs);
+        pred = preds[top];
+        finger = false; // 复用的前驱可能已被删除，重试时从头结点开始
+    }
+    Node* curr = nullptr;
+    // 从最高层开始找（并发插入可能随时抬高currLevel，因此这里从maxLevel开始）
+    for (int i = top; i >= 0; i--) {
+        curr = Node::unmark(pred->forward(i).load());
+        while (curr) {
+            Node* succ = curr->forward(i).load();
+            // curr在第i层已被标记删除，将其从pred后摘除
+            while (Node::isMarked(succ)) {
+                Node* expected = curr;
+                if (!pred->forward(i).compare_exchange_strong(expected, Node::unmark(succ))) {
+                    goto retry; // pred被修改或已被删除，重新查找
+                }
+                curr = Node::unmark(succ);
+                if (!curr) break;
+                succ = curr->forward(i).load();
+            }
+            if (curr && curr->less(key)) {
+                pred = curr;
+                curr = Node::unmark(succ);
+            } else break;
         }
-        update[i] = curr;
+        preds[i] = pred;
+        succs[i] = curr;
     }
+    return succs[0] && succs[0]->equal(key);
+}
 
-    curr = curr->forward[0];
-    // 如果key存在，则更新value
-    if (curr && curr->getKey() == key) {
-        curr->setValue(value);
-        return 1;
+template<typename Key>
+void SkipList<Key>::release(Node* node) {
+    if (node->releases.fetch_add(1) == 1) {
+        this->epoch.retire(node, [](void* arena, void* p) {
+            Node::destroy(*static_cast<Arena*>(arena), static_cast<Node*>(p));
+        }, &this->arena);
     }
+}
+
+template<typename Key>
+void SkipList<Key>::retireValue(Value* value) {
+    if (!value) return;
+    this->epoch.retire(value, [](void* arena, void* p) {
+        Value* v = static_cast<Value*>(p);
+        static_cast<Arena*>(arena)->deallocate(v, Value::allocSize(v->len));
+    }, &this->arena);
+}
+
+template<typename Key>
+void SkipList<Key>::commit(Node* node, const Value* version) {
+    // 先链接再取提交序号：取得的序号小于某个快照的序号时，创建快照之前版本已经链接，快照的读者一定能看到它
+    version->seq.store(this->mvcc->now());
+    this->trim(node, version);
+}
+
+template<typename Key>
+void SkipList<Key>::trim(Node* node, const Value* from) {
+    uint64_t oldest = this->mvcc->oldest();
+    // 最早的快照可见的版本，更新的快照看到的版本不会比它更旧；没有快照时就是from本身
+    const Value* v = from;
+    while (v && !(v->seq.load() < oldest)) v = v->prev.load();
+    if (!v) return;
+    // 通过exchange取得后续版本的所有权，并发回收同一条链的线程不会重复回收
+    Value* tail = v->prev.exchange(nullptr);
+    int n = 0;
+    while (tail) {
+        Value* prev = tail->prev.exchange(nullptr);
+        if (!node->isInline(tail)) this->retireValue(tail);
+        tail = prev;
+        n++;
+    }
+    if (n) this->versionCount -= n;
+}
+
+template<typename Key>
+int SkipList<Key>::insertElement(Arg k, std::string_view value, uint32_t expire) {
+    std::unique_lock<std::mutex> lock(this->mutex, std::defer_lock);
+    if (!this->concurrent) lock.lock();
+    EpochGuard guard(this->epoch);
+    Node* preds[this->maxLevel+1];
+    Node* succs[this->maxLevel+1];
+    return this->insert(k, value, expire, preds, succs, false);
+}
 
-    if (curr == NULL || curr->getKey() != key ) {
-        // 随机生成结点的插入层
-        int randomLevel = this->getRandomLevel();
-        // 如果randomLevel>跳表当前层，则update数组中这些层应该填上head
-        if (randomLevel > this->currLevel) {
-            for (int i = this->currLevel+1; i < randomLevel+1; i++) {
-                update[i] = this->header;
+template<typename Key>
+int SkipList<Key>::updateElement(Arg k, const Updater& fn) {
+    std::unique_lock<std::mutex> lock(this->mutex, std::defer_lock);
+    if (!this->concurrent) lock.lock();
+    EpochGuard guard(this->epoch);
+    Node* preds[this->maxLevel+1];
+    Node* succs[this->maxLevel+1];
+    return this->insert(k, "", 0, preds, succs, false, &fn);
+}
+
+template<typename Key>
+void SkipList<Key>::insertElements(const std::vector<Key>& keys, const std::vector<std::string_view>& values, int* results) {
+    std::unique_lock<std::mutex> lock(this->mutex, std::defer_lock);
+    if (!this->concurrent) lock.lock();
+    EpochGuard guard(this->epoch);
+    Node* preds[this->maxLevel+1];
+    Node* succs[this->maxLevel+1];
+    for (size_t i = 0; i < keys.size(); i++) {
+        // 插入后前驱指向了新结点，重复的key不能复用（前驱必须小于key）
+        bool finger = (i > 0 && Traits::keyLess(keys[i - 1], keys[i]));
+        results[i] = this->insert(keys[i], values[i], 0, preds, succs, finger);
+    }
+}
+
+template<typename Key>
+int SkipList<Key>::insert(Arg k, std::string_view value, uint32_t expire, Node** preds, Node** succs, bool finger,
+                          const Updater* update) {
+    Probe key = Traits::probe(k);
+    Node* node = nullptr;
+    int randomLevel = 0;
+    std::string updated; // update计算出的新value
+    // 以当前版本current（key不存在时为nullptr）调用update，得到新的value和过期时间
+    auto modify = [&](const Value* current) {
+        bool alive = current && current->alive();
+        std::string_view view = (alive ? current->view() : std::string_view());
+        expire = (alive ? current->expire : 0);
+        updated.clear();
+        if (!(*update)(alive ? &view : nullptr, updated, expire)) return false;
+        value = updated;
+        return true;
+    };
+    while (true) {
+        if (this->find(key, preds, succs, finger)) {
+            // 如果key存在，则更新value
+            if (node) { // 之前准备插入的结点没有被链接过，可以直接释放
+                Node::destroy(this->arena, node);
+                node = nullptr;
+            }
+            const Value* old;
+            const Value* expected = nullptr;
+            if (update) {
+                expected = succs[0]->current();
+                if (!modify(expected)) return -1;
+            }
+            Value* version = succs[0]->setValue(this->arena, value, expire, &old, expected);
+            if (!version) { // 读取之后value被并发修改，重新读取
+                finger = false;
+                continue;
             }
-            this->currLevel = randomLevel;
+            this->versionCount++;
+            this->commit(succs[0], version);
+            succs[0]->touch();
+            this->ttlCount += (expire != 0) - (old->expire != 0);
+            if (old->deleted()) this->count++;
+            return old->alive() ? 1 : 0; // 旧value已经过期或者已被删除时相当于插入新key
+        }
+        if (update && node) { // 重试时key的状态可能已经变化，需要重新计算value
+            Node::destroy(this->arena, node);
+            node = nullptr;
+        }
+        if (!node) {
+            if (update && !modify(nullptr)) return -1;
+            // 随机生成结点的插入层
+            randomLevel = this->getRandomLevel();
+            node = Node::create(this->arena, k, value, randomLevel, expire);
         }
-        // 插入结点
-        auto node = new Node(key, value, randomLevel);
         for (int i = 0; i <= randomLevel; i++) {
-            node->forward[i] = update[i]->forward[i];
-            update[i]->forward[i] = node;
+            node->forward(i).store(succs[i], std::memory_order_relaxed);
+        }
+        // 在第0层链接成功即插入成功
+        Node* expected = succs[0];
+        if (preds[0]->forward(0).compare_exchange_strong(expected, node)) break;
+        finger = false;
+    }
+    this->commit(node, node->current());
+    this->count++;
+    if (expire != 0) this->ttlCount++;
+    // 如果randomLevel>跳表当前层，则抬高当前层
+    int level = this->currLevel.load();
+    while (randomLevel > level && !this->currLevel.compare_exchange_weak(level, randomLevel));
+    // 自底向上链接其余各层
+    for (int i = 1; i <= randomLevel; i++) {
+        while (true) {
+            Node* next = node->forward(i).load();
+            // 结点已被删除线程标记，不再继续链接
+            if (Node::isMarked(next)) goto linked;
+            // 只有删除线程会修改尚未链接层的forward（加标记），因此CAS失败说明结点已被标记
+            if (next != succs[i] && !node->forward(i).compare_exchange_strong(next, succs[i])) goto linked;
+            Node* expected = succs[i];
+            if (preds[i]->forward(i).compare_exchange_strong(expected, node)) break;
+            // 前驱发生变化，重新查找该层的前驱和后继
+            this->find(key, preds, succs);
+            if (Node::isMarked(node->forward(0).load())) goto linked;
         }
-        this->count++;
     }
+linked:
+    // 链接期间结点可能被删除：删除线程摘除时可能还没看到后来链接的层，这里再摘除一次
+    if (Node::isMarked(node->forward(0).load())) {
+        this->find(key, preds, succs);
+    } else {
+        // 新结点是之后更大的key在这些层的前驱
+        for (int i = 0; i <= randomLevel; i++) preds[i] = node;
+    }
+    this->release(node);
     return 0;
 }
 
-int SkipList::deleteElement(int key) {
-    std::unique_lock<std::mutex> lock(this->mutex);
-    Node* curr = this->header;
-    Node* update[this->maxLevel+1];
-    memset(update, 0, sizeof(Node*)*(this->maxLevel+1));
-    // 从跳表最高层开始找
-    for (int i = this->currLevel; i >= 0; i--) {
-        while (curr->forward[i] && curr->forward[i]->getKey() < key) {
-            curr = curr->forward[i];
+template<typename Key>
+int SkipList<Key>::deleteElement(Arg k) {
+    std::unique_lock<std::mutex> lock(this->mutex, std::defer_lock);
+    if (!this->concurrent) lock.lock();
+    EpochGuard guard(this->epoch);
+    Node* preds[this->maxLevel+1];
+    Node* succs[this->maxLevel+1];
+    return this->erase(k, preds, succs, false);
+}
+
+template<typename Key>
+void SkipList<Key>::deleteElements(const std::vector<Key>& keys, int* results) {
+    std::unique_lock<std::mutex> lock(this->mutex, std::defer_lock);
+    if (!this->concurrent) lock.lock();
+    EpochGuard guard(this->epoch);
+    Node* preds[this->maxLevel+1];
+    Node* succs[this->maxLevel+1];
+    for (size_t i = 0; i < keys.size(); i++) {
+        results[i] = this->erase(keys[i], preds, succs, i > 0);
+    }
+}
+
+template<typename Key>
+int SkipList<Key>::expireElement(Arg k) {
+    std::unique_lock<std::mutex> lock(this->mutex, std::defer_lock);
+    if (!this->concurrent) lock.lock();
+    EpochGuard guard(this->epoch);
+    Node* preds[this->maxLevel+1];
+    Node* succs[this->maxLevel+1];
+    return this->erase(k, preds, succs, false, true);
+}
+
+template<typename Key>
+int SkipList<Key>::erase(Arg k, Node** preds, Node** succs, bool finger, bool expiredOnly) {
+    Probe key = Traits::probe(k);
+    if (!this->find(key, preds, succs, finger)) return 1; // key不存在
+    Node* curr = succs[0];
+    const Value* value;
+    bool alive;
+    while (true) {
+        value = curr->current();
+        alive = value->alive();
+        if (expiredOnly && alive) return 1;
+        if (!this->mvcc->idle()) {
+            // 有快照时不能直接摘除结点（快照可能还需要旧版本）：写入删除标记，持有快照的读者沿版本链读到删除之前的value
+            if (alive) {
+                const Value* old;
+                Value* tombstone = curr->setValue(this->arena, "", Value::DELETED, &old);
+                if (!tombstone) return 1; // 结点已被冻结，其他线程正在删除它
+                this->versionCount++;
+                this->commit(curr, tombstone);
+                this->ttlCount += 1 - (old->expire != 0); // 删除标记由主动过期回收
+                if (!old->deleted()) this->count--;
+                return old->alive() ? 0 : 1;
+            }
+            // 已过期的key和删除标记：所有快照都能看到最新版本之后才能摘除
+            if (!(value->seq.load() < this->mvcc->oldest())) return 1;
         }
-        update[i] = curr;
+        // 冻结成功的线程完成删除；检查之后value被并发修改时重新检查（expiredOnly不会删除刚刚更新的key）
+        if (curr->freeze(value)) break;
+        if (curr->frozen()) return 1; // 其他线程已经删除了该结点
     }
+    // 自顶向下标记各层，value已被冻结，之后的写入线程会重新查找并插入新结点
+    for (int i = curr->getLevel(); i >= 0; i--) {
+        Node* next = curr->forward(i).load();
+        while (!Node::isMarked(next)) {
+            curr->forward(i).compare_exchange_weak(next, Node::mark(next));
+        }
+    }
+    // 物理摘除各层
+    this->find(key, preds, succs);
+    if (!value->deleted()) this->count--;
+    if (value->expire != 0) this->ttlCount--;
+    for (const Value* v = value->prev.load(); v; v = v->prev.load()) this->versionCount--;
+    this->release(curr);
+    return (alive || expiredOnly) ? 0 : 1; // 删除已过期的key时，对调用者来说key不存在
+}
 
-    curr = curr->forward[0];
-    if (curr && curr->getKey() == key) {
-        // 从最低层开始删除当前结点
-        for (int i = 0; i <= this->currLevel; i++) {
-            // 如果curr结点没在该层，说明已经删完，退出循环
-            if (update[i]->forward[i] != curr)break;
-            // 删除curr
-            update[i]->forward[i] = curr->forward[i];
+template<typename Key>
+Node<Key>* SkipList<Key>::lowerBound(const Probe* key, Node** preds, Node** succs, bool finger) {
+    if (!key) return this->nextNode(this->header);
+    int top = this->currLevel.load();
+    Node* pred = this->header;
+    if (finger) {
+        top = this->fingerLevel(*key, succs);
+        pred = preds[top];
+    } else if (preds) {
+        for (int i = this->maxLevel; i > top; i--) {
+            preds[i] = this->header;
+            succs[i] = nullptr;
         }
-        // 移除没有元素的层
-        while (this->currLevel > 0 && this->header->forward[this->currLevel] == NULL) {
-            this->currLevel--;
+    }
+    Node* curr = nullptr;
+    // 从跳表最高层开始找，只读不写，跳过被标记的结点
+    for (int i = top; i >= 0; i--) {
+        curr = Node::unmark(pred->forward(i).load());
+        while (curr) {
+            Node* succ = curr->forward(i).load();
+            if (Node::isMarked(succ)) {
+                curr = Node::unmark(succ);
+            } else if (curr->less(*key)) {
+                pred = curr;
+                curr = succ;
+            } else break;
+        }
+        if (preds) {
+            preds[i] = pred;
+            succs[i] = curr;
         }
-        // delete curr;
-        this->count--;
-        return 0;
-    }else return 1; // key不存在
+    }
+    // 到达第0层，curr是第一个key不小于目标key的未删除结点
+    return curr;
 }
 
-std::pair<std::string,bool> SkipList::searchElement(int key) {
-    std::unique_lock<std::mutex> lock(this->mutex);
-    Node* curr = this->header;
-    // 从跳表最高层开始找
-    for (int i = this->currLevel; i >= 0; i--) {
-        while (curr->forward[i] && curr->forward[i]->getKey() < key) {
-            curr = curr->forward[i];
+template<typename Key>
+Node<Key>* SkipList<Key>::search(const Probe& key) {
+    Node* curr = this->lowerBound(&key);
+    return (curr && curr->equal(key)) ? curr : nullptr;
+}
+
+template<typename Key>
+Node<Key>* SkipList<Key>::lastBefore(const Probe* key, bool inclusive) {
+    Node* pred = this->header;
+    for (int i = this->currLevel.load(); i >= 0; i--) {
+        Node* curr = Node::unmark(pred->forward(i).load());
+        while (curr) {
+            Node* succ = curr->forward(i).load();
+            if (Node::isMarked(succ)) {
+                curr = Node::unmark(succ);
+            } else if (!key || curr->less(*key) || (inclusive && curr->equal(*key))) {
+                pred = curr;
+                curr = succ;
+            } else break;
         }
     }
-    // 到达第0层，还需要再向前看一个
-    curr = curr->forward[0];
-    // 如果当前结点的key等于目标key，则找到
-    if (curr&&curr->getKey()==key) {
-        return std::pair<std::string,bool>(curr->getValue(), true);
-    }else { // 没有找到目标key
-        return std::pair<std::string,bool>("", false);
+    return pred == this->header ? nullptr : pred;
+}
+
+template<typename Key>
+Node<Key>* SkipList<Key>::nextNode(Node* node) {
+    Node* curr = Node::unmark(node->forward(0).load());
+    // 跳过已被删除的结点
+    while (curr && Node::isMarked(curr->forward(0).load())) {
+        curr = Node::unmark(curr->forward(0).load());
+    }
+    return curr;
+}
+
+template<typename Key>
+SkipList<Key>::Iterator::Iterator(SkipList& list, const Key* start, bool reverse, const ReadView* view)
+    : list(list), lock(list.mutex, std::defer_lock), reverse(reverse), snapshot(view ? view->seq() : 0) {
+    if (!list.concurrent) this->lock.lock();
+    list.epoch.enter();
+    Probe probe{};
+    if (start) probe = Traits::probe(*start);
+    this->curr = reverse ? list.lastBefore(start ? &probe : nullptr, true) : list.lowerBound(start ? &probe : nullptr);
+    this->skipExpired();
+}
+
+template<typename Key>
+SkipList<Key>::Iterator::~Iterator() {
+    this->list.epoch.exit();
+}
+
+template<typename Key>
+void SkipList<Key>::Iterator::next() {
+    this->advance();
+    this->skipExpired();
+}
+
+template<typename Key>
+void SkipList<Key>::Iterator::skipExpired() {
+    while (this->curr) {
+        this->version = (this->snapshot ? this->curr->visible(this->snapshot) : this->curr->current());
+        if (this->version && this->version->alive()) return; // 删除标记总是处于过期状态
+        this->advance();
+    }
+}
+
+template<typename Key>
+void SkipList<Key>::Iterator::advance() {
+    if (this->reverse) {
+        // 跳表只有后向指针，逆序时从上层重新查找前驱
+        Probe probe = Traits::probe(this->curr->getKey());
+        this->curr = this->list.lastBefore(&probe, false);
+    } else {
+        this->curr = this->list.nextNode(this->curr);
     }
 }
 
-std::vector<std::pair<int,std::string>> SkipList::searchAll() {
-    std::unique_lock<std::mutex> lock(this->mutex);
-    std::vector<std::pair<int,std::string>> result;
-    Node* curr = this->header->forward[0];
+template<typename Key>
+std::pair<std::string,bool> SkipList<Key>::searchElement(Arg key) {
+    std::pair<std::string,bool> result("", false);
+    result.second = this->searchElement(key, [&result](std::string_view value) {
+        result.first.assign(value.data(), value.size());
+    });
+    return result;
+}
+
+template<typename Key>
+std::vector<std::pair<Key,std::string>> SkipList<Key>::searchAll() {
+    std::vector<std::pair<Key,std::string>> result;
+    ReadView view(*this->mvcc);
+    for (Iterator iter(*this, nullptr, false, &view); iter.valid(); iter.next()) {
+        result.push_back({Key(iter.key()), std::string(iter.value())});
+    }
+    return result;
+}
+
+template<typename Key>
+std::vector<size_t> SkipList<Key>::levelHistogram() {
+    std::unique_lock<std::mutex> lock(this->mutex, std::defer_lock);
+    if (!this->concurrent) lock.lock();
+    EpochGuard guard(this->epoch);
+    std::vector<size_t> result(this->maxLevel + 1, 0);
+    Node* curr = Node::unmark(this->header->forward(0).load());
     while(curr) {
-        result.push_back({curr->getKey(), curr->getValue()});
-        curr = curr->forward[0];
+        Node* next = curr->forward(0).load();
+        if (!Node::isMarked(next)) {
+            result[curr->getLevel()]++;
+        }
+        curr = Node::unmark(next);
     }
     return result;
-}
\ No newline at end of file
+}
+
+// 支持的key类型
+template class Node<int64_t>;
+template class Node<FixedKey<16>>;
+template class Node<std::string>;
+template class SkipList<int64_t>;
+template class SkipList<FixedKey<16>>;
+template class SkipList<std::string>;
@@ -1,66 +1,453 @@
 #ifndef SKIPLIST
 #define SKIPLIST
 
-#include <fstream>
 #include <vector>
+#include <memory>
 #include <mutex>
-#include <cstring>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <functional>
+#include "Epoch.h"
+#include "Arena.h"
+#include "KeyTraits.h"
+#include "Mvcc.h"
 
-// TODO：最好使用智能指针
+// 跳表中存储的value：长度、过期时间和数据位于同一块内存中
+// 过期时间随value一起替换，因此更新value和设置过期时间是同一个原子操作
+// 每次写入生成一个新版本，旧版本通过prev挂在新版本之后，持有快照的读者沿版本链找到对自己可见的版本（见Mvcc）
+struct Value {
+    uint32_t len; // 数据长度，数据紧跟在Value之后
+    uint32_t expire; // 过期时间（Unix时间，秒），0表示永不过期，DELETED表示删除标记
+    // 版本链接之后，读者只读取以下两个字段，写入线程设置提交序号，回收线程摘下旧版本
+    mutable std::atomic<uint64_t> seq; // 提交序号，PENDING表示版本已经链接但还没有取得提交序号
+    mutable std::atomic<Value*> prev; // 上一个版本，不再被任何快照需要的版本从链上摘下并回收
+
+    static const uint32_t DELETED = 1; // 删除标记是一个永远处于过期状态的空版本
+    static const uint64_t PENDING = UINT64_MAX;
+
+    // 在p处构造一个版本（提交序号为PENDING）
+    static Value* create(void* p, std::string_view data, uint32_t expire);
+    const char* data() const {
+        return reinterpret_cast<const char*>(this + 1);
+    }
+    std::string_view view() const {
+        return std::string_view(this->data(), this->len);
+    }
+    bool alive() const { // 没有过期时间的value不需要读取时钟
+        return this->expire == 0 || this->expire > clock();
+    }
+    bool deleted() const {
+        return this->expire == DELETED;
+    }
+    static size_t allocSize(size_t len) { // 长度为len的value占用的字节数
+        return sizeof(Value) + len;
+    }
+    static uint32_t clock(); // 当前的Unix时间（秒）
+};
+
+// 读-改-写的修改函数：old为当前value（key不存在或者已过期时为nullptr），在value中给出新value，
+// expire给出新的过期时间（调用时为当前的过期时间，key不存在时为0）；返回false表示放弃修改
+// 当前value被并发修改时会以新的当前value再次调用，因此修改函数不应有其他副作用
+using Updater = std::function<bool(const std::string_view* old, std::string& value, uint32_t& expire)>;
+
+// 结点只需要一次分配，内存布局为：| 结点头 | forward塔（level+1个指针）| 变长key（可选）| 内联value（可选）|
+// 不超过INLINE_VALUE字节的value直接存放在结点中，更长的value单独分配
+// 结点和单独分配的value都来自跳表的Arena
+template<typename Key>
 class Node {
 public:
-    Node(const int k, const std::string& v, int level) {
-        this->key = k;
-        this->value = v;
-        // 该结点需要存储0~level共level+1层结点地址
-        this->forward = new Node*[level+1];
-        // 不同层下一个结点地址初始化为0（NULL）
-        memset(this->forward, 0, sizeof(Node*)*(level+1));
+    using Traits = KeyTraits<Key>;
+    using Arg = typename Traits::Arg;
+    using Probe = typename Traits::Probe;
+
+    static Node* create(Arena& arena, Arg key, std::string_view value, int level, uint32_t expire = 0);
+    static void destroy(Arena& arena, Node* node); // 释放结点以及单独分配的value
+
+    Arg getKey() const{ // 字符串key返回结点中key的视图
+        return Traits::load(this->key, this->keyData());
+    }
+    bool less(const Probe& key) const{ // 结点的key是否小于key
+        return Traits::less(this->key, this->keyData(), key);
     }
-    ~Node() {
-        delete []forward;
+    bool equal(const Probe& key) const{
+        return Traits::equal(this->key, this->keyData(), key);
     }
-    int getKey() const{
-        return this->key;
+    int getLevel() const{
+        return this->level;
+    }
+    // 直接返回结点中value的视图，不进行拷贝；调用者必须处于跳表的纪元临界区中
+    std::string_view getValue() const{
+        return this->current()->view();
+    }
+    const Value* current() const{ // 当前的value（同时读取value和过期时间时使用，保证二者属于同一次写入）
+        return strip(this->value.load());
+    }
+    uint32_t getExpire() const{
+        return this->current()->expire;
+    }
+    // 对序号为snapshot的快照可见的版本（提交序号小于snapshot的最新版本），没有时返回nullptr
+    // 遇到还没有取得提交序号的版本时等待写入线程完成（fork出的子进程中不等待，视为不可见）
+    const Value* visible(uint64_t snapshot) const;
+    bool isInline(const Value* v) const{ // v是否为内联在结点中的版本（随结点一起释放）
+        return this->inlineSize && reinterpret_cast<const char*>(v) == this->keyData() + alignValue(Traits::slotExtra(this->key));
+    }
+    bool alive() const{ // value是否还没有过期
+        return this->current()->alive();
+    }
+    // 写入新版本（替换value和过期时间），old为替换前的版本（用于判断旧value是否过期）
+    // 旧版本挂在新版本之后，返回的新版本还没有提交序号，调用者随后调用SkipList::commit
+    // expected不为nullptr时只有当前版本仍然是expected时才替换，否则返回nullptr；结点已被冻结时同样返回nullptr
+    Value* setValue(Arena& arena, std::string_view v, uint32_t expire, const Value** old, const Value* expected = nullptr);
+    // 冻结value：只有当前版本仍然是expected时成功，之后所有的setValue都会失败
+    // 删除线程在标记结点之前冻结它，检查value和删除结点成为一个原子操作，并发的写入不会落在正在被摘除的结点上
+    bool freeze(const Value* expected);
+    bool frozen() const{
+        return isFrozen(this->value.load());
+    }
+    // 第i层下一个结点地址
+    // 指针的最低位用作删除标记：某一层的forward被标记，说明该结点在这一层已被逻辑删除
+    std::atomic<Node*>& forward(int i) {
+        return reinterpret_cast<std::atomic<Node*>*>(this + 1)[i];
+    }
+    size_t allocSize() const{ // 结点占用的字节数
+        size_t extra = Traits::slotExtra(this->key);
+        return sizeof(Node) + this->towerSize() + (this->inlineSize ? alignValue(extra) : extra) + this->inlineSize;
+    }
+    // 结点和单独分配的value在分配器中实际占用的字节数（删除结点后释放的内存）
+    size_t memorySize() const{
+        const Value* v = this->current();
+        size_t bytes = Arena::roundUp(this->allocSize());
+        if (!this->isInline(v)) {
+            bytes += Arena::roundUp(Value::allocSize(v->len));
+        }
+        return bytes;
+    }
+    void touch() { // 设置CLOCK的访问位；已经设置时不再写，避免热点key的缓存行在核之间来回失效
+        if (!this->referenced.load(std::memory_order_relaxed)) this->referenced.store(1, std::memory_order_relaxed);
+    }
+
+    // 插入线程完成链接、删除线程完成摘除时各加1，加到2的线程负责回收结点
+    std::atomic<uint8_t> releases;
+    // CLOCK淘汰的访问位：查询和写入时置1，淘汰指针经过时清0，经过时已经为0的结点被淘汰
+    // 占用结点头中的填充字节，不增加结点大小
+    std::atomic<uint8_t> referenced;
+
+    static const size_t INLINE_VALUE = 64; // 内联value的最大长度
+
+    static bool isMarked(Node* p){
+        return reinterpret_cast<uintptr_t>(p)&1;
     }
-    std::string getValue() const{
-        return this->value;
+    static Node* mark(Node* p){
+        return reinterpret_cast<Node*>(reinterpret_cast<uintptr_t>(p)|1);
     }
-    void setValue(const std::string v) {
-        this->value=v;
+    static Node* unmark(Node* p){
+        return reinterpret_cast<Node*>(reinterpret_cast<uintptr_t>(p)&~static_cast<uintptr_t>(1));
     }
-    // 不同层下一个结点地址
-    Node** forward;
+
+    Node(const Node&) = delete; // 禁用拷贝构造函数
+    Node& operator=(const Node&) = delete; // 禁用赋值运算符
 private:
-    int key;
-    std::string value;
+    Node() = default; // 只能通过create创建
+    size_t towerSize() const{
+        return (this->level + 1) * sizeof(std::atomic<Node*>);
+    }
+    const char* keyData() const{ // 变长key的地址（紧跟在forward塔之后）
+        return reinterpret_cast<const char*>(this + 1) + this->towerSize();
+    }
+    Value* inlineValue() { // 内联value的地址（在变长key之后）
+        return reinterpret_cast<Value*>(const_cast<char*>(this->keyData()) + alignValue(Traits::slotExtra(this->key)));
+    }
+    static size_t alignValue(size_t n) { // 内联value紧跟在变长key之后，按Value的对齐要求补齐
+        return (n + alignof(Value) - 1) & ~(alignof(Value) - 1);
+    }
+    // value指针的最低位用作冻结标记
+    static bool isFrozen(const Value* v) {
+        return reinterpret_cast<uintptr_t>(v)&1;
+    }
+    static Value* strip(Value* v) {
+        return reinterpret_cast<Value*>(reinterpret_cast<uintptr_t>(v)&~static_cast<uintptr_t>(1));
+    }
+
+    std::atomic<Value*> value;
+    typename Traits::Slot key;
+    uint8_t level; // 结点的最高层
+    uint16_t inlineSize; // 内联value占用的字节数，0表示没有内联value
 };
 
+// 跳表有两种模式：
+// 并发模式（默认）：forward通过CAS链接，查询无锁且无等待，插入和删除无锁，被删除的结点通过纪元回收
+// 互斥模式：每个操作都持有同一把互斥锁，用于对比测试
+// Key可以是int64_t、FixedKey<N>或std::string，key的保存、比较和编码方式由KeyTraits<Key>决定
+template<typename Key>
 class SkipList {
 public:
-    explicit SkipList(int maxLevel);
+    using Traits = KeyTraits<Key>;
+    using Arg = typename Traits::Arg;
+    using Probe = typename Traits::Probe;
+    using Node = ::Node<Key>;
+
+    // mvcc为提交序号和快照的来源，多个跳表共享同一个mvcc时可以在它们之间得到一致的快照；为nullptr时跳表使用自己的
+    explicit SkipList(int maxLevel, bool concurrent = true, Mvcc* mvcc = nullptr);
     ~SkipList();
     int size() const{ // 获取跳表元素数量
-        return this->count;
+        return this->count.load();
     }
 
-    void dump(const std::string& fileName); // 落盘
-    void load(const std::string& fileName); // 加载
-    int insertElement(int key, const std::string value); // 插入数据：0插入成功；1key已存在，更新value
-    int deleteElement(int key); // 删除数据：0删除成功；1key不存在
-    std::pair<std::string, bool> searchElement(int key); // 查询数据
-    std::vector<std::pair<int, std::string>> searchAll(); // 查询所有数据
+    bool dump(const std::string& fileName); // 落盘（二进制快照）
+    // 加载（兼容旧的文本格式）；指定filter时只加载filter返回true的key
+    void load(const std::string& fileName, const std::function<bool(Arg)>& filter = nullptr);
+    // 插入数据：0插入成功；1key已存在，更新value（同时更新过期时间）
+    // expire为过期时间（Unix时间，秒），0表示永不过期；已过期的key视为不存在
+    int insertElement(Arg key, std::string_view value, uint32_t expire = 0);
+    // 原子的读-改-写：一次查找定位key，以当前value调用fn，再用CAS写入fn给出的新value（key不存在时插入新结点）
+    // 0插入了新key；1更新了已存在的key；-1 fn放弃修改
+    int updateElement(Arg key, const Updater& fn);
+    // 删除数据：0删除成功；1key不存在（已过期的key同样会被删除，但返回1）
+    // 有活跃的快照时不摘除结点，而是写入删除标记，结点之后由expireElement回收
+    int deleteElement(Arg key);
+    // 删除已过期的key（包括删除标记）：0删除成功；1key不存在、没有过期或者仍有快照需要它的旧版本
+    // 检查之后key被并发更新时不会删除它
+    int expireElement(Arg key);
+    std::pair<std::string, bool> searchElement(Arg key); // 查询数据
+    // 零拷贝查询：找到key时以value的视图调用visit，visit返回后视图不再有效
+    // 已过期的key视为不存在（惰性过期），expired不为nullptr时记录是否遇到了已过期的key，调用者可以随后用expireElement删除它
+    template<typename F>
+    bool searchElement(Arg key, F&& visit, bool* expired = nullptr) {
+        std::unique_lock<std::mutex> lock(this->mutex, std::defer_lock);
+        if (!this->concurrent) lock.lock();
+        EpochGuard guard(this->epoch);
+        Node* node = this->search(Traits::probe(key));
+        if (!node) return false;
+        const Value* value = node->current();
+        if (!value->alive()) {
+            if (expired) *expired = true;
+            return false;
+        }
+        node->touch();
+        visit(value->view());
+        return true;
+    }
+    // 批量操作：keys必须按升序排列（可以重复），整批只进入一次临界区（互斥模式下只加一次锁），
+    // 并且从上一个key的查找结果中仍然有效的最低层开始查找下一个key（finger search），key越密集，查找路径越短
+    // 批量查询：对找到的第i个key以(i, value视图)调用visit
+    template<typename F>
+    void searchElements(const std::vector<Key>& keys, F&& visit) {
+        std::unique_lock<std::mutex> lock(this->mutex, std::defer_lock);
+        if (!this->concurrent) lock.lock();
+        EpochGuard guard(this->epoch);
+        Node* preds[this->maxLevel + 1];
+        Node* succs[this->maxLevel + 1];
+        for (size_t i = 0; i < keys.size(); i++) {
+            Probe probe = Traits::probe(keys[i]);
+            Node* node = this->lowerBound(&probe, preds, succs, i > 0);
+            if (!node || !node->equal(probe)) continue;
+            const Value* value = node->current();
+            if (!value->alive()) continue;
+            node->touch();
+            visit(i, value->view());
+        }
+    }
+    // 批量插入和删除，results[i]为第i个key的结果（与insertElement和deleteElement相同）
+    void insertElements(const std::vector<Key>& keys, const std::vector<std::string_view>& values, int* results);
+    void deleteElements(const std::vector<Key>& keys, int* results);
+    std::vector<std::pair<Key, std::string>> searchAll(); // 查询所有数据（快照读，不阻塞写入）
+    // 批量构建：按key升序追加记录，每个新结点直接链接在各层的最后一个结点之后（自底向上），不需要任何查找，
+    // 追加n条记录的时间复杂度为O(n)；用于从有序的快照加载数据，也可以追加到非空的跳表之后
+    // key不大于上一个key时退化为普通的插入（并重新定位各层的尾结点），因此无序的输入也能得到正确的结果
+    // Builder存在期间不能有其他写入线程（并发的读者可以看到已经追加的结点），互斥模式下一直持有跳表的锁
+    class Builder {
+    public:
+        explicit Builder(SkipList& list);
+        ~Builder(); // 把追加的结点计入跳表的元素数量
+        void add(Arg key, std::string_view value, uint32_t expire = 0);
+
+        Builder(const Builder&) = delete; // 禁用拷贝构造函数
+        Builder& operator=(const Builder&) = delete; // 禁用赋值运算符
+    private:
+        void locateTails(); // 从最高层开始向右、向下找到每一层的最后一个结点
+
+        SkipList& list;
+        std::unique_lock<std::mutex> lock;
+        std::vector<Node*> tails; // 每一层的最后一个结点（头结点表示该层为空）
+        int added = 0; // 追加的结点数量
+        int expiring = 0; // 追加的带有过期时间的结点数量
+    };
+    // 迭代器：按key升序（reverse为true时降序）遍历未删除且没有过期的结点
+    // 迭代器存在期间一直处于跳表的纪元临界区中（互斥模式下持有跳表的锁），只能在创建它的线程中使用
+    class Iterator {
+    public:
+        // 从第一个不小于start（reverse时为最后一个不大于start）的key开始，start为nullptr时从头（reverse时从尾）开始
+        // view不为nullptr时只访问对该快照可见的版本（view必须来自跳表的mvcc，且在迭代器销毁之前一直有效）
+        Iterator(SkipList& list, const Key* start, bool reverse = false, const ReadView* view = nullptr);
+        ~Iterator();
+        bool valid() const {
+            return this->curr != nullptr;
+        }
+        Arg key() const { // 字符串key返回视图，迭代器移动后不再有效
+            return this->curr->getKey();
+        }
+        std::string_view value() const { // value的视图，迭代器移动后不再有效
+            return this->version->view();
+        }
+        uint32_t expire() const {
+            return this->version->expire;
+        }
+        void next();
+        bool less(const Iterator& other) const { // 当前key是否小于other的当前key
+            return this->curr->less(Traits::probe(other.key()));
+        }
+        // 当前key是否已经越过遍历方向上的边界end
+        bool beyond(const Probe& end) const {
+            return this->reverse ? this->curr->less(end) : !this->curr->less(end) && !this->curr->equal(end);
+        }
+
+        Iterator(const Iterator&) = delete; // 禁用拷贝构造函数
+        Iterator& operator=(const Iterator&) = delete; // 禁用赋值运算符
+    private:
+        void advance(); // 移动到下一个未删除的结点
+        void skipExpired(); // 从当前结点开始跳过已过期、已删除以及没有可见版本的结点
+
+        SkipList& list;
+        std::unique_lock<std::mutex> lock;
+        bool reverse;
+        uint64_t snapshot; // 快照的序号，0表示读取最新版本
+        Node* curr;
+        const Value* version; // curr中被访问的版本（key、value和过期时间属于同一次写入）
+    };
+    // 范围查询：按key升序（reverse为true时降序）以(key, value视图)调用visit，最多访问[lo,hi]内的limit个key
+    // lo或hi为nullptr时表示该方向没有边界
+    // 范围内还有剩余的key时返回true，并将next设置为下一个要访问的key（作为下一页的起点）
+    // 逆序遍历时每一步都需要重新查找前驱，时间复杂度为O(limit*logn)
+    template<typename F>
+    bool scan(const Key* lo, const Key* hi, int limit, bool reverse, F&& visit, Key& next) {
+        const Key* bound = reverse ? lo : hi; // 遍历终点一侧的边界
+        Probe end{};
+        if (bound) end = Traits::probe(*bound);
+        int n = 0;
+        for (Iterator iter(*this, reverse ? hi : lo, reverse); iter.valid(); iter.next()) {
+            if (bound && iter.beyond(end)) break;
+            if (n++ == limit) {
+                next = Key(iter.key());
+                return true;
+            }
+            visit(iter.key(), iter.value());
+        }
+        return false;
+    }
+    // 主动过期的一步：从第一个不小于from的key开始（from为nullptr时从头开始），最多检查limit个结点，对已过期的key调用visit
+    // 同时回收经过的结点中不再被任何快照需要的旧版本
+    // 每次只访问有限个结点，不会持有任何锁遍历整个跳表；还没有到达末尾时返回true，并将next设置为下一次开始的key
+    template<typename F>
+    bool sampleExpired(const Key* from, int limit, F&& visit, Key& next) {
+        std::unique_lock<std::mutex> lock(this->mutex, std::defer_lock);
+        if (!this->concurrent) lock.lock();
+        EpochGuard guard(this->epoch);
+        Probe probe{};
+        if (from) probe = Traits::probe(*from);
+        Node* curr = this->lowerBound(from ? &probe : nullptr);
+        uint32_t now = Value::clock();
+        for (int n = 0; curr; n++) {
+            if (n == limit) {
+                next = Key(curr->getKey());
+                return true;
+            }
+            if (this->versionCount.load() > 0) this->trim(curr, curr->current());
+            uint32_t expire = curr->getExpire();
+            if (expire != 0 && expire <= now) visit(curr->getKey());
+            curr = this->nextNode(curr);
+        }
+        return false;
+    }
+    // CLOCK淘汰的一步：淘汰指针从第一个不小于from的key开始（from为nullptr时从头开始）最多经过limit个结点，
+    // 清除经过的结点的访问位，对访问位已经为0或者已经过期的结点以(key, 删除后释放的字节数)调用visit，visit返回false时停止
+    // 范围查询不设置访问位，一次大范围的扫描不会把热点key挤出去
+    // 还没有到达末尾时返回true，并将next设置为淘汰指针的下一个位置
+    template<typename F>
+    bool clockSweep(const Key* from, int limit, F&& visit, Key& next) {
+        std::unique_lock<std::mutex> lock(this->mutex, std::defer_lock);
+        if (!this->concurrent) lock.lock();
+        EpochGuard guard(this->epoch);
+        Probe probe{};
+        if (from) probe = Traits::probe(*from);
+        Node* curr = this->lowerBound(from ? &probe : nullptr);
+        for (int n = 0; curr; n++) {
+            if (n == limit) {
+                next = Key(curr->getKey());
+                return true;
+            }
+            Node* succ = this->nextNode(curr);
+            if (curr->referenced.load(std::memory_order_relaxed) && curr->alive()) {
+                curr->referenced.store(0, std::memory_order_relaxed); // 第二次机会
+            } else if (!visit(curr->getKey(), curr->memorySize())) {
+                if (!succ) return false;
+                next = Key(succ->getKey());
+                return true;
+            }
+            curr = succ;
+        }
+        return false;
+    }
+    int expiringCount() const { // 带有过期时间的key（包括删除标记）的数量（近似值），为0时不需要主动过期
+        return this->ttlCount.load();
+    }
+    int retainedVersions() const { // 为快照保留的旧版本数量（近似值）
+        return this->versionCount.load();
+    }
+    Mvcc& versions() { // 跳表使用的mvcc，用于创建快照
+        return *this->mvcc;
+    }
+    size_t memoryUsage() const { // 结点和value占用的字节数
+        return this->arena.allocatedBytes();
+    }
+    size_t reservedMemory() const { // 分配器向系统申请的字节数
+        return this->arena.reservedBytes();
+    }
+    // 各层的结点数量：result[i]为最高层等于i的结点数量，层数分布正常时每一层约为下一层的一半
+    std::vector<size_t> levelHistogram();
 private:
     int maxLevel; // 跳表最大层数
-    int currLevel; // 跳表当前层数
+    std::atomic<int> currLevel; // 跳表当前层数（只增不减）
     Node* header; // 头结点指针
-    int count; // 跳表当前元素数量
+    std::atomic<int> count; // 跳表当前元素数量（包括已过期但还没有被删除的key）
+    std::atomic<int> ttlCount; // 带有过期时间的key的数量，并发的更新和删除之间不同步，只是近似值
+    std::atomic<int> versionCount; // 版本链上除最新版本之外的版本数量，近似值
+    std::unique_ptr<Mvcc> ownMvcc; // 没有指定mvcc时跳表自己的mvcc
+    Mvcc* mvcc;
+    bool concurrent; // 是否为并发模式
+    std::mutex dumpLock; // 同一时间只允许一个线程落盘
 
-    std::ofstream writer; // 将跳表落盘
-    std::ifstream reader; // 从磁盘中加载跳表
-    std::mutex mutex; // 读写锁
+    std::mutex mutex; // 互斥模式下使用的锁
+    Arena arena; // 结点和value的分配器（必须在epoch之前声明，保证回收器析构时分配器仍然有效）
+    Epoch epoch; // 被删除结点和被替换value的回收器
     // 随机生成新元素所在层
     int getRandomLevel();
+    // 查找key在每一层的前驱preds和后继succs，并顺便摘除途经的被标记结点；返回key是否存在
+    // finger为true时preds和succs中是上一个（更小的）key的查找结果，从其中仍然有效的最低层开始查找
+    bool find(const Probe& key, Node** preds, Node** succs, bool finger = false);
+    int fingerLevel(const Probe& key, Node** succs); // 根据上一个key每一层的后继succs确定开始查找的层
+    // update不为nullptr时由它根据当前value计算新value和过期时间（读-改-写），放弃修改时返回-1
+    int insert(Arg key, std::string_view value, uint32_t expire, Node** preds, Node** succs, bool finger,
+               const Updater* update = nullptr);
+    // expiredOnly为true时只删除已过期的key；返回0表示删除了一个存在的key（expiredOnly时为已过期的key）
+    int erase(Arg key, Node** preds, Node** succs, bool finger, bool expiredOnly = false);
+    // 以下查找函数的调用者必须处于纪元临界区中
+    Node* search(const Probe& key); // 查找key对应的未删除结点，不存在时返回nullptr
+    // 第一个key不小于key的未删除结点（key为nullptr时为第一个结点）；preds不为nullptr时记录每一层的查找结果，用法与find相同
+    Node* lowerBound(const Probe* key, Node** preds = nullptr, Node** succs = nullptr, bool finger = false);
+    // 最后一个key小于key（inclusive时为不大于）的未删除结点（key为nullptr时为最后一个结点）
+    Node* lastBefore(const Probe* key, bool inclusive);
+    Node* nextNode(Node* node); // node在第0层之后第一个未删除的结点
+    // 插入线程和删除线程各调用一次，第二次调用时回收结点
+    void release(Node* node);
+    void retireValue(Value* value); // 将被替换的value交给回收器
+    // 为node中刚刚链接的版本version设置提交序号，然后回收不再被任何快照需要的旧版本
+    void commit(Node* node, const Value* version);
+    // 从from开始找到对最早的快照可见的版本，摘下并回收它之后的版本；多个线程可以同时对同一个结点调用
+    void trim(Node* node, const Value* from);
+    // 加载旧版本的文本格式（每行 key:value）
+    void loadText(const std::string& fileName, const std::function<bool(Arg)>& filter);
 };
 
 #endif
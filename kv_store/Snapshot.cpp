@@ -0,0 +1,229 @@
+#include "Snapshot.h"
+#include "Coding.h"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char MAGIC[8] = {'K','V','S','N','A','P','S','H'};
+static const uint32_t VERSION = 2;
+static const size_t HEADER_SIZE = 12;
+static const size_t FOOTER_SIZE = 36;
+
+// 将文件所在目录刷盘，保证重命名在崩溃后仍然生效
+static void syncDir(const std::string& fileName) {
+    size_t pos = fileName.rfind('/');
+    std::string dir = (pos == std::string::npos ? "." : (pos == 0 ? "/" : fileName.substr(0, pos)));
+    int dirFd = ::open(dir.c_str(), O_RDONLY);
+    if (dirFd != -1) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+}
+
+SnapshotWriter::SnapshotWriter(const std::string& fileName) {
+    this->fileName = fileName;
+    this->tmpName = fileName + ".tmp";
+    this->fd = ::open(this->tmpName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (this->fd == -1) {
+        std::cerr << "快照: 无法创建文件 " << this->tmpName << std::endl;
+        this->ok = false;
+        return;
+    }
+    this->out.reserve(WRITE_SIZE + BLOCK_SIZE);
+    this->out.append(MAGIC, sizeof(MAGIC));
+    putFixed32(this->out, VERSION);
+    this->offset = HEADER_SIZE;
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    if (this->fd != -1) close(this->fd);
+    if (!this->finished) unlink(this->tmpName.c_str());
+}
+
+bool SnapshotWriter::writeOut(bool all) {
+    if (!this->ok) return false;
+    if (!all && this->out.size() < WRITE_SIZE) return true;
+    size_t written = 0;
+    while (written < this->out.size()) {
+        ssize_t len = write(this->fd, this->out.data() + written, this->out.size() - written);
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "快照: 写入失败" << std::endl;
+            this->ok = false;
+            return false;
+        }
+        written += len;
+    }
+    this->out.clear();
+    return true;
+}
+
+void SnapshotWriter::finishBlock() {
+    if (this->blockRecords == 0) return;
+    putFixed64(this->index, this->offset);
+    putFixed32(this->index, this->block.size());
+    putFixed32(this->index, this->blockRecords);
+    putFixed32(this->index, crc32c(this->block.data(), this->block.size()));
+    putFixed32(this->index, this->firstKey.size());
+    this->index.append(this->firstKey);
+    this->offset += this->block.size();
+    this->blocks++;
+    this->out.append(this->block);
+    this->block.clear();
+    this->blockRecords = 0;
+    this->writeOut(false);
+}
+
+bool SnapshotWriter::add(std::string_view key, std::string_view value, uint32_t expire) {
+    if (!this->ok) return false;
+    if (this->blockRecords == 0) this->firstKey.assign(key.data(), key.size());
+    putFixed32(this->block, key.size());
+    this->block.append(key.data(), key.size());
+    putFixed32(this->block, value.size());
+    this->block.append(value.data(), value.size());
+    putFixed32(this->block, expire);
+    this->blockRecords++;
+    this->records++;
+    if (this->block.size() >= BLOCK_SIZE) this->finishBlock();
+    return this->ok;
+}
+
+bool SnapshotWriter::finish() {
+    this->finishBlock();
+    uint64_t indexOffset = this->offset;
+    this->out.append(this->index);
+    putFixed64(this->out, indexOffset);
+    putFixed32(this->out, this->index.size());
+    putFixed32(this->out, crc32c(this->index.data(), this->index.size()));
+    putFixed32(this->out, this->blocks);
+    putFixed64(this->out, this->records);
+    this->out.append(MAGIC, sizeof(MAGIC));
+    if (!this->writeOut(true)) return false;
+    // 数据刷盘后再重命名，保证目标文件要么是旧快照，要么是完整的新快照
+    if (fdatasync(this->fd) != 0) return false;
+    close(this->fd);
+    this->fd = -1;
+    if (std::rename(this->tmpName.c_str(), this->fileName.c_str()) != 0) {
+        std::cerr << "快照: 重命名失败" << std::endl;
+        return false;
+    }
+    syncDir(this->fileName);
+    this->finished = true;
+    return true;
+}
+
+SnapshotReader::~SnapshotReader() {
+    if (this->data) munmap(const_cast<char*>(this->data), this->length);
+}
+
+bool SnapshotReader::isSnapshot(const std::string& fileName) {
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd == -1) return false;
+    char magic[sizeof(MAGIC)];
+    bool result = (read(fd, magic, sizeof(magic)) == sizeof(magic) && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0);
+    close(fd);
+    return result;
+}
+
+bool SnapshotReader::open(const std::string& fileName) {
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd == -1) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < HEADER_SIZE + FOOTER_SIZE) {
+        close(fd);
+        return false;
+    }
+    this->length = st.st_size;
+    void* addr = mmap(nullptr, this->length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // 映射建立后即可关闭文件
+    if (addr == MAP_FAILED) {
+        this->length = 0;
+        return false;
+    }
+    this->data = static_cast<const char*>(addr);
+    madvise(addr, this->length, MADV_SEQUENTIAL); // 顺序读取，提示内核预读
+    this->version = decodeFixed32(this->data + 8);
+    if (memcmp(this->data, MAGIC, sizeof(MAGIC)) != 0 || this->version < 1 || this->version > VERSION) {
+        std::cerr << "快照: 不支持的文件格式或版本 " << fileName << std::endl;
+        return false;
+    }
+    const char* footer = this->data + this->length - FOOTER_SIZE;
+    if (memcmp(footer + 28, MAGIC, sizeof(MAGIC)) != 0) {
+        std::cerr << "快照: 文件尾损坏 " << fileName << std::endl;
+        return false;
+    }
+    uint64_t indexOffset = decodeFixed64(footer);
+    this->indexLen = decodeFixed32(footer + 8);
+    uint32_t indexCrc = decodeFixed32(footer + 12);
+    this->blocks = decodeFixed32(footer + 16);
+    this->records = decodeFixed64(footer + 20);
+    if (indexOffset < HEADER_SIZE || indexOffset + this->indexLen != this->length - FOOTER_SIZE ||
+        crc32c(this->data + indexOffset, this->indexLen) != indexCrc) {
+        std::cerr << "快照: 索引损坏 " << fileName << std::endl;
+        return false;
+    }
+    this->index = this->data + indexOffset;
+    // 预先定位每个数据块的索引项，多个线程可以直接从任意数据块开始遍历
+    this->entries.clear();
+    this->entries.reserve(this->blocks);
+    const char* entry = this->index;
+    const char* indexEnd = this->index + this->indexLen;
+    for (uint32_t b = 0; b < this->blocks; b++) {
+        if (entry + 24 > indexEnd) {
+            std::cerr << "快照: 索引损坏 " << fileName << std::endl;
+            this->index = nullptr;
+            return false;
+        }
+        this->entries.push_back(entry);
+        entry += 24 + decodeFixed32(entry + 20);
+    }
+    return true;
+}
+
+bool SnapshotReader::forEach(const std::function<void(std::string_view key, std::string_view value, uint32_t expire)>& visit) {
+    return this->forEach(0, this->blocks, visit);
+}
+
+bool SnapshotReader::forEach(uint32_t from, uint32_t to, const std::function<void(std::string_view key, std::string_view value, uint32_t expire)>& visit) {
+    if (!this->index) return false;
+    to = std::min(to, this->blocks);
+    for (uint32_t b = from; b < to; b++) {
+        const char* entry = this->entries[b];
+        uint64_t blockOffset = decodeFixed64(entry);
+        uint32_t blockLen = decodeFixed32(entry + 8);
+        uint32_t blockRecords = decodeFixed32(entry + 12);
+        uint32_t blockCrc = decodeFixed32(entry + 16);
+        if (blockOffset + blockLen > this->length - FOOTER_SIZE) return false;
+        const char* p = this->data + blockOffset;
+        const char* end = p + blockLen;
+        if (crc32c(p, blockLen) != blockCrc) {
+            std::cerr << "快照: 第" << b << "个数据块校验失败" << std::endl;
+            return false;
+        }
+        for (uint32_t i = 0; i < blockRecords; i++) {
+            if (p + 4 > end) return false;
+            uint32_t keyLen = decodeFixed32(p);
+            if (p + 8 + keyLen > end) return false;
+            std::string_view key(p + 4, keyLen);
+            p += 4 + keyLen;
+            uint32_t valueLen = decodeFixed32(p);
+            if (p + 4 + valueLen > end) return false;
+            std::string_view value(p + 4, valueLen);
+            p += 4 + valueLen;
+            uint32_t expire = 0;
+            if (this->version >= 2) {
+                if (p + 4 > end) return false;
+                expire = decodeFixed32(p);
+                p += 4;
+            }
+            visit(key, value, expire);
+        }
+    }
+    return true;
+}
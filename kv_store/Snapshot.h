@@ -0,0 +1,81 @@
+#ifndef SNAPSHOT
+#define SNAPSHOT
+
+#include <string>
+#include <string_view>
+#include <functional>
+#include <vector>
+#include <cstdint>
+
+// 二进制快照文件（版本2）
+// 文件头：magic(8) | 版本号(4)
+// 数据块：若干条记录，每条记录为 key长度(4) | key | value长度(4) | value | 过期时间(4)，每个数据块约BLOCK_SIZE字节
+//        过期时间为Unix时间（秒），0表示永不过期；版本1的记录没有过期时间
+// 索引：每个数据块一项，偏移(8) | 长度(4) | 记录数(4) | crc(4) | 第一个key长度(4) | 第一个key
+// 文件尾（定长）：索引偏移(8) | 索引长度(4) | 索引crc(4) | 数据块数(4) | 记录总数(8) | magic(8)
+// 所有整数均为小端序，crc为CRC32C
+
+// 快照写入器：数据先写入 文件名.tmp，finish时刷盘并原子地重命名为目标文件
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const std::string& fileName);
+    ~SnapshotWriter(); // 没有调用finish时删除临时文件
+
+    bool add(std::string_view key, std::string_view value, uint32_t expire = 0); // 追加一条记录（记录按key升序追加）
+    bool finish(); // 写入索引和文件尾，刷盘后重命名
+
+    SnapshotWriter(const SnapshotWriter&) = delete; // 禁用拷贝构造函数
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete; // 禁用赋值运算符
+
+    static const size_t BLOCK_SIZE = 64 * 1024; // 数据块大小
+    static const size_t WRITE_SIZE = 1024 * 1024; // 攒够该大小后再写文件，保证大块顺序写
+private:
+    void finishBlock(); // 结束当前数据块，生成索引项
+    bool writeOut(bool all); // 将out中的数据写入文件
+
+    std::string fileName;
+    std::string tmpName;
+    int fd = -1;
+    bool ok = true; // 之前的写入是否都成功
+    bool finished = false;
+    std::string out; // 等待写入文件的数据
+    std::string block; // 当前数据块
+    std::string firstKey; // 当前数据块的第一个key
+    uint32_t blockRecords = 0; // 当前数据块的记录数
+    std::string index; // 索引
+    uint64_t offset = 0; // 下一个数据块在文件中的偏移
+    uint32_t blocks = 0; // 数据块数
+    uint64_t records = 0; // 记录总数
+};
+
+// 快照读取器：使用mmap映射整个文件，直接在映射的内存上解析记录
+class SnapshotReader {
+public:
+    SnapshotReader() = default;
+    ~SnapshotReader();
+
+    // 打开快照并校验文件头、文件尾和索引；文件不存在或格式不正确时返回false
+    bool open(const std::string& fileName);
+    uint64_t size() const { return this->records; } // 记录总数
+    // 按顺序遍历所有记录，key和value指向映射的内存，版本1的记录的过期时间为0；数据块校验失败时返回false
+    bool forEach(const std::function<void(std::string_view key, std::string_view value, uint32_t expire)>& visit);
+    // 只遍历第[from, to)个数据块，不同的线程可以同时遍历不相交的数据块区间
+    bool forEach(uint32_t from, uint32_t to, const std::function<void(std::string_view key, std::string_view value, uint32_t expire)>& visit);
+    uint32_t blockCount() const { return this->blocks; } // 数据块数
+
+    SnapshotReader(const SnapshotReader&) = delete; // 禁用拷贝构造函数
+    SnapshotReader& operator=(const SnapshotReader&) = delete; // 禁用赋值运算符
+
+    static bool isSnapshot(const std::string& fileName); // 判断文件是否是二进制快照（检查magic）
+private:
+    const char* data = nullptr; // 映射的内存
+    uint32_t version = 0; // 文件格式的版本号
+    size_t length = 0; // 文件长度
+    const char* index = nullptr; // 索引
+    uint32_t indexLen = 0;
+    uint32_t blocks = 0;
+    uint64_t records = 0;
+    std::vector<const char*> entries; // 每个数据块的索引项
+};
+
+#endif
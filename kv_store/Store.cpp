@@ -0,0 +1,164 @@
+#include "Store.h"
+#include "ShardedStore.h"
+#include <memory>
+#include <type_traits>
+#include <charconv>
+
+// 将key转换为文本，整数key写入buf，其余类型直接返回视图
+static std::string_view keyText(int64_t key, char* buf) {
+    auto result = std::to_chars(buf, buf + 24, key);
+    return std::string_view(buf, result.ptr - buf);
+}
+
+static std::string_view keyText(std::string_view key, char*) {
+    return key;
+}
+
+template<size_t N>
+static std::string_view keyText(const FixedKey<N>& key, char*) {
+    return KeyTraits<FixedKey<N>>::text(key);
+}
+
+template<typename Key>
+class StoreImpl : public Store {
+public:
+    using Traits = KeyTraits<Key>;
+
+    StoreImpl(int shards, long long expectedKeys)
+        : store(shards, expectedKeys), cursors(store.shardCount()), hands(store.shardCount()) {}
+
+    std::string normalize(std::string_view key) override {
+        if constexpr (std::is_same_v<Key, std::string>) return std::string(key);
+        else return Traits::toString(Traits::parse(key));
+    }
+    int insert(std::string_view key, std::string_view value, uint32_t expire) override {
+        return this->store.insertElement(arg(key), value, expire);
+    }
+    int update(std::string_view key, const Updater& fn) override {
+        return this->store.updateElement(arg(key), fn);
+    }
+    int erase(std::string_view key) override {
+        return this->store.deleteElement(arg(key));
+    }
+    int expire(std::string_view key) override {
+        return this->store.expireElement(arg(key));
+    }
+    bool search(std::string_view key, const std::function<void(std::string_view value)>& visit,
+                bool* expired) override {
+        return this->store.searchElement(arg(key), visit, expired);
+    }
+    bool scan(const std::string_view* lo, const std::string_view* hi, int limit, bool reverse,
+              const std::function<void(std::string_view key, std::string_view value)>& visit,
+              std::string& next) override {
+        Key low, high, nextKey;
+        if (lo) low = Traits::parse(*lo);
+        if (hi) high = Traits::parse(*hi);
+        char buf[24];
+        bool more = this->store.scan(lo ? &low : nullptr, hi ? &high : nullptr, limit, reverse,
+            [&visit, &buf](typename Traits::Arg key, std::string_view value) {
+                visit(keyText(key, buf), value);
+            }, nextKey);
+        if (more) next = Traits::toString(nextKey);
+        return more;
+    }
+    void forEach(const std::function<void(std::string_view key, std::string_view value, uint32_t expire)>& visit) override {
+        char buf[24];
+        this->store.forEach([&visit, &buf](typename Traits::Arg key, std::string_view value, uint32_t expire) {
+            visit(keyText(key, buf), value, expire);
+        });
+    }
+    void searchBatch(const std::vector<std::string_view>& keys,
+                     const std::function<void(size_t i, std::string_view value)>& visit) override {
+        this->store.searchElements(parse(keys), visit);
+    }
+    void insertBatch(const std::vector<std::string>& keys, const std::vector<std::string_view>& values,
+                     std::vector<int>& results) override {
+        this->store.insertElements(parse(keys), values, results);
+    }
+    void eraseBatch(const std::vector<std::string>& keys, std::vector<int>& results) override {
+        this->store.deleteElements(parse(keys), results);
+    }
+    void sampleExpired(int limit, std::vector<std::string>& keys) override {
+        for (int i = 0; i < this->store.shardCount(); i++) {
+            if (this->store.expiringCount(i) <= 0 && this->store.retainedVersions(i) <= 0) continue;
+            Cursor& cursor = this->cursors[i];
+            Key next;
+            cursor.valid = this->store.sampleExpired(i, cursor.valid ? &cursor.key : nullptr, limit,
+                [&keys](typename Traits::Arg key) { keys.push_back(Traits::toString(key)); }, next);
+            if (cursor.valid) cursor.key = next; // 到达末尾后下一次从头开始
+        }
+    }
+    int size() override {
+        return this->store.size();
+    }
+    bool dump(const std::string& fileName) override {
+        return this->store.dump(fileName);
+    }
+    void load(const std::string& fileName, const LoadProgress& progress) override {
+        this->store.load(fileName, progress);
+    }
+    size_t memoryUsage() override {
+        return this->store.memoryUsage();
+    }
+    size_t reservedMemory() override {
+        return this->store.reservedMemory();
+    }
+    int retainedVersions() override {
+        return this->store.retainedVersions();
+    }
+    bool snapshotActive() override {
+        return this->store.snapshotActive();
+    }
+    void evictionCandidates(size_t bytes, std::vector<std::pair<std::string, size_t>>& victims) override {
+        // 每个分片每次最多前进SWEEP个结点，所有结点的访问位都为1时，第二圈一定能找到候选
+        static const int SWEEP = 1024;
+        size_t found = 0;
+        for (int n = 0; n < this->store.shardCount() && found < bytes; n++) {
+            int i = this->nextHand;
+            this->nextHand = (this->nextHand + 1) % this->store.shardCount();
+            Cursor& hand = this->hands[i];
+            Key next;
+            hand.valid = this->store.clockSweep(i, hand.valid ? &hand.key : nullptr, SWEEP,
+                [&](typename Traits::Arg key, size_t size) {
+                    victims.push_back({Traits::toString(key), size});
+                    found += size;
+                    return found < bytes;
+                }, next);
+            if (hand.valid) hand.key = next; // 到达末尾后下一次从头开始
+        }
+    }
+private:
+    // 将文本key转换为跳表接口的参数：string类型的key直接使用视图，不产生拷贝
+    static auto arg(std::string_view key) {
+        if constexpr (std::is_same_v<Key, std::string>) return key;
+        else return Traits::parse(key);
+    }
+    template<typename Text>
+    static std::vector<Key> parse(const std::vector<Text>& keys) {
+        std::vector<Key> result;
+        result.reserve(keys.size());
+        for (auto& key : keys) result.push_back(Traits::parse(key));
+        return result;
+    }
+
+    struct Cursor { // 分片中下一次主动过期（或淘汰）开始的位置
+        bool valid = false;
+        Key key;
+    };
+
+    ShardedStore<Key> store;
+    std::vector<Cursor> cursors; // 主动过期的位置
+    std::vector<Cursor> hands; // CLOCK淘汰指针
+    int nextHand = 0; // 下一次首先淘汰的分片
+};
+
+uint32_t Store::clock() {
+    return Value::clock();
+}
+
+Store* Store::create(const std::string& keyType, int shards, long long expectedKeys) {
+    if (keyType == "int") return new StoreImpl<int64_t>(shards, expectedKeys);
+    if (keyType == "string") return new StoreImpl<std::string>(shards, expectedKeys);
+    if (keyType == "fixed16") return new StoreImpl<FixedKey<16>>(shards, expectedKeys);
+    return nullptr;
+}
@@ -0,0 +1,64 @@
+#ifndef STORE
+#define STORE
+
+#include <string>
+#include <string_view>
+#include <functional>
+#include <vector>
+#include <cstdint>
+
+// 命令层使用的存储接口：key以文本形式传入和传出，由具体的实现解析为配置的key类型
+// key无法解析时（例如整数key不是合法的整数或者超出范围）抛出std::invalid_argument或std::out_of_range
+class Store {
+public:
+    virtual ~Store() = default;
+
+    // 根据key类型（int、string、fixed16）创建分片存储，类型不支持时返回nullptr
+    static Store* create(const std::string& keyType, int shards, long long expectedKeys);
+
+    // key的规范文本形式（例如整数key "007" 规范化为 "7"），同一个key的规范形式唯一
+    virtual std::string normalize(std::string_view key) = 0;
+    // 0插入成功；1key已存在，更新value；expire为过期时间（Unix时间，秒），0表示永不过期
+    virtual int insert(std::string_view key, std::string_view value, uint32_t expire = 0) = 0;
+    // 原子的读-改-写：0插入了新key；1更新了已存在的key；-1 fn放弃修改（fn的语义见SkipList.h中的Updater）
+    using Updater = std::function<bool(const std::string_view* old, std::string& value, uint32_t& expire)>;
+    virtual int update(std::string_view key, const Updater& fn) = 0;
+    virtual int erase(std::string_view key) = 0; // 0删除成功；1key不存在
+    // 删除已过期的key：0删除成功；1key不存在或者没有过期（调用者需要持有该key的写锁，见SkipList::expireElement）
+    virtual int expire(std::string_view key) = 0;
+    // 零拷贝查询：找到key时以value的视图调用visit；已过期的key视为不存在，expired不为nullptr时记录是否遇到了已过期的key
+    virtual bool search(std::string_view key, const std::function<void(std::string_view value)>& visit,
+                        bool* expired = nullptr) = 0;
+    // 范围查询，语义与SkipList::scan相同，lo或hi为nullptr时表示该方向没有边界
+    virtual bool scan(const std::string_view* lo, const std::string_view* hi, int limit, bool reverse,
+                      const std::function<void(std::string_view key, std::string_view value)>& visit,
+                      std::string& next) = 0;
+    // 按key顺序以(key, value, 过期时间)访问所有未过期的key，读到的是调用时刻的一致视图，各分片并行遍历（用于全量查询和复制的全量同步）
+    virtual void forEach(const std::function<void(std::string_view key, std::string_view value, uint32_t expire)>& visit) = 0;
+    // 批量操作，结果按keys的顺序返回（见ShardedStore::searchElements）
+    virtual void searchBatch(const std::vector<std::string_view>& keys,
+                             const std::function<void(size_t i, std::string_view value)>& visit) = 0;
+    virtual void insertBatch(const std::vector<std::string>& keys, const std::vector<std::string_view>& values,
+                             std::vector<int>& results) = 0;
+    virtual void eraseBatch(const std::vector<std::string>& keys, std::vector<int>& results) = 0;
+    // 主动过期：每个带有过期时间（或者为快照保留了旧版本）的分片从上次停下的位置继续检查最多limit个key，
+    // 将其中已过期的key和删除标记（规范文本形式）追加到keys，同时回收经过的结点中不再被快照需要的旧版本
+    // 各分片的位置保存在存储中，只能由一个线程调用
+    virtual void sampleExpired(int limit, std::vector<std::string>& keys) = 0;
+    virtual int size() = 0; // 包括已过期但还没有被删除的key
+    static uint32_t clock(); // 当前的Unix时间（秒）
+    virtual bool dump(const std::string& fileName) = 0;
+    // 加载快照，progress不为空时每加载一批记录以(已加载的记录数, 记录总数)调用一次（见ShardedStore::load）
+    using LoadProgress = std::function<void(uint64_t loaded, uint64_t total)>;
+    virtual void load(const std::string& fileName, const LoadProgress& progress = nullptr) = 0;
+    virtual size_t memoryUsage() = 0; // 结点（包括forward塔和内联的key、value）和单独分配的value占用的字节数
+    virtual size_t reservedMemory() = 0; // 分配器向系统申请的字节数
+    virtual int retainedVersions() = 0; // 为快照保留的旧版本数量（近似值）
+    // 是否有活跃的MVCC快照（范围查询、全量遍历、落盘）：此时删除写入删除标记而不是摘除结点，不会释放内存
+    virtual bool snapshotActive() = 0;
+    // CLOCK淘汰：各分片的淘汰指针轮流前进，收集预计可以释放bytes字节的淘汰候选(规范文本形式的key, 释放的字节数)
+    // 每次调用在每个分片中最多经过一定数量的结点；淘汰指针保存在存储中，只能由一个线程调用
+    virtual void evictionCandidates(size_t bytes, std::vector<std::pair<std::string, size_t>>& victims) = 0;
+};
+
+#endif
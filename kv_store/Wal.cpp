@@ -0,0 +1,270 @@
+#include "Wal.h"
+#include "Coding.h"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+Wal::Wal(const std::string& prefix, SyncPolicy policy, int groupMS, int groupRecords) {
+    size_t pos = prefix.rfind('/');
+    if (pos == std::string::npos) {
+        this->dir = ".";
+        this->name = prefix;
+    } else {
+        this->dir = (pos == 0 ? "/" : prefix.substr(0, pos));
+        this->name = prefix.substr(pos + 1);
+    }
+    this->policy = policy;
+    this->groupMS = groupMS > 0 ? groupMS : 1;
+    this->groupRecords = groupRecords > 0 ? groupRecords : 1;
+}
+
+Wal::~Wal() {
+    if (this->thread.joinable()) {
+        {
+            std::unique_lock<std::mutex> l(this->lock);
+            this->stop = true;
+        }
+        this->flushCond.notify_one();
+        this->thread.join();
+    }
+    std::unique_lock<std::mutex> l(this->lock);
+    while (this->flushing || !this->buffer.empty()) {
+        this->flush(l, true);
+    }
+    if (this->fd != -1) {
+        fdatasync(this->fd);
+        close(this->fd);
+    }
+}
+
+Wal::SyncPolicy Wal::parsePolicy(const std::string& policy) {
+    if (policy == "always") return ALWAYS;
+    if (policy == "os") return OS;
+    return GROUP;
+}
+
+std::string Wal::segmentName(uint64_t segment) {
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%06llu", static_cast<unsigned long long>(segment));
+    return this->dir + "/" + this->name + suffix;
+}
+
+std::vector<uint64_t> Wal::listSegments() {
+    std::vector<uint64_t> segments;
+    DIR* d = opendir(this->dir.c_str());
+    if (!d) return segments;
+    std::string prefix = this->name + ".";
+    while (struct dirent* entry = readdir(d)) {
+        std::string file(entry->d_name);
+        if (file.size() <= prefix.size() || file.compare(0, prefix.size(), prefix) != 0) continue;
+        std::string number = file.substr(prefix.size());
+        if (!std::all_of(number.begin(), number.end(), ::isdigit)) continue;
+        segments.push_back(std::stoull(number));
+    }
+    closedir(d);
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+bool Wal::openSegment(uint64_t segment) {
+    int newFd = ::open(this->segmentName(segment).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (newFd == -1) {
+        std::cerr << "WAL: 无法创建段文件 " << this->segmentName(segment) << std::endl;
+        return false;
+    }
+    // 新建文件后需要同步目录，保证崩溃后段文件仍然存在
+    int dirFd = ::open(this->dir.c_str(), O_RDONLY);
+    if (dirFd != -1) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+    this->fd = newFd;
+    this->segment = segment;
+    return true;
+}
+
+bool Wal::replaySegment(uint64_t segment, const std::function<void(const Record&)>& apply) {
+    int segFd = ::open(this->segmentName(segment).c_str(), O_RDONLY);
+    if (segFd == -1) return false;
+    std::string data;
+    char buf[65536];
+    ssize_t len;
+    while ((len = read(segFd, buf, sizeof(buf))) > 0) {
+        data.append(buf, len);
+    }
+    close(segFd);
+    size_t pos = 0;
+    while (pos + 8 <= data.size()) {
+        uint32_t crc = decodeFixed32(&data[pos]);
+        uint32_t length = decodeFixed32(&data[pos + 4]);
+        // 记录不完整或校验失败，说明写到一半时发生了崩溃，丢弃该段剩余的数据
+        if (length < 17 || pos + 8 + length > data.size() || crc32c(&data[pos + 8], length) != crc) {
+            std::cerr << "WAL: 段文件 " << this->segmentName(segment) << " 在偏移 " << pos << " 处截断" << std::endl;
+            break;
+        }
+        const char* p = &data[pos + 8];
+        const char* end = p + length;
+        Record record;
+        record.lsn = decodeFixed64(p);
+        record.type = static_cast<RecordType>(p[8]);
+        uint32_t keyLen = decodeFixed32(p + 9);
+        p += 13;
+        if (p + keyLen + 4 > end) break;
+        record.key.assign(p, keyLen);
+        p += keyLen;
+        uint32_t valueLen = decodeFixed32(p);
+        p += 4;
+        if (p + valueLen > end) break;
+        record.value.assign(p, valueLen);
+        apply(record);
+        if (record.lsn >= this->nextLsn) this->nextLsn = record.lsn + 1;
+        pos += 8 + length;
+    }
+    return true;
+}
+
+bool Wal::open(const std::function<void(const Record&)>& apply) {
+    std::vector<uint64_t> segments = this->listSegments();
+    for (uint64_t segment : segments) {
+        this->replaySegment(segment, apply);
+    }
+    this->syncedLsn = this->nextLsn - 1;
+    // 之前的段可能以不完整的记录结尾，因此总是新建一个段用于追加
+    if (!this->openSegment(segments.empty() ? 1 : segments.back() + 1)) return false;
+    if (this->policy != ALWAYS) {
+        this->thread = std::thread(&Wal::flusher, this);
+    }
+    return true;
+}
+
+uint64_t Wal::append(RecordType type, const std::string& key, const std::string& value) {
+    std::unique_lock<std::mutex> l(this->lock);
+    if (this->failed) return 0;
+    return this->encode(type, key, value);
+}
+
+uint64_t Wal::append(RecordType type, const std::vector<std::pair<std::string_view, std::string_view>>& records) {
+    std::unique_lock<std::mutex> l(this->lock);
+    uint64_t lsn = 0;
+    if (this->failed) return lsn;
+    for (auto& record : records) {
+        lsn = this->encode(type, record.first, record.second);
+    }
+    return lsn;
+}
+
+uint64_t Wal::encode(RecordType type, std::string_view key, std::string_view value) {
+    uint64_t lsn = this->nextLsn++;
+    std::string payload;
+    payload.reserve(21 + key.size() + value.size());
+    putFixed64(payload, lsn);
+    payload.push_back(static_cast<char>(type));
+    putFixed32(payload, key.size());
+    payload.append(key);
+    putFixed32(payload, value.size());
+    payload.append(value);
+    putFixed32(this->buffer, crc32c(payload.data(), payload.size()));
+    putFixed32(this->buffer, payload.size());
+    this->buffer.append(payload);
+    if (++this->pendingRecords >= this->groupRecords && this->policy != ALWAYS) {
+        this->flushCond.notify_one(); // 积累的记录足够多，立即唤醒刷盘线程
+    }
+    return lsn;
+}
+
+void Wal::flush(std::unique_lock<std::mutex>& l, bool doSync) {
+    // 同一时间只有一个线程写文件
+    while (this->flushing) this->cond.wait(l);
+    if (this->buffer.empty()) return;
+    if (this->failed) {
+        // 日志中已经有缺口，之后的记录写入文件也无法回放，直接丢弃
+        this->buffer.clear();
+        this->pendingRecords = 0;
+        return;
+    }
+    std::string data;
+    data.swap(this->buffer);
+    uint64_t target = this->nextLsn - 1;
+    this->pendingRecords = 0;
+    this->flushing = true;
+    int currFd = this->fd;
+    l.unlock();
+    // 写文件和刷盘期间不持有锁，其他线程可以继续向缓冲区追加记录，这些记录将在下一次刷盘时一起写入
+    bool ok = true;
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t len = write(currFd, data.data() + written, data.size() - written);
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "WAL: 写入失败: " << strerror(errno) << std::endl;
+            ok = false;
+            break;
+        }
+        written += len;
+    }
+    if (ok && doSync && fdatasync(currFd) != 0) {
+        std::cerr << "WAL: 刷盘失败: " << strerror(errno) << std::endl;
+        ok = false;
+    }
+    l.lock();
+    this->flushing = false;
+    // 只有写入和刷盘都成功时记录才算持久化，失败后等待的写入线程全部返回失败
+    if (!ok) this->failed = true;
+    else if (target > this->syncedLsn) this->syncedLsn = target;
+    this->cond.notify_all();
+}
+
+bool Wal::sync(uint64_t lsn) {
+    std::unique_lock<std::mutex> l(this->lock);
+    if (this->policy == OS) return !this->failed; // 由操作系统决定何时刷盘，不等待
+    while (!this->failed && this->syncedLsn < lsn) {
+        if (this->policy == ALWAYS && !this->flushing) {
+            // 没有线程在刷盘，当前线程成为leader，将缓冲区中所有线程的记录一起刷盘
+            this->flush(l, true);
+        } else {
+            // 等待leader线程或者后台刷盘线程完成刷盘
+            this->cond.wait(l);
+        }
+    }
+    return !this->failed;
+}
+
+void Wal::flusher() {
+    std::unique_lock<std::mutex> l(this->lock);
+    while (!this->stop) {
+        this->flushCond.wait_for(l, std::chrono::milliseconds(this->groupMS), [this]() {
+            return this->stop || this->pendingRecords >= this->groupRecords;
+        });
+        this->flush(l, this->policy == GROUP);
+    }
+}
+
+uint64_t Wal::rotate() {
+    std::unique_lock<std::mutex> l(this->lock);
+    while (this->flushing || !this->buffer.empty()) {
+        this->flush(l, true);
+    }
+    if (fdatasync(this->fd) != 0) this->failed = true;
+    close(this->fd);
+    this->fd = -1;
+    if (!this->openSegment(this->segment + 1)) this->failed = true;
+    return this->segment;
+}
+
+void Wal::removeBefore(uint64_t segment) {
+    for (uint64_t s : this->listSegments()) {
+        if (s < segment) unlink(this->segmentName(s).c_str());
+    }
+}
+
+uint64_t Wal::lastLsn() {
+    std::unique_lock<std::mutex> l(this->lock);
+    return this->nextLsn - 1;
+}
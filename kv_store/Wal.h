@@ -0,0 +1,89 @@
+#ifndef WAL
+#define WAL
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+
+// 预写日志（Write-Ahead Log）
+// 日志由若干个段文件组成（文件名为 前缀.段号），只向最新的段追加记录
+// 每条记录的格式：crc(4) | 长度(4) | lsn(8) | 类型(1) | key长度(4) | key | value长度(4) | value
+// 并发写入的记录先追加到内存缓冲区，由一个线程一次write（和fdatasync）批量写入（组提交）
+// 写文件或刷盘失败后日志进入失败状态（直到重启）：之后的append和sync都返回失败，调用者不能再认为修改已经持久化
+class Wal {
+public:
+    // 刷盘策略
+    enum SyncPolicy {
+        ALWAYS, // 每次写入都等待数据刷盘（同时等待的写入会合并为一次刷盘）
+        GROUP,  // 每隔groupMS毫秒或积累groupRecords条记录刷盘一次，写入等待刷盘完成
+        OS      // 每隔groupMS毫秒写入文件，不调用fdatasync，由操作系统决定何时刷盘，写入不等待
+    };
+    // 记录类型
+    enum RecordType : uint8_t {
+        PUT = 1,
+        DEL = 2,
+        PUT_TTL = 3 // 带过期时间的PUT，value的前4字节为过期时间（Unix时间，秒），之后为value
+    };
+    struct Record {
+        uint64_t lsn; // 日志序列号，从1开始递增
+        RecordType type;
+        std::string key;
+        std::string value;
+    };
+
+    Wal(const std::string& prefix, SyncPolicy policy, int groupMS, int groupRecords);
+    ~Wal(); // 停止刷盘线程，并将缓冲区中的记录写入文件
+
+    // 按顺序回放所有段中的记录，然后新建一个段用于追加；失败返回false
+    bool open(const std::function<void(const Record&)>& apply);
+    // 追加一条记录，返回lsn；日志处于失败状态时不再追加，返回0
+    uint64_t append(RecordType type, const std::string& key, const std::string& value);
+    // 在一次加锁内追加多条同类型的记录（批量命令），返回最后一条记录的lsn（没有记录或者日志处于失败状态时返回0）
+    uint64_t append(RecordType type, const std::vector<std::pair<std::string_view, std::string_view>>& records);
+    // 按照刷盘策略等待lsn及之前的记录持久化；日志处于失败状态时返回false
+    bool sync(uint64_t lsn);
+    uint64_t rotate(); // 将缓冲区刷盘后新建一个段，返回新段的段号
+    void removeBefore(uint64_t segment); // 删除段号小于segment的段（这些段中的记录已经包含在快照中）
+    uint64_t lastLsn(); // 最后一条记录的lsn
+
+    static SyncPolicy parsePolicy(const std::string& policy);
+
+    Wal(const Wal&) = delete; // 禁用拷贝构造函数
+    Wal& operator=(const Wal&) = delete; // 禁用赋值运算符
+private:
+    std::string segmentName(uint64_t segment); // 段号对应的文件名
+    std::vector<uint64_t> listSegments(); // 列出当前存在的所有段号（升序）
+    bool openSegment(uint64_t segment); // 新建段文件并作为当前追加的段
+    uint64_t encode(RecordType type, std::string_view key, std::string_view value); // 将记录追加到缓冲区，调用时必须持有lock
+    bool replaySegment(uint64_t segment, const std::function<void(const Record&)>& apply);
+    // 将缓冲区中的记录写入文件，调用时必须持有lock，写文件期间会暂时释放锁
+    void flush(std::unique_lock<std::mutex>& lock, bool doSync);
+    void flusher(); // 后台刷盘线程（GROUP和OS策略）
+
+    std::string dir; // 段文件所在目录
+    std::string name; // 段文件名前缀
+    SyncPolicy policy;
+    int groupMS;
+    int groupRecords;
+
+    std::mutex lock; // 保护以下所有成员
+    std::condition_variable cond; // 刷盘完成时通知等待的写入线程
+    std::condition_variable flushCond; // 通知后台刷盘线程
+    std::string buffer; // 尚未写入文件的记录
+    int pendingRecords = 0; // buffer中的记录数
+    uint64_t nextLsn = 1; // 下一条记录的lsn
+    uint64_t syncedLsn = 0; // 已经持久化的最大lsn（OS策略下为已写入文件的最大lsn）
+    bool flushing = false; // 是否有线程正在写文件
+    bool failed = false; // 写文件或刷盘是否失败过（失败之后syncedLsn不再前进）
+    bool stop = false; // 是否停止后台刷盘线程
+    int fd = -1; // 当前段的文件描述符
+    uint64_t segment = 0; // 当前段的段号
+    std::thread thread; // 后台刷盘线程
+};
+
+#endif
@@ -0,0 +1,58 @@
+#include "Bloom.h"
+#include <algorithm>
+
+// 过滤器会写入文件，哈希函数必须在不同的编译器和标准库版本下保持一致，因此不使用std::hash
+// FNV-1a之后再做一次混合，使高低位都足够随机
+static uint64_t bloomHash(std::string_view key) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : key) {
+        h = (h ^ c) * 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+BloomBuilder::BloomBuilder(int bitsPerKey) {
+    this->bitsPerKey = std::max(bitsPerKey, 1);
+}
+
+void BloomBuilder::add(std::string_view key) {
+    this->hashes.push_back(bloomHash(key));
+}
+
+std::string BloomBuilder::finish() {
+    // 哈希函数个数取 bitsPerKey*ln2 时误判率最低
+    int k = std::min(std::max(static_cast<int>(this->bitsPerKey * 0.69), 1), 30);
+    size_t bits = std::max<size_t>(this->hashes.size() * this->bitsPerKey, 64);
+    size_t bytes = (bits + 7) / 8;
+    bits = bytes * 8;
+    std::string filter(bytes, 0);
+    for (uint64_t h : this->hashes) {
+        uint64_t delta = (h >> 33) | (h << 31);
+        for (int i = 0; i < k; i++) {
+            size_t pos = h % bits;
+            filter[pos / 8] |= static_cast<char>(1 << (pos % 8));
+            h += delta;
+        }
+    }
+    filter.push_back(static_cast<char>(k));
+    this->hashes.clear();
+    return filter;
+}
+
+bool bloomMayContain(std::string_view filter, std::string_view key) {
+    if (filter.size() < 2) return true;
+    int k = static_cast<unsigned char>(filter.back());
+    if (k < 1 || k > 30) return true;
+    size_t bits = (filter.size() - 1) * 8;
+    uint64_t h = bloomHash(key);
+    uint64_t delta = (h >> 33) | (h << 31);
+    for (int i = 0; i < k; i++) {
+        size_t pos = h % bits;
+        if ((filter[pos / 8] & (1 << (pos % 8))) == 0) return false;
+        h += delta;
+    }
+    return true;
+}
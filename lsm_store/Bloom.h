@@ -0,0 +1,25 @@
+#ifndef BLOOM
+#define BLOOM
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+// 布隆过滤器：每张表一个，查找时先判断key是否可能在表中，不在时不需要读数据块
+// 过滤器的格式：位数组 | 哈希函数个数(1)
+// 使用双重哈希 h1 + i*h2 模拟k个哈希函数，每个key只需要计算一次哈希
+class BloomBuilder {
+public:
+    explicit BloomBuilder(int bitsPerKey);
+    void add(std::string_view key);
+    std::string finish(); // 生成过滤器并清空已添加的key
+private:
+    int bitsPerKey;
+    std::vector<uint64_t> hashes; // 已添加的key的哈希值
+};
+
+// 判断key是否可能在过滤器中：返回false时key一定不存在；过滤器为空（或格式不正确）时总是返回true
+bool bloomMayContain(std::string_view filter, std::string_view key);
+
+#endif
@@ -0,0 +1,612 @@
+#include "LsmTree.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <set>
+#include <cstdio>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// memtable中跳表的最大层数，4MB的memtable约有几万个key
+static const int MEMTABLE_LEVEL = 18;
+
+// memtable的数据源：持有memtable的引用，保证遍历期间memtable不被释放
+class MemSource : public Source {
+public:
+    MemSource(std::shared_ptr<SkipList<std::string>> list, const std::string* start)
+        : list(std::move(list)), iter(*this->list, start) {}
+    bool valid() const override {
+        return this->iter.valid();
+    }
+    std::string_view key() const override {
+        return this->iter.key();
+    }
+    std::string_view value() const override {
+        return this->iter.value();
+    }
+    void next() override {
+        this->iter.next();
+    }
+private:
+    std::shared_ptr<SkipList<std::string>> list; // 必须在iter之前声明，iter先析构
+    SkipList<std::string>::Iterator iter;
+};
+
+// 一层中的所有表（key范围互不重叠，按最小key排列）作为一个数据源，依次遍历每张表
+class LevelSource : public Source {
+public:
+    LevelSource(std::vector<std::shared_ptr<Table>> tables, const std::string* start) : tables(std::move(tables)) {
+        size_t i = 0;
+        if (start) {
+            while (i < this->tables.size() && this->tables[i]->largest() < *start) i++;
+        }
+        this->open(i, start);
+    }
+    bool valid() const override {
+        return this->iter && this->iter->valid();
+    }
+    std::string_view key() const override {
+        return this->iter->key();
+    }
+    std::string_view value() const override {
+        return this->iter->value();
+    }
+    void next() override {
+        this->iter->next();
+        if (!this->iter->valid()) this->open(this->index + 1, nullptr);
+    }
+private:
+    // 从第i张表开始找到第一条记录（第一张表从start开始）
+    void open(size_t i, const std::string* start) {
+        for (this->index = i; this->index < this->tables.size(); this->index++) {
+            this->iter.reset(new Table::Iterator(this->tables[this->index]));
+            if (start) this->iter->seek(*start);
+            else this->iter->seekToFirst();
+            if (this->iter->valid()) return;
+            start = nullptr;
+        }
+        this->iter.reset();
+    }
+
+    std::vector<std::shared_ptr<Table>> tables;
+    size_t index = 0;
+    std::unique_ptr<Table::Iterator> iter;
+};
+
+// 将目录刷盘，保证文件的创建和重命名在崩溃后仍然生效
+static void syncDir(const std::string& dir) {
+    int dirFd = ::open(dir.c_str(), O_RDONLY);
+    if (dirFd != -1) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+}
+
+// 判断表的key范围是否与[lo,hi]重叠
+static bool intersects(const Table& table, const std::string& lo, const std::string& hi) {
+    return !(table.largest() < lo || table.smallest() > hi);
+}
+
+LsmTree::LsmTree(const Options& options) : options(options) {
+    this->mem = this->newMemtable();
+    this->current = std::make_shared<Version>();
+}
+
+LsmTree::~LsmTree() {
+    if (this->thread.joinable()) {
+        this->flush();
+        {
+            std::unique_lock<std::mutex> lock(this->bgLock);
+            this->stop = true;
+        }
+        this->bgCond.notify_all();
+        this->thread.join();
+    }
+}
+
+std::string LsmTree::tableName(uint64_t number) const {
+    char name[32];
+    snprintf(name, sizeof(name), "/%06llu.sst", static_cast<unsigned long long>(number));
+    return this->options.dir + name;
+}
+
+std::shared_ptr<LsmTree::Memtable> LsmTree::newMemtable() const {
+    return std::make_shared<Memtable>(MEMTABLE_LEVEL);
+}
+
+uint64_t LsmTree::maxBytes(int level) const {
+    uint64_t bytes = this->options.levelBase;
+    for (int i = 1; i < level; i++) bytes *= this->options.levelRatio;
+    return bytes;
+}
+
+bool LsmTree::open() {
+    if (mkdir(this->options.dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << "LSM: 无法创建数据目录 " << this->options.dir << std::endl;
+        return false;
+    }
+    if (!this->loadManifest()) return false;
+    if (this->options.wal) {
+        this->wal.reset(new Wal(this->options.dir + "/wal", this->options.walSync,
+            this->options.walGroupMS, this->options.walGroupRecords));
+        // 回放上次没有落盘的memtable中的写入
+        bool ok = this->wal->open([this](const Wal::Record& record) {
+            std::string tagged(1, record.type == Wal::PUT ? TYPE_PUT : TYPE_DEL);
+            if (record.type == Wal::PUT) tagged.append(record.value);
+            this->mem->insertElement(record.key, tagged);
+        });
+        if (!ok) {
+            std::cerr << "LSM: WAL打开失败" << std::endl;
+            return false;
+        }
+    }
+    this->thread = std::thread(&LsmTree::background, this);
+    this->schedule(); // 检查加载的版本是否需要合并
+    return true;
+}
+
+bool LsmTree::loadManifest() {
+    auto version = std::make_shared<Version>();
+    std::set<uint64_t> live;
+    std::ifstream file(this->options.dir + "/MANIFEST");
+    if (file.is_open()) {
+        // 每行一项：next 下一个表号 或者 table 层号 表号（同一层按照版本中的顺序排列）
+        std::string line;
+        while (getline(file, line)) {
+            std::istringstream in(line);
+            std::string kind;
+            in >> kind;
+            if (kind == "next") {
+                in >> this->nextTableNumber;
+            } else if (kind == "table") {
+                int level = -1;
+                uint64_t number = 0;
+                in >> level >> number;
+                if (!in || level < 0 || level >= LEVELS) {
+                    std::cerr << "LSM: MANIFEST格式不正确" << std::endl;
+                    return false;
+                }
+                auto table = Table::open(this->tableName(number), number);
+                if (!table) return false;
+                version->levels[level].push_back(table);
+                live.insert(number);
+            }
+        }
+    }
+    // 删除不属于任何版本的表（落盘或合并到一半时进程退出留下的文件）
+    DIR* dir = opendir(this->options.dir.c_str());
+    if (dir) {
+        while (dirent* entry = readdir(dir)) {
+            unsigned long long number;
+            char suffix[8];
+            if (sscanf(entry->d_name, "%llu.%7s", &number, suffix) == 2 && std::string(suffix) == "sst" &&
+                !live.count(number)) {
+                unlink((this->options.dir + "/" + entry->d_name).c_str());
+            }
+        }
+        closedir(dir);
+    }
+    this->current = version;
+    return true;
+}
+
+bool LsmTree::saveManifest(const Version& version) {
+    std::string name = this->options.dir + "/MANIFEST";
+    std::string tmp = name + ".tmp";
+    std::string content = "next " + std::to_string(this->nextTableNumber) + "\n";
+    for (int level = 0; level < LEVELS; level++) {
+        for (auto& table : version.levels[level]) {
+            content += "table " + std::to_string(level) + " " + std::to_string(table->number()) + "\n";
+        }
+    }
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        std::cerr << "LSM: 无法创建MANIFEST" << std::endl;
+        return false;
+    }
+    bool ok = ::write(fd, content.data(), content.size()) == static_cast<ssize_t>(content.size()) && fdatasync(fd) == 0;
+    close(fd);
+    if (!ok || rename(tmp.c_str(), name.c_str()) != 0) {
+        std::cerr << "LSM: 写入MANIFEST失败" << std::endl;
+        unlink(tmp.c_str());
+        return false;
+    }
+    syncDir(this->options.dir);
+    return true;
+}
+
+bool LsmTree::install(const std::function<void(Version&)>& edit) {
+    std::shared_ptr<Version> version;
+    {
+        std::unique_lock<std::mutex> lock(this->stateLock);
+        version = std::make_shared<Version>(*this->current);
+    }
+    edit(*version);
+    // 只有后台线程修改版本，写MANIFEST期间当前版本不会变化，不需要持有锁
+    if (!this->saveManifest(*version)) return false;
+    std::unique_lock<std::mutex> lock(this->stateLock);
+    this->current = version;
+    return true;
+}
+
+void LsmTree::write(Wal::RecordType type, const std::vector<std::pair<std::string_view, std::string_view>>& records) {
+    uint64_t lsn = 0;
+    {
+        std::unique_lock<std::mutex> lock(this->writeLock);
+        this->makeRoom(lock, false);
+        if (this->wal && !records.empty()) {
+            lsn = this->wal->append(type, records);
+            if (lsn == 0) throw std::runtime_error("WAL写入失败");
+        }
+        std::string tagged;
+        for (auto& record : records) {
+            tagged.assign(1, type == Wal::PUT ? TYPE_PUT : TYPE_DEL);
+            if (type == Wal::PUT) tagged.append(record.second.data(), record.second.size());
+            this->mem->insertElement(record.first, tagged);
+        }
+    }
+    if (this->wal && !this->wal->sync(lsn)) throw std::runtime_error("WAL写入失败");
+}
+
+void LsmTree::makeRoom(std::unique_lock<std::mutex>& lock, bool force) {
+    while (true) {
+        if (!force && this->mem->memoryUsage() < this->options.memtableSize) return;
+        bool wait;
+        {
+            std::unique_lock<std::mutex> state(this->stateLock);
+            wait = this->imm != nullptr ||
+                   static_cast<int>(this->current->levels[0].size()) >= this->options.l0Stop;
+        }
+        if (wait) {
+            this->roomCond.wait(lock);
+            continue;
+        }
+        {
+            std::unique_lock<std::mutex> state(this->stateLock);
+            this->imm = this->mem;
+            this->mem = this->newMemtable();
+            // 冻结之后的写入进入新的段，imm落盘后之前的段就不再需要了
+            this->immSegment = this->wal ? this->wal->rotate() : 0;
+        }
+        this->schedule();
+        return;
+    }
+}
+
+void LsmTree::wakeWriters() {
+    // 写入线程在writeLock内检查条件后等待，短暂获取writeLock保证通知不会丢失
+    { std::unique_lock<std::mutex> lock(this->writeLock); }
+    this->roomCond.notify_all();
+}
+
+void LsmTree::schedule() {
+    {
+        std::unique_lock<std::mutex> lock(this->bgLock);
+        this->bgWork = true;
+    }
+    this->bgCond.notify_one();
+}
+
+bool LsmTree::flush() {
+    std::unique_lock<std::mutex> lock(this->writeLock);
+    if (this->mem->size() == 0) {
+        // 等待已经冻结的imm落盘
+        while (true) {
+            std::unique_lock<std::mutex> state(this->stateLock);
+            if (this->imm == nullptr) return true;
+            state.unlock();
+            this->roomCond.wait(lock);
+        }
+    }
+    this->makeRoom(lock, true);
+    std::shared_ptr<Memtable> frozen;
+    uint64_t failures;
+    {
+        std::unique_lock<std::mutex> state(this->stateLock);
+        frozen = this->imm;
+        failures = this->flushFailures;
+    }
+    while (true) {
+        std::unique_lock<std::mutex> state(this->stateLock);
+        if (this->imm != frozen) return true;
+        if (this->flushFailures != failures) return false;
+        state.unlock();
+        this->roomCond.wait(lock);
+    }
+}
+
+bool LsmTree::get(std::string_view key, std::string& value) {
+    std::shared_ptr<Memtable> mem, imm;
+    std::shared_ptr<const Version> version;
+    {
+        std::unique_lock<std::mutex> lock(this->stateLock);
+        mem = this->mem;
+        imm = this->imm;
+        version = this->current;
+    }
+    std::string tagged;
+    auto copy = [&tagged](std::string_view v) { tagged.assign(v.data(), v.size()); };
+    bool found = mem->searchElement(key, copy) || (imm && imm->searchElement(key, copy));
+    if (!found) {
+        // L0的表之间可能重叠，从新到旧逐个查找
+        for (auto& table : version->levels[0]) {
+            if (table->get(key, tagged)) {
+                found = true;
+                break;
+            }
+        }
+    }
+    for (int level = 1; !found && level < LEVELS; level++) {
+        // 其余各层最多只有一张表可能包含key：二分查找第一张最大key不小于key的表
+        auto& tables = version->levels[level];
+        auto iter = std::lower_bound(tables.begin(), tables.end(), key,
+            [](const std::shared_ptr<Table>& table, std::string_view k) { return table->largest() < k; });
+        if (iter != tables.end() && (*iter)->get(key, tagged)) found = true;
+    }
+    if (!found || tagged.empty() || tagged[0] != TYPE_PUT) return false;
+    value.assign(tagged, 1, std::string::npos);
+    return true;
+}
+
+std::unique_ptr<MergeIterator> LsmTree::newIterator(const std::string* start) {
+    std::shared_ptr<Memtable> mem, imm;
+    std::shared_ptr<const Version> version;
+    {
+        std::unique_lock<std::mutex> lock(this->stateLock);
+        mem = this->mem;
+        imm = this->imm;
+        version = this->current;
+    }
+    // 数据源按从新到旧排列
+    std::vector<std::unique_ptr<Source>> sources;
+    sources.emplace_back(new MemSource(mem, start));
+    if (imm) sources.emplace_back(new MemSource(imm, start));
+    for (auto& table : version->levels[0]) {
+        std::unique_ptr<Table::Iterator> iter(new Table::Iterator(table));
+        if (start) iter->seek(*start);
+        else iter->seekToFirst();
+        sources.push_back(std::move(iter));
+    }
+    for (int level = 1; level < LEVELS; level++) {
+        if (!version->levels[level].empty()) sources.emplace_back(new LevelSource(version->levels[level], start));
+    }
+    return std::unique_ptr<MergeIterator>(new MergeIterator(std::move(sources)));
+}
+
+uint64_t LsmTree::count() {
+    uint64_t total = 0;
+    for (auto iter = this->newIterator(nullptr); iter->valid(); iter->next()) {
+        std::string_view value = iter->value();
+        if (!value.empty() && value[0] == TYPE_PUT) total++;
+    }
+    return total;
+}
+
+std::string LsmTree::stats() {
+    std::shared_ptr<const Version> version;
+    size_t memBytes;
+    {
+        std::unique_lock<std::mutex> lock(this->stateLock);
+        version = this->current;
+        memBytes = this->mem->memoryUsage() + (this->imm ? this->imm->memoryUsage() : 0);
+    }
+    std::string json = "{\"memtable\": \"" + std::to_string(memBytes) + "\", \"levels\": [";
+    for (int level = 0; level < LEVELS; level++) {
+        uint64_t bytes = 0;
+        for (auto& table : version->levels[level]) bytes += table->fileSize();
+        if (level) json += ", ";
+        json += "{\"tables\": \"" + std::to_string(version->levels[level].size()) +
+                "\", \"bytes\": \"" + std::to_string(bytes) + "\"}";
+    }
+    json += "]}";
+    return json;
+}
+
+void LsmTree::background() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(this->bgLock);
+            this->bgCond.wait(lock, [this] { return this->stop || this->bgWork; });
+            if (this->stop) return;
+            this->bgWork = false;
+        }
+        // 落盘imm优先于合并，因为写入可能正在等待imm落盘
+        while (!this->stop) {
+            bool pending;
+            {
+                std::unique_lock<std::mutex> lock(this->stateLock);
+                pending = this->imm != nullptr;
+            }
+            if (pending) {
+                if (!this->flushImm()) {
+                    // 稍后重试（例如磁盘空间不足）
+                    std::unique_lock<std::mutex> lock(this->bgLock);
+                    this->bgCond.wait_for(lock, std::chrono::seconds(1), [this] { return this->stop.load(); });
+                    this->bgWork = true;
+                    break;
+                }
+                continue;
+            }
+            if (!this->compact()) break;
+        }
+    }
+}
+
+bool LsmTree::flushImm() {
+    std::shared_ptr<Memtable> imm;
+    uint64_t segment;
+    {
+        std::unique_lock<std::mutex> lock(this->stateLock);
+        imm = this->imm;
+        segment = this->immSegment;
+    }
+    std::shared_ptr<Table> table;
+    if (imm->size() > 0) {
+        uint64_t number = this->nextTableNumber++;
+        TableBuilder builder(this->tableName(number), this->options.bloomBits);
+        bool ok = true;
+        for (Memtable::Iterator iter(*imm, nullptr); ok && iter.valid(); iter.next()) {
+            ok = builder.add(iter.key(), iter.value());
+        }
+        if (ok) ok = builder.finish();
+        if (ok) table = Table::open(this->tableName(number), number);
+        if (!table || !this->install([&table](Version& version) {
+                version.levels[0].insert(version.levels[0].begin(), table);
+            })) {
+            std::cerr << "LSM: memtable落盘失败" << std::endl;
+            if (table) table->markObsolete();
+            {
+                std::unique_lock<std::mutex> lock(this->stateLock);
+                this->flushFailures++;
+            }
+            this->wakeWriters();
+            return false;
+        }
+    }
+    {
+        std::unique_lock<std::mutex> lock(this->stateLock);
+        this->imm = nullptr;
+    }
+    if (this->wal) this->wal->removeBefore(segment);
+    this->wakeWriters();
+    return true;
+}
+
+bool LsmTree::pickCompaction(int& level, TableList& inputs, TableList& overlaps) {
+    std::shared_ptr<const Version> version;
+    {
+        std::unique_lock<std::mutex> lock(this->stateLock);
+        version = this->current;
+    }
+    level = -1;
+    if (static_cast<int>(version->levels[0].size()) >= this->options.l0Trigger) {
+        level = 0;
+        inputs = version->levels[0];
+    } else {
+        for (int i = 1; i < LEVELS - 1 && level < 0; i++) {
+            uint64_t bytes = 0;
+            for (auto& table : version->levels[i]) bytes += table->fileSize();
+            if (bytes <= this->maxBytes(i)) continue;
+            level = i;
+            // 从上一次合并的位置之后选一张表，保证整层的key范围都能轮到
+            auto& tables = version->levels[i];
+            auto iter = std::find_if(tables.begin(), tables.end(), [this, i](const std::shared_ptr<Table>& table) {
+                return table->smallest() > this->compactPointer[i];
+            });
+            inputs = {iter == tables.end() ? tables.front() : *iter};
+            this->compactPointer[i] = inputs[0]->largest();
+        }
+    }
+    if (level < 0) return false;
+    std::string lo = inputs[0]->smallest(), hi = inputs[0]->largest();
+    for (auto& table : inputs) {
+        lo = std::min(lo, table->smallest());
+        hi = std::max(hi, table->largest());
+    }
+    overlaps.clear();
+    for (auto& table : version->levels[level + 1]) {
+        if (intersects(*table, lo, hi)) overlaps.push_back(table);
+    }
+    return true;
+}
+
+bool LsmTree::compact() {
+    int level;
+    TableList inputs, overlaps;
+    if (!this->pickCompaction(level, inputs, overlaps)) return false;
+    auto contains = [](const TableList& tables, const std::shared_ptr<Table>& table) {
+        return std::find(tables.begin(), tables.end(), table) != tables.end();
+    };
+    auto bySmallest = [](const std::shared_ptr<Table>& a, const std::shared_ptr<Table>& b) {
+        return a->smallest() < b->smallest();
+    };
+    if (level > 0 && overlaps.empty()) {
+        // 下一层没有重叠的表，直接把表移动到下一层，不需要重写数据
+        return this->install([&](Version& version) {
+            auto& from = version.levels[level];
+            from.erase(std::find(from.begin(), from.end(), inputs[0]));
+            auto& to = version.levels[level + 1];
+            to.insert(std::upper_bound(to.begin(), to.end(), inputs[0], bySmallest), inputs[0]);
+        });
+    }
+    // 更深的层中没有数据时，墓碑已经没有可以遮盖的旧值，可以丢弃
+    bool dropDeletes = true;
+    {
+        std::unique_lock<std::mutex> lock(this->stateLock);
+        for (int i = level + 2; i < LEVELS; i++) {
+            if (!this->current->levels[i].empty()) dropDeletes = false;
+        }
+    }
+    TableList outputs;
+    std::unique_ptr<TableBuilder> builder;
+    uint64_t number = 0;
+    bool ok = true;
+    auto finishOutput = [&]() {
+        ok = builder->finish();
+        std::shared_ptr<Table> table = ok ? Table::open(this->tableName(number), number) : nullptr;
+        if (table) outputs.push_back(table);
+        else ok = false;
+        builder.reset();
+    };
+    try {
+        std::vector<std::unique_ptr<Source>> sources;
+        for (auto& table : inputs) { // L0的表从新到旧排列，排在下一层的表之前
+            std::unique_ptr<Table::Iterator> iter(new Table::Iterator(table));
+            iter->seekToFirst();
+            sources.push_back(std::move(iter));
+        }
+        if (!overlaps.empty()) sources.emplace_back(new LevelSource(overlaps, nullptr));
+        MergeIterator merge(std::move(sources));
+        for (; ok && merge.valid(); merge.next()) {
+            std::string_view value = merge.value();
+            if (dropDeletes && !value.empty() && value[0] == TYPE_DEL) continue;
+            if (!builder) {
+                number = this->nextTableNumber++;
+                builder.reset(new TableBuilder(this->tableName(number), this->options.bloomBits));
+            }
+            ok = builder->add(merge.key(), value);
+            if (ok && builder->fileSize() >= this->options.tableSize) finishOutput();
+            // 合并可能持续较长时间，期间及时落盘新冻结的imm，避免写入一直等待
+            bool pending;
+            {
+                std::unique_lock<std::mutex> lock(this->stateLock);
+                pending = this->imm != nullptr;
+            }
+            if (ok && pending && !this->flushImm()) ok = false;
+        }
+        if (ok && builder) finishOutput();
+    } catch (const std::exception&) {
+        // 输入表的数据块损坏：放弃这次合并，已经写好的输出表在下面删除
+        ok = false;
+    }
+    if (ok) {
+        ok = this->install([&](Version& version) {
+            auto& from = version.levels[level];
+            from.erase(std::remove_if(from.begin(), from.end(), [&](const std::shared_ptr<Table>& table) {
+                return contains(inputs, table);
+            }), from.end());
+            auto& to = version.levels[level + 1];
+            to.erase(std::remove_if(to.begin(), to.end(), [&](const std::shared_ptr<Table>& table) {
+                return contains(overlaps, table);
+            }), to.end());
+            to.insert(to.end(), outputs.begin(), outputs.end());
+            std::sort(to.begin(), to.end(), bySmallest);
+        });
+    }
+    if (!ok) {
+        std::cerr << "LSM: L" << level << "合并失败" << std::endl;
+        for (auto& table : outputs) table->markObsolete();
+        return false;
+    }
+    // 被替换的表在最后一个读操作释放引用后删除文件
+    for (auto& table : inputs) table->markObsolete();
+    for (auto& table : overlaps) table->markObsolete();
+    this->wakeWriters();
+    return true;
+}
@@ -0,0 +1,146 @@
+#ifndef LSMTREE
+#define LSMTREE
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+#include "SkipList.h"
+#include "Wal.h"
+#include "Table.h"
+#include "Merge.h"
+
+// LSM树：数据量可以超过内存，key和value都是任意字节串，按字节序排序
+// 写入：先写WAL，再写入内存中的跳表（memtable）。memtable超过memtableSize时被冻结为只读的imm，
+//       同时切换WAL段并新建一个memtable，后台线程将imm写成L0的一张表后删除旧的WAL段
+// 读取：依次查找memtable、imm、L0的表（从新到旧，表之间key范围可以重叠）、L1及以下各层（每层的表key范围互不重叠）
+// 合并（leveled compaction）：L0的表数量达到l0Trigger时，将L0的所有表与L1中重叠的表合并为L1的新表；
+//       Li（i>=1）的总大小超过上限（levelBase*levelRatio^(i-1)）时，轮流选一张表与Li+1中重叠的表合并
+// 删除写入墓碑，墓碑在合并到没有更深层数据的层时才被丢弃
+// 表的集合称为版本（Version），只由后台线程修改；每次修改生成新版本并写入MANIFEST（临时文件+重命名），
+// 读操作持有版本的shared_ptr，因此合并期间被替换的表在最后一个读操作结束后才删除文件
+class LsmTree {
+public:
+    struct Options {
+        std::string dir = "lsm_data"; // 数据目录：MANIFEST、表文件和WAL段都在这里
+        size_t memtableSize = 4 * 1024 * 1024; // memtable的大小上限
+        size_t tableSize = 2 * 1024 * 1024; // 合并输出的单张表的大小
+        int l0Trigger = 4; // L0的表数量达到该值时开始合并
+        int l0Stop = 12; // L0的表数量达到该值时，memtable写满的写入等待合并
+        uint64_t levelBase = 10 * 1024 * 1024; // L1的大小上限
+        int levelRatio = 10; // 相邻两层大小上限的倍数
+        int bloomBits = 10; // 布隆过滤器每个key占用的位数
+        bool wal = true; // 是否开启预写日志；关闭时只有正常退出时memtable中的数据才会落盘
+        Wal::SyncPolicy walSync = Wal::GROUP;
+        int walGroupMS = 2;
+        int walGroupRecords = 128;
+    };
+    // memtable和表中的value的第一个字节为类型标记
+    static constexpr char TYPE_PUT = 'P'; // 之后为value
+    static constexpr char TYPE_DEL = 'D'; // 墓碑
+    static constexpr int LEVELS = 7;
+
+    explicit LsmTree(const Options& options);
+    ~LsmTree(); // 将memtable落盘后停止后台线程
+
+    bool open(); // 加载MANIFEST和表，回放WAL，启动后台线程；失败返回false
+
+    // 写入一批同类型的记录（PUT或DEL，DEL的value被忽略），整批只写一次WAL、等待一次刷盘
+    // 写入都是盲写，不读取旧值，因此不区分插入和更新、删除的key是否存在
+    // 先追加WAL再写memtable：追加失败（WAL已经进入失败状态）时不修改memtable，抛出std::runtime_error
+    // 刷盘在释放写锁之后进行，刷盘期间写入已经对读可见；刷盘失败时同样抛出std::runtime_error，
+    // 此时写入可能已经被读到，但不能认为已经持久化（重启后可能丢失）
+    void write(Wal::RecordType type, const std::vector<std::pair<std::string_view, std::string_view>>& records);
+    void put(std::string_view key, std::string_view value) {
+        this->write(Wal::PUT, {{key, value}});
+    }
+    void remove(std::string_view key) {
+        this->write(Wal::DEL, {{key, std::string_view()}});
+    }
+    // 找到时返回true；表的数据块损坏时抛出std::runtime_error，不会继续查找更旧的表
+    bool get(std::string_view key, std::string& value);
+
+    // 从第一个不小于start（nullptr时从头开始）的key开始遍历所有数据源，value带类型标记（包括墓碑）
+    // 遍历中读到损坏的数据块时抛出std::runtime_error（scan和count同样），不会返回不完整的结果
+    std::unique_ptr<MergeIterator> newIterator(const std::string* start);
+    // 范围查询：按key升序以(key, value)调用visit，最多访问[lo,hi]内的limit个key（lo或hi为nullptr时不限制该方向）
+    // 范围内还有剩余的key时返回true，并将next设置为下一个key
+    template<typename F>
+    bool scan(const std::string* lo, const std::string* hi, int limit, F&& visit, std::string& next) {
+        auto iter = this->newIterator(lo);
+        int n = 0;
+        for (; iter->valid(); iter->next()) {
+            std::string_view key = iter->key();
+            if (hi && key > *hi) break;
+            std::string_view value = iter->value();
+            if (value.empty() || value[0] != TYPE_PUT) continue;
+            if (n++ == limit) {
+                next.assign(key.data(), key.size());
+                return true;
+            }
+            visit(key, value.substr(1));
+        }
+        return false;
+    }
+    uint64_t count(); // 未删除的key的数量，需要归并遍历所有数据
+    bool flush(); // 冻结当前memtable并等待写入L0（memtable为空时直接返回），失败返回false
+    std::string stats(); // memtable大小和各层的表数量、字节数（json）
+
+    LsmTree(const LsmTree&) = delete; // 禁用拷贝构造函数
+    LsmTree& operator=(const LsmTree&) = delete; // 禁用赋值运算符
+private:
+    using Memtable = SkipList<std::string>;
+    using TableList = std::vector<std::shared_ptr<Table>>;
+    struct Version {
+        TableList levels[LEVELS]; // L0按从新到旧排列，其余各层按最小key排列
+    };
+
+    std::string tableName(uint64_t number) const;
+    std::shared_ptr<Memtable> newMemtable() const;
+    // 保证memtable有空间写入：memtable已满时冻结它，上一个imm还没有落盘或者L0的表过多时等待；force为true时总是冻结
+    void makeRoom(std::unique_lock<std::mutex>& lock, bool force);
+    void wakeWriters(); // 后台线程修改imm或版本后通知等待的写入
+    void schedule(); // 通知后台线程有新的工作
+
+    bool loadManifest(); // 读取MANIFEST并打开其中的表，删除不在其中的表文件
+    bool saveManifest(const Version& version);
+    // 在当前版本上应用修改生成新版本，写入MANIFEST后替换当前版本（只在后台线程中调用）
+    bool install(const std::function<void(Version&)>& edit);
+
+    void background(); // 后台线程：落盘imm和合并
+    bool flushImm(); // 将imm写成L0的一张表
+    bool pickCompaction(int& level, TableList& inputs, TableList& overlaps);
+    bool compact(); // 执行一次合并，没有需要合并的层或者合并失败时返回false
+    uint64_t maxBytes(int level) const;
+
+    Options options;
+    std::unique_ptr<Wal> wal;
+
+    std::mutex writeLock; // 串行化写入：冻结检查、写memtable和追加WAL在同一把锁内完成，保证WAL中的顺序与写入顺序一致
+    std::condition_variable roomCond; // 与writeLock配合，等待imm落盘或者合并
+
+    std::mutex stateLock; // 保护以下四个成员；与writeLock同时持有时先获取writeLock
+    std::shared_ptr<Memtable> mem;
+    std::shared_ptr<Memtable> imm; // 正在落盘的memtable，没有时为nullptr
+    uint64_t immSegment = 0; // 冻结imm时切换出的新WAL段，imm落盘后删除之前的段
+    std::shared_ptr<const Version> current;
+    uint64_t flushFailures = 0; // imm落盘失败的次数（flush据此结束等待）
+
+    // 以下成员只由后台线程（和open）访问
+    uint64_t nextTableNumber = 1;
+    std::string compactPointer[LEVELS]; // 各层上一次合并的表的最大key，下一次从它之后的表开始
+
+    std::mutex bgLock;
+    std::condition_variable bgCond;
+    bool bgWork = false; // 是否有待处理的工作
+    std::atomic<bool> stop{false};
+    std::thread thread;
+};
+
+#endif
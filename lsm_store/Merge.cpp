@@ -0,0 +1,24 @@
+#include "Merge.h"
+
+MergeIterator::MergeIterator(std::vector<std::unique_ptr<Source>> sources) : sources(std::move(sources)) {
+    this->findSmallest();
+}
+
+void MergeIterator::findSmallest() {
+    this->current = -1;
+    for (int i = 0; i < static_cast<int>(this->sources.size()); i++) {
+        if (!this->sources[i]->valid()) continue;
+        // 严格小于才替换，key相同时保留更新的数据源
+        if (this->current < 0 || this->sources[i]->key() < this->sources[this->current]->key()) {
+            this->current = i;
+        }
+    }
+}
+
+void MergeIterator::next() {
+    std::string key(this->key()); // 移动数据源之后视图失效，先拷贝
+    for (auto& source : this->sources) {
+        if (source->valid() && source->key() == key) source->next();
+    }
+    this->findSmallest();
+}
@@ -0,0 +1,44 @@
+#ifndef MERGE
+#define MERGE
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+
+// 有序数据源：memtable、一张表或者一层中的所有表，按key升序遍历带类型标记的value（见LsmTree）
+class Source {
+public:
+    virtual ~Source() = default;
+    virtual bool valid() const = 0;
+    virtual std::string_view key() const = 0; // 视图在next之后不再有效
+    virtual std::string_view value() const = 0;
+    virtual void next() = 0;
+};
+
+// 多路归并：sources中越靠前的数据源越新，同一个key只返回最新的数据源中的记录
+// 数据源的数量不多（memtable、L0的表和每层一个），每一步线性比较各数据源的当前key，不使用堆
+class MergeIterator {
+public:
+    explicit MergeIterator(std::vector<std::unique_ptr<Source>> sources);
+    bool valid() const {
+        return this->current >= 0;
+    }
+    std::string_view key() const {
+        return this->sources[this->current]->key();
+    }
+    std::string_view value() const {
+        return this->sources[this->current]->value();
+    }
+    void next(); // 跳过当前key在所有数据源中的记录
+
+    MergeIterator(const MergeIterator&) = delete; // 禁用拷贝构造函数
+    MergeIterator& operator=(const MergeIterator&) = delete; // 禁用赋值运算符
+private:
+    void findSmallest(); // 找到当前key最小的数据源（key相同时取最新的）
+
+    std::vector<std::unique_ptr<Source>> sources;
+    int current = -1; // 当前记录所在的数据源，-1表示遍历结束
+};
+
+#endif
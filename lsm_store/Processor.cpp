@@ -0,0 +1,299 @@
+#include "Processor.h"
+#include "LsmTree.h"
+#include "KeyTraits.h"
+#include "Config.h"
+#include "Command.h"
+#include <memory>
+#include <mutex>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <climits>
+
+static std::shared_ptr<Processor> processor=nullptr;
+static std::mutex mutex;
+static LsmTree* tree=nullptr; // LSM树存储引擎
+static std::unordered_map<std::string,std::string> config; // 存储引擎配置
+static bool intKeys=true; // key是否为64位整数
+
+// LSM树按字节序比较key，整数key编码为翻转符号位后的8字节大端序，使字节序与数值顺序一致
+// 字符串key原样保存；key无法解析时抛出异常
+static std::string encodeKey(const std::string& text){
+    if(!intKeys) return text;
+    uint64_t value=static_cast<uint64_t>(KeyTraits<int64_t>::parse(text))^(1ULL<<63);
+    std::string key(8,'\0');
+    for(int i=7;i>=0;i--){
+        key[i]=static_cast<char>(value&0xff);
+        value>>=8;
+    }
+    return key;
+}
+
+static std::string decodeKey(std::string_view key){
+    if(!intKeys) return std::string(key);
+    uint64_t value=0;
+    for(unsigned char c:key) value=(value<<8)|c;
+    return std::to_string(static_cast<int64_t>(value^(1ULL<<63)));
+}
+
+// 范围查询每页最多返回的key数量，保证每个请求的工作量有上限
+static const int MAX_PAGE=1000;
+
+// 游标：将每页数量、下一页的起点和终点编码为十六进制字符串，对客户端不透明
+// 编码前的格式与kv_store相同：方向(只支持a) 每页数量,起点长度,起点终点（起点和终点为key的文本形式）
+static std::string encodeCursor(const std::string& next,const std::string& bound,int limit){
+    std::string plain="a"+std::to_string(limit)+","+std::to_string(next.size())+","+next+bound;
+    static const char* digits="0123456789abcdef";
+    std::string cursor;
+    for(unsigned char c:plain){
+        cursor.push_back(digits[c>>4]);
+        cursor.push_back(digits[c&0xf]);
+    }
+    return cursor;
+}
+
+static bool decodeCursor(const std::string& cursor,std::string& next,std::string& bound,int& limit){
+    if(cursor.empty()||cursor.size()%2!=0) return false;
+    std::string plain;
+    for(size_t i=0;i<cursor.size();i+=2){
+        plain.push_back(static_cast<char>(std::stoi(cursor.substr(i,2),nullptr,16)));
+    }
+    if(plain[0]!='a') return false;
+    size_t first=plain.find(',');
+    if(first==std::string::npos) return false;
+    size_t second=plain.find(',',first+1);
+    if(second==std::string::npos) return false;
+    limit=std::stoi(plain.substr(1,first-1));
+    size_t len=std::stoul(plain.substr(first+1,second-first-1));
+    if(second+1+len>plain.size()) return false;
+    next=plain.substr(second+1,len);
+    bound=plain.substr(second+1+len);
+    return true;
+}
+
+// key为文本形式，key和value按json的规则转义
+static void appendItem(std::string& json,std::string_view key,std::string_view value){
+    json+="{\"k\": \"";
+    Command::escape(json,key);
+    json+="\", \"v\": \"";
+    Command::escape(json,value);
+    json+="\"}";
+}
+
+// 查询[lo,hi]内的一页数据，返回 {"items": [...], "cursor": "下一页的游标（没有下一页时为空）"}
+static std::string rangePage(const std::string& lo,const std::string& hi,int limit){
+    if(limit<1) limit=1;
+    if(limit>MAX_PAGE) limit=MAX_PAGE;
+    std::string from=encodeKey(lo),to=encodeKey(hi);
+    std::string json="{\"items\": [";
+    bool first=true;
+    std::string next;
+    bool more=tree->scan(&from,&to,limit,[&](std::string_view key,std::string_view value){
+        if(!first) json+=", ";
+        first=false;
+        appendItem(json,decodeKey(key),value);
+    },next);
+    json+="], \"cursor\": \"";
+    if(more) json+=encodeCursor(decodeKey(next),hi,limit);
+    json+="\"}";
+    return json;
+}
+
+std::shared_ptr<Processor> Processor::instance(){
+    // 懒汉模式
+    // 使用双重检查保证线程安全
+    if(processor==nullptr){
+        std::unique_lock<std::mutex> lock(mutex); // 访问临界区之前需要加锁
+        if(processor==nullptr){
+            processor=std::shared_ptr<Processor>(new Processor());
+        }
+    }
+    return processor;
+}
+
+void Processor::init() {
+    // 存储引擎的配置文件位于http_server的运行目录
+    config=parseIni("lsm_store.ini", {
+        {"dataDir","lsm_data"},
+        {"isOpenWal","true"},
+        {"walSync","group"},
+        {"walGroupMS","2"},
+        {"walGroupRecords","128"},
+        {"memtableSize","4194304"},
+        {"tableSize","2097152"},
+        {"l0Trigger","4"},
+        {"l0Stop","12"},
+        {"levelBase","10485760"},
+        {"levelRatio","10"},
+        {"bloomBits","10"},
+        {"keyType","int"}
+    });
+    if(config["keyType"]!="int"&&config["keyType"]!="string"){
+        std::cerr<<"不支持的key类型"<<config["keyType"]<<"，使用int"<<std::endl;
+    }
+    intKeys=(config["keyType"]!="string");
+    LsmTree::Options options;
+    options.dir=config["dataDir"];
+    options.wal=(config["isOpenWal"]=="true");
+    options.walSync=Wal::parsePolicy(config["walSync"]);
+    options.walGroupMS=std::stoi(config["walGroupMS"]);
+    options.walGroupRecords=std::stoi(config["walGroupRecords"]);
+    options.memtableSize=std::stoull(config["memtableSize"]);
+    options.tableSize=std::stoull(config["tableSize"]);
+    options.l0Trigger=std::stoi(config["l0Trigger"]);
+    options.l0Stop=std::stoi(config["l0Stop"]);
+    options.levelBase=std::stoull(config["levelBase"]);
+    options.levelRatio=std::stoi(config["levelRatio"]);
+    options.bloomBits=std::stoi(config["bloomBits"]);
+    tree=new LsmTree(options);
+    if(!tree->open()){
+        std::cerr<<"LSM树打开失败，数据目录"<<options.dir<<std::endl;
+        exit(1); // 不能在缺失部分数据的情况下继续提供服务
+    }
+}
+
+std::string Processor::process(std::string& method, std::string& url, std::string& body) {
+    if(method!="POST" || url!="/kv_store") return "404";
+    else {
+        // 解析json格式的命令（与kv_store使用同一个解析器，支持转义和数组形式），并得到命令序列
+        std::vector<std::string_view> views;
+        std::string scratch;
+        if(!Command::parse(body,views,scratch)) return "";
+        std::vector<std::string> tokens(views.begin(),views.end());
+        // 如果解析出的tokens错误，则返回空字符，表示服务器内部错误
+        if(tokens.empty()) return "";
+        else{
+            // LSM树的写入都是盲写（不读取旧值），insert和delete总是返回success；WAL写入或刷盘失败时抛出异常，返回500
+            if(tokens[0]=="insert") {
+                if(tokens.size()!=3)return "";
+                else{
+                    try{
+                        tree->put(encodeKey(tokens[1]), tokens[2]);
+                        return "{\"result\": \"success\"}";
+                    }catch(std::exception&){
+                        return "";
+                    }
+                }
+            }else if(tokens[0]=="delete") {
+                if(tokens.size()!=2)return "";
+                else{
+                    try{
+                        tree->remove(encodeKey(tokens[1]));
+                        return "{\"result\": \"success\"}";
+                    }catch(std::exception&){
+                        return "";
+                    }
+                }
+            }else if(tokens[0]=="search") {
+                if(tokens.size()==1){ // 全查
+                    try{
+                        std::string json = "[";
+                        std::string next;
+                        tree->scan(nullptr,nullptr,INT_MAX,[&json](std::string_view key,std::string_view value){
+                            appendItem(json,decodeKey(key),value);
+                            json+=", ";
+                        },next);
+                        json+="]";
+                        return json;
+                    }catch(std::exception&){ // 数据块损坏时不返回不完整的结果
+                        return "";
+                    }
+                }else if(tokens.size()==2){
+                    try{
+                        std::string value;
+                        if(!tree->get(encodeKey(tokens[1]),value)) return "{}";
+                        std::string json;
+                        appendItem(json,tokens[1],value);
+                        return json;
+                    }catch(std::exception&){
+                        return "";
+                    }
+                }else if(tokens.size()==3&&tokens[1]=="cursor"){ // 使用游标查询下一页：search cursor 游标
+                    try{
+                        std::string next,bound;
+                        int limit;
+                        if(!decodeCursor(tokens[2],next,bound,limit)) return "";
+                        return rangePage(next,bound,limit);
+                    }catch(std::exception&){
+                        return "";
+                    }
+                }else if(tokens.size()==4||tokens.size()==5){ // 范围查询：search lo hi limit [asc]（只支持升序）
+                    try{
+                        if(tokens.size()==5&&tokens[4]!="asc") return "";
+                        return rangePage(tokens[1],tokens[2],std::stoi(tokens[3]));
+                    }catch(std::exception&){
+                        return "";
+                    }
+                }else return "";
+            }else if(tokens[0]=="mget") { // 批量查询：mget k1 k2 ...，返回 {"items": [{"k": "k1", "v": "v1"}, {"k": "k2"}, ...]}（不存在的key没有v）
+                if(tokens.size()<2)return "";
+                else{
+                    try{
+                        std::string json="{\"items\": [";
+                        std::string value;
+                        for(size_t i=1;i<tokens.size();i++){
+                            if(i>1) json+=", ";
+                            if(tree->get(encodeKey(tokens[i]),value)) appendItem(json,tokens[i],value);
+                            else{
+                                json+="{\"k\": \"";
+                                Command::escape(json,tokens[i]);
+                                json+="\"}";
+                            }
+                        }
+                        json+="]}";
+                        return json;
+                    }catch(std::exception&){
+                        return "";
+                    }
+                }
+            }else if(tokens[0]=="mset"||tokens[0]=="mdel") { // 批量插入：mset k1 v1 k2 v2 ...；批量删除：mdel k1 k2 ...
+                bool put=(tokens[0]=="mset");
+                if(tokens.size()<2||(put&&tokens.size()%2==0))return "";
+                else{
+                    try{
+                        // 整批写入memtable，只写一次WAL
+                        std::vector<std::string> keys;
+                        std::vector<std::pair<std::string_view,std::string_view>> records;
+                        for(size_t i=1;i<tokens.size();i+=(put?2:1)) keys.push_back(encodeKey(tokens[i]));
+                        for(size_t i=0;i<keys.size();i++){
+                            records.push_back({keys[i], put?std::string_view(tokens[2*i+2]):std::string_view()});
+                        }
+                        tree->write(put?Wal::PUT:Wal::DEL, records);
+                        std::string json="{\"result\": [";
+                        for(size_t i=0;i<keys.size();i++){
+                            if(i) json+=", ";
+                            json+="\"success\"";
+                        }
+                        json+="]}";
+                        return json;
+                    }catch(std::exception&){
+                        return "";
+                    }
+                }
+            }else if(tokens[0]=="size") { // 需要归并遍历所有数据
+                if(tokens.size()!=1)return "";
+                else {
+                    try{
+                        return "{\"size\": \"" + std::to_string(tree->count()) + "\"}";
+                    }catch(std::exception&){ // 数据块损坏
+                        return "";
+                    }
+                }
+            }else if(tokens[0]=="dump") { // 将memtable写入L0，写入完成后返回
+                if(tokens.size()!=1)return "";
+                else {
+                    return tree->flush()?"{\"result\": \"success\"}":"";
+                }
+            }else if(tokens[0]=="stats") { // 各层的表数量和大小
+                if(tokens.size()!=1)return "";
+                else {
+                    return tree->stats();
+                }
+            }else return "";
+        }
+    }
+}
+
+Processor::~Processor() {
+    delete tree; // 将memtable落盘后停止后台线程
+}
@@ -0,0 +1,250 @@
+#include "Table.h"
+#include "Coding.h"
+#include <iostream>
+#include <stdexcept>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+static const char MAGIC[8] = {'K','V','L','S','M','T','B','L'};
+static const size_t FOOTER_SIZE = 44;
+
+// 解析一条 长度(4) | 数据 形式的字段，越界时返回false
+static bool getField(std::string_view& src, std::string_view& field) {
+    if (src.size() < 4) return false;
+    uint32_t len = decodeFixed32(src.data());
+    if (src.size() - 4 < len) return false;
+    field = src.substr(4, len);
+    src.remove_prefix(4 + len);
+    return true;
+}
+
+// 从offset处读取len字节，读到文件末尾之前不足len字节时返回false
+static bool readAt(int fd, uint64_t offset, size_t len, std::string& dst) {
+    dst.resize(len);
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, &dst[done], len - done, offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += n;
+    }
+    return true;
+}
+
+TableBuilder::TableBuilder(const std::string& fileName, int bloomBits) : bloom(bloomBits) {
+    this->fileName = fileName;
+    this->fd = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (this->fd == -1) {
+        std::cerr << "LSM: 无法创建文件 " << fileName << std::endl;
+        this->ok = false;
+    }
+    this->out.reserve(WRITE_SIZE + BLOCK_SIZE);
+}
+
+TableBuilder::~TableBuilder() {
+    if (this->fd != -1) close(this->fd);
+    if (!this->finished) unlink(this->fileName.c_str());
+}
+
+bool TableBuilder::writeOut(bool all) {
+    if (!this->ok) return false;
+    if (!all && this->out.size() < WRITE_SIZE) return true;
+    size_t written = 0;
+    while (written < this->out.size()) {
+        ssize_t len = write(this->fd, this->out.data() + written, this->out.size() - written);
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "LSM: 写入失败 " << this->fileName << std::endl;
+            this->ok = false;
+            return false;
+        }
+        written += len;
+    }
+    this->out.clear();
+    return true;
+}
+
+void TableBuilder::finishBlock() {
+    if (this->block.empty()) return;
+    putFixed32(this->index, this->lastKey.size());
+    this->index.append(this->lastKey);
+    putFixed64(this->index, this->offset);
+    putFixed32(this->index, this->block.size());
+    this->out.append(this->block);
+    putFixed32(this->out, crc32c(this->block.data(), this->block.size()));
+    this->offset += this->block.size() + 4;
+    this->block.clear();
+    this->writeOut(false);
+}
+
+bool TableBuilder::add(std::string_view key, std::string_view value) {
+    if (!this->ok) return false;
+    if (this->records == 0) this->smallest.assign(key.data(), key.size());
+    putFixed32(this->block, key.size());
+    this->block.append(key.data(), key.size());
+    putFixed32(this->block, value.size());
+    this->block.append(value.data(), value.size());
+    this->lastKey.assign(key.data(), key.size());
+    this->bloom.add(key);
+    this->records++;
+    if (this->block.size() >= BLOCK_SIZE) this->finishBlock();
+    return this->ok;
+}
+
+bool TableBuilder::finish() {
+    this->finishBlock();
+    std::string filter = this->bloom.finish();
+    std::string tail = this->index;
+    tail.append(filter);
+    tail.append(this->smallest);
+    tail.append(this->lastKey);
+    this->out.append(tail);
+    putFixed64(this->out, this->offset);
+    putFixed32(this->out, this->index.size());
+    putFixed32(this->out, filter.size());
+    putFixed32(this->out, this->smallest.size());
+    putFixed32(this->out, this->lastKey.size());
+    putFixed64(this->out, this->records);
+    putFixed32(this->out, crc32c(tail.data(), tail.size()));
+    this->out.append(MAGIC, sizeof(MAGIC));
+    if (!this->writeOut(true)) return false;
+    if (fdatasync(this->fd) != 0) {
+        std::cerr << "LSM: 刷盘失败 " << this->fileName << std::endl;
+        return false;
+    }
+    close(this->fd);
+    this->fd = -1;
+    this->finished = true;
+    return true;
+}
+
+std::shared_ptr<Table> Table::open(const std::string& fileName, uint64_t number) {
+    std::shared_ptr<Table> table(new Table());
+    table->fileName = fileName;
+    table->tableNumber = number;
+    table->fd = ::open(fileName.c_str(), O_RDONLY);
+    if (table->fd == -1) {
+        std::cerr << "LSM: 无法打开表 " << fileName << std::endl;
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(table->fd, &st) != 0 || static_cast<size_t>(st.st_size) < FOOTER_SIZE) {
+        std::cerr << "LSM: 表文件不完整 " << fileName << std::endl;
+        return nullptr;
+    }
+    table->size = st.st_size;
+    std::string footer;
+    if (!readAt(table->fd, table->size - FOOTER_SIZE, FOOTER_SIZE, footer) ||
+        footer.compare(FOOTER_SIZE - sizeof(MAGIC), sizeof(MAGIC), MAGIC, sizeof(MAGIC)) != 0) {
+        std::cerr << "LSM: 表文件尾损坏 " << fileName << std::endl;
+        return nullptr;
+    }
+    const char* p = footer.data();
+    uint64_t tailOffset = decodeFixed64(p);
+    uint64_t indexLen = decodeFixed32(p + 8);
+    uint64_t filterLen = decodeFixed32(p + 12);
+    uint64_t smallestLen = decodeFixed32(p + 16);
+    uint64_t largestLen = decodeFixed32(p + 20);
+    table->records = decodeFixed64(p + 24);
+    uint32_t crc = decodeFixed32(p + 32);
+    uint64_t tailLen = indexLen + filterLen + smallestLen + largestLen;
+    std::string tail;
+    if (tailOffset + tailLen + FOOTER_SIZE != table->size || !readAt(table->fd, tailOffset, tailLen, tail) ||
+        crc32c(tail.data(), tail.size()) != crc) {
+        std::cerr << "LSM: 表索引损坏 " << fileName << std::endl;
+        return nullptr;
+    }
+    std::string_view src(tail.data(), indexLen);
+    while (!src.empty()) {
+        std::string_view lastKey;
+        if (!getField(src, lastKey) || src.size() < 12) {
+            std::cerr << "LSM: 表索引损坏 " << fileName << std::endl;
+            return nullptr;
+        }
+        table->index.push_back({std::string(lastKey), decodeFixed64(src.data()), decodeFixed32(src.data() + 8)});
+        src.remove_prefix(12);
+    }
+    table->filter = tail.substr(indexLen, filterLen);
+    table->smallestKey = tail.substr(indexLen + filterLen, smallestLen);
+    table->largestKey = tail.substr(indexLen + filterLen + smallestLen, largestLen);
+    return table;
+}
+
+Table::~Table() {
+    if (this->fd != -1) close(this->fd);
+    if (this->obsolete) unlink(this->fileName.c_str());
+}
+
+size_t Table::findBlock(std::string_view key) const {
+    size_t lo = 0, hi = this->index.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (this->index[mid].lastKey < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+void Table::readBlock(size_t i, std::string& data) const {
+    const IndexEntry& entry = this->index[i];
+    if (!readAt(this->fd, entry.offset, entry.size + 4, data) ||
+        crc32c(data.data(), entry.size) != decodeFixed32(data.data() + entry.size)) {
+        std::cerr << "LSM: 数据块损坏 " << this->fileName << " 偏移 " << entry.offset << std::endl;
+        throw std::runtime_error("LSM: 数据块损坏 " + this->fileName);
+    }
+    data.resize(entry.size);
+}
+
+bool Table::get(std::string_view key, std::string& value) {
+    if (key < this->smallestKey || key > this->largestKey) return false;
+    if (!bloomMayContain(this->filter, key)) return false;
+    size_t i = this->findBlock(key);
+    if (i == this->index.size()) return false;
+    std::string data;
+    this->readBlock(i, data);
+    std::string_view src(data);
+    std::string_view k, v;
+    while (getField(src, k) && getField(src, v)) {
+        if (k == key) {
+            value.assign(v.data(), v.size());
+            return true;
+        }
+        if (k > key) break;
+    }
+    return false;
+}
+
+Table::Iterator::Iterator(std::shared_ptr<Table> table) : table(std::move(table)) {
+    this->blockIndex = this->table->index.size();
+}
+
+void Table::Iterator::loadBlock(size_t i) {
+    for (this->blockIndex = i; this->blockIndex < this->table->index.size(); this->blockIndex++) {
+        this->table->readBlock(this->blockIndex, this->data);
+        this->pos = 0;
+        if (this->parse()) return;
+    }
+}
+
+bool Table::Iterator::parse() {
+    std::string_view src(this->data);
+    src.remove_prefix(this->pos);
+    if (!getField(src, this->currKey) || !getField(src, this->currValue)) return false;
+    this->pos = this->data.size() - src.size();
+    return true;
+}
+
+void Table::Iterator::seekToFirst() {
+    this->loadBlock(0);
+}
+
+void Table::Iterator::seek(std::string_view target) {
+    this->loadBlock(this->table->findBlock(target));
+    while (this->valid() && this->currKey < target) this->next();
+}
+
+void Table::Iterator::next() {
+    if (!this->parse()) this->loadBlock(this->blockIndex + 1);
+}
@@ -0,0 +1,142 @@
+#ifndef TABLE
+#define TABLE
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <atomic>
+#include "Merge.h"
+#include "Bloom.h"
+
+// 磁盘上不可变的有序表（SSTable），由memtable落盘或者合并产生，文件名为 表号.sst
+// 数据块：若干条记录，每条记录为 key长度(4) | key | value长度(4) | value，每个数据块约BLOCK_SIZE字节，块尾为记录部分的crc(4)
+// 尾部区域：索引 | 布隆过滤器 | 最小key | 最大key
+//   索引：每个数据块一项，最后一个key长度(4) | 最后一个key | 偏移(8) | 长度(4)（不含块尾的crc）
+// 文件尾（定长）：尾部区域偏移(8) | 索引长度(4) | 过滤器长度(4) | 最小key长度(4) | 最大key长度(4) | 记录数(8) | 尾部区域crc(4) | magic(8)
+// 所有整数均为小端序，crc为CRC32C
+
+// 表写入器：记录必须按key严格升序追加；没有调用finish时删除文件
+class TableBuilder {
+public:
+    TableBuilder(const std::string& fileName, int bloomBits);
+    ~TableBuilder();
+
+    bool add(std::string_view key, std::string_view value);
+    bool finish(); // 写入尾部区域和文件尾并刷盘
+    uint64_t fileSize() const { // 已经写入的数据量（用于切分合并输出的表）
+        return this->offset + this->block.size();
+    }
+    uint64_t count() const {
+        return this->records;
+    }
+
+    TableBuilder(const TableBuilder&) = delete; // 禁用拷贝构造函数
+    TableBuilder& operator=(const TableBuilder&) = delete; // 禁用赋值运算符
+
+    static const size_t BLOCK_SIZE = 4 * 1024; // 数据块大小，与页大小相同，点查询只需读一页
+    static const size_t WRITE_SIZE = 256 * 1024; // 攒够该大小后再写文件
+private:
+    void finishBlock();
+    bool writeOut(bool all);
+
+    std::string fileName;
+    int fd = -1;
+    bool ok = true;
+    bool finished = false;
+    std::string out; // 等待写入文件的数据
+    std::string block; // 当前数据块
+    std::string lastKey; // 最后一次追加的key
+    std::string smallest; // 第一个key
+    std::string index;
+    BloomBuilder bloom;
+    uint64_t offset = 0; // 下一个数据块在文件中的偏移
+    uint64_t records = 0;
+};
+
+// 只读的表：打开时将索引和过滤器读入内存，数据块按需通过pread读取（依赖操作系统的页缓存）
+// 表通过shared_ptr在版本之间共享；合并后不再使用的表被标记为过期，最后一个引用释放时删除文件
+class Table {
+public:
+    // 打开表并校验文件尾和尾部区域，失败返回nullptr
+    static std::shared_ptr<Table> open(const std::string& fileName, uint64_t number);
+    ~Table();
+
+    // 查找key：找到时将带类型标记的value写入value并返回true；布隆过滤器判断key不存在时不读数据块
+    // 数据块读取失败或者损坏时抛出std::runtime_error（不能当作key不存在，否则会读到更旧的表中被覆盖或删除的值）
+    bool get(std::string_view key, std::string& value);
+
+    uint64_t number() const {
+        return this->tableNumber;
+    }
+    uint64_t fileSize() const {
+        return this->size;
+    }
+    uint64_t count() const {
+        return this->records;
+    }
+    const std::string& smallest() const {
+        return this->smallestKey;
+    }
+    const std::string& largest() const {
+        return this->largestKey;
+    }
+    void markObsolete() { // 标记为过期，析构时删除文件
+        this->obsolete = true;
+    }
+
+    // 表的迭代器，按key升序遍历，同一时刻只缓存一个数据块；数据块读取失败或者损坏时抛出std::runtime_error（不会静默地结束遍历）
+    class Iterator : public Source {
+    public:
+        explicit Iterator(std::shared_ptr<Table> table);
+        void seekToFirst();
+        void seek(std::string_view target); // 定位到第一个不小于target的key
+        bool valid() const override {
+            return this->blockIndex < this->table->index.size();
+        }
+        std::string_view key() const override {
+            return this->currKey;
+        }
+        std::string_view value() const override {
+            return this->currValue;
+        }
+        void next() override;
+    private:
+        void loadBlock(size_t i); // 读取第i个数据块并定位到第一条记录
+        bool parse(); // 解析pos处的记录，数据块结束时返回false
+
+        std::shared_ptr<Table> table;
+        size_t blockIndex; // 当前数据块，等于索引项数时表示遍历结束
+        std::string data; // 当前数据块的内容
+        size_t pos = 0; // 下一条记录在data中的偏移
+        std::string_view currKey;
+        std::string_view currValue;
+    };
+
+    Table(const Table&) = delete; // 禁用拷贝构造函数
+    Table& operator=(const Table&) = delete; // 禁用赋值运算符
+private:
+    struct IndexEntry {
+        std::string lastKey;
+        uint64_t offset;
+        uint32_t size;
+    };
+
+    Table() = default;
+    size_t findBlock(std::string_view key) const; // 第一个最后一个key不小于key的数据块
+    void readBlock(size_t i, std::string& data) const; // 读取第i个数据块并校验crc，失败时抛出std::runtime_error
+
+    std::string fileName;
+    uint64_t tableNumber = 0;
+    int fd = -1;
+    uint64_t size = 0;
+    uint64_t records = 0;
+    std::vector<IndexEntry> index;
+    std::string filter;
+    std::string smallestKey;
+    std::string largestKey;
+    std::atomic<bool> obsolete{false}; // 由后台线程设置，由最后一个释放引用的线程读取
+};
+
+#endif